@@ -14,6 +14,8 @@
 // You should have received a copy of the GNU General Public License
 // along with Backup Band. If not, see <http://www.gnu.org/licenses/>.
 
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
 #include "Options.h"
 #include "Main.h"
 #include "PickDevice.h"
@@ -32,8 +34,22 @@
 static void update_chord(void);
 static uint32_t do_countoff(register void *);
 static uint32_t get_hw_clock(void);
+static void start_tick_clock(void);
+static void next_tick_deadline(void);
+static int sleep_until_tick(void);
+static void start_tempo_ramp(void);
+static void late_start(register unsigned char);
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+static void clock_out_start(void);
+static void clock_out_tick(void);
+static void clock_out_stop(void);
+static void align_outputs(void);
+#endif
 #ifndef NO_MIDICLOCK_IN
 static void wait_for_midiclock(void);
+static void pll_clock(void);
+static unsigned char pll_deadline(register struct timespec *);
+static uint32_t pll_period(void);
 #endif
 
 #ifdef MIDIFILE_PLAYBACK
@@ -88,18 +104,108 @@ static unsigned char		PrevCrashCymbal;
 unsigned char				MidiChans[5];
 static const unsigned char	MidiChansDef[5] = {9,1,2,3,0};
 
-// For timing the playback of events
-static uint32_t			MsecsPerTick;	// Milliseconds per seq tick at current tempo
+// For timing the playback of events. TickLen is the length of one PPQN (in
+// nsecs with 16 fractional bits) at the current tempo. TickTime is when the
+// next PPQN is due, in the same units since TickStart, and TickDeadline is
+// that time on CLOCK_MONOTONIC. Because each deadline is advanced from the
+// previous one, and not from when we woke, neither rounding nor lateness
+// accumulates
+static uint64_t			TickLen;
+static uint64_t			TickTime;
+static struct timespec	TickStart, TickDeadline;
+#define TICKLEN_SHIFT	16
+#define TICKLEN_MIN		(13000000ULL << TICKLEN_SHIFT)
+#define TICKLEN_MAX		(66000000ULL << TICKLEN_SHIFT)
+#ifdef JG_DRIFT_TEST
+static uint32_t			DriftTicks;
+#endif
 static uint32_t			CurrentClock;
 #ifndef NO_MIDICLOCK_IN
 static uint32_t			TimeoutClock;
+
+// To smooth incoming MIDI clock, a delay-locked loop estimates when each
+// clock is due. PllTime is when the next clock (count PllClock) is
+// expected, and PllPeriod the time between clocks, in nsecs on
+// CLOCK_MONOTONIC. PllLocked counts clocks in a row close to where
+// expected, up to PLL_LOCK_CLOCKS when we consider the loop locked.
+// PllSeq is odd while the MIDI In thread updates them. ClockPll is
+// the loop bandwidth setting (0 = off), and PllReset tells the loop
+// to start over
+static int64_t				PllTime;
+static double				PllPeriod;
+static uint32_t			PllClock;
+static uint32_t			PllSeq;
+static unsigned char		PllLocked;
+static unsigned char		PllReset;
+static unsigned char		ClockPll = 3;
+#define PLL_LOCK_CLOCKS	PPQN_VALUE
+#define PLL_NUM_BWS		5
+
+// Loop bandwidths, as a fraction of the clock rate. [0] is used to
+// (re)acquire lock
+static const float		PllBandwidths[PLL_NUM_BWS] = {.05f, .002f, .005f, .01f, .02f};
 #endif
 static unsigned char		Clocks[] = {CLOCK_MONOTONIC, CLOCK_MONOTONIC_RAW, CLOCK_MONOTONIC_COARSE, 0xFE};
 static unsigned char		ClockId = CLOCK_MONOTONIC;
-static unsigned char		TempoChangeCnt;
+#ifndef NO_JACK_SUPPORT
+static unsigned char		JackClock;
+
+// Where in the measure the Jack transport relocated to, in PPQN, plus 1.
+// 0 if not relocated. Picked up by the Beat thread at its next PPQN
+static uint32_t			MeasureResync;
+#endif
 static unsigned char		TempoBPM;
 static unsigned char		PrevTempoBPM = 120;
 
+// Tempo in 1/100 BPM. TempoBPM is this rounded to a whole BPM
+static uint32_t			TempoCenti;
+
+// For a ritard/accel. TickLen at its start and end, how many PPQN it
+// lasts, and how many have passed. RampLen=0 if none in progress
+static uint64_t			RampStartLen, RampEndLen;
+static unsigned short	RampLen, RampPos;
+static unsigned char		RampFinal;
+
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+// MIDI clock out. ClockOut has bit 0 to 3 set for each MIDI Out bus (External
+// Synth 1 to 4) the user wants to get our MIDI clock, start/stop and song
+// position. ClockOutPlay is the buses we sent Start to. ClockOutCnt counts the
+// clocks sent since then (PPQN_VALUE is the same 24 per beat as MIDI clock)
+static unsigned char		ClockOut;
+static unsigned char		ClockOutPlay;
+static uint32_t			ClockOutCnt;
+#endif
+
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+// When the PPQN the Beat thread is now playing was due, on CLOCK_MONOTONIC
+static struct timespec	BeatDue;
+
+// For lining up the outputs, so a robot note sounds at the same time on each
+// synth. MidiOutLatency[] is how many msecs each External Synth takes to sound
+// a note it's sent (set by the user, or measured). MidiOutDelay[] is how many
+// nsecs the Beat thread's msgs to it are held back, so it sounds along with the
+// slowest output the robots play
+static unsigned char		MidiOutLatency[DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1];
+static uint32_t			MidiOutDelay[DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1];
+#endif
+
+#ifndef NO_SEQ_SUPPORT
+// For timestamped ALSA seq MIDI out. SeqQueue is the queue we schedule our
+// events on (-1 if none), and SeqQueueStart when it started on CLOCK_MONOTONIC.
+// SeqLead is how many msecs after its PPQN was due (or, if not from the Beat
+// thread, after it was sent) that each event is stamped to play (0 to send it
+// immediately instead)
+static int					SeqQueue = -1;
+static struct timespec	SeqQueueStart;
+static unsigned char		SeqLead;
+#define SEQLEAD_MAX			20
+
+// All our seq ports share the one seq handle, and its output buffer isn't
+// thread-safe. So the MIDI Out writer threads (and main thread) take turns
+// with it
+static pthread_mutex_t	SeqOutMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 // For transposing by half steps
 #ifdef GIGGING_DRUMS
 static char					Transpose = -2;
@@ -464,8 +570,8 @@ static void * playMidiThread(void * arg)
 	// Get trk start
 	trk = Tracking.TrackStart;
 
-	// Set MsecsPerTick based upon BPM tempo
-	set_PPQN(*trk++);
+	// Set TickLen based upon BPM tempo
+	set_PPQN((uint32_t)*trk++ * 100);
 
 	// Get the kit/bass/gtr
 	setInstrumentByNum(PLAYER_DRUMS | SETINS_NO_MSB | SETINS_NO_LSB | BEATTHREADID, *trk++, 0);
@@ -499,11 +605,8 @@ static void * playMidiThread(void * arg)
 				wait_for_midiclock(currentEvtTime);
 			else do
 			{
-				register uint32_t			target_msecs;
-
-				target_msecs = CurrentClock + MsecsPerTick;
-				usleep(MsecsPerTick*900);
-				while ((CurrentClock = get_hw_clock()) < target_msecs) sched_yield();
+				next_tick_deadline();
+				while (sleep_until_tick());
 			} while (--currentEvtTime);
 		}
 
@@ -594,10 +697,14 @@ static uint32_t do_countoff(register void * signalHandle)
 	if (ClockId >= 0xFE)
 	{
 		while (!(TimeoutClock = CurrentClock)) sched_yield();
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+		// Time 0 is the clock we just sync'ed to
+		clock_gettime(CLOCK_MONOTONIC, &BeatDue);
+#endif
 	}
 	else
 #endif
-		CurrentClock = get_hw_clock();
+		start_tick_clock();
 
 	// If playing a songsheet, issue non-note events at time 0
 #ifndef NO_SONGSHEET_SUPPORT
@@ -605,7 +712,7 @@ static uint32_t do_countoff(register void * signalHandle)
 #else
 	refreshGuiMask = 0;
 #endif
-	TempoChangeCnt = 0;
+	RampLen = RampFinal = 0;
 
 	// If "Setup -> Robots -> Autostart -> Auto" enabled, turn off autostart temporarily
 	if (AppFlags3 & APPFLAG3_AUTOSTARTARM)
@@ -641,16 +748,9 @@ static uint32_t do_countoff(register void * signalHandle)
 				else
 #endif
 				{
-					register uint32_t			target_msecs;
-
 					// See comments in playBeatThread()
-					target_msecs = CurrentClock + MsecsPerTick;
-					goto chk_clk;
-					do
-					{
-						usleep((target_msecs - CurrentClock) * 900);
-chk_clk:			;
-					} while ((CurrentClock = get_hw_clock()) < target_msecs);
+					next_tick_deadline();
+					while (sleep_until_tick());
 				}
 
 				if (PlayFlags & PLAYFLAG_STOP) goto out;
@@ -688,10 +788,15 @@ static void * playBeatThread(void * arg)
 	arg = (void *)2;
 
 	// Set the priority to slightly less than audio thread, but > GUI thread
-	set_thread_priority();
+	set_thread_priority(RTTHREAD_BEAT);
 
 	refreshGuiMask = 0;
 wait:
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+	// Tell any slaves to stop
+	clock_out_stop();
+#endif
+
 	// Fade out pad notes (if user not manually playing the background pad)
 	if (!(TempFlags & APPFLAG3_NOPAD)) refreshGuiMask |= fadePadVoices(100);
 
@@ -727,6 +832,9 @@ wait:
 	if (!PlayThreadHandle) goto out;
 
 	xrun_count(-1);
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	resetBeatOnset();
+#endif
 
 	// Do the countoff if any
 	refreshGuiMask = do_countoff(arg);
@@ -741,13 +849,16 @@ wait:
 	update_chord();
 
 	// Start pad notes if pad is selected, and robot musician on
-	if (Scale && !(TempFlags & APPFLAG3_NOPAD)) startPadVoices(&GtrStrings[0], 0);
+	if (Scale && !(TempFlags & APPFLAG3_NOPAD)) startPadVoices(&GtrStrings[0], 0, BEATTHREADID);
 
 	// Highlight the chord on the graphical piano
 	refreshGuiMask |= lightPianoKey(getCurrChord());
 
 	// Reset time to meas start. Clear flags
 	PlayFlags = currentPpqnTime = 0;
+#if !defined(NO_JACK_SUPPORT) && !defined(NO_MIDICLOCK_IN)
+	__atomic_store_n(&MeasureResync, 0, __ATOMIC_RELAXED);
+#endif
 
 	// Reset bass for chord play
 	bassNtfTime = 0xff;
@@ -759,8 +870,27 @@ wait:
 	// Get time of first drum event
 	drumTime = *(DrumEvtPtr)++;
 
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+	// Start any slaves on this first PPQN
+	clock_out_start();
+#endif
+
 	do
 	{
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+		// Hold back this PPQN's notes to the faster outputs
+		align_outputs();
+#endif
+#ifndef NO_ALSA_AUDIO_SUPPORT
+		// Place this PPQN's notes on the audio thread's frame grid. If
+		// following MIDI clock, we know the PPQN length only if the loop
+		// is locked to it
+#ifndef NO_MIDICLOCK_IN
+		beatTick(ClockId >= 0xFE ? pll_period() : (uint32_t)(TickLen >> TICKLEN_SHIFT));
+#else
+		beatTick((uint32_t)(TickLen >> TICKLEN_SHIFT));
+#endif
+#endif
 		// Has user played a chord yet? can't do anything with the bass or
 		// guitar until the first chord
 		if (Scale)
@@ -783,6 +913,9 @@ wait:
 				{
 					register unsigned char	spec, note;
 
+					// If we resync'ed back to a late chord, the note may belong a few PPQN ago
+					late_start(currentPpqnTime - *BassEvtPtr);
+
 					// Skip timing, get note #, and inc to next evt
 					++BassEvtPtr;
 					spec = *BassEvtPtr++;
@@ -847,6 +980,8 @@ wait:
 				{
 					register unsigned char	note, spec;
 
+					late_start(currentPpqnTime - *GtrEvtPtr);
+
 					// Skip timing, get note spec, and inc to velocity byte
 					GtrEvtPtr++;
 					spec = *GtrEvtPtr++;
@@ -999,6 +1134,9 @@ wait:
 			drumTime = *DrumEvtPtr++;
 		}
 
+#ifndef NO_ALSA_AUDIO_SUPPORT
+		endBeatTick();
+#endif
 		// ================= PPQN advance ======================
 
 		// We just advanced within the measure 1 ppqn. Now we need to
@@ -1038,6 +1176,22 @@ wait:
 		// Check for a song sheet event
 		else
 			refreshGuiMask |= nextSongBeat(currentPpqnTime);
+#endif
+#if !defined(NO_JACK_SUPPORT) && !defined(NO_MIDICLOCK_IN)
+		// Did the Jack transport relocate? Jump to that place in the measure,
+		// without playing the notes skipped over
+		{
+		register uint32_t		resync;
+
+		if ((resync = __atomic_exchange_n(&MeasureResync, 0, __ATOMIC_ACQUIRE)))
+		{
+			currentPpqnTime = (unsigned char)((resync - 1) % endTime);
+			seekDrumEvtPtr(currentPpqnTime);
+			drumTime = *DrumEvtPtr++;
+			setAccompEvtPtr(currentPpqnTime);
+			bassNtfTime = 0xff;
+		}
+		}
 #endif
 		// Check for audio underruns
 		if (xrun_count(1)) refreshGuiMask |= CTLMASK_XRUN;
@@ -1058,37 +1212,25 @@ wait:
 		if (refreshGuiMask) refreshGuiMask = drawGuiCtl(arg, refreshGuiMask, BEATTHREADID);
 		}
 
-		// If user wants to ritard, reduce the tempo each ppqn. Accelerando option too
-		if (TempoChangeCnt)
-		{
-			if (!(currentPpqnTime % ((TempoBPM/(256/4)) * 3)))
-			{
-				if (PlayFlags & PLAYFLAG_RITARD)
-				{
-					if (PlayFlags & PLAYFLAG_FINAL_PTN)
-					{
-						if (currentPpqnTime > PPQN_VALUE*2) MsecsPerTick++;
-						if (currentPpqnTime > PPQN_VALUE) MsecsPerTick++;
-					}
-					if (++MsecsPerTick > 66)
-					{
-						MsecsPerTick = 66;
-						goto zero;
-					}
-				}
-				else if (--MsecsPerTick < 13)
-				{
-					MsecsPerTick = 13;
-zero:				TempoChangeCnt = 0;
-				}
-				if (TempoChangeCnt) --TempoChangeCnt;
-			}
-		}
+		// If user wants to ritard, start gliding the tempo down. Accelerando option too.
+		// Also broaden a ritard (or the style's programmed ritard) over the End's final meas
+		if ((PlayFlags & PLAYFLAG_ACCEL) || (!RampFinal && (PlayFlags & (PLAYFLAG_RITARD|PLAYFLAG_FINAL_PTN)) == (PLAYFLAG_RITARD|PLAYFLAG_FINAL_PTN)))
+			start_tempo_ramp();
 
-		if (!TempoChangeCnt && (PlayFlags & PLAYFLAG_ACCEL))
+		// Move the tempo one ppqn along the ramp's S curve
+		if (RampLen)
 		{
-			PlayFlags &= ~PLAYFLAG_ACCEL;
-			TempoChangeCnt = 256 / (TempoBPM - 40);
+			register uint64_t		curve;
+
+			// How far along the ramp (with 16 fractional bits), smoothed so the tempo
+			// eases out of the old, and into the new
+			curve = ((uint64_t)++RampPos << 16) / RampLen;
+			curve = (curve * curve * ((3 << 16) - (curve << 1))) >> 32;
+			if (RampEndLen > RampStartLen)
+				TickLen = RampStartLen + (((RampEndLen - RampStartLen) * curve) >> 16);
+			else
+				TickLen = RampStartLen - (((RampStartLen - RampEndLen) * curve) >> 16);
+			if (RampPos >= RampLen) RampLen = 0;
 		}
 
 		// =====================================================
@@ -1096,7 +1238,7 @@ zero:				TempoChangeCnt = 0;
 		// something useful to do while waiting -- checking for, and responding
 		// to the user changing the chord
 		{
-		register uint32_t			target_msecs;
+		register int				waitErr;
 		register unsigned char	beat, measQueue;
 
 		// Calc the next ppqn where we allow a chord change
@@ -1108,15 +1250,21 @@ zero:				TempoChangeCnt = 0;
 		// If the 1st beat, indicate we need to queue the next meas below
 		measQueue = (!currentPpqnTime ? 0x80 : 0xFF);
 
-		// Add the amount of milliseconds in one PPQN, to the current time
-		target_msecs = CurrentClock + MsecsPerTick;
+		// Set when the next PPQN is due
+		next_tick_deadline();
+		waitErr = EINTR;
 		goto chk_clock;
 
-		// (Partially) busy-wait for the remainder of a PPQN clock
+		// Sleep until the next PPQN
 		do
 		{
-			// Sleep for only part of the wait, just in case this takes longer than we request
-			usleep((target_msecs - CurrentClock) * 900);
+			// Sleep until the deadline, rather than for a duration, so we don't wake
+			// late by however long it takes us to get here
+			waitErr = sleep_until_tick();
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+			// Send MIDI clock as soon as we wake, before anything else can delay it
+			if (!waitErr && ClockOutPlay) clock_out_tick();
+#endif
 chk_clock:
 			// ================ chord update ===============
 			// Is this a point where we allow a chord change? (Allow 4 ticks of "wiggle room" in
@@ -1148,7 +1296,13 @@ chk_clock:
 					// "glitch", but hopefully not. User needs to not lag. Practice!
 					if (beat || currentPpqnTime) measQueue = beat;
 
-					if (Scale && !(TempFlags & APPFLAG3_NOPAD)) startPadVoices(&GtrStrings[0], 0);
+					// Start the pad as if the chord came on time
+					if (Scale && !(TempFlags & APPFLAG3_NOPAD))
+					{
+						late_start(currentPpqnTime - beat);
+						startPadVoices(&GtrStrings[0], 0, BEATTHREADID);
+						late_start(0);
+					}
 
 					refreshGuiMask |= lightPianoKey(getCurrChord());
 				}
@@ -1209,7 +1363,7 @@ chk_clock:
 			}
 #endif
 			// Otherwise, check our internal clock
-		} while ((CurrentClock = get_hw_clock()) < target_msecs);
+		} while (waitErr);
 
 		// Queue the next meas, or resync the current? (Wait until user plays the first
 		// chord before we queue anything)
@@ -1252,8 +1406,21 @@ out:
 
 static void wait_for_midiclock(void)
 {
+	struct timespec	deadline;
+
+	// If the loop is locked to the clock, sleep until the clock is due,
+	// rather than waking upon whenever it actually arrives
+	if (pll_deadline(&deadline))
+	{
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR);
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+		BeatDue = deadline;
+		goto inc;
+#endif
+	}
+
 	// Has the previously set timeout been satisfied?
-	if (CurrentClock < TimeoutClock)
+	else if (CurrentClock < TimeoutClock)
 	{
 		// Tell Midi In thread's advance_midiclock() to wake us
 		ClockId = 0xFF;
@@ -1267,12 +1434,22 @@ static void wait_for_midiclock(void)
 		pthread_mutex_unlock(&PlayMutex);
 	}
 
-	// Inc to next midi clock for the next call
-	TimeoutClock = CurrentClock + 1;
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+	// The clock is due whenever it came
+	clock_gettime(CLOCK_MONOTONIC, &BeatDue);
+inc:
+#endif
+	// Inc to next midi clock for the next call. If several clocks came
+	// while we were busy, we catch up on them without sleeping
+	TimeoutClock++;
 }
 
 unsigned char is_midiclock(void)
 {
+#ifndef NO_JACK_SUPPORT
+	// Jack transport sync uses the same clocking, but it isn't MIDI clock
+	if (JackClock) return 0;
+#endif
 	return (ClockId & 0xF0);
 }
 
@@ -1283,14 +1460,166 @@ unsigned char is_midiclock(void)
 
 void advance_midiclock(void)
 {
-	if (ClockId >= 0xFE && BeatInPlay &&
-		++CurrentClock >= TimeoutClock && (ClockId & 0x01))
+	if (ClockId >= 0xFE)
 	{
-		// Wakeup beat thread sleeping in wait_for_midiclock()
-		pthread_mutex_lock(&PlayMutex);
-		pthread_cond_signal(&PlayCondition);
-		pthread_mutex_unlock(&PlayMutex);
+		if (BeatInPlay) ++CurrentClock;
+		if (ClockPll) pll_clock();
+
+		if (BeatInPlay && CurrentClock >= TimeoutClock && (ClockId & 0x01))
+		{
+			// Wakeup beat thread sleeping in wait_for_midiclock()
+			pthread_mutex_lock(&PlayMutex);
+			pthread_cond_signal(&PlayCondition);
+			pthread_mutex_unlock(&PlayMutex);
+		}
+	}
+}
+
+#ifndef NO_JACK_SUPPORT
+/************ resync_measure() *************
+ * Called by the Jack process callback when the
+ * transport relocates, to have the Beat thread
+ * jump to the specified PPQN within the measure.
+ * Doesn't wait, so it's safe in the callback.
+ */
+
+void resync_measure(register uint32_t clock)
+{
+	__atomic_store_n(&MeasureResync, clock + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+/************************ pll_clock() *************************
+ * Called by advance_midiclock() for each MIDI clock, to
+ * update our estimate of when the next is due.
+ *
+ * This is a 2nd order delay-locked loop. The error between
+ * when the clock came and when expected pulls both the
+ * expected time and the period, so that a jittery clock
+ * is smoothed, but a tempo change is followed. Until the
+ * clock comes close to where expected for a beat's worth
+ * of clocks, a wider bandwidth is used to lock quickly.
+ * A clock way off (ie, the master stopped awhile, or
+ * jumped tempo) starts over.
+ */
+
+static void pll_clock(void)
+{
+	struct timespec		tv;
+	register int64_t		now;
+	register double		err, abserr, omega;
+
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	now = ((int64_t)tv.tv_sec * 1000000000) + tv.tv_nsec;
+
+	__atomic_add_fetch(&PllSeq, 1, __ATOMIC_ACQ_REL);
+
+	if (PllReset)
+	{
+		PllReset = 0;
+		PllTime = 0;
+	}
+
+	// First clock? Then we can't know the period until the next
+	if (!PllTime)
+	{
+restart:
+		PllPeriod = 0.0;
+		PllLocked = 0;
+		PllTime = now;
+	}
+	else if (PllPeriod == 0.0)
+	{
+		PllPeriod = (double)(now - PllTime);
+		PllTime = now + (int64_t)PllPeriod;
+	}
+	else
+	{
+		err = (double)(now - PllTime);
+		abserr = (err < 0.0 ? -err : err);
+		if (abserr > PllPeriod) goto restart;
+
+		// Count the clocks in a row that came within a quarter period of where expected. Lose
+		// lock if one doesn't (ie, the tempo changed), and widen the loop to catch up
+		if (abserr < PllPeriod / 4)
+		{
+			if (PllLocked < PLL_LOCK_CLOCKS) PllLocked++;
+		}
+		else
+			PllLocked = 0;
+
+		omega = 6.2831853 * PllBandwidths[PllLocked >= PLL_LOCK_CLOCKS ? ClockPll : 0];
+		PllTime += (int64_t)((1.4142136 * omega * err) + PllPeriod);
+		PllPeriod += omega * omega * err;
+	}
+
+	PllClock = CurrentClock + 1;
+
+	__atomic_add_fetch(&PllSeq, 1, __ATOMIC_ACQ_REL);
+}
+
+/*********************** pll_deadline() ************************
+ * Called by Play Beat thread to get when the MIDI clock
+ * it's waiting for (TimeoutClock) is due, per the loop.
+ *
+ * RETURN: 0 if the loop isn't locked, or the clock isn't
+ * near the last one received (ie, the master stopped), so
+ * the caller must wait for the clock itself.
+ */
+
+static unsigned char pll_deadline(register struct timespec * deadline)
+{
+	register int64_t		time;
+	register double		period;
+	register uint32_t		clock, seq;
+	register unsigned char	locked;
+
+	if (!ClockPll) return 0;
+
+	do
+	{
+		seq = __atomic_load_n(&PllSeq, __ATOMIC_ACQUIRE);
+		time = PllTime;
+		period = PllPeriod;
+		clock = PllClock;
+		locked = PllLocked;
+	} while ((seq & 1) || seq != __atomic_load_n(&PllSeq, __ATOMIC_ACQUIRE));
+
+	// Run no more than 1 clock ahead of the master, and don't use a count
+	// from before play started
+	if (locked < PLL_LOCK_CLOCKS || TimeoutClock + 1 < clock || TimeoutClock > clock + 1) return 0;
+
+	time += (int64_t)((double)(int32_t)(TimeoutClock - clock) * period);
+	deadline->tv_sec = (time_t)(time / 1000000000);
+	deadline->tv_nsec = (long)(time % 1000000000);
+	return 1;
+}
+
+/*********************** pll_period() ************************
+ * Gets the time between MIDI clocks (in nsecs) estimated
+ * by the loop, or 0 if not locked.
+ */
+
+static uint32_t pll_period(void)
+{
+	return (ClockPll && PllLocked >= PLL_LOCK_CLOCKS) ? (uint32_t)PllPeriod : 0;
+}
+
+/********************* setClockPll() *********************
+ * Sets the loop bandwidth for smoothing MIDI clock, 0
+ * (off) to PLL_NUM_BWS - 1 (widest). 0xFF queries.
+ *
+ * RETURN: The setting. If locked, bit 7 is set.
+ */
+
+unsigned char setClockPll(register unsigned char bw)
+{
+	if (bw < PLL_NUM_BWS)
+	{
+		if (!ClockPll) PllReset = 1;
+		ClockPll = bw;
 	}
+	return ClockPll | ((ClockPll && PllLocked >= PLL_LOCK_CLOCKS) ? 0x80 : 0);
 }
 #endif
 
@@ -1304,6 +1633,94 @@ static uint32_t get_hw_clock(void)
 	return (uint32_t)((1000 * tv.tv_sec) + (tv.tv_nsec/1000000));
 }
 
+/******************** start_tick_clock() *********************
+ * Called by Play Beat thread to make now the time from
+ * which its PPQN deadlines are measured.
+ */
+
+static void start_tick_clock(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &TickStart);
+	TickTime = 0;
+	CurrentClock = get_hw_clock();
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+	// So songStart()'s time 0 events aren't stamped from the previous play
+	BeatDue = TickStart;
+#endif
+#ifdef JG_DRIFT_TEST
+	DriftTicks = 0;
+#endif
+}
+
+/******************** next_tick_deadline() *********************
+ * Called by Play Beat thread to advance TickDeadline by one
+ * PPQN at the current tempo.
+ */
+
+static void next_tick_deadline(void)
+{
+	register uint64_t		nsecs;
+
+	TickTime += TickLen;
+#ifdef JG_DRIFT_TEST
+	// Every 4 beats, print how far our deadlines have strayed from the exact time
+	// of that many PPQN at the set tempo, and how late we got here after the
+	// previous deadline. Let it play for an hour at a steady tempo. The drift
+	// should stay within a few nsecs
+	if (!(++DriftTicks % (PPQN_VALUE * 4)) && TempoCenti)
+	{
+		struct timespec	now;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		printf("%u beats: drift %lld nsec, late %lld usec\r\n", DriftTicks / PPQN_VALUE,
+			(long long)(TickTime >> TICKLEN_SHIFT) - (long long)(((uint64_t)DriftTicks * 6000000000000ULL) / ((uint64_t)TempoCenti * PPQN_VALUE)),
+			((((long long)now.tv_sec - TickDeadline.tv_sec) * 1000000000LL) + now.tv_nsec - TickDeadline.tv_nsec) / 1000);
+	}
+#endif
+	nsecs = (TickTime >> TICKLEN_SHIFT) + TickStart.tv_nsec;
+	TickDeadline.tv_sec = TickStart.tv_sec + (time_t)(nsecs / 1000000000);
+	TickDeadline.tv_nsec = (long)(nsecs % 1000000000);
+}
+
+/******************** sleep_until_tick() *********************
+ * Called by Play Beat thread to sleep until TickDeadline.
+ * The clock setting doesn't apply because only
+ * CLOCK_MONOTONIC is sure to support absolute sleeps.
+ *
+ * RETURN: 0 if the deadline has come, or EINTR if woken
+ * early by a signal.
+ */
+
+static int sleep_until_tick(void)
+{
+	register int	err;
+
+	if (!(err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &TickDeadline, 0)))
+	{
+		CurrentClock = get_hw_clock();
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+		BeatDue = TickDeadline;
+#endif
+	}
+	return err == EINTR ? err : 0;
+}
+
+/*********************** late_start() ***********************
+ * Called by Play Beat thread before it starts bass, gtr, or
+ * pad notes that belong the specified number of PPQN ago
+ * (ie, replaying notes for a chord the user played late).
+ * The audio thread starts them that far into their waves,
+ * and fades them in, so they sound on the beat rather than
+ * flammed. 0 starts notes normally.
+ */
+
+static void late_start(register unsigned char ticks)
+{
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	setBeatLate(ticks * (uint32_t)(TickLen >> TICKLEN_SHIFT));
+#endif
+}
+
 uint32_t get_current_clock(void)
 {
 #ifndef NO_MIDICLOCK_IN
@@ -1324,6 +1741,20 @@ void set_clock_type(void)
 	ClockId = Clocks[(AppFlags2 & APPFLAG2_CLOCKMASK)];
 
 #ifndef NO_MIDICLOCK_IN
+	// Lock to the new clock source anew
+	PllReset = 1;
+
+#ifndef NO_JACK_SUPPORT
+	// If syncing to Jack's transport, the audio thread clocks us as
+	// if MIDI clock. Only when following the transport does it own
+	// the tempo and play
+	if ((JackClock = isJackSync()))
+	{
+		if (ClockId < 0xFE && BeatInPlay) PlayFlags |= PLAYFLAG_STOP;
+		ClockId = 0xFE;
+		if (JackClock == JACKSYNC_MASTER) goto unlock;
+	}
+#endif
 	// If clock = "MIDI sync", then grab and hold the tempo
 	// and play locks with the id CLOCKTHREADID so that the
 	// GUI/MIDI/BEAT threads can't change the tempo
@@ -1335,6 +1766,9 @@ void set_clock_type(void)
 	}
 	else
 	{
+#ifndef NO_JACK_SUPPORT
+unlock:
+#endif
 		unlockPlay(CLOCKTHREADID);
 		unlockTempo(CLOCKTHREADID);
 	}
@@ -1484,7 +1918,7 @@ void signalMainFromMidiIn(register void * signalHandle, register uint32_t mask)
 
 
 
-void checkStartPadNotes(void)
+void checkStartPadNotes(register unsigned char threadId)
 {
 	// Note: Caller checks if Pad robot is enabled (DevAssigns[PLAYER_PAD])
 
@@ -1501,7 +1935,7 @@ void checkStartPadNotes(void)
 				// Autostart is off
 				!(TempFlags & TEMPFLAG_AUTOSTART))
 			{
-				startPadVoices(&GtrStrings[0], 255);
+				startPadVoices(&GtrStrings[0], 255, threadId);
 			}
 		}
 		else
@@ -1539,7 +1973,7 @@ static void strum_chord(register unsigned char vel, register unsigned char threa
 	}
 
 	if (!(TempFlags & APPFLAG3_NOPAD))
-		startPadVoices(&GtrStrings[0], 255);
+		startPadVoices(&GtrStrings[0], 255, threadId);
 }
 
 
@@ -2194,6 +2628,8 @@ void close_midi_port(register struct SOUNDDEVINFO * sounddev)
 				if (sounddev->Handle == handle) goto out;
 			} while (++sounddev <= &SoundDev[DEVNUM_MIDIIN]);
 
+			// Closing the handle frees our queue
+			SeqQueue = -1;
 			closeAlsaSeq();
 		}
 #endif
@@ -2224,124 +2660,1143 @@ void send_alloff(register uint32_t roboNum, register unsigned char threadId)
 #ifndef NO_SEQ_SUPPORT
 static const unsigned char SeqTypes[] = {SND_SEQ_EVENT_NOTEOFF, SND_SEQ_EVENT_NOTEON, SND_SEQ_EVENT_KEYPRESS,
 SND_SEQ_EVENT_CONTROLLER, SND_SEQ_EVENT_PGMCHANGE, SND_SEQ_EVENT_CHANPRESS, SND_SEQ_EVENT_PITCHBEND};
-#endif
 
-/****************** sendMidiOut() *******************
- * Sends to MIDI Out, if open.
+/****************** seq_event_time() *******************
+ * Called by write_midi_out() to get when an event should
+ * play on our queue, SeqLead msecs after the given time.
+ * The kernel then delivers it on time, however late the
+ * sending thread woke (or the writer wrote it), provided
+ * that's within SeqLead.
  *
- * sounddev =		One of the four MIDI Out playback devices.
- * msg =				MIDI bytes
- * count =			How many bytes.
+ * when =	On CLOCK_MONOTONIC, when its PPQN was due plus
+ *				any hold back (Beat thread), or when it was
+ *				sent (other threads).
  *
- * NOTE: The caller's thread ID must be OR'd with count.
+ * RETURN: 0 if it can't be scheduled, so must be sent
+ * immediately.
  */
 
-void sendMidiOut(register struct SOUNDDEVINFO * sounddev, register unsigned char * msg, register uint32_t count)
+static unsigned char seq_event_time(register snd_seq_real_time_t * time, register const struct timespec * when)
 {
-	register unsigned char				threadId;
-
-	threadId = count & (MIDITHREADID|BEATTHREADID|GUITHREADID);
-	count &= ~(MIDITHREADID|BEATTHREADID|GUITHREADID);
+	register long			nsecs;
+	register long			secs;
 
-	// Make sure other threads aren't accessing "SoundDev[MIDIOUT_x]" at
-	// this moment. If otherwise, let other thread first finish
-	while (__atomic_or_fetch(&sounddev->Lock, threadId, __ATOMIC_RELAXED) != threadId) usleep(100);
+	if (!SeqLead || __atomic_load_n(&SeqQueue, __ATOMIC_ACQUIRE) < 0) return 0;
 
-	// Output open?
-	if (sounddev->Handle)
+	secs = (long)(when->tv_sec - SeqQueueStart.tv_sec);
+	nsecs = when->tv_nsec - SeqQueueStart.tv_nsec + (SeqLead * 1000000L);
+	if (nsecs < 0)
 	{
-#ifndef NO_SEQ_SUPPORT
-		if ((sounddev->DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ)
-		{
-			// Use ALSA Seq API
-			snd_seq_event_t	ev;
-
-			snd_seq_ev_clear(&ev);
-			snd_seq_ev_set_source(&ev, sounddev->Card);
-			snd_seq_ev_set_subs(&ev);
-			snd_seq_ev_set_direct(&ev);
-			do
-			{
-				ev.type = SeqTypes[(*msg >> 4) - 8];
-//				snd_seq_ev_set_fixed(&ev);
-				ev.data.note.channel = *msg++ & 0x0F;
-				ev.data.note.note = *msg++;
-				if (count >= 3 && !(msg[0] & 0x80))
-				{
-					count--;
-					if (!(ev.data.note.velocity = *msg++) && ev.type == SND_SEQ_EVENT_NOTEON)
-						ev.type = SND_SEQ_EVENT_NOTEOFF;
-				}
-				count -= 2;
-				snd_seq_event_output(sounddev->Handle, &ev);
-			} while (count);
-			snd_seq_drain_output(sounddev->Handle);
-		}
-#ifndef NO_MIDI_OUT_SUPPORT
-		else
-#endif
-#endif
-#ifndef NO_MIDI_OUT_SUPPORT
-			snd_rawmidi_write((snd_rawmidi_t *)sounddev->Handle, msg, count);
-#endif
+		nsecs += 1000000000L;
+		--secs;
+	}
+	else if (nsecs >= 1000000000L)
+	{
+		nsecs -= 1000000000L;
+		++secs;
 	}
 
-	// Allow other threads access now
-	__atomic_and_fetch(&sounddev->Lock, ~threadId, __ATOMIC_RELAXED);
-}
-
-
-
+	// Due before the queue started? (ie, a stale BeatDue)
+	if (secs < 0) return 0;
 
+	time->tv_sec = (unsigned int)secs;
+	time->tv_nsec = (unsigned int)nsecs;
+	return 1;
+}
 
-/************** send_patch() ******************
- * Sends a patch change to an external synth.
+/****************** remove_seq_events() *******************
+ * Called before an all notes (or sound) off is sent on a
+ * seq bus, to remove the events we stamped for that bus
+ * and MIDI chan which are still waiting on SeqQueue to
+ * play. Otherwise those note ons would sound after it.
+ * Note offs are kept.
  *
- * roboNum =	PLAYER_xxx.
- * pgm =			MIDI pgm change #
- * threadId =	Caller's ID. Bits 8 to 15 are the bank MSB to send
- * 				or SETINS_NO_MSB. Bits 16 to 24 are the bank
- * 				LSB to send, or SETINS_NO_LSB.
+ * tag =	The bus' MIDIOUTWRITER index, which we tag its
+ *			stamped events with.
+ *
+ * Caller must hold SeqOutMutex.
  */
 
-void send_patch(register unsigned char roboNum, register unsigned char pgm, register uint32_t threadId)
+static void remove_seq_events(register snd_seq_t * handle, register unsigned char chan, register unsigned char tag)
 {
-	unsigned char						msg[8];
-	register unsigned char *		msgPtr;
-	register unsigned char			midichan;
+	snd_seq_remove_events_t *	remove;
 
-	midichan = 0xB0 | MidiChans[roboNum];
-	msgPtr = &msg[0];
-	if (!(threadId & SETINS_NO_MSB))
-	{
-		*msgPtr++ = midichan;
-		*msgPtr++ = 0x00;
-		*msgPtr++ = (threadId >> 8) & 0xff;
-	}
-	if (!(threadId & SETINS_NO_LSB))
+	if (__atomic_load_n(&SeqQueue, __ATOMIC_ACQUIRE) >= 0)
 	{
-		*msgPtr++ = midichan;
-		*msgPtr++ = 0x20;
-		*msgPtr++ = (threadId >> 16) & 0xff;
+		// Any still in our output buffer must reach the kernel first
+		snd_seq_drain_output(handle);
+
+		snd_seq_remove_events_alloca(&remove);
+		snd_seq_remove_events_set_condition(remove, SND_SEQ_REMOVE_OUTPUT|SND_SEQ_REMOVE_DEST_CHANNEL|SND_SEQ_REMOVE_IGNORE_OFF|SND_SEQ_REMOVE_TAG_MATCH);
+		snd_seq_remove_events_set_queue(remove, SeqQueue);
+		snd_seq_remove_events_set_channel(remove, chan);
+		snd_seq_remove_events_set_tag(remove, tag);
+		snd_seq_remove_events(handle, remove);
 	}
-
-	*msgPtr++ = midichan - 16;
-	*msgPtr++ = pgm;
-	sendMidiOut(DevAssigns[roboNum], &msg[0], (unsigned char)(msgPtr - &msg[0]) | (threadId & 0xFF));
 }
 
+/****************** open_seq_queue() *******************
+ * Called by openMidiOut() to allocate and start the queue
+ * that seq_event_time() schedules on, if not already.
+ * All our seq ports share the one seq handle, so they
+ * share this queue too.
+ */
 
+static void open_seq_queue(register snd_seq_t * handle)
+{
+	register int	queue;
 
+	if (SeqQueue < 0 && (queue = snd_seq_alloc_named_queue(handle, &WindowTitle[0])) >= 0)
+	{
+		pthread_mutex_lock(&SeqOutMutex);
+		snd_seq_start_queue(handle, queue, 0);
+		snd_seq_drain_output(handle);
+		pthread_mutex_unlock(&SeqOutMutex);
+
+		// The queue's real time starts at 0 now
+		clock_gettime(CLOCK_MONOTONIC, &SeqQueueStart);
+		__atomic_store_n(&SeqQueue, queue, __ATOMIC_RELEASE);
+	}
+}
 
-/****************** closeMidiOut() *****************
- * Closes MIDI output if open.
+/****************** setSeqLead() *******************
+ * Sets how many msecs after its PPQN is due each
+ * accompaniment event (or, for other events, after it's
+ * sent) is stamped to play on ALSA seq outputs. 0 sends
+ * each immediately.
  *
- * Called only by main (GUI) thread.
+ * msecs =		0 to SEQLEAD_MAX, or 0xFF to query.
+ *
+ * RETURN: The setting.
  */
 
-void closeMidiOut(register struct SOUNDDEVINFO * sounddev)
+unsigned char setSeqLead(register unsigned char msecs)
 {
-	while (__atomic_or_fetch(&sounddev->Lock, GUITHREADID, __ATOMIC_RELAXED) != GUITHREADID) usleep(100);
+	if (msecs <= SEQLEAD_MAX) SeqLead = msecs;
+	return SeqLead;
+}
+#endif
+
+/****************** getSeqLead() *******************
+ * Gets how many msecs after it's due each event on
+ * the specified MIDI Out bus is stamped to play. 0
+ * if the bus isn't an ALSA seq output, or its
+ * events aren't stamped.
+ *
+ * bus =		0 to 3 for DEVNUM_MIDIOUT1 to DEVNUM_MIDIOUT4.
+ */
+
+unsigned char getSeqLead(register unsigned char bus)
+{
+#ifndef NO_SEQ_SUPPORT
+	if (__atomic_load_n(&SeqQueue, __ATOMIC_ACQUIRE) >= 0 && (SoundDev[DEVNUM_MIDIOUT1 + bus].DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ)
+		return SeqLead;
+#endif
+	return 0;
+}
+
+/********************* MIDI Out writers **********************
+ * Each open MIDI Out bus has its own realtime thread that
+ * does the actual writing to ALSA. sendMidiOut() only
+ * queues msgs for it, so the Beat play, MIDI In, and GUI
+ * threads never wait on ALSA, nor on each other. Each of
+ * those threads has its own queue per bus (so each queue
+ * has one sender and one reader, and needs no lock), and
+ * the writer empties them all with a single write (or seq
+ * drain) per wakeup. The writer also holds back the Beat
+ * thread's msgs until due, when align_outputs() says to,
+ * and stamps seq events on SeqQueue when SeqLead is set.
+ * The Beat thread's MIDI clock, start/stop, and song
+ * position go on a 4th queue that's never held back, so
+ * clock keeps its own even pace.
+ */
+
+#define MIDIOUT_QUEUESIZE	256
+
+typedef struct {
+	struct timespec		Queued;		// When sendMidiOut() queued it
+	struct timespec		Due;			// When to write it, if held back, or clock's PPQN deadline (tv_sec = 0 if neither)
+	uint32_t					Order;		// MidiOutOrder when queued
+	unsigned char			Len;
+	unsigned char			Msg[3];
+} MIDIOUTEVT;
+
+typedef struct {
+	uint32_t					Head;		// Changed only by midiOutThread()
+	uint32_t					Tail;		// Changed only by sendMidiOut()
+	MIDIOUTEVT				Evts[MIDIOUT_QUEUESIZE];
+} MIDIOUTQUEUE;
+
+typedef struct {
+	MIDIOUTQUEUE			Queues[4];	// For the Beat play, MIDI In, and GUI threads, and the Beat thread's clock
+	uint32_t					Seen[4];		// Each queue's Tail when the thread last looked
+#ifndef NO_SEQ_SUPPORT
+	snd_seq_real_time_t	Stamp;		// When the last event stamped on SeqQueue plays
+#endif
+	pthread_t				Thread;
+	int						WakeFd;		// eventfd that wakes the thread
+	unsigned char			Running;		// sendMidiOut() may queue msgs
+	unsigned char			Sleeping;	// Thread is (about to be) waiting on WakeFd
+	unsigned char			Quit;
+	// Counts since the bus was opened. MaxDepth is the most msgs we found
+	// waiting at one wakeup, and MaxLatency the longest (in usecs) from a
+	// msg being queued to its write finishing. Lost is how many msgs
+	// were dropped because the queue was full, or they were malformed (ie,
+	// missing their status or data bytes). MaxWire is the longest (in
+	// usecs) one wakeup's msgs take to go out a DIN cable (raw MIDI only)
+	uint32_t					MaxDepth, MaxLatency, Lost, MaxWire;
+	// The earliest and latest a MIDI clock was written relative to its PPQN's
+	// deadline, in nsecs, since play started. Min > Max if none measured yet
+	int32_t					ClockMin, ClockMax;
+} MIDIOUTWRITER;
+
+static MIDIOUTWRITER		MidiOutWriters[DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1];
+
+// Incremented per msg queued, by any thread, so the writer can merge its
+// queues back into the order the msgs were sent
+static uint32_t			MidiOutOrder;
+
+// Serializes the GUI queue's senders
+static pthread_mutex_t	MidiOutGuiMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifndef NO_JACK_SUPPORT
+// Serializes senders to Jack's midi_out_N queues, which take one at a time
+static pthread_mutex_t	JackMidiOutMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/****************** queue_midi_out() *******************
+ * Called by sendMidiOut() to queue msgs for the bus's
+ * writer thread, and wake it if need be.
+ *
+ * queue =	The calling thread's queue.
+ * msg =		MIDI bytes. Each msg must have its status.
+ * count =	How many bytes.
+ */
+
+static void queue_midi_out(register MIDIOUTWRITER * writer, register MIDIOUTQUEUE * queue, register const unsigned char * msg, register uint32_t count, register unsigned char threadId)
+{
+	struct timespec		now, due;
+	register uint32_t		tail, next, delay;
+	register unsigned char	len;
+
+	due.tv_sec = 0;
+	if (threadId == BEATTHREADID)
+	{
+		// Have the writer hold it back until its PPQN was due, plus any delay to
+		// sound with slower outputs. A seq event is also stamped from then. Clock
+		// isn't held back, but the writer measures its jitter from then
+		delay = (queue == &writer->Queues[3] ? 0 : MidiOutDelay[writer - &MidiOutWriters[0]]);
+		due.tv_sec = BeatDue.tv_sec;
+		if ((due.tv_nsec = BeatDue.tv_nsec + delay) >= 1000000000L)
+		{
+			due.tv_nsec -= 1000000000L;
+			++due.tv_sec;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tail = queue->Tail;
+	while (count)
+	{
+		// A msg without its status, or cut short, is lost
+		len = (*msg >= 0xF8 ? 1 : (*msg >= 0xC0 && *msg <= 0xDF ? 2 : 3));
+		if (!(*msg & 0x80) || len > count) goto lost;
+
+		// If the queue is full, the msg is lost
+		next = (tail + 1) % MIDIOUT_QUEUESIZE;
+		if (next == __atomic_load_n(&queue->Head, __ATOMIC_ACQUIRE))
+		{
+lost:		__atomic_add_fetch(&writer->Lost, 1, __ATOMIC_RELAXED);
+			break;
+		}
+
+		queue->Evts[tail].Queued = now;
+		queue->Evts[tail].Due = due;
+		queue->Evts[tail].Order = __atomic_fetch_add(&MidiOutOrder, 1, __ATOMIC_RELAXED);
+		queue->Evts[tail].Len = len;
+		memcpy(queue->Evts[tail].Msg, msg, len);
+		msg += len;
+		count -= len;
+		tail = next;
+	}
+	__atomic_store_n(&queue->Tail, tail, __ATOMIC_SEQ_CST);
+
+	// Wake the writer only if it's waiting. Otherwise it will see the
+	// msgs before it waits
+	if (__atomic_exchange_n(&writer->Sleeping, 0, __ATOMIC_SEQ_CST))
+	{
+		uint64_t		val;
+
+		val = 1;
+		write(writer->WakeFd, &val, sizeof(val));
+	}
+}
+
+#ifndef NO_MIDI_OUT_SUPPORT
+
+/******************** din_priority() *********************
+ * Called by pack_din_msgs() to get how soon a msg should
+ * go out, compared to others sent at the same time. Lower
+ * is sooner. On a 31.25 kbaud DIN cable, each byte takes
+ * 320 usecs, so a strummed chord plus a drum hit can take
+ * several msecs to go out. We send clock first, then the
+ * kick and snare, then bass, then other drums, then the
+ * rest.
+ *
+ * msg =	Len byte, followed by the msg.
+ *
+ * RETURN: Priority, or 0xFF if the msg must not be moved
+ * past any other (ie, a controller or pgm change which
+ * later notes may rely upon).
+ */
+
+static unsigned char din_priority(register const unsigned char * msg)
+{
+	register unsigned char	chan;
+
+	if (msg[1] == 0xF8) return 0;
+
+	// Note off or on?
+	if ((msg[1] & 0xE0) != 0x80) return 0xFF;
+
+	// Note: A note's off gets the same priority as its on, so they
+	// never swap
+	chan = msg[1] & 0x0F;
+	if (chan == MidiChans[PLAYER_DRUMS])
+	{
+		switch (msg[2])
+		{
+			// GM kick and snare
+			case 35:
+			case 36:
+			case 38:
+			case 40:
+				return 1;
+		}
+		return 3;
+	}
+	if (chan == MidiChans[PLAYER_BASS]) return 2;
+	return 4;
+}
+
+/******************** pack_din_msgs() *********************
+ * Called by write_midi_out() to put msgs bound for a raw
+ * MIDI port in the order that gets the most time-critical
+ * onto the cable first, then pack them into as few bytes
+ * as possible.
+ *
+ * msgs =		Each msg is 4 bytes -- the Len, then the msg.
+ * count =		How many msgs.
+ * buffer =		Where to pack them.
+ *
+ * RETURN: How many bytes packed.
+ */
+
+static uint32_t pack_din_msgs(register unsigned char * msgs, register uint32_t count, register unsigned char * buffer)
+{
+	register unsigned char *	msg;
+	register unsigned char *	ptr;
+	register uint32_t				i, j, start;
+	register unsigned char		pri, status;
+	unsigned char					temp[4];
+
+	// Sort by din_priority(). Keep the original order among msgs of the same
+	// priority, and don't move any msg past a "fixed" one
+	start = 0;
+	for (i = 0; i < count; i++)
+	{
+		msg = &msgs[i * 4];
+		if ((pri = din_priority(msg)) == 0xFF)
+			start = i + 1;
+		else
+		{
+			for (j = i; j > start && din_priority(&msgs[(j - 1) * 4]) > pri; j--);
+			if (j < i)
+			{
+				memcpy(temp, msg, 4);
+				memmove(&msgs[(j + 1) * 4], &msgs[j * 4], (i - j) * 4);
+				memcpy(&msgs[j * 4], temp, 4);
+			}
+		}
+	}
+
+	// Use running status, and send each note off as a note on with 0 velocity
+	// so a chord of ons and offs needs only one status. Each write starts with
+	// a status, in case the synth was turned on since the last
+	ptr = buffer;
+	status = 0;
+	for (i = 0; i < count; i++)
+	{
+		msg = &msgs[i * 4];
+
+		// Realtime doesn't affect running status
+		if (msg[1] >= 0xF8)
+			*ptr++ = msg[1];
+
+		// System common cancels it
+		else if (msg[1] >= 0xF0)
+		{
+			memcpy(ptr, &msg[1], msg[0]);
+			ptr += msg[0];
+			status = 0;
+		}
+		else
+		{
+			pri = msg[1];
+			if ((pri & 0xF0) == 0x80)
+			{
+				pri |= 0x10;
+				msg[3] = 0;
+			}
+			if (pri != status) *ptr++ = status = pri;
+			memcpy(ptr, &msg[2], msg[0] - 1);
+			ptr += msg[0] - 1;
+		}
+	}
+
+	return (uint32_t)(ptr - buffer);
+}
+
+#endif
+
+/****************** write_midi_out() *******************
+ * Called by midiOutThread() to write all msgs queued for
+ * its bus, with one write (or seq drain). The queues'
+ * msgs are written in the order sendMidiOut() queued them,
+ * so (for example) a note off from the MIDI In thread can't
+ * go out ahead of the Beat thread's note on before it.
+ *
+ * flush =	1 to write held back msgs too, even if not due.
+ * wait =	Where to return when the first held back msg is
+ *				due.
+ *
+ * RETURN: 1 if some msgs are still held back.
+ */
+
+static unsigned char write_midi_out(register struct SOUNDDEVINFO * sounddev, register MIDIOUTWRITER * writer, register unsigned char flush, struct timespec * wait)
+{
+	struct timespec		oldest, now, clockFirst, clockLast;
+	uint32_t					heads[4];
+	register struct timespec *	when;
+	register MIDIOUTQUEUE *	queue;
+	register MIDIOUTEVT *	evt;
+	register MIDIOUTEVT *	next;
+	register uint32_t		head, tail, depth, i;
+	register unsigned char	held;
+#ifndef NO_MIDI_OUT_SUPPORT
+	unsigned char			msgs[MIDIOUT_QUEUESIZE * 4 * 4];
+	unsigned char			buffer[MIDIOUT_QUEUESIZE * 4 * 3];
+	register unsigned char *	ptr;
+
+	ptr = &msgs[0];
+#endif
+	// See what's queued. The Beat thread's msgs mustn't be held back past any other
+	// thread's controller, pgm change, etc, (ie, an all notes off when the user
+	// stops play), so then write them all now. (But not for the Beat thread's own
+	// clock, which goes out every PPQN)
+	for (i = 0; i < 4; i++)
+	{
+		queue = &writer->Queues[i];
+		heads[i] = queue->Head;
+		tail = writer->Seen[i] = __atomic_load_n(&queue->Tail, __ATOMIC_ACQUIRE);
+		if (i && i < 3)
+		{
+			for (head = heads[i]; head != tail && !flush; head = (head + 1) % MIDIOUT_QUEUESIZE)
+			{
+				if ((queue->Evts[head].Msg[0] & 0xE0) != 0x80) flush = 1;
+			}
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	depth = held = 0;
+	oldest.tv_sec = clockFirst.tv_sec = 0;
+#ifndef NO_SEQ_SUPPORT
+	if ((sounddev->DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ) pthread_mutex_lock(&SeqOutMutex);
+#endif
+	for (;;)
+	{
+		// Get the earliest queued of the msgs at the queues' heads. Once the
+		// Beat thread's (queue 0) is held back, so are those after it
+		evt = 0;
+		for (i = (held ? 1 : 0); i < 4; i++)
+		{
+			if (heads[i] != writer->Seen[i])
+			{
+				next = &writer->Queues[i].Evts[heads[i]];
+				if (!evt || (int32_t)(next->Order - evt->Order) < 0)
+				{
+					evt = next;
+					head = i;
+				}
+			}
+		}
+		if (!evt) break;
+
+		// Cancelled below?
+		if (!evt->Len) goto skip;
+
+		// Held back, and not yet due? (Clock is never held back)
+		when = &evt->Queued;
+		if (evt->Due.tv_sec)
+		{
+			when = &evt->Due;
+			if (head != 3 && !flush && (evt->Due.tv_sec > now.tv_sec || (evt->Due.tv_sec == now.tv_sec && evt->Due.tv_nsec > now.tv_nsec)))
+			{
+				*wait = evt->Due;
+				held = 1;
+				continue;
+			}
+		}
+
+		// A note off from another thread must also stop the Beat thread's note ons
+		// (for that chan and note) sent before it, but still held back. Otherwise
+		// they'd play after it, and stick. So drop them
+		if (head && held && ((evt->Msg[0] & 0xF0) == 0x80 || ((evt->Msg[0] & 0xF0) == 0x90 && !evt->Msg[2])))
+		{
+			for (tail = heads[0]; tail != writer->Seen[0]; tail = (tail + 1) % MIDIOUT_QUEUESIZE)
+			{
+				next = &writer->Queues[0].Evts[tail];
+				if ((int32_t)(next->Order - evt->Order) > 0) break;
+				if (next->Msg[0] == (0x90 | (evt->Msg[0] & 0x0F)) && next->Msg[1] == evt->Msg[1] && next->Msg[2]) next->Len = 0;
+			}
+		}
+skip:
+		heads[head] = (heads[head] + 1) % MIDIOUT_QUEUESIZE;
+		if (!evt->Len) continue;
+
+		// Measure latency from when it was due to be written
+		if (!depth++ || when->tv_sec < oldest.tv_sec || (when->tv_sec == oldest.tv_sec && when->tv_nsec < oldest.tv_nsec))
+			oldest = *when;
+
+		// Clock's jitter is measured once written, from the first and last
+		// clocks' PPQN deadlines
+		if (head == 3 && evt->Msg[0] == 0xF8 && evt->Due.tv_sec)
+		{
+			if (!clockFirst.tv_sec) clockFirst = evt->Due;
+			clockLast = evt->Due;
+		}
+#ifndef NO_SEQ_SUPPORT
+		if ((sounddev->DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ)
+		{
+			// Use ALSA Seq API
+			snd_seq_event_t		ev;
+			snd_seq_real_time_t	time;
+			register unsigned char	stamped;
+
+			snd_seq_ev_clear(&ev);
+			snd_seq_ev_set_source(&ev, sounddev->Card);
+			snd_seq_ev_set_subs(&ev);
+
+			// Stamp it to play SeqLead after its PPQN was due (Beat thread), or
+			// after it was sent (other threads). But never before the last one
+			// we stamped, so the kernel plays them in the order we write them.
+			// Except clock, which mustn't wait on held back notes
+			if ((stamped = seq_event_time(&time, when)))
+			{
+				if (time.tv_sec < writer->Stamp.tv_sec || (time.tv_sec == writer->Stamp.tv_sec && time.tv_nsec < writer->Stamp.tv_nsec))
+				{
+					if (head != 3) time = writer->Stamp;
+				}
+				else
+					writer->Stamp = time;
+				snd_seq_ev_schedule_real(&ev, SeqQueue, 0, &time);
+				snd_seq_ev_set_tag(&ev, writer - &MidiOutWriters[0]);
+			}
+			else
+				snd_seq_ev_set_direct(&ev);
+
+			// System msg? We send only clock, start, stop, and song position
+			if (evt->Msg[0] >= 0xF0)
+			{
+				switch (evt->Msg[0])
+				{
+					case 0xF2:
+						ev.type = SND_SEQ_EVENT_SONGPOS;
+						ev.data.control.value = evt->Msg[1] | (evt->Msg[2] << 7);
+						break;
+					case 0xFA:
+						ev.type = SND_SEQ_EVENT_START;
+						break;
+					case 0xFC:
+						ev.type = SND_SEQ_EVENT_STOP;
+						break;
+					default:
+						ev.type = SND_SEQ_EVENT_CLOCK;
+				}
+			}
+			else
+			{
+				ev.type = SeqTypes[(evt->Msg[0] >> 4) - 8];
+//					snd_seq_ev_set_fixed(&ev);
+				ev.data.note.channel = evt->Msg[0] & 0x0F;
+				switch (ev.type)
+				{
+					case SND_SEQ_EVENT_CONTROLLER:
+						ev.data.control.param = evt->Msg[1];
+						ev.data.control.value = evt->Msg[2];
+
+						// All sound/notes off? Don't let stamped note ons still waiting on
+						// the queue play after it
+						if (stamped && (evt->Msg[1] == 120 || evt->Msg[1] == 123))
+							remove_seq_events(sounddev->Handle, ev.data.control.channel, writer - &MidiOutWriters[0]);
+						break;
+					case SND_SEQ_EVENT_PGMCHANGE:
+					case SND_SEQ_EVENT_CHANPRESS:
+						ev.data.control.value = evt->Msg[1];
+						break;
+					case SND_SEQ_EVENT_PITCHBEND:
+						ev.data.control.value = (evt->Msg[1] | (evt->Msg[2] << 7)) - 0x2000;
+						break;
+					default:
+						ev.data.note.note = evt->Msg[1];
+						if (!(ev.data.note.velocity = evt->Msg[2]) && ev.type == SND_SEQ_EVENT_NOTEON)
+							ev.type = SND_SEQ_EVENT_NOTEOFF;
+				}
+			}
+
+			// This only buffers it. The drain below does the write
+			snd_seq_event_output(sounddev->Handle, &ev);
+		}
+#ifndef NO_MIDI_OUT_SUPPORT
+		else
+#endif
+#endif
+#ifndef NO_MIDI_OUT_SUPPORT
+		{
+			// Copy it for pack_din_msgs()
+			*ptr = evt->Len;
+			memcpy(ptr + 1, evt->Msg, evt->Len);
+			ptr += 4;
+		}
+#endif
+	}
+
+	// Free those evts for sendMidiOut()
+	for (i = 0; i < 4; i++) __atomic_store_n(&writer->Queues[i].Head, heads[i], __ATOMIC_RELEASE);
+
+	if (depth)
+	{
+#ifndef NO_SEQ_SUPPORT
+		if ((sounddev->DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ) snd_seq_drain_output(sounddev->Handle);
+#ifndef NO_MIDI_OUT_SUPPORT
+		else
+#endif
+#endif
+#ifndef NO_MIDI_OUT_SUPPORT
+		{
+			// Pack them, then note how long they take on a DIN cable (10 bits per
+			// byte at 31250 baud = 320 usecs)
+			head = pack_din_msgs(&msgs[0], (ptr - &msgs[0]) / 4, &buffer[0]);
+			snd_rawmidi_write((snd_rawmidi_t *)sounddev->Handle, &buffer[0], head);
+			head *= 320;
+			if (head > writer->MaxWire) writer->MaxWire = head;
+		}
+#endif
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		head = (uint32_t)((((now.tv_sec - oldest.tv_sec) * 1000000000L) + now.tv_nsec - oldest.tv_nsec) / 1000);
+		if (head > writer->MaxLatency) writer->MaxLatency = head;
+		if (depth > writer->MaxDepth) writer->MaxDepth = depth;
+
+		if (clockFirst.tv_sec)
+		{
+			register int32_t		late;
+
+			register int32_t		early;
+
+			early = (int32_t)(((now.tv_sec - clockLast.tv_sec) * 1000000000L) + now.tv_nsec - clockLast.tv_nsec);
+			late = (int32_t)(((now.tv_sec - clockFirst.tv_sec) * 1000000000L) + now.tv_nsec - clockFirst.tv_nsec);
+			if (writer->ClockMin > writer->ClockMax)
+			{
+				writer->ClockMin = early;
+				writer->ClockMax = late;
+			}
+			else
+			{
+				if (early < writer->ClockMin) writer->ClockMin = early;
+				if (late > writer->ClockMax) writer->ClockMax = late;
+			}
+		}
+	}
+#ifndef NO_SEQ_SUPPORT
+	if ((sounddev->DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ) pthread_mutex_unlock(&SeqOutMutex);
+#endif
+
+	return held;
+}
+
+/****************** midiOutThread() *******************
+ * A MIDI Out bus' writer thread. Sleeps until
+ * sendMidiOut() queues msgs, then writes them.
+ *
+ * arg =	Its MIDIOUTWRITER.
+ */
+
+static void * midiOutThread(void * arg)
+{
+	struct pollfd					pfd;
+	struct timespec				wait, timeout;
+	uint64_t							val;
+	register MIDIOUTWRITER *	writer;
+	register struct SOUNDDEVINFO *	sounddev;
+	register MIDIOUTQUEUE *		queue;
+	register unsigned char		quit, held;
+
+	writer = (MIDIOUTWRITER *)arg;
+	sounddev = &SoundDev[DEVNUM_MIDIOUT1 + (writer - &MidiOutWriters[0])];
+
+	// Same priority as the MIDI In thread, and on the same CPU if the
+	// user pinned that
+	set_thread_priority(RTTHREAD_MIDIIN);
+
+	pfd.fd = writer->WakeFd;
+	pfd.events = POLLIN;
+	for (;;)
+	{
+		// If told to quit, do so after writing what's left (including what's
+		// held back)
+		quit = __atomic_load_n(&writer->Quit, __ATOMIC_ACQUIRE);
+		held = write_midi_out(sounddev, writer, quit, &wait);
+		if (quit) break;
+
+		// Say we're going to sleep, then check once more that nothing was
+		// queued before sendMidiOut() could see that
+		__atomic_store_n(&writer->Sleeping, 1, __ATOMIC_SEQ_CST);
+		queue = &writer->Queues[0];
+		do
+		{
+			if (__atomic_load_n(&queue->Tail, __ATOMIC_SEQ_CST) != writer->Seen[queue - &writer->Queues[0]]) goto awake;
+		} while (++queue < &writer->Queues[4]);
+
+		// If holding back msgs, wake when the first is due
+		if (held)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &timeout);
+			timeout.tv_sec = wait.tv_sec - timeout.tv_sec;
+			if ((timeout.tv_nsec = wait.tv_nsec - timeout.tv_nsec) < 0)
+			{
+				timeout.tv_nsec += 1000000000L;
+				--timeout.tv_sec;
+			}
+			if (timeout.tv_sec < 0) goto awake;
+		}
+		if (ppoll(&pfd, 1, held ? &timeout : 0, 0) > 0) read(writer->WakeFd, &val, sizeof(val));
+awake:
+		__atomic_store_n(&writer->Sleeping, 0, __ATOMIC_RELAXED);
+	}
+
+	return 0;
+}
+
+/****************** start_midi_out() *******************
+ * Called by openMidiOut() to start the bus' writer thread
+ * once its device is open.
+ *
+ * RETURN: 0 if success.
+ */
+
+static int start_midi_out(register struct SOUNDDEVINFO * sounddev)
+{
+	register MIDIOUTWRITER *	writer;
+
+	writer = &MidiOutWriters[sounddev - &SoundDev[DEVNUM_MIDIOUT1]];
+	memset(writer, 0, sizeof(MIDIOUTWRITER));
+	writer->ClockMin = 1;
+	if ((writer->WakeFd = eventfd(0, EFD_NONBLOCK)) > 0)
+	{
+		if (!create_rt_thread(&writer->Thread, midiOutThread, writer))
+		{
+			__atomic_store_n(&writer->Running, 1, __ATOMIC_SEQ_CST);
+			return 0;
+		}
+		close(writer->WakeFd);
+	}
+	writer->WakeFd = 0;
+	return -1;
+}
+
+/****************** stop_midi_out() *******************
+ * Called by closeMidiOut() to stop sendMidiOut() queuing
+ * for the bus, before it waits for other threads to leave
+ * the bus.
+ */
+
+static void stop_midi_out(register struct SOUNDDEVINFO * sounddev)
+{
+	__atomic_store_n(&MidiOutWriters[sounddev - &SoundDev[DEVNUM_MIDIOUT1]].Running, 0, __ATOMIC_SEQ_CST);
+}
+
+/****************** end_midi_out() *******************
+ * Called by closeMidiOut(), once no other thread is in
+ * sendMidiOut() for the bus, to end its writer thread
+ * after it writes whatever is still queued.
+ */
+
+static void end_midi_out(register struct SOUNDDEVINFO * sounddev)
+{
+	register MIDIOUTWRITER *	writer;
+
+	writer = &MidiOutWriters[sounddev - &SoundDev[DEVNUM_MIDIOUT1]];
+	if (writer->WakeFd > 0)
+	{
+		uint64_t		val;
+
+		__atomic_store_n(&writer->Quit, 1, __ATOMIC_RELEASE);
+		val = 1;
+		write(writer->WakeFd, &val, sizeof(val));
+		pthread_join(writer->Thread, 0);
+		close(writer->WakeFd);
+		writer->WakeFd = 0;
+	}
+}
+
+/****************** getMidiOutStats() *******************
+ * Gets the most msgs found queued at once, the longest
+ * write latency (in usecs), the msgs lost to a full
+ * queue, and the longest wire time of one write (in
+ * usecs), for a MIDI Out bus since it was opened.
+ *
+ * bus =		0 to 3 for External Synth 1 to 4.
+ *
+ * RETURN: 0 if the bus isn't open.
+ */
+
+unsigned char getMidiOutStats(register unsigned char bus, register uint32_t * depth, register uint32_t * usecs, register uint32_t * lost, register uint32_t * wire)
+{
+	register MIDIOUTWRITER *	writer;
+
+	writer = &MidiOutWriters[bus];
+	if (!writer->Running) return 0;
+	*depth = writer->MaxDepth;
+	*usecs = writer->MaxLatency;
+	*lost = writer->Lost;
+	*wire = writer->MaxWire;
+	return 1;
+}
+
+/****************** setMidiOutLatency() *******************
+ * Sets how many msecs an External Synth takes to sound a
+ * note it's sent, so the robots' faster outputs can be
+ * held back to sound along with it. Takes effect at the
+ * next PPQN.
+ *
+ * bus =		0 to 3 for External Synth 1 to 4.
+ * msecs =	0 to MIDIOUT_LATENCY_MAX, or 0xFF to query.
+ *
+ * RETURN: The setting.
+ */
+
+unsigned char setMidiOutLatency(register unsigned char bus, register unsigned char msecs)
+{
+	if (msecs <= MIDIOUT_LATENCY_MAX) MidiOutLatency[bus] = msecs;
+	return MidiOutLatency[bus];
+}
+
+/****************** align_outputs() *******************
+ * Called by the Beat thread at each PPQN, before it plays
+ * that PPQN's notes, to set how long to hold them back on
+ * each output the robots play, so they all sound along
+ * with the slowest. An External Synth takes its
+ * MidiOutLatency, plus the SeqLead if its notes are
+ * stamped. The Internal Synth takes as long as the audio
+ * out's buffer, and its notes are held back by the audio
+ * thread instead. If the user hasn't set any External
+ * Synth's latency, nothing is held back.
+ */
+
+static void align_outputs(void)
+{
+	uint32_t								latency[DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 2];
+	register struct SOUNDDEVINFO *	sounddev;
+	register uint32_t					slowest;
+	register unsigned char			i, used;
+
+	// Which outputs do the robots play? Bits 0 to 3 are the External Synths,
+	// and bit 4 the Internal Synth
+	used = 0;
+	for (i = 0; i < PLAYER_SOLO; i++)
+	{
+		if ((sounddev = DevAssigns[i]))
+			used |= (sounddev >= &SoundDev[DEVNUM_MIDIOUT1] ? 0x01 << (sounddev - &SoundDev[DEVNUM_MIDIOUT1]) : 0x10);
+	}
+
+	// Lining up is opt-in. With all latencies 0, don't hold back even the
+	// External Synths for the Internal Synth's buffer
+	for (i = 0; i < DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1 && !MidiOutLatency[i]; i++);
+	if (i >= DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1) used = 0;
+
+	slowest = 0;
+	for (i = 0; i < DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1; i++)
+	{
+		if (used & (0x01 << i))
+		{
+			latency[i] = (MidiOutLatency[i] + getSeqLead(i)) * 1000000;
+			if (latency[i] > slowest) slowest = latency[i];
+		}
+	}
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	if (used & 0x10)
+	{
+		latency[i] = getBeatLatency();
+		if (latency[i] > slowest) slowest = latency[i];
+	}
+	setBeatDelay((used & 0x10) ? slowest - latency[i] : 0);
+#endif
+	while (i--) MidiOutDelay[i] = (used & (0x01 << i)) ? slowest - latency[i] : 0;
+}
+
+/****************** sendMidiOut() *******************
+ * Sends to MIDI Out, if open. For an ALSA device, the
+ * msgs are queued for the bus' writer thread, so this
+ * doesn't wait.
+ *
+ * sounddev =		One of the four MIDI Out playback devices.
+ * msg =				MIDI bytes. Each msg must have its status.
+ * count =			How many bytes.
+ *
+ * NOTE: The caller's thread ID must be OR'd with count.
+ */
+
+void sendMidiOut(register struct SOUNDDEVINFO * sounddev, register unsigned char * msg, register uint32_t count)
+{
+	register MIDIOUTWRITER *	writer;
+	register unsigned char		threadId;
+
+	threadId = count & (MIDITHREADID|BEATTHREADID|GUITHREADID);
+	count &= ~(MIDITHREADID|BEATTHREADID|GUITHREADID);
+
+	// The GUI's queue can have more than one sender (ie, Setup's Measure worker
+	// thread too). None are realtime, so they simply take turns
+	if (threadId == GUITHREADID) pthread_mutex_lock(&MidiOutGuiMutex);
+
+	// Tell closeMidiOut() we're using "SoundDev[MIDIOUT_x]". Other senders don't
+	// matter, since each has its own queue
+	__atomic_or_fetch(&sounddev->Lock, threadId, __ATOMIC_SEQ_CST);
+
+	// Writer thread running? Queue the msgs for it
+	writer = &MidiOutWriters[sounddev - &SoundDev[DEVNUM_MIDIOUT1]];
+	if (__atomic_load_n(&writer->Running, __ATOMIC_SEQ_CST))
+		queue_midi_out(writer, &writer->Queues[threadId == BEATTHREADID ? (*msg >= 0xF0 ? 3 : 0) : (threadId == MIDITHREADID ? 1 : 2)], msg, count, threadId);
+#ifndef NO_JACK_SUPPORT
+
+	// No ALSA device on this bus. Use Jack's midi_out port if Jack is running. Its
+	// queue takes one sender at a time, so let any other first finish. (Queuing
+	// is only a copy, so no one waits long)
+	else if (!sounddev->Handle)
+	{
+		pthread_mutex_lock(&JackMidiOutMutex);
+		queueJackMidi(sounddev - &SoundDev[DEVNUM_MIDIOUT1], msg, count);
+		pthread_mutex_unlock(&JackMidiOutMutex);
+	}
+#endif
+
+	// Allow other threads access now
+	__atomic_and_fetch(&sounddev->Lock, ~threadId, __ATOMIC_RELAXED);
+	if (threadId == GUITHREADID) pthread_mutex_unlock(&MidiOutGuiMutex);
+}
+
+
+
+
+
+/************** send_patch() ******************
+ * Sends a patch change to an external synth.
+ *
+ * roboNum =	PLAYER_xxx.
+ * pgm =			MIDI pgm change #
+ * threadId =	Caller's ID. Bits 8 to 15 are the bank MSB to send
+ * 				or SETINS_NO_MSB. Bits 16 to 24 are the bank
+ * 				LSB to send, or SETINS_NO_LSB.
+ */
+
+void send_patch(register unsigned char roboNum, register unsigned char pgm, register uint32_t threadId)
+{
+	unsigned char						msg[8];
+	register unsigned char *		msgPtr;
+	register unsigned char			midichan;
+
+	midichan = 0xB0 | MidiChans[roboNum];
+	msgPtr = &msg[0];
+	if (!(threadId & SETINS_NO_MSB))
+	{
+		*msgPtr++ = midichan;
+		*msgPtr++ = 0x00;
+		*msgPtr++ = (threadId >> 8) & 0xff;
+	}
+	if (!(threadId & SETINS_NO_LSB))
+	{
+		*msgPtr++ = midichan;
+		*msgPtr++ = 0x20;
+		*msgPtr++ = (threadId >> 16) & 0xff;
+	}
+
+	*msgPtr++ = midichan + 16;
+	*msgPtr++ = pgm;
+	sendMidiOut(DevAssigns[roboNum], &msg[0], (unsigned char)(msgPtr - &msg[0]) | (threadId & 0xFF));
+}
+
+
+
+
+
+/******************** clock_out() *********************
+ * Called by Play Beat thread to send MIDI clock, start,
+ * stop, or (0xF2) song position to each MIDI Out bus
+ * that got our Start.
+ */
+
+static void clock_out(register unsigned char status)
+{
+	register struct SOUNDDEVINFO *	soundDev;
+	register unsigned char				mask;
+	register uint32_t						len;
+	unsigned char							msg[3];
+
+	msg[0] = status;
+	len = 1;
+	if (status == 0xF2)
+	{
+		// Song position is in 16th notes (6 clocks), limited to 14 bits
+		len = ClockOutCnt / (PPQN_VALUE / 4);
+		if (len > 0x3FFF) len = 0x3FFF;
+		msg[1] = len & 0x7F;
+		msg[2] = len >> 7;
+		len = 3;
+	}
+
+	soundDev = &SoundDev[DEVNUM_MIDIOUT1];
+	for (mask = ClockOutPlay; mask; mask >>= 1)
+	{
+		if (mask & 0x01) sendMidiOut(soundDev, &msg[0], len|BEATTHREADID);
+		soundDev++;
+	}
+}
+
+/****************** clock_out_start() *******************
+ * Called by Play Beat thread when it starts playing the
+ * first PPQN. Sends MIDI Start, and the first clock, to
+ * the buses the user chose, unless we're following
+ * someone else's clock.
+ */
+
+static void clock_out_start(void)
+{
+#ifndef NO_MIDICLOCK_IN
+	if (ClockId >= 0xFE) return;
+#endif
+	if ((ClockOutPlay = ClockOut))
+	{
+		register unsigned char	i;
+
+		for (i = 0; i < DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1; i++)
+		{
+			MidiOutWriters[i].ClockMin = 1;
+			MidiOutWriters[i].ClockMax = 0;
+		}
+		ClockOutCnt = 0;
+		clock_out(0xFA);
+		clock_out(0xF8);
+		ClockOutCnt++;
+	}
+}
+
+/****************** clock_out_tick() *******************
+ * Called by Play Beat thread as soon as it wakes for a
+ * PPQN. Sends MIDI clock. Each bus' writer measures how
+ * late it went out compared to the PPQN's deadline.
+ */
+
+static void clock_out_tick(void)
+{
+	clock_out(0xF8);
+	ClockOutCnt++;
+}
+
+/****************** clock_out_stop() *******************
+ * Called by Play Beat thread when play stops. Sends MIDI
+ * Stop, then the song position where we stopped.
+ */
+
+static void clock_out_stop(void)
+{
+	if (ClockOutPlay)
+	{
+		clock_out(0xFC);
+		clock_out(0xF2);
+		ClockOutPlay = 0;
+	}
+}
+
+/****************** setClockOut() *******************
+ * Sets whether the specified MIDI Out bus gets our
+ * MIDI clock, start/stop, and song position. Takes
+ * effect the next time play starts.
+ *
+ * bus =		0 to 3 for External Synth 1 to 4.
+ * on =		1 to send, 0 not to, 0xFF to query.
+ *
+ * RETURN: 1 if the bus gets clock.
+ */
+
+unsigned char setClockOut(register unsigned char bus, register unsigned char on)
+{
+	if (on != 0xFF)
+	{
+		if (on)
+			ClockOut |= (0x01 << bus);
+		else
+			ClockOut &= ~(0x01 << bus);
+	}
+	return (ClockOut >> bus) & 0x01;
+}
+
+/***************** getClockOutJitter() *****************
+ * Gets the spread between the earliest and latest that
+ * MIDI clock was written relative to the exact time, since
+ * play last started, in usecs. The worst of the buses
+ * that get clock. (Jack's midi_out ports aren't measured.)
+ *
+ * RETURN: 0 if nothing measured, or 1 if so.
+ */
+
+unsigned char getClockOutJitter(register uint32_t * usecs)
+{
+	register MIDIOUTWRITER *	writer;
+	register uint32_t				spread;
+	register unsigned char		mask, found;
+
+	found = 0;
+	writer = &MidiOutWriters[0];
+	for (mask = ClockOut; mask; mask >>= 1)
+	{
+		if ((mask & 0x01) && writer->ClockMin <= writer->ClockMax)
+		{
+			spread = (uint32_t)(writer->ClockMax - writer->ClockMin) / 1000;
+			if (!found++ || spread > *usecs) *usecs = spread;
+		}
+		writer++;
+	}
+
+	return found ? 1 : 0;
+}
+
+
+
+
+/****************** closeMidiOut() *****************
+ * Closes MIDI output if open.
+ *
+ * Called only by main (GUI) thread.
+ */
+
+void closeMidiOut(register struct SOUNDDEVINFO * sounddev)
+{
+	// Stop other threads queuing msgs, wait for any in sendMidiOut() to
+	// leave, then let the writer thread finish what they queued
+	stop_midi_out(sounddev);
+	pthread_mutex_lock(&MidiOutGuiMutex);
+	while (__atomic_or_fetch(&sounddev->Lock, GUITHREADID, __ATOMIC_RELAXED) != GUITHREADID) usleep(100);
+	pthread_mutex_unlock(&MidiOutGuiMutex);
+	end_midi_out(sounddev);
 
 #ifndef NO_SEQ_SUPPORT
 	// Is it open?
@@ -2353,7 +3808,9 @@ void closeMidiOut(register struct SOUNDDEVINFO * sounddev)
 			snd_seq_event_t	ev;
 			register unsigned char	musicianNum;
 
-			// Send an ALL NOTES OFF
+			// Send an ALL NOTES OFF, after removing any note ons still waiting
+			// on the queue
+			pthread_mutex_lock(&SeqOutMutex);
 			snd_seq_ev_clear(&ev);
 			snd_seq_ev_set_source(&ev, sounddev->Card);
 			snd_seq_ev_set_subs(&ev);
@@ -2366,10 +3823,12 @@ void closeMidiOut(register struct SOUNDDEVINFO * sounddev)
 				if (DevAssigns[--musicianNum] == sounddev)
 				{
 					ev.data.control.channel = MidiChans[musicianNum];
+					remove_seq_events(sounddev->Handle, ev.data.control.channel, sounddev - &SoundDev[DEVNUM_MIDIOUT1]);
 					snd_seq_event_output(sounddev->Handle, &ev);
 				}
 			} while (musicianNum);
 			snd_seq_drain_output(sounddev->Handle);
+			pthread_mutex_unlock(&SeqOutMutex);
 		}
 	}
 #endif
@@ -2429,9 +3888,14 @@ err:			sprintf((char *)TempBuffer, "Can't open %s", getPlayDestDevName(devnum));
 			// If a client specified, connect to it
 			if (sounddev->DevHash && snd_seq_connect_to((snd_seq_t *)sounddev->Handle, sounddev->Card, sounddev->Dev, sounddev->SubDev) < 0)
 			{
+				// The port stays open for the user to connect manually
 				sprintf((char *)TempBuffer, "Can't connect %s to other software", getPlayDestDevName(devnum));
+				start_midi_out(sounddev);
 				goto err2;
 			}
+
+			// For timestamped output
+			open_seq_queue((snd_seq_t *)sounddev->Handle);
 		}
 #ifndef NO_MIDI_OUT_SUPPORT
 		else
@@ -2456,6 +3920,15 @@ err2:
 			}
 		}
 #endif
+
+		// Start its writer thread
+		if (start_midi_out(sounddev))
+		{
+			close_midi_port(sounddev);
+			__atomic_and_fetch(&sounddev->Lock, ~GUITHREADID, __ATOMIC_RELAXED);
+			show_msgbox("Can't create MIDI out thread");
+			return -1;
+		}
 	}
 
 	__atomic_and_fetch(&sounddev->Lock, ~GUITHREADID, __ATOMIC_RELAXED);
@@ -2605,42 +4078,60 @@ void unlockTempo(register unsigned char threadId)
 
 /******************** set_bpm() *********************
  * Sets micro PPQN from specified BPM. 0 queries the
- * current tempo.
+ * current tempo (rounded to a whole BPM).
  *
  * Note: Caller should lockTempo()
  */
 
 unsigned char set_bpm(register unsigned char tempo)
 {
-	if (tempo)
+	if (tempo) set_tempo((uint32_t)tempo * 100);
+	return TempoBPM;
+}
+
+/******************** set_tempo() *********************
+ * Sets micro PPQN from specified tempo in 1/100 BPM,
+ * for a tempo that isn't a whole BPM. 0 queries the
+ * current tempo.
+ *
+ * Note: Caller should lockTempo()
+ */
+
+uint32_t set_tempo(register uint32_t centiBpm)
+{
+	if (centiBpm)
 	{
+		register unsigned char	tempo;
+
+		tempo = (unsigned char)((centiBpm + 50) / 100);
 		if (TempoBPM != tempo) PrevTempoBPM = TempoBPM;
 		TempoBPM = tempo;
+		TempoCenti = centiBpm;
 
 		// Update tempo for beat play thread
-		set_PPQN(tempo);
+		set_PPQN(centiBpm);
 
 		cancel_midi_taptempo();
 	}
 
-	return TempoBPM;
+	return TempoCenti;
 }
 
 
 
 
 /********************* set_PPQN() *********************
- * Sets the "milliseconds per seq tick" based upon tempo
- * in BPM.
+ * Sets the length of a seq tick based upon tempo in
+ * 1/100 BPM.
  */
 
-void set_PPQN(register unsigned char bpm)
+void set_PPQN(register uint32_t centiBpm)
 {
 	// Cancel any ritard/accel in progress
 	PlayFlags &= ~(PLAYFLAG_RITARD|PLAYFLAG_ACCEL);
-	TempoChangeCnt = 0;
+	RampLen = 0;
 
-	MsecsPerTick = 60000000/((uint32_t)bpm * (PPQN_VALUE * 1000));
+	TickLen = (6000000000000ULL << TICKLEN_SHIFT) / (centiBpm * PPQN_VALUE);
 }
 
 
@@ -2656,6 +4147,35 @@ unsigned char get_prev_bpm(void)
 
 
 
+/******************** start_tempo_ramp() *********************
+ * Called by Play Beat thread to start a ritard/accel. The
+ * tempo glides from where it is now, to 20% slower/faster
+ * over 2 beats. On the End variation's final measure, a
+ * ritard instead broadens to 2/3 the tempo by the end of
+ * the measure.
+ */
+
+static void start_tempo_ramp(void)
+{
+	PlayFlags &= ~PLAYFLAG_ACCEL;
+	RampStartLen = TickLen;
+	RampPos = 0;
+	RampLen = PPQN_VALUE * 2;
+	if (!(PlayFlags & PLAYFLAG_RITARD))
+		RampEndLen = (TickLen * 5) / 6;
+	else if ((RampFinal = (PlayFlags & PLAYFLAG_FINAL_PTN) ? 1 : 0))
+	{
+		RampEndLen = (TickLen * 3) / 2;
+		RampLen = getMeasureTime();
+	}
+	else
+		RampEndLen = (TickLen * 5) / 4;
+
+	// Stay within 38 to 192 BPM
+	if (RampEndLen > TICKLEN_MAX) RampEndLen = TICKLEN_MAX;
+	if (RampEndLen < TICKLEN_MIN) RampEndLen = TICKLEN_MIN;
+}
+
 void set_ritard_or_accel(register unsigned char flag)
 {
 	register unsigned char	newFlags;
@@ -2767,7 +4287,7 @@ void initBeatThread(void)
 	if (!getStyleCategory(0)) goto none;
 
 	// Start up a background thread to play accomp
-	if (pthread_create(&PlayThreadHandle, 0, playBeatThread, 0))
+	if (create_rt_thread(&PlayThreadHandle, playBeatThread, 0))
 	{
 		show_msgbox("Can't create beat play thread");
 none:	PlayThreadHandle = 0;
@@ -2926,6 +4446,27 @@ unsigned char * saveAccompConfig(register unsigned char * buffer)
 		*buffer++ = CONFIGKEY_CHORDBOUND;
 		*buffer++ = ChordBoundary;
 	}
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+	if (ClockOut)
+	{
+		*buffer++ = CONFIGKEY_CLOCKOUT;
+		*buffer++ = ClockOut;
+	}
+#endif
+#ifndef NO_MIDICLOCK_IN
+	if (ClockPll != 3)
+	{
+		*buffer++ = CONFIGKEY_CLOCKPLL;
+		*buffer++ = ClockPll;
+	}
+#endif
+#ifndef NO_SEQ_SUPPORT
+	if (SeqLead)
+	{
+		*buffer++ = CONFIGKEY_SEQLEAD;
+		*buffer++ = SeqLead;
+	}
+#endif
 
 	if (!(AppFlags & (APPFLAG_2KEY|APPFLAG_1FINGER)))
 	{
@@ -2988,6 +4529,21 @@ ret1:	return 1;
 		case CONFIGKEY_CHORDBOUND:
 			ChordBoundary = ptr[0];
 			goto ret1;
+		case CONFIGKEY_CLOCKOUT:
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+			ClockOut = ptr[0] & 0x0F;
+#endif
+			goto ret1;
+		case CONFIGKEY_CLOCKPLL:
+#ifndef NO_MIDICLOCK_IN
+			if (ptr[0] < PLL_NUM_BWS) ClockPll = ptr[0];
+#endif
+			goto ret1;
+		case CONFIGKEY_SEQLEAD:
+#ifndef NO_SEQ_SUPPORT
+			setSeqLead(ptr[0]);
+#endif
+			goto ret1;
 		case CONFIGKEY_TRANSPOSE:
 			ConfigTranspose = Transpose = ptr[0];
 			goto ret1;
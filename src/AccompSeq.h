@@ -20,6 +20,7 @@ void				clear_note(void);
 unsigned char	lockChord(register unsigned char);
 void				unlockChord(register unsigned char);
 void				advance_midiclock(void);
+void				resync_measure(register uint32_t);
 unsigned char	is_midiclock(void);
 uint32_t			pickChord(register unsigned char, register unsigned char, register unsigned char);
 uint32_t			getCurrChord(void);
@@ -28,8 +29,9 @@ uint32_t			get_current_clock(void);
 void				songChordChange(register unsigned char, register unsigned char);
 uint32_t			clearChord(register unsigned char);
 unsigned char	set_bpm(register unsigned char);
+uint32_t			set_tempo(register uint32_t);
 unsigned char	get_prev_bpm(void);
-void				set_PPQN(register unsigned char);
+void				set_PPQN(register uint32_t);
 void				set_ritard_or_accel(register unsigned char);
 void				initBeatThread(void);
 void				endBeatThread(void);
@@ -41,6 +43,14 @@ uint32_t			mute_playing_chord(register unsigned char);
 uint32_t			midiChordTrigger(register unsigned char, register unsigned char);
 uint32_t			eventChordTrigger(register unsigned char, register unsigned char, register unsigned char);
 void				sendMidiOut(register struct SOUNDDEVINFO *, register unsigned char *, register uint32_t);
+unsigned char	setClockOut(register unsigned char, register unsigned char);
+unsigned char	getClockOutJitter(register uint32_t *);
+unsigned char	setClockPll(register unsigned char);
+unsigned char	setSeqLead(register unsigned char);
+unsigned char	getSeqLead(register unsigned char);
+unsigned char	getMidiOutStats(register unsigned char, register uint32_t *, register uint32_t *, register uint32_t *, register uint32_t *);
+unsigned char	setMidiOutLatency(register unsigned char, register unsigned char);
+#define MIDIOUT_LATENCY_MAX	100
 uint32_t			allNotesOff(register unsigned char);
 void				send_patch(register unsigned char, register unsigned char, register uint32_t);
 uint32_t			set_sustain(register unsigned char, register unsigned char, register unsigned char );
@@ -52,7 +62,7 @@ int				loadAccompConfig(register unsigned char *, register unsigned long);
 unsigned char	lockGui(register unsigned char);
 void				unlockGui(register unsigned char);
 void				signalMainFromMidiIn(register void *, register uint32_t);
-void				checkStartPadNotes(void);
+void				checkStartPadNotes(register unsigned char);
 void				send_alloff(register uint32_t, register unsigned char);
 unsigned char	setChordSensitivity(register unsigned char);
 void				close_midi_port(register struct SOUNDDEVINFO *);
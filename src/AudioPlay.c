@@ -11,10 +11,21 @@
 // You should have received a copy of the GNU General Public License
 // along with Backup Band. If not, see <http://www.gnu.org/licenses/>.
 
+// For sched_setaffinity()
+#define _GNU_SOURCE
+
 //#define TEST_AUDIO_MIX
 //#define JG_NOTE_DEBUG
+//#define JG_LOAD_TIMING
+//#define JG_MIX_TIMING
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <dirent.h>
+#include <sys/resource.h>
 #include "Options.h"
 #include "Main.h"
 #include "PickDevice.h"
@@ -30,12 +41,35 @@
 #ifndef O_NOATIME
 #define O_NOATIME        01000000
 #endif
+#ifndef O_TMPFILE
+#define O_TMPFILE        (020000000 | O_DIRECTORY)
+#endif
 #pragma pack(1)
 
 #define WAVEFLAG_STEREO		0x01
 #define WAVEFLAG_48000		0x10
 #define WAVEFLAG_88200		0x20
 #define WAVEFLAG_96000		0x30
+#define WAVEFLAG_LOSSLESS	0x40	// .cmp file only. Data has lossless compression. See WaveCmp.c
+
+// WAVEFORM_INFO MemFlags
+#define WAVEMEM_POOLED		0x01	// WaveForm[] is mapped from the shared sample pool
+#define WAVEMEM_ADPCM		0x02	// WaveForm[] holds ADPCM blocks. See compactWave()
+
+// A compacted wave is stored as fixed-size blocks of 4-bit IMA ADPCM, so the mixer
+// can start decoding at any block (ie, seek for looping). Each block holds an
+// ADPCM_CHAN per chan, followed by a nibble per sample (interleaved like the
+// 16-bit data). The first frame's sample is the ADPCM_CHAN's Pt, so its nibbles
+// are unused
+#define ADPCM_BLOCK_SHIFT	6
+#define ADPCM_BLOCK_FRAMES	(1 << ADPCM_BLOCK_SHIFT)
+#define ADPCM_BLOCK_SIZE	(sizeof(ADPCM_CHAN) + (ADPCM_BLOCK_FRAMES / 2))	// Per chan
+
+typedef struct {
+	short						Pt;				// First sample of the block, for this chan
+	unsigned char			Index;			// Step index at the start of the block. 0 to 88
+	unsigned char			Unused;
+} ADPCM_CHAN;
 
 // Holds info about one loaded waveform
 typedef struct _WAVEFORM_INFO {
@@ -46,8 +80,8 @@ typedef struct _WAVEFORM_INFO {
 	uint32_t					LoopEnd;			// Sample offset to loop end
 	uint32_t					LegatoOffset;	// Offset (past the initial attack of the wave) to where a hammer-on/legato note would begin. In 16-bit samples
 	unsigned char			WaveFlags;
-	unsigned char			Unused;
-	char						WaveForm[1];	// Loaded wave data. Size=WaveformLen*2
+	unsigned char			MemFlags;		// WAVEMEM_xxx
+	char						WaveForm[1];	// Loaded wave data. Size=waveDataSize()
 } WAVEFORM_INFO;
 
 // Holds info about one Zone in an instrument/kit
@@ -85,6 +119,7 @@ typedef struct _INS_INFO {
 	PLAYZONE_INFO *		Zones;			// The zones for this instrument
 	PLAYZONE_INFO *		ReleaseZones;	// A set of release samples, or 0 if none
 	PLAYZONE_INFO *		LayerZones;		// A set of samples for a dual layer, or 0 if none
+	void *					Bundle;			// Mapped bundle that holds the zones, or 0 if they're malloc'ed
 	union {
 	uint32_t					Hash;				// Used temp for kits
 	struct _INS_INFO *	Kit;				// Any sub-kit for this kit
@@ -120,6 +155,8 @@ typedef struct _VOICE_INFO {
 	uint32_t					CurrentOffset;			// Current read ptr for this wave. Used for copying data to the mix buffer
 	uint32_t					TransposeIncrement;	// For linear interpolation
 	uint32_t					TransposeFracPos;		// For linear interpolation
+	uint32_t					StartFrame;				// If not 0, the MixFrames at which the voice starts
+	uint32_t					BeatFrame;				// If not 0, the frame on the beat thread's PPQN grid where it belongs
 	uint32_t					ReleaseTime;			// Loop fadeout speed, or note release speed
 	float						AttackLevel;			// If not 0, then initial attack fades in until this vol
 	float						VolumeFactor;			// Volume of this voice
@@ -137,6 +174,9 @@ typedef struct _VOICE_INFO {
 															// has been turned off with MIDI noteoff, but may still be playing in release env
 	unsigned char			Velocity;				// MIDI note velocity
 	unsigned char			Musician;				// Musician using this voice (PLAYER_xxx)
+	WAVEFORM_INFO *		DecodedWave[2];		// Compacted waves whose blocks are in Decoded[]
+	uint32_t					DecodedBlock[2];		// Block #s of the blocks in Decoded[]
+	short						Decoded[2][ADPCM_BLOCK_FRAMES * 2];	// Decoded ADPCM blocks. Even # blocks in [0], odd in [1]
 } VOICE_INFO;
 
 #pragma pack()
@@ -205,18 +245,40 @@ static VOICE_INFO *			AudioThreadQueue;
 static char *					MixBuffPtr;
 static char *					MixBuffEnd;
 
-// For MVerb reverb code
+// Which chan pair of audio out each musician (and the reverb return) plays
+// on, as the user set it. 0 = the first 2 chans
+static unsigned char			OutPairs[OUTPUT_REVERB + 1];
+
+// # of floats per frame in MixBuffPtr. It interleaves every chan pair in use,
+// the same as the card does, so the final conversion is one straight loop.
+// MixOffsets[] is where each musician's (and reverb's) pair is in a frame
+static unsigned char			MixChans = 2;
+static unsigned char			MixOffsets[OUTPUT_REVERB + 1];
+
+// For MVerb reverb code. Reverb is stereo, so when its return isn't the
+// only pair, we process into RevOutBuffPtr, then add that to its pair
 #ifndef NO_REVERB_SUPPORT
 static REVERBHANDLE			Reverb = 0;
 static char *					ReverbBuffPtr;
+static char *					RevOutBuffPtr;
 #endif
 
 // For arbitrating voice access between threads
 static int						SecondaryThreadPriority, AudioThreadPriority;
 
+// CPU each RTTHREAD_ is pinned to. 0 = any, else CPU # + 1
+static unsigned char			ThreadCpus[3];
+
+// Our realtime threads get a modest stack (instead of the default 8M, which
+// mlockall() would lock in RAM), and touch RT_STACK_PREFAULT of it upon
+// starting, so it's paged in before they need it
+#define RT_STACK_SIZE			(256 * 1024)
+#define RT_STACK_PREFAULT		(64 * 1024)
+
 // Ptr to a buffer where we mix the currently playing (out) waveforms.
-// Ideally will point to the soundcard's 32-bit MMAP buffer
-static int32_t *				MixBufferPtr[2];
+// Ideally will point to the soundcard's 32-bit MMAP buffer. For
+// non-interleaved (or JACK), one ptr per chan
+static int32_t *				MixBufferPtr[MAX_OUT_PAIRS * 2];
 
 // Linear interpolation for transposing a wave
 #define PCM_TRANSPOSE_LIMIT	12		// allow +- 1 octave
@@ -296,11 +358,93 @@ static unsigned char		SampleRateFactor = 0;
 #define MAX_HUMAN_POLYPHONY	64
 static unsigned char		Polyphony[5] = {MAX_DRUM_POLYPHONY, MAX_BASS_POLYPHONY, MAX_GUITAR_POLYPHONY, MAX_PAD_POLYPHONY, MAX_HUMAN_POLYPHONY};
 
+// For the master recorder. The audio thread copies each period's mix (all
+// MixChans, before master volume) into RecBuffer, a ring of RecFrames frames.
+// Our recordThread() streams it to a WAV file in large writes. Only the audio
+// thread moves RecHead, and only recordThread moves RecTail, so no lock is
+// needed. If the ring is full, the audio thread drops the period and counts it
+// in RecDrops, rather than wait. (Only the free-running AUDIODEV_FILE, which
+// isn't realtime, waits for room instead)
+static float *					RecBuffer;
+static uint32_t				RecFrames;
+static uint32_t				RecHead, RecTail;
+static uint32_t				RecDrops;
+static pthread_t				RecThreadHandle;
+static int						RecHandle = -1;
+static uint32_t				RecBytes;
+static unsigned char			RecMode, RecChans, RecFileNum, RecStop;
+static char *					RecWriteBuf;
+static char						RecPath[PATH_MAX];
+#define REC_RING_SECS		4
+#define REC_WRITE_SIZE		(256 * 1024)
+#define WAVE_FORMAT_FLOAT	3
+
+// Count of frames mixed. A VOICE_INFO's StartFrame is in these units
+static uint32_t				MixFrames;
+
+// While a MIDI in thread parses input the audio thread queued, the MixFrames
+// at which any note it starts should begin. 0 to begin with the next block
+static uint32_t				MidiStartFrame;
+
+// For sample accurate accomp. The MixFrames at which the beat thread's
+// notes of the current PPQN start (0 to begin with the next block), and
+// where that PPQN falls on its grid (0 if unknown). BeatPlaceFrame is
+// BeatGridFrame while the beat thread starts a PPQN's notes, or 0 for
+// notes it starts between PPQNs. BeatOnsetMin/Max are
+// the earliest and latest any of its notes started relative to the grid,
+// in frames, and BeatLate counts those that started after their frame.
+// BeatOnsetReset tells the audio thread to start measuring anew. BeatSched
+// is set if the beat thread places its notes at exact frames
+static unsigned char			BeatSched;
+static uint32_t				BeatStartFrame;
+static uint32_t				BeatGridFrame;
+static uint32_t				BeatPlaceFrame;
+static int32_t					BeatOnsetMin, BeatOnsetMax;
+static uint32_t				BeatLate;
+static unsigned char			BeatOnsetReset;
+
+// How many frames into its waveform the beat thread's next bass/gtr/pad
+// note starts, when a late chord makes it replay notes it should have
+// already played. 0 to start at the waveform's head
+static uint32_t				BeatSkipFrames;
+
+// How many frames after its place on the PPQN grid each beat note starts,
+// so the Internal Synth sounds along with slower External Synths
+static uint32_t				BeatDelayFrames;
+
 // ==============================================
 #ifndef NO_ALSA_AUDIO_SUPPORT
 
-// Index into a buffer where we store audio input
+// Index into a buffer where we store audio input, and how many frames
+// it holds
 static uint32_t				InputIndex;
+static uint32_t				InputCount;
+static char *					InputBuffPtr;
+
+// Set if audio in/out are linked to start/stop together
+static unsigned char			AudioLinked;
+
+// Audio in monitor vol, pan, and reverb send. MonitorGain[] are the
+// resulting left/right/reverb factors the Audio thread applies
+static unsigned char			MonitorAdjust[3] = {MAX_VOL_ADJUST - 15, 50, 0};
+static float					MonitorGain[3];
+
+// Most recent measure of audio in to out delay (in frames)
+static uint32_t				RoundTripFrames;
+
+// For measuring an External Synth's latency. While CalibState is CALIB_ARMED,
+// the audio thread looks in audio in for the onset of the test note, then sets
+// CalibOnset to when it arrived (CLOCK_MONOTONIC), and CalibState to CALIB_FOUND
+static struct timespec		CalibOnset;
+static unsigned char			CalibState;
+#define CALIB_IDLE				0
+#define CALIB_ARMED				1
+#define CALIB_FOUND				2
+// An onset is the first sample louder than -20 dB
+#define CALIB_THRESHOLD			0.1f
+
+// Hardware buffer/period size of audio out. Audio in must match
+static snd_pcm_uframes_t	HwBufferFrames, HwPeriodFrames;
 
 // Allows us to wait for ALSA to signal when it needs audio output,
 // or has audio input
@@ -308,9 +452,36 @@ static struct pollfd *		DescPtrs;
 static uint32_t				NumPlayDesc;
 static uint32_t				NumInDesc;
 
+// Set if the audio thread polls MIDI in, and stamps and queues it for the
+// MIDI in thread to parse (instead of the MIDI in thread polling it)
+static unsigned char			MidiInPoll;
+
+// For placing, and measuring the delay of, MIDI in notes. When the audio
+// thread last mixed a block (in nsecs), and the MixFrames then being heard.
+// MixStampSeq is odd while the audio thread updates them. The min/max delay
+// from MIDI in to audio out, in frames
+static uint64_t				LastMixTime;
+static uint32_t				LastHeardFrame;
+static uint32_t				MixStampSeq;
+static uint32_t				MidiDelayMin, MidiDelayMax;
+
 // ALSA MMAP buffer 'chunk' size
 static snd_pcm_uframes_t	FramesPerPeriod;
 
+// For timer scheduling (APPFLAG4_TSCHED), the size of the card's buffer, how full
+// we keep it, and how far it may empty before we wake to refill. TschedBufferFrames
+// = 0 if we instead poll on the card's period interrupts
+static snd_pcm_uframes_t	TschedBufferFrames;
+static snd_pcm_uframes_t	TschedTarget;
+static snd_pcm_uframes_t	TschedWatermark;
+
+// Set if ALSA timestamps the hardware pointer with CLOCK_MONOTONIC
+static unsigned char			TschedStamp;
+
+// For AUDIODEV_FILE, the name of the WAV file the recorder streams all
+// outs to, in the user's BackupBand dir
+static const char				WaveOutName[] = "BackupBand";
+
 // Whether we must do non-interleaved output
 static unsigned char			NonInterleaveFlag;
 
@@ -329,6 +500,40 @@ static pthread_t			AudioThreadHandle;
 static unsigned char		CurrentXRuns;
 static unsigned char		PreviousXRuns;
 
+// Auto buffer tuning of an audio out card. The buffer size (as per setFrameSize())
+// the tuner has arrived at, the smallest size that xrun'ed (0 if none yet), the peak
+// percent of a block's time spent mixing it, and the minutes played clean at this size.
+// Saved in the Devices file
+typedef struct {
+	uint32_t			DevHash;
+	unsigned char	Dev;
+	unsigned char	FrameSize;
+	unsigned char	Floor;
+	unsigned char	Load;
+	unsigned char	Minutes;
+} LATENCY_TUNE;
+
+#define MAX_TUNINGS			8
+static LATENCY_TUNE		Tunings[MAX_TUNINGS];
+
+// The open card's tuning, or 0 if the tuner is off
+static LATENCY_TUNE *	CurrTune;
+
+// Minutes to play clean at one size before trying a smaller. 0 turns off the tuner
+static unsigned char		TuneSoak;
+
+// For the tuner, the audio thread counts xruns, the peak load, and frames mixed
+// while the accomp plays
+static unsigned char		TuneXRuns;
+static unsigned char		TuneLoad;
+static uint32_t			TuneFrames;
+
+// Size we start a card at. 512 frame blocks
+#define TUNE_START_SIZE		((512 - 12) / 4)
+
+// Must spend less than this percent of a block's time mixing it, before trying a smaller
+#define TUNE_MAX_LOAD		50
+
 #endif	// !defined(NO_ALSA_AUDIO_SUPPORT)
 
 #endif	// !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
@@ -348,15 +553,126 @@ const char					CardSpec[] = "hw:%i,%u,%u";
 // ALSA card name
 const char					CardCtlSpec[] = "hw:%i";
 
-// For loading the drumkits/instruments
-static PLAYZONE_INFO *	LoadedZones;
-static uint32_t			SubKit;
-static unsigned char		ListNum;
-static char					TransposeVal;
+// For loading the drumkits/instruments. The Load thread queues a LOAD_TASK
+// for each instrument txt file found, and a pool of worker threads (one per
+// CPU core) parses the txt files, and loads the waves, simultaneously. Each
+// LOAD_TASK has its own parse buffer and error msg, so the workers don't
+// contend for TempBuffer nor ErrorStr. The Load thread then links the loaded
+// instruments into InstrumentLists[] in the same order they were queued
+#define MAX_LOAD_THREADS	16
+
+typedef struct {
+	uint32_t					SubKit;			// Hash of LAYER name
+	char						TransposeVal;	// OCT
+	unsigned char			Options;			// OPT
+	unsigned char			PgmNum;			// PGM, or 0xFF if not specified
+	unsigned char			BankMsb;			// MSB, or 0x80 if not specified
+	unsigned char			BankLsb;			// LSB, or 0x80 if not specified
+} LOAD_HDR;
+
+typedef struct _LOAD_TASK {
+	struct _LOAD_TASK *	Next;
+	PLAYZONE_INFO *		Zones;			// Loaded zones/waves
+	PLAYZONE_INFO *		ReleaseZones;	// Loaded release map, or 0 if none
+	unsigned char *		Buffer;			// Parsing buffer
+	uint32_t					BufferSize;
+	void *					Bundle;			// Mapped bundle holding the zones/waves, or 0 if malloc'ed
+	unsigned char *		Sources;			// BUNDLE_SRCs of the files loaded, when compiling a bundle
+	uint32_t					SourcesSize;
+	uint32_t					SourcesLen;
+	uint32_t					Offset;			// Byte offset to the end of dir in Path[]
+	LOAD_HDR					Hdr;
+	unsigned char			ListNum;			// PLAYER_xxx
+	unsigned char			Flags;			// LOADTASKFLAG_xxx
+	char						ErrMsg[PATH_MAX + 128];	// Nul-terminated error msg, or empty if no error
+	char						Path[PATH_MAX];
+	char						Name[1];			// Instrument filename minus txt extension
+} LOAD_TASK;
+
+#define LOADTASKFLAG_DONE		0x01	// Worker has finished with this task
+#define LOADTASKFLAG_FAILED	0x02	// Instrument txt or release map had an error. Not linked
+#define LOADTASKFLAG_RELEASE	0x04	// Loading the release map (.rel)
+#define LOADTASKFLAG_WAVES		0x08	// Some waves were loaded
+#define LOADTASKFLAG_BUNDLE	0x10	// Load from the instrument's bundle, if it's up to date
+#define LOADTASKFLAG_COMPILE	0x20	// Bundle is missing/stale. Record sources, and write a new bundle
+#define LOADTASKFLAG_POOL		0x40	// Map waves from the shared sample pool
+#define LOADTASKFLAG_COMPACT	0x80	// Store (unpooled) waves as ADPCM
+
+// An instrument bundle (.bnd file in the instrument's dir) is a prebuilt image
+// of the instrument's PLAYZONE_INFOs and WAVEFORM_INFOs, so we can mmap it,
+// instead of opening/parsing the txt file and every wave file. Ptrs are stored
+// as byte offsets from the start of the file, and relocated when mapped. The
+// layout is:
+//
+// BUNDLE_HDR
+// BUNDLE_SRC[SrcCount]		Files the bundle was built from, to check staleness
+// PLAYZONE_INFOs				Zones, then ReleaseZones, each aligned to 8 bytes
+// WAVEFORM_INFOs				Each starts on a page boundary
+//
+// We map it copy-on-write, so relocating the ptrs (and updating WaveQueue[]
+// while playing) copies only the zones and the first page of each wave. We
+// then fault in the rest by reading it, so the rest of the wave data stays
+// shared with the page cache
+#pragma pack(1)
+typedef struct {
+	uint32_t					Id;				// BUNDLE_ID
+	uint32_t					TotalSize;		// Size of the file
+	uint32_t					Zones;			// Offset to the first zone, or 0 if none
+	uint32_t					ReleaseZones;	// Offset to the first release zone, or 0 if none
+	uint32_t					SrcCount;		// # of BUNDLE_SRCs
+	uint32_t					DirCount;		// # of files in the instrument's dir, not counting bundles
+	uint32_t					DirHash;			// Sum of their names' hashes
+	LOAD_HDR					Hdr;
+	unsigned char			Version;			// BUNDLE_VERSION
+	unsigned char			PtrSize;			// sizeof(void *) of the app that built it
+	unsigned char			RateFactor;		// SampleRateFactor the waves were loaded at
+	unsigned char			Flags;			// LOADTASKFLAG_WAVES/COMPACT
+} BUNDLE_HDR;
+
+typedef struct {
+	uint32_t					MTime;			// st_mtime of the source file
+	uint32_t					MTimeNs;
+	uint32_t					Size;				// st_size
+	unsigned short			NameLen;			// Length of Name[] including nul
+	char						Name[1];			// Filename relative to the instrument's dir
+} BUNDLE_SRC;
+#pragma pack()
+
+#define BUNDLE_ID				0x444E4242	// "BBND"
+#define BUNDLE_VERSION		2
+
+// Size of a PLAYZONE_INFO plus its appended WaveInfoLists[], WaveQueue[], and Ranges[]
+#define BUNDLE_ZONE_SIZE(count)	(sizeof(PLAYZONE_INFO) + (count) + ((count) * 2 * sizeof(void *)))
+
+static LOAD_TASK *		LoadTasks;			// Queued tasks, in order of linking
+static LOAD_TASK **		LoadTaskTail = &LoadTasks;
+static LOAD_TASK *		LoadTaskNext;		// Next task for a worker to grab
+static LOAD_TASK *		LoadTaskLinked;	// Task most recently linked by the Load thread
+static pthread_mutex_t	LoadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	LoadCondition = PTHREAD_COND_INITIALIZER;
+static pthread_t			LoadThreads[MAX_LOAD_THREADS];
+static unsigned char		NumLoadThreads;
+#ifdef JG_LOAD_TIMING
+static uint32_t			NumLoadTasks;
+static struct timespec	LoadStartTime;
+static uint64_t			LoadFileBytes;		// Size of the .cmp files read
+static uint64_t			LoadWaveBytes;		// Size of their (uncompressed) wave data
+#endif
 static const char			TxtExtension[] = ".txt";
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
 static const char 		Extension[] = ".cmp";
 static const char			DidNotOpen[] = " didn't open";
+static const char			BundleExtension[] = ".bnd";
+
+// For the shared sample pool. Each loaded wave is a file in PoolDir, which
+// other BackupBand instances (run by the same user) map instead of loading
+// their own copy. PoolDir is per user, so no other user can plant or alter a
+// wave we'd map
+static const char			PoolDirFmt[] = "/dev/shm/bbpool-%u/";
+static char					PoolDir[32];
+static const char			PoolPrefix[] = "bbpool-";
+static const char			PoolLock[] = "bbpool.lock";
+static int					PoolLockHandle = -1;
 #endif
 
 #define NUM_OF_ZONE_IDS	12
@@ -461,9 +777,13 @@ static void cache_pads(void);
 
 // ============================= JACK support ================================
 #include <jack/jack.h>
+#include <jack/midiport.h>
+#include <sys/eventfd.h>
 
 static void mixPlayingVoices(snd_pcm_uframes_t);
 static void setupReverb(void);
+static void setup_outputs(register uint32_t);
+static const char * startRecorder(register const char *);
 
 typedef jack_client_t * (JACKOPENCLIENT)(const char *, jack_options_t, jack_status_t *);
 typedef void (JACKCLOSECLIENT)(jack_client_t *);
@@ -476,20 +796,514 @@ typedef const char ** (JACKGETPORTS)(jack_client_t *, const char *, const char *
 typedef int (JACKACTIVATE)(jack_client_t *);
 typedef int (JACKCONNECT)(jack_client_t *, const char *, const char *);
 typedef jack_nframes_t (JACKBUFSIZE)(jack_client_t *);
+typedef uint32_t (JACKMIDICOUNT)(void *);
+typedef int (JACKMIDIGET)(jack_midi_event_t *, void *, uint32_t);
+typedef void (JACKMIDICLEAR)(void *);
+typedef int (JACKMIDIWRITE)(void *, jack_nframes_t, const jack_midi_data_t *, size_t);
+typedef jack_nframes_t (JACKFRAMETIME)(const jack_client_t *);
+typedef jack_transport_state_t (JACKQUERY)(const jack_client_t *, jack_position_t *);
+typedef int (JACKTIMEBASE)(jack_client_t *, int, JackTimebaseCallback, void *);
+typedef int (JACKRELEASE)(jack_client_t *);
+typedef void (JACKTRANSPORT)(jack_client_t *);
+typedef int (JACKLOCATE)(jack_client_t *, jack_nframes_t);
+
+// A queue of msgs for one of Jack's midi_out_N ports. sendMidiOut() adds msgs,
+// stamped with the Jack frame time, and jackProcessFunc() writes them to the port
+#define JACKMIDI_QUEUESIZE	256
+
+typedef struct {
+	jack_nframes_t		Time;
+	unsigned char		Len;
+	unsigned char		Msg[3];
+} JACKMIDIEVT;
 
+typedef struct {
+	uint32_t				Head;		// Changed only by jackProcessFunc()
+	uint32_t				Tail;		// Changed only by queueJackMidi()
+	JACKMIDIEVT			Evts[JACKMIDI_QUEUESIZE];
+} JACKMIDIQUEUE;
 
 static jack_client_t *	JackClient;
 //static jack_port_t *		JackInPort;
-static jack_port_t *		JackOut1Port;
-static jack_port_t *		JackOut2Port;
+static jack_port_t *		JackOutPorts[MAX_OUT_PAIRS * 2];
 static JACKGETBUFFER *	JackGetBufPtr;
+static jack_port_t *		JackMidiInPort;
+static jack_port_t *		JackMidiOutPorts[DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1];
+static JACKMIDIQUEUE		JackMidiQueues[DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 + 1];
+static JACKMIDICOUNT *	JackMidiCountPtr;
+static JACKMIDIGET *		JackMidiGetPtr;
+static JACKMIDICLEAR *	JackMidiClearPtr;
+static JACKMIDIWRITE *	JackMidiWritePtr;
+static JACKFRAMETIME *	JackFrameTimePtr;
+static JACKFRAMETIME *	JackLastFrameTimePtr;
+
+// Jack transport sync. JackTicks is the transport position in
+// JACK_TICKS_PER_BEAT, and JackClocks how many PPQN of it the
+// beat play thread has been clocked
+#define JACK_TICKS_PER_BEAT	1920
+static JACKQUERY *		JackQueryPtr;
+static JACKTRANSPORT *	JackStartPtr;
+static JACKTRANSPORT *	JackStopPtr;
+static JACKLOCATE *		JackLocatePtr;
+static uint64_t			JackTicks;
+static uint64_t			JackTickFrac;
+static uint32_t			JackClocks;
+static unsigned char		JackSync;
+static unsigned char		JackRolling;
+static unsigned char		JackBeatsPerBar = 4;
+
+// What jackTransport() wants jackSyncThread() to do. The process
+// callback mustn't take the locks those functions wait on. JackSyncClocks
+// counts the PPQNs it has yet to clock the beat thread
+#ifndef NO_MIDICLOCK_IN
+#define JACKREQ_TEMPO	0x01
+#define JACKREQ_START	0x02
+#define JACKREQ_STOP		0x04
+#define JACKREQ_CLOCK	0x08
+#define JACKREQ_QUIT		0x80
+static pthread_t			JackSyncThread;
+static int					JackSyncFd = -1;
+static uint32_t			JackSyncReq;
+static uint32_t			JackSyncTempo;
+static uint32_t			JackSyncClocks;
+#endif
+
+/****************** queueJackMidi() *******************
+ * Queues MIDI msgs for Jack's midi_out_N port. Called by
+ * sendMidiOut() for a MIDI Out bus that has no ALSA device
+ * open, while it holds that bus' lock.
+ *
+ * bus =		0 to 3 for DEVNUM_MIDIOUT1 to DEVNUM_MIDIOUT4.
+ * msg =		MIDI bytes. Each msg must have its status.
+ * count =	How many bytes.
+ *
+ * RETURN: 0 if Jack isn't in use.
+ */
+
+unsigned char queueJackMidi(register uint32_t bus, register const unsigned char * msg, register uint32_t count)
+{
+	register JACKMIDIQUEUE *	queue;
+	register uint32_t				tail, next;
+	register jack_nframes_t		time;
+	register unsigned char		len;
+
+	if (bus > DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1 || !JackMidiOutPorts[bus]) return 0;
+
+	queue = &JackMidiQueues[bus];
+	time = JackFrameTimePtr(JackClient);
+	tail = queue->Tail;
+	while (count && (*msg & 0x80))
+	{
+		len = (*msg >= 0xF8 ? 1 : (*msg >= 0xC0 && *msg <= 0xDF ? 2 : 3));
+		if (len > count) break;
+
+		// If the queue is full, the msg is lost
+		next = (tail + 1) % JACKMIDI_QUEUESIZE;
+		if (next == __atomic_load_n(&queue->Head, __ATOMIC_ACQUIRE)) break;
+
+		queue->Evts[tail].Time = time;
+		queue->Evts[tail].Len = len;
+		memcpy(queue->Evts[tail].Msg, msg, len);
+		msg += len;
+		count -= len;
+		tail = next;
+	}
+	__atomic_store_n(&queue->Tail, tail, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/****************** jackMidiOut() *******************
+ * Writes the msgs queued by queueJackMidi() to the
+ * midi_out_N ports. Called by jackProcessFunc().
+ *
+ * The msgs were queued during the previous period, so
+ * each is written one period after its time stamp. That
+ * way they have exactly the same spacing as when sent.
+ */
+
+static void jackMidiOut(register jack_nframes_t nframes)
+{
+	register jack_nframes_t		start;
+	register unsigned char		bus;
+
+	start = JackLastFrameTimePtr(JackClient) - nframes;
+	for (bus = 0; bus <= DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1; bus++)
+	{
+		if (JackMidiOutPorts[bus])
+		{
+			register JACKMIDIQUEUE *	queue;
+			register void *				buffer;
+			register uint32_t				head, tail;
+			register int32_t				offset, prev;
+
+			queue = &JackMidiQueues[bus];
+			buffer = JackGetBufPtr(JackMidiOutPorts[bus], nframes);
+			JackMidiClearPtr(buffer);
+			head = queue->Head;
+			tail = __atomic_load_n(&queue->Tail, __ATOMIC_ACQUIRE);
+			prev = 0;
+			while (head != tail)
+			{
+				// Jack requires ascending times, within this period
+				offset = (int32_t)(queue->Evts[head].Time - start);
+				if (offset < prev) offset = prev;
+				if (offset >= (int32_t)nframes) offset = nframes - 1;
+				JackMidiWritePtr(buffer, offset, queue->Evts[head].Msg, queue->Evts[head].Len);
+				prev = offset;
+				head = (head + 1) % JACKMIDI_QUEUESIZE;
+			}
+			__atomic_store_n(&queue->Head, head, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+#ifndef NO_MIDICLOCK_IN
+/****************** jackSyncRequest() *******************
+ * Asks jackSyncThread() to do the specified JACKREQ_.
+ * Doesn't wait, so it's safe in the process callback.
+ */
+
+static void jackSyncRequest(register uint32_t req)
+{
+	uint64_t		val;
+
+	// A start cancels a pending stop, and vice versa
+	if (req & (JACKREQ_START|JACKREQ_STOP)) __atomic_and_fetch(&JackSyncReq, ~(JACKREQ_START|JACKREQ_STOP), __ATOMIC_RELAXED);
+	__atomic_or_fetch(&JackSyncReq, req, __ATOMIC_RELEASE);
+	val = 1;
+	write(JackSyncFd, &val, sizeof(val));
+}
+
+/****************** jackSyncThread() *******************
+ * Does what jackTransport() requests of the beat play
+ * thread and GUI.
+ */
+
+static void * jackSyncThread(void * arg)
+{
+	uint64_t				val;
+	register uint32_t	req;
+
+	while (read(JackSyncFd, &val, sizeof(val)) > 0 || errno == EINTR)
+	{
+		req = __atomic_exchange_n(&JackSyncReq, 0, __ATOMIC_ACQUIRE);
+		if (req & JACKREQ_QUIT) break;
+		if (req & JACKREQ_TEMPO)
+		{
+			set_tempo(__atomic_load_n(&JackSyncTempo, __ATOMIC_RELAXED));
+			drawGuiCtl((void *)1, CTLMASK_TEMPO, CLOCKTHREADID);
+		}
+		if (req & JACKREQ_STOP) stop_play(0, CLOCKTHREADID);
+		if ((req & JACKREQ_START) && !BeatInPlay) start_play(1, CLOCKTHREADID);
+
+		// advance_midiclock() signals the beat thread under PlayMutex
+		if (req & JACKREQ_CLOCK)
+		{
+			req = __atomic_exchange_n(&JackSyncClocks, 0, __ATOMIC_ACQUIRE);
+			while (req--) advance_midiclock();
+		}
+	}
+
+	return 0;
+}
+
+/****************** startJackSync() *******************
+ * Starts jackSyncThread().
+ *
+ * RETURN: 0 if success.
+ */
+
+static int startJackSync(void)
+{
+	JackSyncReq = JackSyncTempo = JackSyncClocks = 0;
+	if ((JackSyncFd = eventfd(0, 0)) >= 0)
+	{
+		if (!create_rt_thread(&JackSyncThread, jackSyncThread, 0)) return 0;
+		close(JackSyncFd);
+		JackSyncFd = -1;
+	}
+	return -1;
+}
+
+/******************* endJackSync() *******************
+ * Ends jackSyncThread(). Called after the process
+ * callback no longer runs.
+ */
+
+static void endJackSync(void)
+{
+	if (JackSyncFd >= 0)
+	{
+		jackSyncRequest(JACKREQ_QUIT);
+		pthread_join(JackSyncThread, 0);
+		close(JackSyncFd);
+		JackSyncFd = -1;
+	}
+}
+
+/****************** jackTransport() *******************
+ * Syncs the beat play thread to Jack's transport. Called
+ * by jackProcessFunc() each period.
+ *
+ * The beat thread is clocked just as it is by MIDI clock
+ * (via advance_midiclock(), which jackSyncThread() calls
+ * for us), but we do it once per PPQN of the transport
+ * position, so it stays within one period of the
+ * transport.
+ *
+ * JACKSYNC_FOLLOW takes the position and tempo from the
+ * transport, and starts play on the first downbeat after
+ * the transport rolls. JACKSYNC_MASTER counts the position
+ * at our own tempo, and starts/stops the transport along
+ * with play.
+ *
+ * Anything that may wait (tempo change, start/stop play,
+ * clocking) is handed to jackSyncThread().
+ */
+
+static void jackTransport(register jack_nframes_t nframes)
+{
+	register uint32_t		clocks;
+
+	if (JackSync == JACKSYNC_FOLLOW)
+	{
+		jack_position_t		pos;
+
+		if (JackQueryPtr(JackClient, &pos) == JackTransportRolling)
+		{
+			register uint32_t		barClocks;
+
+			// Is there a timebase master? Then take its bar/beat/tick, and tempo
+			if ((pos.valid & JackPositionBBT) && pos.beats_per_bar >= 1.0f && pos.ticks_per_beat > 0.0)
+			{
+				register uint32_t		tempo;
+
+				JackBeatsPerBar = (unsigned char)pos.beats_per_bar;
+				JackTicks = ((((uint64_t)(pos.bar - 1) * JackBeatsPerBar) + pos.beat - 1) * JACK_TICKS_PER_BEAT) + (uint64_t)((pos.tick * JACK_TICKS_PER_BEAT) / pos.ticks_per_beat);
+
+				tempo = (pos.beats_per_minute < 11.0 ? 1100 : (pos.beats_per_minute > 255.0 ? 25500 : (uint32_t)((pos.beats_per_minute * 100.0) + 0.5)));
+				if (tempo != JackSyncTempo)
+				{
+					__atomic_store_n(&JackSyncTempo, tempo, __ATOMIC_RELAXED);
+					jackSyncRequest(JACKREQ_TEMPO);
+				}
+			}
+
+			// Otherwise count beats from the frame position, at our tempo
+			else
+			{
+				JackBeatsPerBar = getMeasureBeats();
+				JackTicks = ((uint64_t)pos.frame * set_tempo(0) * JACK_TICKS_PER_BEAT) / (60 * 100 * (uint64_t)pos.frame_rate);
+			}
+			JackTickFrac = 0;
+
+			clocks = (uint32_t)(JackTicks / (JACK_TICKS_PER_BEAT / PPQN_VALUE));
+			barClocks = JackBeatsPerBar * PPQN_VALUE;
+
+			// Just started rolling, or relocated? Resync to the new position. If
+			// playing, the beat thread jumps to the same place in its measure
+			if (!JackRolling || clocks < JackClocks || clocks > JackClocks + barClocks)
+			{
+				if (JackRolling && BeatInPlay) resync_measure(clocks % barClocks);
+				JackRolling = 1;
+				JackClocks = clocks;
+			}
+
+			if (!BeatInPlay)
+			{
+				// Start play (without countoff) on a downbeat
+				if (!(clocks % barClocks) || clocks / barClocks != JackClocks / barClocks)
+					jackSyncRequest(JACKREQ_START);
+				JackClocks = clocks;
+				return;
+			}
+
+			goto clock;
+		}
+
+		// Transport stopped. Stop play too. Any ending ptn is then
+		// clocked at our tempo below
+		if (JackRolling)
+		{
+			JackRolling = 0;
+			JackSyncTempo = 0;
+			jackSyncRequest(JACKREQ_STOP);
+		}
+	}
+
+	// JACKSYNC_MASTER. Start/stop the transport with play
+	else if (BeatInPlay)
+	{
+		if (!JackRolling)
+		{
+			JackRolling = 1;
+			JackTicks = JackTickFrac = 0;
+			JackClocks = 0;
+			JackBeatsPerBar = getMeasureBeats();
+			JackLocatePtr(JackClient, 0);
+			JackStartPtr(JackClient);
+		}
+	}
+	else if (JackRolling)
+	{
+		JackRolling = 0;
+		JackStopPtr(JackClient);
+	}
+
+	if (!BeatInPlay) return;
+
+	// Advance the position by this period, at our tempo
+	JackTickFrac += (uint64_t)nframes * set_tempo(0) * JACK_TICKS_PER_BEAT;
+	JackTicks += JackTickFrac / (60 * 100 * (uint64_t)Rates[SampleRateFactor]);
+	JackTickFrac %= (60 * 100 * (uint64_t)Rates[SampleRateFactor]);
+	clocks = (uint32_t)(JackTicks / (JACK_TICKS_PER_BEAT / PPQN_VALUE));
+
+	// Clock the beat thread up to the position
+clock:
+	if (JackClocks < clocks)
+	{
+		__atomic_add_fetch(&JackSyncClocks, clocks - JackClocks, __ATOMIC_RELEASE);
+		JackClocks = clocks;
+		jackSyncRequest(JACKREQ_CLOCK);
+	}
+}
+#endif
+
+/****************** jackTimebase() *******************
+ * Jack timebase callback, when we're the master. Gives
+ * the other clients our bar/beat/tick, and tempo.
+ */
+
+static void jackTimebase(jack_transport_state_t state, jack_nframes_t nframes, jack_position_t * pos, int newPos, void * arg)
+{
+	register uint64_t		ticks;
+	register uint32_t		barTicks;
+
+	barTicks = JackBeatsPerBar * JACK_TICKS_PER_BEAT;
+	ticks = JackTicks;
+	pos->valid = JackPositionBBT;
+	pos->beats_per_bar = JackBeatsPerBar;
+	pos->beat_type = 4.0f;
+	pos->ticks_per_beat = JACK_TICKS_PER_BEAT;
+	pos->beats_per_minute = (double)set_tempo(0) / 100.0;
+	pos->bar = (int32_t)(ticks / barTicks) + 1;
+	pos->bar_start_tick = (double)(pos->bar - 1) * barTicks;
+	ticks %= barTicks;
+	pos->beat = (int32_t)(ticks / JACK_TICKS_PER_BEAT) + 1;
+	pos->tick = (int32_t)(ticks % JACK_TICKS_PER_BEAT);
+}
+
+/****************** jack_timebase() *******************
+ * Becomes, or stops being, Jack's timebase master, per
+ * JackSync.
+ */
+
+static void jack_timebase(void)
+{
+	if (JackQueryPtr)
+	{
+		if (JackSync == JACKSYNC_MASTER)
+		{
+			register JACKTIMEBASE *	ptr;
+
+			ptr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_set_timebase_callback");
+			ptr(JackClient, 1, jackTimebase, 0);
+		}
+		else
+		{
+			register JACKRELEASE *	ptr;
+
+			ptr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_release_timebase");
+			ptr(JackClient);
+		}
+	}
+}
+
+/******************** setJackSync() *********************
+ * Sets/queries how the beat play thread syncs to Jack's
+ * transport.
+ *
+ * mode =	JACKSYNC_OFF, JACKSYNC_FOLLOW, JACKSYNC_MASTER,
+ *			or 0xFF to query.
+ *
+ * Called by main thread only.
+ */
+
+unsigned char setJackSync(register unsigned char mode)
+{
+	if (mode <= JACKSYNC_MASTER && mode != JackSync)
+	{
+		if (JackSync == JACKSYNC_MASTER && JackRolling && JackClient) JackStopPtr(JackClient);
+		JackRolling = 0;
+		JackSync = mode;
+		if (JackClient) jack_timebase();
+		set_clock_type();
+	}
+
+	return JackSync;
+}
+
+/********************* isJackSync() *********************
+ * Returns the JACKSYNC_ mode, if Jack is running and has
+ * transport support. Otherwise JACKSYNC_OFF.
+ */
+
+unsigned char isJackSync(void)
+{
+	return (JackClient && JackQueryPtr) ? JackSync : JACKSYNC_OFF;
+}
+
+/****************** mixJackFrames() *******************
+ * Mixes the next block of a Jack period, and advances
+ * the port buffer ptrs past it.
+ */
+
+static void mixJackFrames(register jack_nframes_t frames)
+{
+	register unsigned char	chan;
+
+	clear_mix_buf(frames);
+	/* if (AudioThreadFlags & 0x01) */ mixPlayingVoices(frames);
+	for (chan = 0; chan < MixChans; chan++)
+		MixBufferPtr[chan] = (int32_t *)((float *)MixBufferPtr[chan] + frames);
+}
 
 static int jackProcessFunc(jack_nframes_t nframes, void * arg)
 {
-	MixBufferPtr[0] = (int32_t *)JackGetBufPtr(JackOut1Port, nframes);
-	MixBufferPtr[1] = (int32_t *)JackGetBufPtr(JackOut2Port, nframes);
-	clear_mix_buf(nframes);
-	/* if (AudioThreadFlags & 0x01) */ mixPlayingVoices(nframes);
+	register unsigned char	chan;
+
+	for (chan = 0; chan < MixChans; chan++)
+		MixBufferPtr[chan] = (int32_t *)JackGetBufPtr(JackOutPorts[chan], nframes);
+
+	jackMidiOut(nframes);
+#ifndef NO_MIDICLOCK_IN
+	if (JackSync && JackQueryPtr) jackTransport(nframes);
+#endif
+
+	// If there's no ALSA MIDI In, then midi_in is the controller. We can't act upon
+	// it here (that may wait), so queue each msg for jackMidiInThread(). Any note it
+	// starts begins one period later, at the same frame offset, so notes keep
+	// their spacing to the exact sample
+	if (JackMidiInPort && !SoundDev[DEVNUM_MIDIIN].Handle)
+	{
+		register void *		buffer;
+		register uint32_t		count, i, frame;
+		jack_midi_event_t		evt;
+
+		buffer = JackGetBufPtr(JackMidiInPort, nframes);
+		count = JackMidiCountPtr(buffer);
+		for (i = 0; i < count; i++)
+		{
+			if (!JackMidiGetPtr(&evt, buffer, i))
+			{
+				if (!(frame = MixFrames + nframes + (evt.time < nframes ? evt.time : 0))) frame = 1;
+				jackMidiIn(evt.buffer, evt.size, frame);
+			}
+		}
+	}
+
+	mixJackFrames(nframes);
 	return 0;
 }
 
@@ -500,15 +1314,27 @@ static void shutdown_jack(void)
 
 static void unload_libjack(void)
 {
-	if (SoundDev[DEVNUM_AUDIOOUT].Handle && !SoundDev[DEVNUM_AUDIOOUT].DevHash)
+	if (SoundDev[DEVNUM_AUDIOOUT].Handle && IS_JACK_OUT())
 	{
 		if (JackClient)
 		{
 			register JACKCLOSECLIENT *		ptr;
 
+			// Stop sendMidiOut() queuing for Jack, and the transport sync
+			JackMidiInPort = 0;
+			memset(JackMidiOutPorts, 0, sizeof(JackMidiOutPorts));
+			JackQueryPtr = 0;
+
 			ptr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_client_close");
 			ptr(JackClient);
 			JackClient = 0;
+			endJackMidiIn();
+#ifndef NO_MIDICLOCK_IN
+			endJackSync();
+#endif
+
+			// Beat play thread back to its own clock
+			set_clock_type();
 		}
 		dlclose(SoundDev[DEVNUM_AUDIOOUT].Handle);
 		SoundDev[DEVNUM_AUDIOOUT].Handle = 0;
@@ -605,11 +1431,59 @@ static const char * load_libjack(void)
 	ptr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_port_register");
 	JackGetBufPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_port_get_buffer");
 //		JackInPort = ptr(JackClient, "input", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-	JackOut1Port = ptr(JackClient, "out_1", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput|JackPortIsTerminal, 0);
-	JackOut2Port = ptr(JackClient, "out_2", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput|JackPortIsTerminal, 0);
-	if (!JackOut1Port || !JackOut2Port)
-out:	return msg;
+
+	// A pair of ports for each pair of chans the musicians are routed to
+	setup_outputs(MAX_OUT_PAIRS * 2);
+	{
+	register unsigned char	chan;
+	char							name[12];
+
+	for (chan = 0; chan < MixChans; chan++)
+	{
+		sprintf(name, "out_%u", chan + 1);
+		if (!(JackOutPorts[chan] = ptr(JackClient, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput|JackPortIsTerminal, 0)))
+out:		return msg;
+	}
+
+	// MIDI ports. midi_in is the controller when no ALSA MIDI In is open, and
+	// midi_out_N plays any robot set to MIDI Out bus N, if that has no ALSA
+	// device. Not having them isn't an error
+	JackMidiCountPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_midi_get_event_count");
+	JackMidiGetPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_midi_event_get");
+	JackMidiClearPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_midi_clear_buffer");
+	JackMidiWritePtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_midi_event_write");
+	JackFrameTimePtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_frame_time");
+	JackLastFrameTimePtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_last_frame_time");
+	if (JackMidiCountPtr && JackMidiGetPtr && JackMidiClearPtr && JackMidiWritePtr && JackFrameTimePtr && JackLastFrameTimePtr)
+	{
+		// midi_in's msgs are parsed by a thread of their own
+		if ((JackMidiInPort = ptr(JackClient, "midi_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0)) && startJackMidiIn())
+			JackMidiInPort = 0;
+		memset(JackMidiQueues, 0, sizeof(JackMidiQueues));
+		for (chan = 0; chan <= DEVNUM_MIDIOUT4 - DEVNUM_MIDIOUT1; chan++)
+		{
+			sprintf(name, "midi_out_%u", chan + 1);
+			JackMidiOutPorts[chan] = ptr(JackClient, name, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+		}
+	}
 	}
+	}
+
+	// Transport sync. Not having it isn't an error
+	JackStartPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_transport_start");
+	JackStopPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_transport_stop");
+	JackLocatePtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_transport_locate");
+	JackRolling = 0;
+	if ((JackQueryPtr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_transport_query")) &&
+		(!JackStartPtr || !JackStopPtr || !JackLocatePtr ||
+		!dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_set_timebase_callback") || !dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_release_timebase")))
+	{
+		JackQueryPtr = 0;
+	}
+#ifndef NO_MIDICLOCK_IN
+	// Follow mode's tempo/start/stop are done by a thread of their own
+	if (JackQueryPtr && startJackSync()) JackQueryPtr = 0;
+#endif
 
 #ifndef NO_REVERB_SUPPORT
 	// We need a stereo float mixing buffer for the reverb and intermediate mix
@@ -619,14 +1493,17 @@ out:	return msg;
 
 	ptr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_get_buffer_size");
 	size = ptr(JackClient);
-	if (!(MixBuffPtr = (char *)malloc(size * 2 * sizeof(float) * 2)))
+	if (!(MixBuffPtr = (char *)malloc(size * sizeof(float) * (MixChans + 2 + 2))))
 	{
 		msg = &NoMemStr[0];
 		goto out;
 	}
-	ReverbBuffPtr = MixBuffPtr + (size * 2 * sizeof(float));
+	ReverbBuffPtr = MixBuffPtr + (size * MixChans * sizeof(float));
+	RevOutBuffPtr = ReverbBuffPtr + (size * 2 * sizeof(float));
 	}
 #endif
+	if ((msg = startRecorder(0))) goto out;
+
 	{
 	register JACKACTIVATE *		ptr;
 
@@ -646,6 +1523,10 @@ out:	return msg;
 	}
 	}
 
+	// Sync the beat play thread to the transport, if enabled
+	jack_timebase();
+	set_clock_type();
+
 	// Connect to stereo audio out hardware
 	{
 	register const char **	ports;
@@ -661,10 +1542,14 @@ out:	return msg;
 		register JACKCONNECT *		ptr;
 		register JACKPORTNAME *		ptr2;
 
+		register unsigned char		chan;
+
 		ptr = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_connect");
 		ptr2 = dlsym(SoundDev[DEVNUM_AUDIOOUT].Handle, "jack_port_name");
-		ptr(JackClient, ptr2(JackOut1Port), ports[0]);
-		ptr(JackClient, ptr2(JackOut2Port), ports[1]);
+
+		// Each port to the same # hardware out, as far as there are any
+		for (chan = 0; chan < MixChans && ports[chan]; chan++)
+			ptr(JackClient, ptr2(JackOutPorts[chan]), ports[chan]);
 		free(ports);
 	}
 	}
@@ -687,6 +1572,8 @@ out:	return msg;
 
 
 static void unloadZones(register PLAYZONE_INFO *);
+static void unmapBundle(register void *);
+static void unpoolWave(register WAVEFORM_INFO *);
 
 void clear_banksel(void)
 {
@@ -715,9 +1602,15 @@ static void unloadMusician(register unsigned char roboNum, register unsigned cha
 			do
 			{
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-				unloadZones(temp->Zones);
-				unloadZones(temp->ReleaseZones);
+				if (temp->Bundle)
+					unmapBundle(temp->Bundle);
+				else
+				{
+					unloadZones(temp->Zones);
+					unloadZones(temp->ReleaseZones);
+				}
 				temp->Zones = temp->ReleaseZones = 0;
+				temp->Bundle = 0;
 #endif
 				next = temp->Next;
 				if (fullFlag) free(temp);
@@ -879,6 +1772,49 @@ void loadDataSets(register unsigned char loadFlags)
 
 // ========================= Instrument Loading ========================
 
+/******************** format_load_err() *******************
+ * Formats an error msg (that occurred in a user-edited text
+ * file) in the LOAD_TASK's ErrMsg[]. Called by a Load
+ * worker thread, so it doesn't touch TempBuffer nor
+ * ErrorStr.
+ */
+
+static void format_load_err(register LOAD_TASK * task, register const char * errmsg, register uint32_t lineNum, register unsigned char * field)
+{
+	register uint32_t		len;
+
+	len = snprintf(task->ErrMsg, sizeof(task->ErrMsg), "%s Line %u: ", task->Name, lineNum);
+	if (len < sizeof(task->ErrMsg)) snprintf(&task->ErrMsg[len], sizeof(task->ErrMsg) - len, errmsg, field);
+}
+
+/****************** format_load_fileerr() *****************
+ * Formats an error msg (about the file currently named in
+ * the LOAD_TASK's Path[]) in the LOAD_TASK's ErrMsg[]. The
+ * filename is prefaced with a few of its parent dir names.
+ */
+
+static void format_load_fileerr(register LOAD_TASK * task, register const char * sep, register const char * message, register unsigned char numFileLevels)
+{
+	register const char *	temp;
+
+	temp = task->Path + strlen(task->Path);
+	while (temp > task->Path)
+	{
+		if (*(--temp) == '/')
+		{
+			if (!(--numFileLevels))
+			{
+				++temp;
+				break;
+			}
+		}
+	}
+
+	snprintf(task->ErrMsg, sizeof(task->ErrMsg), "%s%s%s", temp, sep, message);
+}
+
+
+
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
 
 unsigned char setSampleRateFactor(register unsigned char rate)
@@ -917,7 +1853,10 @@ static void unloadZones(register PLAYZONE_INFO * zones)
 				while ((waveInfo = *waveInfoTable))
 				{
 					*waveInfoTable = waveInfo->Next;
-					free(waveInfo);
+					if (waveInfo->MemFlags & WAVEMEM_POOLED)
+						unpoolWave(waveInfo);
+					else
+						free(waveInfo);
 				}
 
 				waveInfoTable += 2;
@@ -932,12 +1871,403 @@ static void unloadZones(register PLAYZONE_INFO * zones)
 	}
 }
 
+/********************* add_bundle_src() ********************
+ * Records the file currently named in the LOAD_TASK's
+ * Path[] as a source of the bundle being compiled. Called
+ * by a Load worker thread after it opens the file.
+ */
 
-
-static void initVoices(void)
+static void add_bundle_src(register LOAD_TASK * task, register struct stat * buf)
 {
-	register uint32_t			total;
-	register VOICE_INFO *	mem;
+	register BUNDLE_SRC *	src;
+	register uint32_t			len;
+
+	len = strlen(&task->Path[task->Offset]) + 1;
+	if (task->SourcesLen + sizeof(BUNDLE_SRC) + len > task->SourcesSize)
+	{
+		register unsigned char *	mem;
+
+		// If we can't record it, don't compile the bundle. It would never be up to date
+		if (!(mem = (unsigned char *)realloc(task->Sources, task->SourcesSize + 4096 + len)))
+		{
+			task->Flags &= ~LOADTASKFLAG_COMPILE;
+			return;
+		}
+		task->Sources = mem;
+		task->SourcesSize += 4096 + len;
+	}
+
+	src = (BUNDLE_SRC *)&task->Sources[task->SourcesLen];
+	src->MTime = (uint32_t)buf->st_mtim.tv_sec;
+	src->MTimeNs = (uint32_t)buf->st_mtim.tv_nsec;
+	src->Size = (uint32_t)buf->st_size;
+	src->NameLen = (unsigned short)len;
+	memcpy(src->Name, &task->Path[task->Offset], len);
+	task->SourcesLen += (sizeof(BUNDLE_SRC) - 1) + len;
+}
+
+/******************** hashBundleDir() *********************
+ * Counts the files in the instrument's dir (the first
+ * task->Offset chars of Path[]), and sums their names'
+ * hashes, so a bundle can tell when a file (such as a new
+ * release map) was added or removed. Skips any bundles,
+ * since writing one mustn't make another stale. The sum
+ * doesn't depend on the order readdir returns them.
+ *
+ * RETURN: The hash sum, or 0 if the dir can't be read.
+ */
+
+static uint32_t hashBundleDir(register LOAD_TASK * task, register uint32_t * count)
+{
+	register DIR *					dirp;
+	register struct dirent *	dirEntryPtr;
+	register uint32_t				sum;
+
+	sum = *count = 0;
+	task->Path[task->Offset] = 0;
+	if ((dirp = opendir(task->Offset ? task->Path : ".")))
+	{
+		while ((dirEntryPtr = readdir(dirp)))
+		{
+			register const char *	name;
+			register char *			ext;
+
+			name = dirEntryPtr->d_name;
+			if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+			if ((ext = strrchr(name, '.')) && !strncmp(ext, &BundleExtension[0], sizeof(BundleExtension) - 1) &&
+				(!ext[sizeof(BundleExtension) - 1] || (ext[sizeof(BundleExtension) - 1] == '~' && !ext[sizeof(BundleExtension)]))) continue;
+
+			sum += hash_string((const unsigned char *)name);
+			++*count;
+		}
+		closedir(dirp);
+	}
+
+	return sum;
+}
+
+static void unmapBundle(register void * bundle)
+{
+	munmap(bundle, ((BUNDLE_HDR *)bundle)->TotalSize);
+}
+
+/********************** waveDataSize() *******************
+ * Returns the size (in bytes) of a loaded wave's WaveForm[].
+ */
+
+static uint32_t waveDataSize(register WAVEFORM_INFO * waveInfo)
+{
+	register uint32_t	chans;
+
+	// ADPCM blocks
+	if (waveInfo->MemFlags & WAVEMEM_ADPCM)
+	{
+		chans = (waveInfo->WaveFlags & WAVEFLAG_STEREO) ? 2 : 1;
+		return (((waveInfo->WaveformLen / chans) + ADPCM_BLOCK_FRAMES - 1) >> ADPCM_BLOCK_SHIFT) * ADPCM_BLOCK_SIZE * chans;
+	}
+
+	// 16-bit samples upto CompressPoint, then 8-bit
+	return (waveInfo->CompressPoint << 1) + (waveInfo->WaveformLen - waveInfo->CompressPoint);
+}
+
+/********************** relocZones() *********************
+ * Converts the file offsets in a mapped bundle's zone list
+ * (and their wave lists) to ptrs.
+ *
+ * base =	Start of the mapped bundle.
+ * size =	Size of the bundle.
+ * zones =	Where the offset to the first zone is stored.
+ *
+ * RETURN: 0 if success, or non-zero if a bad offset.
+ */
+
+static int relocZones(register char * base, register uintptr_t size, PLAYZONE_INFO ** zones)
+{
+	register PLAYZONE_INFO **	next;
+
+	next = zones;
+	while (*next)
+	{
+		register PLAYZONE_INFO *	zone;
+		register WAVEFORM_INFO **	waveInfoTable;
+		register unsigned char		rangeCount;
+
+		if ((uintptr_t)*next > size - sizeof(PLAYZONE_INFO)) return -1;
+		zone = *next = (PLAYZONE_INFO *)(base + (uintptr_t)*next);
+		if ((char *)zone + BUNDLE_ZONE_SIZE(zone->RangeCount) > base + size) return -1;
+
+		rangeCount = zone->RangeCount;
+		waveInfoTable = (WAVEFORM_INFO **)((char *)zone + sizeof(PLAYZONE_INFO));
+		while (rangeCount--)
+		{
+			register WAVEFORM_INFO **	nextWave;
+
+			nextWave = waveInfoTable;
+			while (*nextWave)
+			{
+				register WAVEFORM_INFO *	waveInfo;
+
+				if ((uintptr_t)*nextWave > size - sizeof(WAVEFORM_INFO)) return -1;
+				waveInfo = *nextWave = (WAVEFORM_INFO *)(base + (uintptr_t)*nextWave);
+				if (waveInfo->WaveformLen < waveInfo->CompressPoint || (waveInfo->MemFlags & WAVEMEM_POOLED) ||
+					&waveInfo->WaveForm[waveDataSize(waveInfo)] > base + size) return -1;
+				nextWave = &(*nextWave)->Next;
+			}
+
+			// WaveQueue[]
+			waveInfoTable[1] = 0;
+			waveInfoTable += 2;
+		}
+
+		next = &zone->Next;
+	}
+
+	return 0;
+}
+
+/*********************** mapBundle() **********************
+ * Maps the instrument's bundle, if it exists, and is up to
+ * date with the files it was built from. Called by a Load
+ * worker thread.
+ *
+ * task =		LOAD_TASK queued by queueInstrument().
+ * len =		Length of the task's Name[].
+ *
+ * RETURN: 0 if the zones/waves were loaded from the bundle,
+ * or non-zero if they must be loaded from the txt/wave
+ * files.
+ */
+
+static int mapBundle(register LOAD_TASK * task, register uint32_t len)
+{
+	register BUNDLE_HDR *	hdr;
+	register unsigned char *	ptr;
+	register uint32_t			count;
+	register int				hFile;
+	uint32_t						size, dirCount;
+	struct stat					buf;
+
+	memcpy(&task->Path[task->Offset], task->Name, len);
+	strcpy(&task->Path[task->Offset+len], &BundleExtension[0]);
+	if ((hFile = open(task->Path, O_RDONLY|O_NOATIME)) == -1) goto out;
+	if (fstat(hFile, &buf) || buf.st_size < sizeof(BUNDLE_HDR) + sizeof(PLAYZONE_INFO) + sizeof(WAVEFORM_INFO) || buf.st_size > 0xFFFFFFFF) goto close;
+	size = (uint32_t)buf.st_size;
+
+	// Map it read-only first, to check the header and sources without
+	// reading in all the waves
+	if ((hdr = (BUNDLE_HDR *)mmap(0, size, PROT_READ, MAP_SHARED, hFile, 0)) == MAP_FAILED) goto close;
+
+	// Built by this version, for the current sample rate?
+	if (hdr->Id != BUNDLE_ID || hdr->Version != BUNDLE_VERSION || hdr->PtrSize != sizeof(void *) ||
+		hdr->RateFactor != SampleRateFactor || hdr->TotalSize != size || ((hdr->Flags ^ task->Flags) & LOADTASKFLAG_COMPACT)) goto stale;
+
+	// Has a file been added to, or removed from, the instrument's dir? A new
+	// release map, for example, isn't among the sources
+	if (hashBundleDir(task, &dirCount) != hdr->DirHash || dirCount != hdr->DirCount) goto stale;
+
+	// Has any source file been changed since the bundle was built?
+	ptr = (unsigned char *)hdr + sizeof(BUNDLE_HDR);
+	count = hdr->SrcCount;
+	while (count--)
+	{
+		register BUNDLE_SRC *	src;
+
+		src = (BUNDLE_SRC *)ptr;
+		ptr += sizeof(BUNDLE_SRC) - 1;
+		if (ptr > (unsigned char *)hdr + size || (ptr += src->NameLen) > (unsigned char *)hdr + size ||
+			task->Offset + src->NameLen > PATH_MAX || !src->NameLen) goto stale;
+		memcpy(&task->Path[task->Offset], src->Name, src->NameLen);
+		task->Path[task->Offset + src->NameLen - 1] = 0;
+		if (stat(task->Path, &buf) || src->MTime != (uint32_t)buf.st_mtim.tv_sec ||
+			src->MTimeNs != (uint32_t)buf.st_mtim.tv_nsec || src->Size != (uint32_t)buf.st_size) goto stale;
+	}
+
+	// It's good. Map it again copy-on-write. Not MAP_POPULATE, which would
+	// fault every page in for writing, and so copy them all
+	munmap(hdr, size);
+	if ((hdr = (BUNDLE_HDR *)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, hFile, 0)) == MAP_FAILED) goto close;
+
+	task->Zones = (PLAYZONE_INFO *)(uintptr_t)hdr->Zones;
+	task->ReleaseZones = (PLAYZONE_INFO *)(uintptr_t)hdr->ReleaseZones;
+	if (relocZones((char *)hdr, size, &task->Zones) || relocZones((char *)hdr, size, &task->ReleaseZones))
+	{
+		task->Zones = task->ReleaseZones = 0;
+		goto stale;
+	}
+
+	// Read it all in now (so the Audio thread doesn't page fault when it plays
+	// a wave). Reading, not writing, maps the page cache's own pages
+	madvise(hdr, size, MADV_WILLNEED);
+	{
+	register const volatile char *	page;
+	register long						pageSize;
+
+	pageSize = sysconf(_SC_PAGESIZE);
+	for (page = (const volatile char *)hdr; page < (const volatile char *)hdr + size; page += pageSize) (void)*page;
+	}
+
+	close(hFile);
+	memcpy(&task->Hdr, &hdr->Hdr, sizeof(LOAD_HDR));
+	task->Flags |= (hdr->Flags & LOADTASKFLAG_WAVES);
+	task->Bundle = hdr;
+	return 0;
+
+stale:
+	munmap(hdr, size);
+close:
+	close(hFile);
+out:
+	return -1;
+}
+
+/********************** writeBundle() *********************
+ * Writes the instrument's loaded zones/waves to a bundle,
+ * so the next load can map it. Called by a Load worker
+ * thread after loading the txt/wave files. If an error,
+ * we just don't write the bundle. The instrument is still
+ * loaded.
+ *
+ * task =		LOAD_TASK queued by queueInstrument().
+ * len =		Length of the task's Name[].
+ */
+
+static void writeBundle(register LOAD_TASK * task, register uint32_t len)
+{
+	register PLAYZONE_INFO *	zone;
+	register char *				zoneMem;
+	register uint32_t				offset, waveOffset;
+	uint32_t							zoneOffset, pageSize, dirCount;
+	register int					hFile;
+	BUNDLE_HDR						hdr;
+	unsigned char					list;
+
+	memset(&hdr, 0, sizeof(BUNDLE_HDR));
+	hdr.Id = BUNDLE_ID;
+	hdr.Version = BUNDLE_VERSION;
+	hdr.PtrSize = sizeof(void *);
+	hdr.RateFactor = SampleRateFactor;
+	hdr.Flags = task->Flags & (LOADTASKFLAG_WAVES|LOADTASKFLAG_COMPACT);
+	memcpy(&hdr.Hdr, &task->Hdr, sizeof(LOAD_HDR));
+	hdr.DirHash = hashBundleDir(task, &dirCount);
+	hdr.DirCount = dirCount;
+
+	// Count the sources
+	for (offset = 0; offset < task->SourcesLen; hdr.SrcCount++)
+		offset += (sizeof(BUNDLE_SRC) - 1) + ((BUNDLE_SRC *)&task->Sources[offset])->NameLen;
+
+	// Get the size of the zones. The waves start on the next page
+	waveOffset = zoneOffset = (sizeof(BUNDLE_HDR) + task->SourcesLen + 7) & ~7;
+	for (list = 0; list < 2; list++)
+	{
+		zone = (list ? task->ReleaseZones : task->Zones);
+		while (zone)
+		{
+			waveOffset += (BUNDLE_ZONE_SIZE(zone->RangeCount) + 7) & ~7;
+			zone = zone->Next;
+		}
+	}
+	pageSize = sysconf(_SC_PAGESIZE);
+	waveOffset = (waveOffset + pageSize - 1) & ~(pageSize - 1);
+
+	if ((zoneMem = (char *)malloc(waveOffset - zoneOffset)))
+	{
+		memset(zoneMem, 0, waveOffset - zoneOffset);
+
+		// Write to a temp file, and rename it when done, so a partial
+		// bundle is never mapped
+		memcpy(&task->Path[task->Offset], task->Name, len);
+		strcpy(&task->Path[task->Offset+len], &BundleExtension[0]);
+		strcat(&task->Path[task->Offset+len], "~");
+		if ((hFile = open(task->Path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) != -1)
+		{
+			// Copy the zones to zoneMem, replacing the ptrs with file offsets. Write the
+			// waves in the same order, each on its own page
+			offset = zoneOffset;
+			for (list = 0; list < 2; list++)
+			{
+				if ((zone = (list ? task->ReleaseZones : task->Zones)))
+				{
+					if (list) hdr.ReleaseZones = offset;
+					else hdr.Zones = offset;
+				}
+
+				while (zone)
+				{
+					register PLAYZONE_INFO *	copy;
+					register WAVEFORM_INFO **	waveInfoTable;
+					register unsigned char		rangeCount;
+
+					copy = (PLAYZONE_INFO *)&zoneMem[offset - zoneOffset];
+					memcpy(copy, zone, BUNDLE_ZONE_SIZE(zone->RangeCount));
+					offset += (BUNDLE_ZONE_SIZE(zone->RangeCount) + 7) & ~7;
+					if (zone->Next) copy->Next = (PLAYZONE_INFO *)(uintptr_t)offset;
+
+					rangeCount = zone->RangeCount;
+					waveInfoTable = (WAVEFORM_INFO **)((char *)copy + sizeof(PLAYZONE_INFO));
+					while (rangeCount--)
+					{
+						register WAVEFORM_INFO *	waveInfo;
+
+						waveInfoTable[1] = 0;
+						if ((waveInfo = waveInfoTable[0]))
+						{
+							waveInfoTable[0] = (WAVEFORM_INFO *)(uintptr_t)waveOffset;
+							do
+							{
+								WAVEFORM_INFO		waveHdr;
+								register uint32_t	size, next;
+
+								size = waveDataSize(waveInfo);
+								next = (waveOffset + offsetof(WAVEFORM_INFO, WaveForm) + size + pageSize - 1) & ~(pageSize - 1);
+								memcpy(&waveHdr, waveInfo, offsetof(WAVEFORM_INFO, WaveForm));
+								waveHdr.MemFlags &= ~WAVEMEM_POOLED;
+								waveHdr.Next = (waveInfo->Next ? (WAVEFORM_INFO *)(uintptr_t)next : 0);
+								if (pwrite(hFile, &waveHdr, offsetof(WAVEFORM_INFO, WaveForm), waveOffset) != offsetof(WAVEFORM_INFO, WaveForm) ||
+									pwrite(hFile, waveInfo->WaveForm, size, waveOffset + offsetof(WAVEFORM_INFO, WaveForm)) != size) goto bad;
+								waveOffset = next;
+							} while ((waveInfo = waveInfo->Next));
+						}
+
+						waveInfoTable += 2;
+					}
+
+					zone = zone->Next;
+				}
+			}
+
+			hdr.TotalSize = waveOffset;
+			if (pwrite(hFile, &hdr, sizeof(BUNDLE_HDR), 0) == sizeof(BUNDLE_HDR) &&
+				pwrite(hFile, task->Sources, task->SourcesLen, sizeof(BUNDLE_HDR)) == task->SourcesLen &&
+				pwrite(hFile, zoneMem, offset - zoneOffset, zoneOffset) == offset - zoneOffset &&
+				!ftruncate(hFile, waveOffset))
+			{
+				char		tempName[PATH_MAX];
+
+				if (!close(hFile))
+				{
+					strcpy(tempName, task->Path);
+					len = strlen(task->Path);
+					task->Path[len - 1] = 0;
+					if (!rename(tempName, task->Path)) goto out;
+					task->Path[len - 1] = '~';
+				}
+				goto del;
+			}
+bad:
+			close(hFile);
+del:		unlink(task->Path);
+		}
+out:
+		free(zoneMem);
+	}
+}
+
+
+
+static void initVoices(void)
+{
+	register uint32_t			total;
+	register VOICE_INFO *	mem;
 
 	AudioThreadQueue = VoicePlayQueue = 0;
 	VoicePlayLock = 0;
@@ -949,6 +2279,7 @@ static void initVoices(void)
 		{
 			mem->Lock = mem->AudioFuncFlags = 0;
 			mem->NoteNum = 0x80;
+			mem->DecodedWave[0] = mem->DecodedWave[1] = 0;
 			mem++;
 		} while (--total);
 
@@ -1006,172 +2337,604 @@ typedef struct {
 } CMPWAVEFILE;
 #pragma pack()
 
-/************************ waveLoad() ********************
- * Reads in a compressed WAVE file, and stores the info in
- * a WAVEFORM_INFO.
+// The lossless .cmp decoder, shared with WaveCmp.c
+#include "WaveUnpack.c"
+
+/********************* readWaveData() *******************
+ * Reads a .cmp file's wave data, decompressing it if the
+ * file is lossless. Called by a Load worker thread.
  *
- * fn =					Filename to load.
- * waveInfoTable =	Ptr to prev WAVEFORM_INFO in the list.
+ * inHandle =		Open .cmp file.
+ * drum =			The .cmp file's header.
+ * dest =			Where to store the data.
+ * size =			Size of the (uncompressed) data.
+ * fileSize =		Size of the data in the file.
  *
- * If an error, copies a nul-terminated msg to TempBuffer[].
+ * RETURN: 0 if success, or non-zero if an error.
  */
 
-static void waveLoad(char * fn, WAVEFORM_INFO ** waveInfoTable)
+static int readWaveData(register int inHandle, register CMPWAVEFILE * drum, char * dest, uint32_t size, uint32_t fileSize)
 {
-	register WAVEFORM_INFO *waveInfo;
-	register const char *	message;
-	unsigned long				size;
-	CMPWAVEFILE					drum;
-	register int				inHandle;
+	register unsigned char *	packed;
+	register int					result;
 
-	message = &DidNotOpen[0];
+	if (!(drum->WaveFlags & WAVEFLAG_LOSSLESS)) return (pread(inHandle, dest, size, sizeof(CMPWAVEFILE)) != size);
 
-	// Open the WAVE file for reading
-	if ((inHandle = open(fn, O_RDONLY|O_NOATIME)) != -1)
+	result = -1;
+	if ((packed = (unsigned char *)malloc(fileSize)))
 	{
-		message = " is a bad WAVE file";
+		if (pread(inHandle, packed, fileSize, sizeof(CMPWAVEFILE)) == fileSize)
+			result = unpackWave(packed, fileSize, dest, drum->WaveformLen, drum->CompressPoint, (drum->WaveFlags & WAVEFLAG_STEREO) ? 2 : 1);
+		free(packed);
+	}
+	return result;
+}
 
-		// Read in File header
-		if (read(inHandle, &drum, sizeof(CMPWAVEFILE)) == sizeof(CMPWAVEFILE))
-		{
-			struct stat			buf;
+/********************** upsampleWave() *********************
+ * Doubles the rate of loaded wave data, by repeating each
+ * sample.
+ *
+ * data =	Buffer of size*2 bytes, with the loaded data in
+ * 			the second half.
+ */
 
-			if (drum.WaveformLen >= drum.CompressPoint && (drum.LoopBegin == (uint32_t)-1 || drum.LoopBegin < drum.WaveformLen) && (drum.LoopEnd == (uint32_t)-1 || drum.LoopEnd > drum.LoopBegin))
-			{
-				// Allocate a buffer to load in the wave data, and load it
-				fstat(inHandle, &buf);
-				size = buf.st_size - sizeof(CMPWAVEFILE);
-				if (!(waveInfo = (WAVEFORM_INFO *)malloc((SampleRateFactor > 1 ? size : 0) + size + sizeof(WAVEFORM_INFO) - 1)))
-				{
-					setMemErrorStr();
-					close(inHandle);
-					goto badout;
-				}
+static void upsampleWave(register char * data, register uint32_t size)
+{
+	register short *	to;
+	register short *	from;
+	register short		pt;
 
-				// Make sure all waves are the same rate. We don't bother with on-the-fly
-				// rate conversion. User is expected to use the same rate for all waves
-				if ((SampleRateFactor > 1 ? SampleRateFactor - 2 : SampleRateFactor) != (drum.WaveFlags >> 4))
-				{
-					message = " is not the correct sample rate";
-					goto end;
-				}
+	from = (short *)(&data[size]);
+	to = (short *)data;
+	while ((char *)from < &data[size << 1])
+	{
+		pt = *from++;
+		*to++ = pt;
+		*to++ = pt;
+	}
+}
 
-				// Link it into the list
-				memset(waveInfo, 0, sizeof(WAVEFORM_INFO));
-				waveInfo->Next = *waveInfoTable;
-				*waveInfoTable = waveInfo;
-				waveInfo->WaveformLen = drum.WaveformLen;
-				waveInfo->CompressPoint = drum.CompressPoint;
-				waveInfo->LoopBegin = drum.LoopBegin;
-				waveInfo->LoopEnd = drum.LoopEnd;
-				waveInfo->WaveFlags = drum.WaveFlags & WAVEFLAG_STEREO;
-//printf("%s Len=%u Comp=%u Begin=%u End=%u %s\r\n", fn, drum.WaveformLen << 1, drum.CompressPoint << 1,
-//drum.LoopBegin==(uint32_t)-1?0:drum.LoopBegin<<1, drum.LoopEnd==(uint32_t)-1?0:drum.LoopEnd<<1, waveInfo->WaveFlags ? "Stereo" : "");
+/********************* removePoolFiles() ********************
+ * Deletes the pool files. Called only while holding an
+ * exclusive lock on the pool's lock file (ie, no other
+ * instance is using the pool).
+ */
 
-				if (read(inHandle, &waveInfo->WaveForm[(SampleRateFactor > 1 ? size : 0)], size) == size)
-				{
-					register short *	to;
-					register short *	from;
-					register short		pt;
+static void removePoolFiles(void)
+{
+	register DIR *					dirp;
+	register struct dirent *	dirEntryPtr;
 
-					if (SampleRateFactor > 1)
-					{
-						buf.st_size <<= 1;
-						from = (short *)(&waveInfo->WaveForm[size]);
-						to = (short *)(&waveInfo->WaveForm[0]);
-						while ((char *)from < &waveInfo->WaveForm[buf.st_size])
-						{
-							pt = *from++;
-							*to++ = pt;
-							*to++ = pt;
-						}
-						waveInfo->WaveformLen <<= 1;
-						waveInfo->CompressPoint <<= 1;
-						waveInfo->LoopBegin <<= 1;
-						waveInfo->LoopEnd <<= 1;
-					}
-					message = 0;
-				}
-			}
+	if ((dirp = opendir(&PoolDir[0])))
+	{
+		while ((dirEntryPtr = readdir(dirp)))
+		{
+			if (!memcmp(dirEntryPtr->d_name, &PoolPrefix[0], sizeof(PoolPrefix) - 1))
+				unlinkat(dirfd(dirp), dirEntryPtr->d_name, 0);
 		}
-end:
-		close(inHandle);
+		closedir(dirp);
 	}
+}
+
+/*********************** openPool() ***********************
+ * Joins the shared sample pool. Called by the Load thread
+ * before loading instruments.
+ *
+ * Every running instance holds a shared lock on the pool's
+ * lock file. So when an instance leaves the pool, it can
+ * tell whether it's the last user (and delete the pool
+ * files) by trying to get an exclusive lock. The same test
+ * when joining tells whether any pool files were left by
+ * an instance that crashed, and we delete those.
+ *
+ * If the pool dir isn't safe to use, we don't join, and
+ * instruments load as usual.
+ */
 
-  	if (message)
+static void openPool(void)
+{
+	if (PoolLockHandle == -1)
 	{
-		// Error
-		register char *temp;
-		register char *dest;
-		register unsigned char	numFileLevels;
+		struct stat		buf;
+		char				name[sizeof(PoolDir) + sizeof(PoolLock)];
+
+		// The dir must be ours, a real dir (not a symlink), and writable only by us
+		sprintf(&PoolDir[0], &PoolDirFmt[0], (unsigned int)geteuid());
+		if ((mkdir(&PoolDir[0], 0700) && errno != EEXIST) || lstat(&PoolDir[0], &buf) ||
+			!S_ISDIR(buf.st_mode) || buf.st_uid != geteuid() || (buf.st_mode & (S_IWGRP|S_IWOTH)))
+		{
+			return;
+		}
 
-		numFileLevels = 3;
-		temp = fn + strlen(fn);
-		dest = (char *)TempBuffer;
-		while (temp > fn)
+		sprintf(&name[0], "%s%s", &PoolDir[0], &PoolLock[0]);
+		if ((PoolLockHandle = open(&name[0], O_RDONLY|O_CREAT|O_NOFOLLOW, 0600)) != -1)
 		{
-			if (*(--temp) == '/')
+			// No other instance? Then any pool files are orphans
+			if (!flock(PoolLockHandle, LOCK_EX|LOCK_NB)) removePoolFiles();
+
+			if (flock(PoolLockHandle, LOCK_SH))
 			{
-				if (!(--numFileLevels))
-				{
-					++temp;
-					break;
-				}
+				close(PoolLockHandle);
+				PoolLockHandle = -1;
 			}
 		}
-
-		while ((*(dest)++ = *(temp)++));
-		--dest;
-		while ((*(dest)++ = *(message)++));
-		setErrorStr((char *)TempBuffer);
 	}
-badout:
-	return;
 }
 
+/*********************** closePool() **********************
+ * Leaves the shared sample pool. If no other instance is
+ * using it, deletes the pool files. (Any pooled waves still
+ * mapped by this instance remain valid until unmapped).
+ */
 
-
-static unsigned char	NtnNams[] = {'C',0,'D','b','D',0,'E','b','E',0,'F',0,'G','b','G',0,'A','b','A',0,'B','b','B',0,'C',0};
-static unsigned char	NtnVals[] = {9,11,0,2,4,5,7};
-
-static void numToPitchFn(register char * ptr, register unsigned char noteNum)
+static void closePool(void)
 {
-	register unsigned char *	name;
+	if (PoolLockHandle != -1)
+	{
+		if (!flock(PoolLockHandle, LOCK_EX|LOCK_NB)) removePoolFiles();
 
-	*(ptr)++ = ('0' - 1) + (noteNum/12);
-	*(ptr)++ = '_';
-	name = &NtnNams[(noteNum % 12) << 1];
-	*(ptr)++ = *name++;
-	*(ptr)++ = *name;
-	*ptr = 0;
+		close(PoolLockHandle);
+		PoolLockHandle = -1;
+	}
 }
 
-static unsigned char pitchToNum(register unsigned char ** note)
+/************************ poolWave() **********************
+ * Maps a wave's data from the shared sample pool. If no
+ * instance has yet loaded that wave into the pool, loads
+ * it first. Called by a Load worker thread.
+ *
+ * inHandle =	Open .cmp file.
+ * buf =			The .cmp file's stat.
+ * drum =		The .cmp file's header.
+ * size =		Size of the (uncompressed) wave data.
+ *
+ * RETURN: The WAVEFORM_INFO, with only its WaveForm[]
+ * filled in, or 0 if the pool can't be used (including
+ * if openPool() didn't join it).
+ *
+ * A pool file is named by the .cmp file's identity, and its
+ * mtime/size, so any change to the .cmp yields a new pool
+ * file. We load a new pool file unnamed, make it read-only,
+ * and only then link it into the pool dir. So another
+ * instance never sees a partially loaded wave, and no
+ * instance can write to a pooled wave.
+ *
+ * The WAVEFORM_INFO's header fields are private to this
+ * instance. We reserve a page for them, put the header at
+ * the end of the page, and map the pool file read-only
+ * right after it. So WaveForm[] is the pool file's data,
+ * and the mixer needs no special handling. The size of the
+ * whole mapping is stored at the start of that first page.
+ */
+
+static WAVEFORM_INFO * poolWave(register int inHandle, register struct stat * buf, CMPWAVEFILE * drum, register uint32_t size)
 {
-	register unsigned char  *	ptr;
-	register unsigned char		chr;
-	register unsigned char		noteNum;
+	register char *		mem;
+	register uint32_t		len, pageSize;
+	register int			hFile;
+	char						name[PATH_MAX];
 
-	ptr = *note;
-	if ((chr = *ptr) && chr >= '0' && chr <= '9')
+	if (PoolLockHandle == -1) goto out;
+
+	len = (SampleRateFactor > 1 ? size << 1 : size);
+	sprintf(name, "%s%s%lx-%lx-%lx.%lx-%x-%u", &PoolDir[0], &PoolPrefix[0], (unsigned long)buf->st_dev, (unsigned long)buf->st_ino,
+		(unsigned long)buf->st_mtim.tv_sec, (unsigned long)buf->st_mtim.tv_nsec, size, SampleRateFactor);
+
+	// Has some instance already loaded this wave into the pool?
+	if ((hFile = open(name, O_RDONLY|O_NOFOLLOW)) != -1)
 	{
-		noteNum = (chr - ('0' - 1)) * 12;
-		chr = *(++ptr);
-		if (chr == '_')
+		struct stat		poolBuf;
+
+		// Only map a file we made, and that no one else can have altered
+		if (fstat(hFile, &poolBuf) || poolBuf.st_size != len || poolBuf.st_uid != geteuid() || (poolBuf.st_mode & (S_IWGRP|S_IWOTH))) goto bad;
+	}
+
+	// No. Load it into a new pool file, and link it into the pool dir. If
+	// another instance beat us to it, we use our (identical) copy anyway
+	else
+	{
+		char		procName[32];
+
+		if ((hFile = open(&PoolDir[0], O_TMPFILE|O_RDWR, 0444)) == -1) goto out;
+		if (ftruncate(hFile, len) || (mem = (char *)mmap(0, len, PROT_READ|PROT_WRITE, MAP_SHARED, hFile, 0)) == MAP_FAILED) goto bad;
+		if (readWaveData(inHandle, drum, &mem[len - size], size, buf->st_size - sizeof(CMPWAVEFILE)))
 		{
-			if ((chr = *(++ptr) & 0x5F) && chr >= 'A' && chr <= 'G')
-			{
-				if (*(++ptr) == 'b')
-				{
-					noteNum--;
-					ptr++;
-				}
-				noteNum += NtnVals[(chr - 'A')];
-				goto out;
-			}
+			munmap(mem, len);
+			goto bad;
 		}
+		if (SampleRateFactor > 1) upsampleWave(mem, size);
+		munmap(mem, len);
+
+		sprintf(procName, "/proc/self/fd/%d", hFile);
+		linkat(AT_FDCWD, procName, AT_FDCWD, name, AT_SYMLINK_FOLLOW);
 	}
-	ptr = 0;
+
+	// Reserve the header page plus the wave data, then map the pool file over
+	// all but the first page
+	pageSize = sysconf(_SC_PAGESIZE);
+	size = pageSize + ((len + pageSize - 1) & ~(pageSize - 1));
+	if ((mem = (char *)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) goto bad;
+	if (mmap(&mem[pageSize], len, PROT_READ, MAP_SHARED|MAP_FIXED|MAP_POPULATE, hFile, 0) == MAP_FAILED)
+	{
+		munmap(mem, size);
+		goto bad;
+	}
+	close(hFile);
+
+	*((uint32_t *)mem) = size;
+	return (WAVEFORM_INFO *)&mem[pageSize - offsetof(WAVEFORM_INFO, WaveForm)];
+
+bad:
+	close(hFile);
+out:
+	return 0;
+}
+
+static void unpoolWave(register WAVEFORM_INFO * waveInfo)
+{
+	register char *	mem;
+
+	mem = &waveInfo->WaveForm[-sysconf(_SC_PAGESIZE)];
+	munmap(mem, *((uint32_t *)mem));
+}
+
+
+
+
+
+static const short AdpcmSteps[89] = {7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+	73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+	963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+	7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+static const char AdpcmIndexes[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+/*********************** adpcmStep() **********************
+ * Applies one 4-bit ADPCM code to the predicted sample,
+ * and adjusts the step index.
+ *
+ * RETURN: The new sample.
+ */
+
+static int adpcmStep(register unsigned char code, register int pred, register unsigned char * index)
+{
+	register int	step, diff;
+
+	step = AdpcmSteps[*index];
+	diff = step >> 3;
+	if (code & 4) diff += step;
+	if (code & 2) diff += step >> 1;
+	if (code & 1) diff += step >> 2;
+	if (code & 8)
+	{
+		if ((pred -= diff) < -32768) pred = -32768;
+	}
+	else if ((pred += diff) > 32767) pred = 32767;
+
+	step = *index + AdpcmIndexes[code & 7];
+	*index = (step < 0 ? 0 : (step > 88 ? 88 : step));
+	return pred;
+}
+
+/************************ wavePt() ***********************
+ * Returns the 16-bit sample at the specified offset in a
+ * (not compacted) loaded wave, or 0 if past the end.
+ */
+
+static int wavePt(register WAVEFORM_INFO * waveInfo, register uint32_t offset)
+{
+	if (offset >= waveInfo->WaveformLen) return 0;
+	if (offset < waveInfo->CompressPoint) return ((short *)waveInfo->WaveForm)[offset];
+	return waveInfo->WaveForm[(waveInfo->CompressPoint << 1) + (offset - waveInfo->CompressPoint)];
+}
+
+/*********************** encodeBlock() ********************
+ * ADPCM encodes one chan of one block.
+ *
+ * offset =	Offset to the block's first sample for the chan.
+ * codes =	Where to store the 4-bit codes. The first is unused.
+ * index =	Step index to start with. Set to the step index at
+ *				the end of the block.
+ *
+ * RETURN: The sum of the squared errors.
+ */
+
+static uint64_t encodeBlock(register WAVEFORM_INFO * waveInfo, register uint32_t offset, unsigned char chans, register unsigned char * codes, unsigned char * index)
+{
+	register uint32_t		i;
+	register int			pred;
+	uint64_t					error;
+
+	error = 0;
+	pred = wavePt(waveInfo, offset);
+	for (i = 1; i < ADPCM_BLOCK_FRAMES; i++)
+	{
+		register int			diff, step;
+		register unsigned char	code;
+
+		// Quantize the difference from the predicted sample
+		offset += chans;
+		diff = wavePt(waveInfo, offset);
+		code = 0;
+		if ((diff -= pred) < 0)
+		{
+			code = 8;
+			diff = -diff;
+		}
+		step = AdpcmSteps[*index];
+		if (diff >= step)
+		{
+			code |= 4;
+			diff -= step;
+		}
+		step >>= 1;
+		if (diff >= step)
+		{
+			code |= 2;
+			diff -= step;
+		}
+		if (diff >= (step >> 1)) code |= 1;
+		codes[i] = code;
+
+		// Track what the decoder will produce
+		pred = adpcmStep(code, pred, index);
+		diff = wavePt(waveInfo, offset) - pred;
+		error += (int64_t)diff * diff;
+	}
+
+	return error;
+}
+
+/*********************** compactWave() ********************
+ * Replaces a loaded wave with a copy stored as ADPCM blocks,
+ * for less than a third of the RAM. Called by a Load worker
+ * thread after waveLoad().
+ *
+ * waveInfoTable =	Where the WAVEFORM_INFO is linked.
+ *
+ * If there isn't memory for the copy, we just keep the
+ * original wave.
+ *
+ * NOTE: Any legato offset must already be deduced, because
+ * that reads the 16-bit data.
+ */
+
+static void compactWave(WAVEFORM_INFO ** waveInfoTable)
+{
+	register WAVEFORM_INFO *	waveInfo;
+	register WAVEFORM_INFO *	adpcm;
+	register unsigned char *	ptr;
+	register uint32_t				frame, i;
+	uint32_t							frames;
+	unsigned char					chan, chans;
+	unsigned char					index[2];
+	unsigned char					codes[ADPCM_BLOCK_FRAMES], bestCodes[ADPCM_BLOCK_FRAMES];
+
+	waveInfo = *waveInfoTable;
+	chans = (waveInfo->WaveFlags & WAVEFLAG_STEREO) ? 2 : 1;
+	frames = waveInfo->WaveformLen / chans;
+
+	waveInfo->MemFlags |= WAVEMEM_ADPCM;
+	i = waveDataSize(waveInfo);
+	waveInfo->MemFlags &= ~WAVEMEM_ADPCM;
+	if (!(adpcm = (WAVEFORM_INFO *)malloc(i + offsetof(WAVEFORM_INFO, WaveForm)))) return;
+	memcpy(adpcm, waveInfo, offsetof(WAVEFORM_INFO, WaveForm));
+	adpcm->MemFlags = WAVEMEM_ADPCM;
+
+	// No 8-bit data
+	adpcm->CompressPoint = adpcm->WaveformLen;
+
+	index[0] = index[1] = 0;
+	ptr = (unsigned char *)adpcm->WaveForm;
+	for (frame = 0; frame < frames; frame += ADPCM_BLOCK_FRAMES)
+	{
+		register unsigned char *	nibbles;
+
+		nibbles = ptr + (sizeof(ADPCM_CHAN) * chans);
+		memset(nibbles, 0, (ADPCM_BLOCK_FRAMES / 2) * chans);
+
+		for (chan = 0; chan < chans; chan++)
+		{
+			register ADPCM_CHAN *	hdr;
+			uint64_t						error, bestError;
+			unsigned char				start, endIndex, bestEnd, tries;
+
+			// The block starts with the exact sample, so any error doesn't carry
+			// over from the previous block. Try starting with the step index where
+			// the previous block left off, and also a range of others, because a
+			// sharp attack needs a bigger step right away. Keep the best
+			hdr = &((ADPCM_CHAN *)ptr)[chan];
+			i = (frame * chans) + chan;
+			hdr->Pt = wavePt(waveInfo, i);
+			hdr->Unused = 0;
+			bestError = (uint64_t)-1;
+			bestEnd = 0;
+			for (tries = 0; tries <= (88 / 4) + 1 && bestError; tries++)
+			{
+				start = (tries ? (tries - 1) * 4 : index[chan]);
+				if (tries && start == index[chan]) continue;
+				endIndex = start;
+				if ((error = encodeBlock(waveInfo, i, chans, &codes[0], &endIndex)) < bestError)
+				{
+					bestError = error;
+					bestEnd = endIndex;
+					hdr->Index = start;
+					memcpy(bestCodes, codes, sizeof(codes));
+				}
+			}
+			index[chan] = bestEnd;
+
+			for (i = 1; i < ADPCM_BLOCK_FRAMES; i++)
+			{
+				register uint32_t		k;
+
+				k = (i * chans) + chan;
+				nibbles[k >> 1] |= bestCodes[i] << ((k & 1) << 2);
+			}
+		}
+
+		ptr += ADPCM_BLOCK_SIZE * chans;
+	}
+
+	*waveInfoTable = adpcm;
+	free(waveInfo);
+}
+
+
+
+
+/************************ waveLoad() ********************
+ * Reads in a compressed WAVE file, and stores the info in
+ * a WAVEFORM_INFO. Called by a Load worker thread.
+ *
+ * task =				LOAD_TASK whose Path[] is the filename to load.
+ * waveInfoTable =	Ptr to prev WAVEFORM_INFO in the list.
+ *
+ * If an error, copies a nul-terminated msg to the task's
+ * ErrMsg[].
+ */
+
+static void waveLoad(register LOAD_TASK * task, WAVEFORM_INFO ** waveInfoTable)
+{
+	register WAVEFORM_INFO *waveInfo;
+	register const char *	message;
+	unsigned long				size;
+	CMPWAVEFILE					drum;
+	register int				inHandle;
+	unsigned char				memFlags;
+
+	message = &DidNotOpen[0];
+
+	// Open the WAVE file for reading
+	if ((inHandle = open(task->Path, O_RDONLY|O_NOATIME)) != -1)
+	{
+		message = " is a bad WAVE file";
+
+		// Read in File header
+		if (read(inHandle, &drum, sizeof(CMPWAVEFILE)) == sizeof(CMPWAVEFILE))
+		{
+			struct stat			buf;
+
+			if (drum.WaveformLen >= drum.CompressPoint && (drum.LoopBegin == (uint32_t)-1 || drum.LoopBegin < drum.WaveformLen) && (drum.LoopEnd == (uint32_t)-1 || drum.LoopEnd > drum.LoopBegin))
+			{
+				fstat(inHandle, &buf);
+				if (task->Flags & LOADTASKFLAG_COMPILE) add_bundle_src(task, &buf);
+				size = buf.st_size - sizeof(CMPWAVEFILE);
+#ifdef JG_LOAD_TIMING
+				__atomic_add_fetch(&LoadFileBytes, buf.st_size, __ATOMIC_RELAXED);
+#endif
+				// A lossless file's data size is per the header. 16-bit samples upto CompressPoint, then 8-bit
+				if (drum.WaveFlags & WAVEFLAG_LOSSLESS) size = (drum.CompressPoint << 1) + (drum.WaveformLen - drum.CompressPoint);
+
+				// Make sure all waves are the same rate. We don't bother with on-the-fly
+				// rate conversion. User is expected to use the same rate for all waves
+				if ((SampleRateFactor > 1 ? SampleRateFactor - 2 : SampleRateFactor) != ((drum.WaveFlags >> 4) & 0x03))
+				{
+					message = " is not the correct sample rate";
+					goto end;
+				}
+
+				// Map the wave data from the shared sample pool. Or if not using the pool,
+				// allocate a buffer to load in the wave data, and load it
+				memFlags = 0;
+				if ((task->Flags & LOADTASKFLAG_POOL) && (waveInfo = poolWave(inHandle, &buf, &drum, size)))
+					memFlags = WAVEMEM_POOLED;
+				else
+				{
+					if (!(waveInfo = (WAVEFORM_INFO *)malloc((SampleRateFactor > 1 ? size : 0) + size + sizeof(WAVEFORM_INFO) - 1)))
+					{
+						strcpy(task->ErrMsg, NoMemStr);
+						close(inHandle);
+						goto badout;
+					}
+
+					if (readWaveData(inHandle, &drum, &waveInfo->WaveForm[(SampleRateFactor > 1 ? size : 0)], size, buf.st_size - sizeof(CMPWAVEFILE)))
+					{
+						free(waveInfo);
+						goto end;
+					}
+
+					if (SampleRateFactor > 1) upsampleWave(&waveInfo->WaveForm[0], size);
+				}
+#ifdef JG_LOAD_TIMING
+				__atomic_add_fetch(&LoadWaveBytes, size, __ATOMIC_RELAXED);
+#endif
+
+				// Link it into the list
+				memset(waveInfo, 0, offsetof(WAVEFORM_INFO, WaveForm));
+				waveInfo->Next = *waveInfoTable;
+				*waveInfoTable = waveInfo;
+				waveInfo->WaveformLen = drum.WaveformLen;
+				waveInfo->CompressPoint = drum.CompressPoint;
+				waveInfo->LoopBegin = drum.LoopBegin;
+				waveInfo->LoopEnd = drum.LoopEnd;
+				waveInfo->WaveFlags = drum.WaveFlags & WAVEFLAG_STEREO;
+				waveInfo->MemFlags = memFlags;
+//printf("%s Len=%u Comp=%u Begin=%u End=%u %s\r\n", task->Path, drum.WaveformLen << 1, drum.CompressPoint << 1,
+//drum.LoopBegin==(uint32_t)-1?0:drum.LoopBegin<<1, drum.LoopEnd==(uint32_t)-1?0:drum.LoopEnd<<1, waveInfo->WaveFlags ? "Stereo" : "");
+
+				if (SampleRateFactor > 1)
+				{
+					waveInfo->WaveformLen <<= 1;
+					waveInfo->CompressPoint <<= 1;
+					waveInfo->LoopBegin <<= 1;
+					waveInfo->LoopEnd <<= 1;
+				}
+				message = 0;
+			}
+		}
+end:
+		close(inHandle);
+	}
+
+	// Error?
+  	if (message) format_load_fileerr(task, "", message, 3);
+badout:
+	return;
+}
+
+
+
+static unsigned char	NtnNams[] = {'C',0,'D','b','D',0,'E','b','E',0,'F',0,'G','b','G',0,'A','b','A',0,'B','b','B',0,'C',0};
+static unsigned char	NtnVals[] = {9,11,0,2,4,5,7};
+
+static void numToPitchFn(register char * ptr, register unsigned char noteNum)
+{
+	register unsigned char *	name;
+
+	*(ptr)++ = ('0' - 1) + (noteNum/12);
+	*(ptr)++ = '_';
+	name = &NtnNams[(noteNum % 12) << 1];
+	*(ptr)++ = *name++;
+	*(ptr)++ = *name;
+	*ptr = 0;
+}
+
+static unsigned char pitchToNum(register unsigned char ** note)
+{
+	register unsigned char  *	ptr;
+	register unsigned char		chr;
+	register unsigned char		noteNum;
+
+	ptr = *note;
+	if ((chr = *ptr) && chr >= '0' && chr <= '9')
+	{
+		noteNum = (chr - ('0' - 1)) * 12;
+		chr = *(++ptr);
+		if (chr == '_')
+		{
+			if ((chr = *(++ptr) & 0x5F) && chr >= 'A' && chr <= 'G')
+			{
+				if (*(++ptr) == 'b')
+				{
+					noteNum--;
+					ptr++;
+				}
+				noteNum += NtnVals[(chr - 'A')];
+				goto out;
+			}
+		}
+	}
+	ptr = 0;
 out:
 	*note = ptr;
 	return noteNum;
@@ -1203,7 +2966,7 @@ typedef struct {
  * line and PATCH HEADER line.
  */
 
-static unsigned char * parse_common(unsigned char * ptr, register TEMP_PLAYZONE_INFO * zone, TEMP_PLAYZONE_INFO * master, register uint32_t op)
+static unsigned char * parse_common(register LOAD_TASK * task, unsigned char * ptr, register TEMP_PLAYZONE_INFO * zone, TEMP_PLAYZONE_INFO * master, register uint32_t op)
 {
 	switch (op)
 	{
@@ -1211,7 +2974,7 @@ static unsigned char * parse_common(unsigned char * ptr, register TEMP_PLAYZONE_
 		case ZONE_ID_REL:
 		{
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-			zone->Flags &= (ListNum ? ~(PLAYZONEFLAG_ALWAYS_FADE|PLAYZONEFLAG_SUSLOOP) : ~(PLAYZONEFLAG_ALWAYS_FADE));
+			zone->Flags &= (task->ListNum ? ~(PLAYZONEFLAG_ALWAYS_FADE|PLAYZONEFLAG_SUSLOOP) : ~(PLAYZONEFLAG_ALWAYS_FADE));
 			if (*ptr == 'F')
 			{
 				// Always fade
@@ -1221,7 +2984,7 @@ static unsigned char * parse_common(unsigned char * ptr, register TEMP_PLAYZONE_
 			if (*ptr == 'H')	// Infinite loop
 			{
 				// Drums do not support hold loop. Neither do release map
-				if (!ListNum || PickAttack) goto badval;
+				if (!task->ListNum || (task->Flags & LOADTASKFLAG_RELEASE)) goto badval;
 				zone->Flags |= PLAYZONEFLAG_SUSLOOP;
 skipsus:		++ptr;
 			}
@@ -1297,7 +3060,7 @@ skipvol:			++ptr;
 		case ZONE_ID_RANGES:
 		{
 #if defined(NO_ALSA_AUDIO_SUPPORT) && defined(NO_JACK_SUPPORT)
-			if (ListNum) break;
+			if (task->ListNum) break;
 #endif
 			op = asciiToNum(&ptr);
 			if (op > 255 || !ptr)
@@ -1358,33 +3121,97 @@ badval:		ptr = 0;
 
 
 
+/******************* load_task_file() ******************
+ * Loads the text file named in the LOAD_TASK's Path[]
+ * into the task's parse buffer, and nul terminates it.
+ * Called by a Load worker thread.
+ *
+ * RETURN: 0 if success, or non-zero if an error (with a
+ * msg in the task's ErrMsg[]).
+ */
+
+static int load_task_file(register LOAD_TASK * task)
+{
+	register int		len;
+	register int		hFile;
+	struct stat			buf;
+
+	// Open the text file
+	if ((hFile = open(task->Path, O_RDONLY|O_NOATIME)) == -1)
+	{
+		len = errno;
+		goto bad;
+	}
+
+	// Get the size. Use existing parse buffer if big enough
+	fstat(hFile, &buf);
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	if (task->Flags & LOADTASKFLAG_COMPILE) add_bundle_src(task, &buf);
+#endif
+	len = buf.st_size;
+	if (task->BufferSize <= (uint32_t)len)
+	{
+		if (task->Buffer) free(task->Buffer);
+		task->BufferSize = len + 1;
+		if (!(task->Buffer = (unsigned char *)malloc(task->BufferSize)))
+		{
+			task->BufferSize = 0;
+			close(hFile);
+			strcpy(task->ErrMsg, NoMemStr);
+			return -1;
+		}
+	}
+
+	// Read in the file, and close it
+	buf.st_size = read(hFile, task->Buffer, len);
+	close(hFile);
+	if (buf.st_size != len)
+	{
+		len = errno;
+bad:	format_load_fileerr(task, ": ", strerror(len), 5);
+		return -1;
+	}
+
+	// Nul term it
+	task->Buffer[len] = 0;
+	return 0;
+}
+
+
+
+
+
 /********************* loadZones() ********************
  * Loads the zones/waveforms for an Instrument. Called by
- * the Load thread.
+ * a Load worker thread.
  *
- * fn =			Instrument txt file's nul-terminated full pathname.
- * offset =		Byte offset to the end of dir in 'fn'.
- * TempBuffer = Parsing buffer.
+ * task =		LOAD_TASK whose Path[] is the instrument txt
+ * 				file's nul-terminated full pathname, and Offset
+ * 				is the byte offset to the end of dir in Path[].
  *
- * If an error, copies a msg to TempBuffer[] and alerts
- * Main thread.
+ * RETURN: The loaded zones. If an error, copies a msg to the
+ * task's ErrMsg[], and returns 0.
  */
 
-static void loadZones(char * fn, uint32_t offset)
+static PLAYZONE_INFO * loadZones(register LOAD_TASK * task)
 {
 	register unsigned char *	field;
 	unsigned char *				ptr;
 	register uint32_t				lineNum, temp;
 	TEMP_PLAYZONE_INFO			defZone;
 	register PLAYZONE_INFO *	zone;
+	PLAYZONE_INFO *				loadedZones;
+	register char *				fn;
+	register uint32_t				offset;
 
-	zone = LoadedZones = 0;
+	zone = loadedZones = 0;
+	fn = task->Path;
+	offset = task->Offset;
 
-	// Load the file into TempBuffer, nul-terminated
-	if (!load_text_file(fn, 5))
-bad:	return;
+	// Load the file into the task's parse buffer, nul-terminated
+	if (load_task_file(task)) goto bad;
 
-	ptr = TempBuffer;	// Must reget after load_text_file() or file_text_err()
+	ptr = task->Buffer;
 
 	// =====================================================
 	// Parse PATCH HEADER line
@@ -1393,13 +3220,12 @@ bad:	return;
 	lineNum = skip_lines(&ptr) + 1;
 	if (!*ptr)
 	{
-		sprintf((char *)TempBuffer, "%s txt file is missing the header line", NamePtr);
-		setErrorStr((char *)TempBuffer);
+		snprintf(task->ErrMsg, sizeof(task->ErrMsg), "%s txt file is missing the header line", task->Name);
 		goto bad;
 	}
 
-	SubKit = TransposeVal = Options = 0;
-	BankNums[4*2] = BankNums[(4*2)+1] = 0x80;
+	task->Hdr.SubKit = task->Hdr.TransposeVal = task->Hdr.Options = 0;
+	task->Hdr.BankMsb = task->Hdr.BankLsb = 0x80;
 	memset(&defZone, 0, sizeof(TEMP_PLAYZONE_INFO));
 	defZone.PanPosition = 64;
 	defZone.FadeOut = 1;
@@ -1426,12 +3252,12 @@ bad:	return;
 			case HDR_ID_LAYER:
 			{
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-				if (ListNum) goto bad_id;
+				if (task->ListNum) goto bad_id;
 				field = ptr;
 				while (*ptr >= ' ') ++ptr;
 				while (ptr > field && *(ptr - 1) <= ' ') --ptr;
 				*ptr++ = 0;
-				SubKit = hash_string(field);
+				task->Hdr.SubKit = hash_string(field);
 #endif
 				goto donehdr;
 			}
@@ -1440,34 +3266,34 @@ bad:	return;
 			{
 				temp = asciiToNum(&ptr);
 				if (temp > 127 || !ptr) goto badval;
-				VolBoost = (unsigned char)temp;
+				task->Hdr.PgmNum = (unsigned char)temp;
 				break;
 			}
 
 			case HDR_ID_OCT:
 			{
-				if (!ListNum) goto bad_id;
+				if (!task->ListNum) goto bad_id;
 				if (*ptr == '+') ++ptr;
-				TransposeVal = asciiToNum(&ptr);
-				if (TransposeVal < -6 || TransposeVal > 6 || !ptr) goto badval;
+				task->Hdr.TransposeVal = asciiToNum(&ptr);
+				if (task->Hdr.TransposeVal < -6 || task->Hdr.TransposeVal > 6 || !ptr) goto badval;
 				break;
 			}
 
 			case HDR_ID_MSB:
 			{
-				if (!ListNum) goto bad_id;
+				if (!task->ListNum) goto bad_id;
 				temp = asciiToNum(&ptr);
 				if (temp > 127 || !ptr) goto badval;
-				BankNums[4*2] = (unsigned char)temp;
+				task->Hdr.BankMsb = (unsigned char)temp;
 				break;
 			}
 
 			case HDR_ID_LSB:
 			{
-				if (!ListNum) goto bad_id;
+				if (!task->ListNum) goto bad_id;
 				temp = asciiToNum(&ptr);
 				if (temp > 127 || !ptr) goto badval;
-				BankNums[(4*2)+1] = (unsigned char)temp;
+				task->Hdr.BankLsb = (unsigned char)temp;
 				break;
 			}
 
@@ -1477,13 +3303,13 @@ bad:	return;
 				id = 0x80 | NUM_OF_OPT_IDS;
 				ptr = get_field_id(ptr, &OptIds[0], &id, 0);
 				if (id >= NUM_OF_OPT_IDS) goto bad_id;
-				Options |= (0x01 << id);
+				task->Hdr.Options |= (0x01 << id);
 				break;
 			}
 
 			default:
 			{
-				if (!(ptr = parse_common(ptr, &defZone, 0, id - HDR_ID_REL))) goto badval;
+				if (!(ptr = parse_common(task, ptr, &defZone, 0, id - HDR_ID_REL))) goto badval;
 			}
 		}
 		ptr = skip_spaces(ptr);
@@ -1493,25 +3319,25 @@ donehdr:
 	// If the robot musician playing this instrument is not outputting to the "Internal Synth" buss, then don't
 	// load the zones/waves
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-	if (DevAssigns[ListNum] != &SoundDev[DEVNUM_AUDIOOUT])
+	if (DevAssigns[task->ListNum] != &SoundDev[DEVNUM_AUDIOOUT])
 #endif
 	{
-		SubKit = Options = 0;
+		task->Hdr.SubKit = task->Hdr.Options = 0;
 		goto bad;
 	}
 
 #if defined(NO_ALSA_AUDIO_SUPPORT) && defined(NO_JACK_SUPPORT)
 unknown:
-	format_text_err("unknown text %s", lineNum, field);
+	format_load_err(task, "unknown text %s", lineNum, field);
 	goto bad;
 missing:
-	format_text_err("missing %s value", lineNum, field);
+	format_load_err(task, "missing %s value", lineNum, field);
 	goto bad;
 bad_id:
-	format_text_err("unknown id %s", lineNum, field);
+	format_load_err(task, "unknown id %s", lineNum, field);
 	goto bad;
 badval:
-	format_text_err("bad %s value", lineNum, field);
+	format_load_err(task, "bad %s value", lineNum, field);
 	goto bad;
 #else
 
@@ -1558,18 +3384,18 @@ badval:
 
 				if (id == FILEFIELD_UNKNOWN)
 				{
-unknown:			format_text_err("unknown text %s", lineNum, field);
+unknown:			format_load_err(task, "unknown text %s", lineNum, field);
 					goto bad4;
 				}
 
-bad_id:		format_text_err("unknown id %s", lineNum, field);
+bad_id:		format_load_err(task, "unknown id %s", lineNum, field);
 				goto bad4;
 			}
 
 			// Get the field's value
 			if (!*ptr || *ptr == '\n')
 			{
-missing:		format_text_err("missing %s value", lineNum, field);
+missing:		format_load_err(task, "missing %s value", lineNum, field);
 				goto bad4;
 			}
 
@@ -1627,7 +3453,7 @@ badval:				ptr = field;
 						while (*ptr > ' ' && *ptr != '/' && *(ptr+1) != '/') ptr++;
 						if (ptr - field > 128) ptr = &field[128];
 						ptr[0] = 0;
-						format_text_err("bad %s value", lineNum, field);
+						format_load_err(task, "bad %s value", lineNum, field);
 bad4:					if (zone) unloadZones(zone);
 						goto bad;
 					}
@@ -1638,7 +3464,7 @@ bad4:					if (zone) unloadZones(zone);
 
 				case ZONE_ID_HH:
 				{
-					if (ListNum) goto bad_id;
+					if (task->ListNum) goto bad_id;
 					ranges = ptr;
 					while (*ptr > ' ' && *ptr != '/' && *(ptr+1) != '/') *ptr++ &= 0x5F;
 					id = *ptr;
@@ -1677,7 +3503,7 @@ hihat:				*ptr = id;
 
 				default:
 				{
-					if (!(ptr = parse_common(ptr, &tempZone, &defZone, id))) goto badval;
+					if (!(ptr = parse_common(task, ptr, &tempZone, &defZone, id))) goto badval;
 				}
 			}
 
@@ -1695,13 +3521,13 @@ donezone:
 		{
 			if (count)
 			{
-				format_text_err("VOL=0 on a zone with ranges", lineNum, 0);
+				format_load_err(task, "VOL=0 on a zone with ranges", lineNum, 0);
 				goto bad4;
 			}
 
 			if (!tempZone.MuteGroups)
 			{
-				format_text_err("VOL=0 on a zone with no MUTE groups", lineNum, 0);
+				format_load_err(task, "VOL=0 on a zone with no MUTE groups", lineNum, 0);
 				goto bad4;
 			}
 		}
@@ -1715,7 +3541,7 @@ donezone:
 		// Alloc a PLAYZONE_INFO
 		if  (!(zone = (PLAYZONE_INFO *)malloc(sizeof(PLAYZONE_INFO) + count + (count * 2 * sizeof(void *)))))
 		{
-			setMemErrorStr();
+			strcpy(task->ErrMsg, NoMemStr);
 			goto bad4;
 		}
 		memset(zone, 0, sizeof(PLAYZONE_INFO) + count + (count * 2 * sizeof(void *)));
@@ -1745,14 +3571,14 @@ donezone:
 					fn[temp++] = (tempZone.Flags & PLAYZONEFLAG_CC_TRIGGER) ? 'C' : 'A';
 
 				// NOTENAMES OPT
-				if (Options & 0x04)
+				if (task->Hdr.Options & 0x04)
 					numToPitchFn(&fn[temp], tempZone.RootNote);
 				else
 					sprintf(&fn[temp], "%u", tempZone.RootNote);
 				temp += strlen(&fn[temp]);	// ignore uninitialized warning
 
 				// If this is a release map, append an "_r"
-				if (PickAttack)
+				if (task->Flags & LOADTASKFLAG_RELEASE)
 				{
 					fn[temp++] = '_';
 					fn[temp++] = 'r';
@@ -1802,7 +3628,7 @@ donezone:
 				lineNum += skip_lines(&ptr);
 				if (!*ptr)
 				{
-					format_text_err("missing range line", lineNum, 0);
+					format_load_err(task, "missing range line", lineNum, 0);
 					goto bad4;
 				}
 
@@ -1813,7 +3639,7 @@ donezone:
 				// or VEL for instruments
 				if (*ptr >= '0' && *ptr <= '9')
 				{
-					if (ListNum) goto velnum;
+					if (task->ListNum) goto velnum;
 					goto roundnum;
 				}
 
@@ -1891,11 +3717,11 @@ donerange:	// If no ROUND count (there's only 1 wave for this velocity range), u
 					count--;
 
 					// Indicate this robot has waves
-loadit:			WavesLoadedFlag |= (0x04 << ListNum);
+loadit:			task->Flags |= LOADTASKFLAG_WAVES;
 
 					// Load the wave
-					waveLoad(&fn[0], waveInfoTable);
-					if (getErrorStr()) goto bad4;
+					waveLoad(task, waveInfoTable);
+					if (task->ErrMsg[0]) goto bad4;
 
 					// If Instrument txt file didn't specify a legato offset, try to deduce one
 					{
@@ -1916,6 +3742,9 @@ skipmore:			i -= ((waveInfo->WaveFlags & WAVEFLAG_STEREO) ? 2 : 1);
 						if ((waveInfo->WaveFlags & WAVEFLAG_STEREO) && i && (ptr[i] > 4000 || ptr[i] < -4000)) goto skipmore;
 					}
 					if (i < waveInfo->WaveformLen) waveInfo->LegatoOffset = i;
+
+					// Store it as ADPCM? Pooled waves are already shared, so we leave those as is
+					if ((task->Flags & LOADTASKFLAG_COMPACT) && !(waveInfo->MemFlags & WAVEMEM_POOLED)) compactWave(waveInfoTable);
 					}
 				}
 
@@ -1929,25 +3758,36 @@ skipmore:			i -= ((waveInfo->WaveFlags & WAVEFLAG_STEREO) ? 2 : 1);
 		// Link the zone into the list per HighNote
 		if (!zone->HighNote)
 		{
-			if (!ListNum)
+			if (!task->ListNum)
 			{
 				zone->HighNote = zone->RootNote;
 				goto sort;
 			}
-			zone->Next = LoadedZones;
-			LoadedZones = zone;
+			zone->Next = loadedZones;
+			loadedZones = zone;
 		}
 		else
 		{
 			register PLAYZONE_INFO *	prevZone;
 
-sort:		prevZone = (PLAYZONE_INFO *)&LoadedZones;
+sort:		prevZone = (PLAYZONE_INFO *)&loadedZones;
 			while (prevZone->Next && prevZone->Next->HighNote < zone->HighNote) prevZone = prevZone->Next;
 			zone->Next = prevZone->Next;
 			prevZone->Next = zone;
 		}
 	}
 #endif
+
+bad:
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	// If an error, discard the zones loaded so far
+	if (task->ErrMsg[0] && loadedZones)
+	{
+		unloadZones(loadedZones);
+		loadedZones = 0;
+	}
+#endif
+	return loadedZones;
 }
 
 
@@ -1955,106 +3795,399 @@ sort:		prevZone = (PLAYZONE_INFO *)&LoadedZones;
 
 
 /****************** loadInstrument() ********************
- * Loads one Instrument (kit/bass/etc). Called by
- * the Load thread.
+ * Loads one Instrument's (kit/bass/etc) zones/waves, and
+ * any release map. Called by a Load worker thread.
  *
- * path =		Nul-terminated full pathname to data dir.
- * offset =		Byte offset to the end of dir in 'path'.
- * TempBuffer = Parsing buffer.
- * NamePtr =	Instrument filename minus txt extension.
- * ListNum =	PLAYER_xxx
+ * task =		LOAD_TASK queued by queueInstrument().
  *
- * If an error, copies a msg to TempBuffer[], and sets
- * ErrorStr to it. This alerts the Load thread to signal
- * the Main thread (with SIGNALMAIN_LOAD, as detected in
- * handleClientMsg). The Main thread then calls
- * serviceLoadThread to prompt the user whether to
- * continue load or abort. (Only the main thread does GUI).
- * Finally the Main thread informs the waiting Load thread
- * whether to resume or terminate.
+ * If an error, copies a msg to the task's ErrMsg[]. The
+ * Load thread later passes that msg to the Main thread
+ * (with SIGNALMAIN_LOAD, as detected in handleClientMsg)
+ * when it links the instrument in nextLoadedInstrument().
  */
 
-void loadInstrument(char * path, uint32_t offset, unsigned char roboNum)
+static void loadInstrument(register LOAD_TASK * task)
 {
 	register uint32_t	len;
 
-	ListNum = roboNum;
+	len = strlen(task->Name);
+
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	// If this robot plays the internal synth, map the instrument's bundle if it's
+	// up to date. Otherwise load the txt/wave files, and compile a new bundle
+	if ((task->Flags & LOADTASKFLAG_BUNDLE) && DevAssigns[task->ListNum] == &SoundDev[DEVNUM_AUDIOOUT])
+	{
+		if (!mapBundle(task, len)) return;
+		task->Flags |= LOADTASKFLAG_COMPILE;
+	}
+#endif
 
 	// Append the instrument txt file name
-	len = strlen(NamePtr);
-	memcpy(&path[offset], NamePtr, len);
-	strcpy(&path[offset+len], &TxtExtension[0]);
+	memcpy(&task->Path[task->Offset], task->Name, len);
+	strcpy(&task->Path[task->Offset+len], &TxtExtension[0]);
 
 	// Load the zones/waves
-	PickAttack = 0;
-	loadZones(&path[0], offset);
-	if (getErrorStr()) goto err;
+	task->Hdr.PgmNum = 0xFF;
+	if (!(task->Zones = loadZones(task)) && task->ErrMsg[0])
+		task->Flags |= LOADTASKFLAG_FAILED;
 
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-	if (LoadedZones)
-#endif
+	// load release map?
+	else if (task->Zones && task->ListNum && (SoundDev[DEVNUM_AUDIOOUT].DevFlags & DEVFLAG_DEVTYPE_MASK) && (task->Hdr.Options & 0x01))
 	{
-		register INS_INFO *	patch;
-		register INS_INFO *	list;
+		LOAD_HDR		hdr;
 
-		// For HIDE option, a blank kit name doesn't display
-		if (!ListNum && (Options & INSFLAG_HIDDEN)) len = 0;
+		// The instrument's header settings apply, not the release map's
+		memcpy(&hdr, &task->Hdr, sizeof(LOAD_HDR));
+		memcpy(&task->Path[task->Offset], task->Name, len);
+		strcpy(&task->Path[task->Offset+len], ".rel");
+		task->Flags |= LOADTASKFLAG_RELEASE;
+		task->ReleaseZones = loadZones(task);
+		memcpy(&task->Hdr, &hdr, sizeof(LOAD_HDR));
 
-		// Alloc a INS_INFO and link it into the list, ordered by pgm #
-		if (!(patch = (INS_INFO *)malloc(sizeof(INS_INFO) + len)))
-		{
-			setMemErrorStr();
-err:
+		// If the release map failed, so does the instrument. Don't let it play
+		// without its releases. free_load_task() unloads its zones
+		if (task->ErrMsg[0]) task->Flags |= LOADTASKFLAG_FAILED;
+	}
+
+	// Compile the bundle if everything loaded without error
+	if ((task->Flags & LOADTASKFLAG_COMPILE) && task->Zones && !task->ErrMsg[0] && WhatToLoadFlag)
+		writeBundle(task, len);
+	if (task->Sources) free(task->Sources);
+	task->Sources = 0;
+#endif
+
+	// Done with the parse buffer
+	if (task->Buffer) free(task->Buffer);
+	task->Buffer = 0;
+}
+
+static void run_load_task(register LOAD_TASK * task)
+{
+	// Main thread wants us to abort? Then skip the load
+	if (WhatToLoadFlag) loadInstrument(task);
+
+	// Let the Load thread know this task is done
+	pthread_mutex_lock(&LoadMutex);
+	task->Flags |= LOADTASKFLAG_DONE;
+	pthread_cond_broadcast(&LoadCondition);
+	pthread_mutex_unlock(&LoadMutex);
+}
+
+static void free_load_task(register LOAD_TASK * task)
+{
+	if (getErrorStr() == task->ErrMsg) setErrorStr(0);
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-			unloadZones(LoadedZones);
+	if (task->Bundle)
+		unmapBundle(task->Bundle);
+	else
+	{
+		unloadZones(task->Zones);
+		unloadZones(task->ReleaseZones);
+	}
+	if (task->Sources) free(task->Sources);
 #endif
-			return;
-		}
+	if (task->Buffer) free(task->Buffer);
+	free(task);
+}
 
-		list = (INS_INFO *)&InstrumentLists[ListNum];
-		while (list->Next && list->Next->PgmNum < VolBoost) list = list->Next;
-		patch->Next = list->Next;
-		list->Next = patch;
 
-		memcpy(patch->Name, NamePtr, len);
-		patch->Name[len] = 0;
 
-		patch->ReleaseZones = 0;
-		patch->Zones = LoadedZones;
 
-		if (len) NumOfInstruments[ListNum]++;
 
-		if (!ListNum)
-		{
-			patch->Sub.Kit = 0;
+/****************** loadWorkerThread() ******************
+ * A Load worker thread. Grabs the next queued LOAD_TASK
+ * and loads it, until there are no more tasks.
+ */
+
+static void * loadWorkerThread(void * arg)
+{
+	register LOAD_TASK *	task;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&LoadMutex);
+		if ((task = LoadTaskNext)) LoadTaskNext = task->Next;
+		pthread_mutex_unlock(&LoadMutex);
+		if (!task) break;
+
+		run_load_task(task);
+	}
+
+	return 0;
+}
+
+
+
+
+
+/****************** queueInstrument() *******************
+ * Queues one Instrument (kit/bass/etc) to be loaded when
+ * startInstrumentLoad() is called. Called by the Load
+ * thread.
+ *
+ * path =		Nul-terminated full pathname to data dir.
+ * offset =		Byte offset to the end of dir in 'path'.
+ * name =		Instrument filename minus txt extension.
+ * roboNum =	PLAYER_xxx
+ *
+ * RETURN: 0 if success, or non-zero if out of RAM (and
+ * ErrorStr is set).
+ */
+
+int queueInstrument(const char * path, uint32_t offset, const char * name, unsigned char roboNum)
+{
+	register LOAD_TASK *	task;
+	register uint32_t		len;
+
+	len = strlen(name);
+	if (!(task = (LOAD_TASK *)malloc(sizeof(LOAD_TASK) + len)))
+	{
+		setMemErrorStr();
+		return -1;
+	}
+
+	memset(task, 0, sizeof(LOAD_TASK));
+	memcpy(task->Name, name, len + 1);
+	memcpy(task->Path, path, offset);
+	task->Offset = offset;
+	task->ListNum = roboNum;
+	if (AppFlags4 & APPFLAG4_BUNDLES) task->Flags = LOADTASKFLAG_BUNDLE;
+	if (AppFlags4 & APPFLAG4_SHAREPOOL) task->Flags |= LOADTASKFLAG_POOL;
+	if (AppFlags4 & APPFLAG4_COMPACT) task->Flags |= LOADTASKFLAG_COMPACT;
+
+	// Append to the end of the list, so instruments are linked in the
+	// order queued
+	*LoadTaskTail = task;
+	LoadTaskTail = &task->Next;
+
+	return 0;
+}
+
+
+
+
+
+/***************** startInstrumentLoad() *****************
+ * Starts the Load worker threads loading the instruments
+ * queued by queueInstrument(). Called by the Load thread.
+ *
+ * We start one worker per CPU core (minus the core for the
+ * Load thread itself, which also helps load while it waits
+ * in nextLoadedInstrument), but no more workers than
+ * instruments.
+ */
+
+void startInstrumentLoad(void)
+{
+	register LOAD_TASK *	task;
+	register long			num;
+
+	LoadTaskNext = task = LoadTasks;
+	LoadTaskLinked = 0;
+	NumLoadThreads = 0;
+
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-			patch->Sub.Hash = SubKit;	// Resolve it later below after all kits loaded
+	if (AppFlags4 & APPFLAG4_SHAREPOOL) openPool();
+#endif
+
+	num = sysconf(_SC_NPROCESSORS_ONLN);
+#ifdef JG_LOAD_TIMING
+	{
+	register const char *	str;
+
+	// BB_LOAD_THREADS overrides the # of cores, to compare load times
+	if ((str = getenv("BB_LOAD_THREADS"))) num = atoi(str);
+
+	clock_gettime(CLOCK_MONOTONIC, &LoadStartTime);
+	NumLoadTasks = 0;
+	LoadFileBytes = LoadWaveBytes = 0;
+	while (task)
+	{
+		NumLoadTasks++;
+		task = task->Next;
+	}
+	task = LoadTasks;
+	}
 #endif
-			patch->PgmNum = VolBoost++;
+	if (num > MAX_LOAD_THREADS) num = MAX_LOAD_THREADS;
+
+	// If we can't start some workers, the Load thread will pick up the slack
+	while (task && NumLoadThreads < num - 1)
+	{
+		if (pthread_create(&LoadThreads[NumLoadThreads], 0, loadWorkerThread, 0)) break;
+		NumLoadThreads++;
+		task = task->Next;
+	}
+}
+
+
+
+
+
+/**************** nextLoadedInstrument() *****************
+ * Waits for the next queued instrument to be loaded, and
+ * links its INS_INFO into InstrumentLists[], ordered by pgm
+ * #. Instruments are linked in the order they were queued,
+ * regardless of which worker finishes first. So the lists
+ * (and the pgm #s assigned to kits) are the same no matter
+ * how many workers load. Called by the Load thread.
+ *
+ * RETURN: The instrument name, or 0 if no more. If an error
+ * loading that instrument, ErrorStr is set, and the caller
+ * must post it to the Main thread before calling here again.
+ */
+
+const char * nextLoadedInstrument(void)
+{
+	register LOAD_TASK *	task;
+
+	// Free the task we previously linked
+	if ((task = LoadTaskLinked))
+	{
+		LoadTasks = task->Next;
+		free_load_task(task);
+		LoadTaskLinked = 0;
+	}
+
+	setErrorStr(0);
+	if (!(task = LoadTasks)) return 0;
+
+	// Wait for a worker to finish this task. Meanwhile, help load
+	// any task that a worker hasn't yet grabbed
+	pthread_mutex_lock(&LoadMutex);
+	while (!(task->Flags & LOADTASKFLAG_DONE))
+	{
+		register LOAD_TASK *	next;
+
+		if ((next = LoadTaskNext))
+		{
+			LoadTaskNext = next->Next;
+			pthread_mutex_unlock(&LoadMutex);
+			run_load_task(next);
+			pthread_mutex_lock(&LoadMutex);
 		}
+		else
+			pthread_cond_wait(&LoadCondition, &LoadMutex);
+	}
+	pthread_mutex_unlock(&LoadMutex);
+
+	LoadTaskLinked = task;
+
+	// Indicate this robot has waves
+	if (task->Flags & LOADTASKFLAG_WAVES) WavesLoadedFlag |= (0x04 << task->ListNum);
+
+	// PGM sets the pgm # of this kit, and subsequent kits without a PGM
+	if (task->Hdr.PgmNum < 128) VolBoost = task->Hdr.PgmNum;
+
+	if (task->ErrMsg[0]) setErrorStr(task->ErrMsg);
+
+	if (!(task->Flags & LOADTASKFLAG_FAILED)
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+		&& task->Zones
+#endif
+		)
+	{
+		register INS_INFO *	patch;
+		register INS_INFO *	list;
+		register uint32_t		len;
+
+		// For HIDE option, a blank kit name doesn't display
+		len = strlen(task->Name);
+		if (!task->ListNum && (task->Hdr.Options & INSFLAG_HIDDEN)) len = 0;
+
+		// Alloc a INS_INFO and link it into the list, ordered by pgm #
+		if (!(patch = (INS_INFO *)malloc(sizeof(INS_INFO) + len)))
+			setMemErrorStr();
 		else
 		{
-			patch->PgmNum = VolBoost;
+			list = (INS_INFO *)&InstrumentLists[task->ListNum];
+			while (list->Next && list->Next->PgmNum < VolBoost) list = list->Next;
+			patch->Next = list->Next;
+			list->Next = patch;
+
+			memcpy(patch->Name, task->Name, len);
+			patch->Name[len] = 0;
 
-			patch->Sub.Patch.Transpose = TransposeVal * 12;
-			patch->Sub.Patch.BankMsb = BankNums[4*2];
-			patch->Sub.Patch.BankLsb = BankNums[(4*2)+1];
-			patch->Sub.Patch.Flags = Options;
+			// The INS_INFO now owns the zones (and any bundle they're in)
+			patch->Zones = task->Zones;
+			patch->ReleaseZones = task->ReleaseZones;
+			patch->Bundle = task->Bundle;
+			task->Zones = task->ReleaseZones = 0;
+			task->Bundle = 0;
 
+			if (len) NumOfInstruments[task->ListNum]++;
+
+			if (!task->ListNum)
+			{
+				patch->Sub.Kit = 0;
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
-			// load release map?
-			if ((SoundDev[DEVNUM_AUDIOOUT].DevFlags & DEVFLAG_DEVTYPE_MASK) && (Options & 0x01))
+				patch->Sub.Hash = task->Hdr.SubKit;	// Resolve it later in finishWaveLoad() after all kits loaded
+#endif
+				patch->PgmNum = VolBoost++;
+			}
+			else
 			{
-				memcpy(&path[offset], NamePtr, len);
-				strcpy(&path[offset+len], ".rel");
-				PickAttack = 1;
-				loadZones(&path[0], offset);
-				if (getErrorStr()) goto err;
-				patch->ReleaseZones = LoadedZones;
+				patch->PgmNum = VolBoost;
+
+				patch->Sub.Patch.Transpose = task->Hdr.TransposeVal * 12;
+				patch->Sub.Patch.BankMsb = task->Hdr.BankMsb;
+				patch->Sub.Patch.BankLsb = task->Hdr.BankLsb;
+				patch->Sub.Patch.Flags = task->Hdr.Options;
 			}
-#endif
 		}
 	}
+
+	return task->Name;
+}
+
+
+
+
+
+/****************** endInstrumentLoad() ******************
+ * Waits for the Load worker threads to terminate, and frees
+ * any queued instruments not linked (ie, because the user
+ * aborted). Called by the Load thread.
+ */
+
+void endInstrumentLoad(void)
+{
+	register LOAD_TASK *	task;
+#ifdef JG_LOAD_TIMING
+	register uint32_t		numThreads;
+
+	numThreads = NumLoadThreads + 1;
+#endif
+
+	// Don't let workers grab any more tasks
+	pthread_mutex_lock(&LoadMutex);
+	LoadTaskNext = 0;
+	pthread_mutex_unlock(&LoadMutex);
+
+	while (NumLoadThreads) pthread_join(LoadThreads[--NumLoadThreads], 0);
+
+	while ((task = LoadTasks))
+	{
+		LoadTasks = task->Next;
+		free_load_task(task);
+	}
+	LoadTaskLinked = 0;
+	LoadTaskTail = &LoadTasks;
+
+#ifdef JG_LOAD_TIMING
+	{
+	struct timespec	endTime;
+	register uint32_t	msecs;
+
+	clock_gettime(CLOCK_MONOTONIC, &endTime);
+	msecs = (uint32_t)(((endTime.tv_sec - LoadStartTime.tv_sec) * 1000) + ((endTime.tv_nsec - LoadStartTime.tv_nsec) / 1000000));
+	printf("Loaded %u instruments with %u threads in %u msecs\r\n", NumLoadTasks, numThreads, msecs);
+	if (!msecs) msecs = 1;
+	printf("Read %u KB of .cmp files for %u KB of waves (%u KB/sec of waves)\r\n", (uint32_t)(LoadFileBytes >> 10), (uint32_t)(LoadWaveBytes >> 10),
+		(uint32_t)((LoadWaveBytes * 1000 / msecs) >> 10));
+	}
+#endif
 }
 
 
@@ -2247,9 +4380,47 @@ void ignoreErrors(void)
 
 static void clear_mix_buf(snd_pcm_uframes_t numFrames)
 {
-	MixBuffEnd = MixBuffPtr + (numFrames * 2 * sizeof(float));
+	MixBuffEnd = MixBuffPtr + (numFrames * MixChans * sizeof(float));
 	memset(MixBuffPtr, 0, MixBuffEnd - MixBuffPtr);
-	memset(ReverbBuffPtr, 0, MixBuffEnd - MixBuffPtr);
+	memset(ReverbBuffPtr, 0, numFrames * 2 * sizeof(float));
+}
+
+/******************* setOutputPair() *******************
+ * Sets/gets which chan pair of audio out a musician (or
+ * OUTPUT_REVERB for the reverb return) plays on. Takes
+ * effect when audio out is next opened.
+ */
+
+void setOutputPair(register unsigned char musicianNum, register unsigned char pair)
+{
+	if (musicianNum <= OUTPUT_REVERB && pair < MAX_OUT_PAIRS) OutPairs[musicianNum] = pair;
+}
+
+unsigned char getOutputPair(register unsigned char musicianNum)
+{
+	return OutPairs[musicianNum];
+}
+
+/******************* setup_outputs() *******************
+ * Sets MixChans and MixOffsets[] per OutPairs[], when
+ * audio out is opened.
+ *
+ * chans = # of chans audio out has. A musician routed
+ * to a pair it lacks plays on the first pair.
+ */
+
+static void setup_outputs(register uint32_t chans)
+{
+	register unsigned char	i, offset;
+
+	MixChans = 2;
+	for (i = 0; i <= OUTPUT_REVERB; i++)
+	{
+		offset = OutPairs[i] * 2;
+		if (offset + 2 > chans) offset = 0;
+		MixOffsets[i] = offset;
+		if (offset + 2 > MixChans) MixChans = offset + 2;
+	}
 }
 
 void set_vol_factor(register VOICE_INFO * voiceInfo)
@@ -2274,6 +4445,86 @@ void set_vol_factor(register VOICE_INFO * voiceInfo)
 	}
 }
 
+/********************* decodeBlock() ********************
+ * Returns a ptr to the 16-bit sample at the specified
+ * offset in a compacted wave, decoding its ADPCM block into
+ * the voice's Decoded[] if it isn't already there. For a
+ * stereo wave, the right chan sample follows. Called by the
+ * Audio thread.
+ *
+ * The mixer reads only forward (except for wrapping to the
+ * loop start), so consecutive blocks alternate between the
+ * two Decoded[] buffers, and each block is decoded once.
+ */
+
+static const short	AdpcmSilence[2] = {0, 0};
+
+static short * decodeBlock(register VOICE_INFO * voiceInfo, register WAVEFORM_INFO * waveInfo, register uint32_t offset)
+{
+	register uint32_t	block;
+	register unsigned char	slot, chans;
+
+	// Linear interpolation may ask for the sample past the end
+	if (offset >= waveInfo->WaveformLen) return (short *)&AdpcmSilence[0];
+
+	chans = (waveInfo->WaveFlags ? 2 : 1);
+	block = (offset / chans) >> ADPCM_BLOCK_SHIFT;
+	slot = block & 1;
+	if (voiceInfo->DecodedWave[slot] != waveInfo || voiceInfo->DecodedBlock[slot] != block)
+	{
+		register unsigned char *	nibbles;
+		register ADPCM_CHAN *		hdr;
+		unsigned char					chan;
+
+		hdr = (ADPCM_CHAN *)&waveInfo->WaveForm[block * ADPCM_BLOCK_SIZE * chans];
+		nibbles = (unsigned char *)(hdr + chans);
+		for (chan = 0; chan < chans; chan++)
+		{
+			register short *	dest;
+			register uint32_t	i;
+			register int		pred;
+			unsigned char		index;
+
+			dest = &voiceInfo->Decoded[slot][0];
+			dest[chan] = pred = hdr[chan].Pt;
+			if ((index = hdr[chan].Index) > 88) index = 88;
+			for (i = chans + chan; i < ADPCM_BLOCK_FRAMES * chans; i += chans)
+				dest[i] = pred = adpcmStep((nibbles[i >> 1] >> ((i & 1) << 2)) & 0x0F, pred, &index);
+		}
+
+		voiceInfo->DecodedWave[slot] = waveInfo;
+		voiceInfo->DecodedBlock[slot] = block;
+	}
+
+	return &voiceInfo->Decoded[slot][offset - ((block << ADPCM_BLOCK_SHIFT) * chans)];
+}
+
+/******************** recordMix() *******************
+ * Called by the audio thread to copy numFrames of the mix
+ * into the recorder's ring. Never waits. If the writer
+ * has fallen behind, the frames are dropped and counted.
+ */
+
+static void recordMix(register uint32_t numFrames)
+{
+	register uint32_t		head, pos, count;
+
+	head = RecHead;
+	if (RecFrames - (head - __atomic_load_n(&RecTail, __ATOMIC_ACQUIRE)) < numFrames)
+		__atomic_add_fetch(&RecDrops, 1, __ATOMIC_RELAXED);
+	else
+	{
+		// Copy up to the end of the ring, then any rest to its start
+		pos = head & (RecFrames - 1);
+		if ((count = RecFrames - pos) > numFrames) count = numFrames;
+		memcpy(&RecBuffer[pos * MixChans], MixBuffPtr, count * MixChans * sizeof(float));
+		if (count < numFrames) memcpy(RecBuffer, MixBuffPtr + (count * MixChans * sizeof(float)), (numFrames - count) * MixChans * sizeof(float));
+
+		// Let recordThread() see the new frames
+		__atomic_store_n(&RecHead, head + numFrames, __ATOMIC_RELEASE);
+	}
+}
+
 /******************** mixPlayingVoices() *******************
  * Fills the audio card's circular buffer with a mix of all
  * the currently playing waveform data.
@@ -2332,19 +4583,58 @@ again:
 		float *						mixBuffPtr;
 		uint32_t						loopend, numWavePts;
 		float							volumeFactor, s16;
+		short							decoded[4];
 #ifndef NO_REVERB_SUPPORT
 		float *						revBuffPtr;
+#endif
+#ifdef JG_MIX_TIMING
+		struct timespec			startTime;
 #endif
 		// Lock this voice while we mix it into the output buffer. If Lock is already
 		// > 1, then another thread wants to steal the voice, so do nothing with it
 		if (__atomic_or_fetch(&voiceInfo->Lock, 0x01, __ATOMIC_RELAXED) != 0x01) goto nextVoice;
 
-		// Get the mix buffer
-		mixBuffPtr = (float *)MixBuffPtr;
+		// Get the mix buffer, at this musician's chan pair
+		mixBuffPtr = (float *)MixBuffPtr + MixOffsets[voiceInfo->Musician];
 #ifndef NO_REVERB_SUPPORT
 		revBuffPtr = (float *)ReverbBuffPtr;
 #endif
 
+		// Not yet time to start the voice? Or start it at a frame inside this block?
+		if ((i = voiceInfo->StartFrame))
+		{
+			i -= MixFrames;
+			if ((int32_t)i >= (int32_t)numFrames) goto nextVoice;
+			voiceInfo->StartFrame = 0;
+			if ((int32_t)i > 0)
+			{
+				mixBuffPtr += (i * MixChans);
+#ifndef NO_REVERB_SUPPORT
+				revBuffPtr += (i * 2);
+#endif
+			}
+			else
+				i = 0;
+		}
+
+		// Measure how far from its place on the PPQN grid a beat note starts
+		if (voiceInfo->BeatFrame)
+		{
+			register int32_t		onset;
+
+			onset = (int32_t)(MixFrames + i - voiceInfo->BeatFrame);
+			voiceInfo->BeatFrame = 0;
+			if (BeatOnsetReset)
+			{
+				BeatOnsetReset = 0;
+				BeatOnsetMin = BeatOnsetMax = onset;
+				BeatLate = 0;
+			}
+			else if (onset < BeatOnsetMin) BeatOnsetMin = onset;
+			else if (onset > BeatOnsetMax) BeatOnsetMax = onset;
+			if (onset > 0 && BeatSched) BeatLate++;
+		}
+
 		// Delay the note? We check this once only on voice start
 		if ((i = voiceInfo->AttackDelay))
 		{
@@ -2361,7 +4651,7 @@ again:
 
 			// Delay the note by starting at a later point in the buf. Code
 			// above makes sure we don't overrun
-			mixBuffPtr += (i * 2);
+			mixBuffPtr += (i * MixChans);
 			revBuffPtr += (i * 2);
 		}
 
@@ -2408,6 +4698,9 @@ again:
 
 		// Mix this voice
 		numWavePts = waveInfo->WaveformLen;
+#ifdef JG_MIX_TIMING
+		clock_gettime(CLOCK_MONOTONIC, &startTime);
+#endif
 		while ((char *)mixBuffPtr < MixBuffEnd)
 		{
 			register char *	sampPtr;
@@ -2442,6 +4735,7 @@ again:
 
 				// Let other threads know this voice is now free
 				voiceInfo->AudioFuncFlags = 0;
+				voiceInfo->DecodedWave[0] = voiceInfo->DecodedWave[1] = 0;
 
 				// Unlock the voice. This "wakes" any thread sleeping in lockVoice()
 				__atomic_and_fetch(&voiceInfo->Lock, ~0x01, __ATOMIC_RELAXED);
@@ -2503,8 +4797,19 @@ fade:					voiceInfo->ReleaseTime = DecayRate * (uint32_t)voiceInfo->FadeOut;
 				}
 			}
 
-			// Get current 16-bit sample for the left chan
-			if (i < waveInfo->CompressPoint)
+			// Get current 16-bit sample for the left chan. For a compacted wave, copy
+			// the frame out of the decoded block, because fetching the next point may
+			// decode over that block (when wrapping to the loop start). Note: a compacted
+			// wave's CompressPoint is its WaveformLen, so below we treat it as 16-bit
+			if (waveInfo->MemFlags & WAVEMEM_ADPCM)
+			{
+				sampPtr = (char *)decodeBlock(voiceInfo, waveInfo, i);
+				decoded[0] = ((short *)sampPtr)[0];
+				decoded[1] = ((short *)sampPtr)[1];
+				sampPtr = (char *)&decoded[0];
+				s16 = decoded[0];
+			}
+			else if (i < waveInfo->CompressPoint)
 			{
 				sampPtr = (char *)waveInfo->WaveForm + (i << 1);
 				s16 = *((short *)sampPtr);
@@ -2520,7 +4825,15 @@ fade:					voiceInfo->ReleaseTime = DecayRate * (uint32_t)voiceInfo->FadeOut;
 			// We need to factor in the next sample pt for linear interpolation, so get that sample
 			i2 = i + (waveInfo->WaveFlags ? 2 : 1);
 			while (i2 >= loopend) i2 -= (loopend - waveInfo->LoopBegin);
-			if (i2 < waveInfo->CompressPoint)
+			if (waveInfo->MemFlags & WAVEMEM_ADPCM)
+			{
+				sampPtr = (char *)decodeBlock(voiceInfo, waveInfo, i2);
+				decoded[2] = ((short *)sampPtr)[0];
+				decoded[3] = ((short *)sampPtr)[1];
+				sampPtr = (char *)&decoded[2];
+				pt = decoded[2];
+			}
+			else if (i2 < waveInfo->CompressPoint)
 			{
 				sampPtr = (char *)waveInfo->WaveForm + (i2 << 1);
 				pt = *((short *)sampPtr);
@@ -2541,7 +4854,7 @@ fade:					voiceInfo->ReleaseTime = DecayRate * (uint32_t)voiceInfo->FadeOut;
 #ifndef NO_REVERB_SUPPORT
 			*revBuffPtr++ += (val * voiceInfo->Zone->Reverb) / 255.0f;
 #endif
-			*mixBuffPtr++ += val;
+			mixBuffPtr[0] += val;
 
 			// Repeat for the other (right) audio chan. If stereo wave, then we need to get that point
 			if (waveInfo->WaveFlags)
@@ -2568,7 +4881,8 @@ fade:					voiceInfo->ReleaseTime = DecayRate * (uint32_t)voiceInfo->FadeOut;
 #ifndef NO_REVERB_SUPPORT
 			*revBuffPtr++ += (val * voiceInfo->Zone->Reverb) / 255.0f;
 #endif
-			*mixBuffPtr++ += val;
+			mixBuffPtr[1] += val;
+			mixBuffPtr += MixChans;
 			}
 
 			// Update pointer to next sample point, applying linear interpolation
@@ -2579,6 +4893,25 @@ fade:					voiceInfo->ReleaseTime = DecayRate * (uint32_t)voiceInfo->FadeOut;
 		voiceInfo->TransposeFracPos = transposeFracPos;
 		voiceInfo->VolumeFactor = volumeFactor;
 
+#ifdef JG_MIX_TIMING
+		// Average the time to mix one voice for one buffer, separately for compacted waves
+		{
+		static uint64_t		mixTime[2];
+		static uint32_t		mixCount[2];
+		struct timespec		endTime;
+		register unsigned char	type;
+
+		clock_gettime(CLOCK_MONOTONIC, &endTime);
+		type = (waveInfo->MemFlags & WAVEMEM_ADPCM) ? 1 : 0;
+		mixTime[type] += ((endTime.tv_sec - startTime.tv_sec) * 1000000000ULL) + endTime.tv_nsec - startTime.tv_nsec;
+		if (++mixCount[type] >= 10000)
+		{
+			printf("%s voice: %u nsecs per %u frames\r\n", type ? "Compacted" : "16-bit", (uint32_t)(mixTime[type] / mixCount[type]), (uint32_t)numFrames);
+			mixTime[type] = mixCount[type] = 0;
+		}
+		}
+#endif
+
 nextVoice:
 		queuePtr = voiceInfo;
 		voiceInfo = queuePtr->Next;
@@ -2618,28 +4951,57 @@ nextVoice:
 	mixBuffPtr = (float *)MixBuffPtr;
 
 #ifndef NO_REVERB_SUPPORT
-	// Add reverb
+	// Add reverb, to its chan pair
 	if (Reverb && !(APPFLAG3_NOREVERB & TempFlags))
-		ReverbProcess(Reverb, (float *)ReverbBuffPtr, mixBuffPtr, numFrames);
+	{
+		if (MixChans == 2)
+			ReverbProcess(Reverb, (float *)ReverbBuffPtr, mixBuffPtr, numFrames);
+		else
+		{
+			register float *		revBuffPtr;
+			register float *		dest;
+			register uint32_t		i;
+
+			revBuffPtr = (float *)RevOutBuffPtr;
+			memset(revBuffPtr, 0, numFrames * 2 * sizeof(float));
+			ReverbProcess(Reverb, (float *)ReverbBuffPtr, revBuffPtr, numFrames);
+			dest = mixBuffPtr + MixOffsets[OUTPUT_REVERB];
+			for (i = 0; i < numFrames; i++)
+			{
+				dest[0] += *revBuffPtr++;
+				dest[1] += *revBuffPtr++;
+				dest += MixChans;
+			}
+		}
+	}
 #endif
 
+	// Give the mix to the recorder
+	if (RecBuffer) recordMix(numFrames);
+
+	MixFrames += numFrames;
+
 	mastervol = VolFactors[MasterVolAdjust] * 2.5f;
 
-	// Apply master vol
+	// Apply master vol. Note: These loops are kept simple (no ptr
+	// increments, no aliasing of MixBuffPtr) so the compiler turns
+	// them into SIMD, since there may be 16 chans to convert
 #ifndef NO_JACK_SUPPORT
 #ifndef NO_ALSA_AUDIO_SUPPORT
-	if (!SoundDev[DEVNUM_AUDIOOUT].DevHash)
+	if (IS_JACK_OUT())
 #endif
 	{
-		register float *	pMixBuffL;
-		register float *	pMixBuffR;
+		register float *			dest;
+		register uint32_t			i;
+		register unsigned char	chan;
 
-		pMixBuffL = (float *)MixBufferPtr[0];
-		pMixBuffR = (float *)MixBufferPtr[1];
-		while ((char *)mixBuffPtr < MixBuffEnd)
+		// A separate port per chan
+		mastervol /= (float)INT_MAX;
+		for (chan = 0; chan < MixChans; chan++)
 		{
-			*pMixBuffL++ = (*mixBuffPtr++ * mastervol) / (float)INT_MAX;
-			*pMixBuffR++ = (*mixBuffPtr++ * mastervol) / (float)INT_MAX;
+			dest = (float *)MixBufferPtr[chan];
+			for (i = 0; i < numFrames; i++)
+				dest[i] = mixBuffPtr[(i * MixChans) + chan] * mastervol;
 		}
 	}
 #ifndef NO_ALSA_AUDIO_SUPPORT
@@ -2648,155 +5010,1487 @@ nextVoice:
 #endif
 #ifndef NO_ALSA_AUDIO_SUPPORT
 	{
-		register int32_t *		pMixBuffL;
-		register int32_t *		pMixBuffR;
+		register int32_t *		dest;
+		register uint32_t			i;
 
-		pMixBuffL = (int32_t *)MixBufferPtr[0];
 		if (NonInterleaveFlag)
 		{
-			pMixBuffR = (int32_t *)MixBufferPtr[1];
-			while ((char *)mixBuffPtr < MixBuffEnd)
+			register unsigned char	chan;
+
+			for (chan = 0; chan < MixChans; chan++)
+			{
+				dest = MixBufferPtr[chan];
+				for (i = 0; i < numFrames; i++)
+					dest[i] = (int32_t)(mixBuffPtr[(i * MixChans) + chan] * mastervol);
+			}
+		}
+		else
+		{
+			dest = MixBufferPtr[0];
+
+			// Our mix has the card's layout? Then it's one straight run
+			if (MixChans == NumChans)
+			{
+				register uint32_t		count;
+
+				count = numFrames * MixChans;
+				for (i = 0; i < count; i++)
+					dest[i] = (int32_t)(mixBuffPtr[i] * mastervol);
+			}
+			else while ((char *)mixBuffPtr < MixBuffEnd)
 			{
-				*pMixBuffL++ = (int32_t)(*mixBuffPtr++ * mastervol);
-				*pMixBuffR++ = (int32_t)(*mixBuffPtr++ * mastervol);
+				for (i = 0; i < MixChans; i++)
+					dest[i] = (int32_t)(mixBuffPtr[i] * mastervol);
+
+				// Skip over interleaved channels we don't use
+				mixBuffPtr += MixChans;
+				dest += NumChans;
 			}
+#ifdef TEST_AUDIO_MIX
+			runWaveRecord((const char *)MixBufferPtr[0], numFrames * sizeof(int32_t) * 2);
+#endif
+		}
+	}
+	}
+#endif
+}
+
+
+
+
+/****************** writeWaveHeader() *******************
+ * Writes the 44-byte header of a WAV file of 32-bit
+ * float samples, for the specified bytes of wave data.
+ */
+
+static unsigned char * storeLE(register uint32_t val, register unsigned char * ptr, register unsigned char size)
+{
+	while (size--)
+	{
+		*ptr++ = (unsigned char)val;
+		val >>= 8;
+	}
+	return ptr;
+}
+
+static void writeWaveHeader(register int handle, register uint32_t bytes, register unsigned char chans)
+{
+	unsigned char					header[44];
+	register unsigned char *	ptr;
+
+	memcpy(&header[0], "RIFF", 4);
+	ptr = storeLE(bytes + sizeof(header) - 8, &header[4], 4);
+	memcpy(ptr, "WAVEfmt ", 8);
+	ptr = storeLE(16, ptr + 8, 4);
+	ptr = storeLE(WAVE_FORMAT_FLOAT, ptr, 2);
+	ptr = storeLE(chans, ptr, 2);
+	ptr = storeLE(Rates[SampleRateFactor], ptr, 4);
+	ptr = storeLE(Rates[SampleRateFactor] * chans * sizeof(int32_t), ptr, 4);
+	ptr = storeLE(chans * sizeof(int32_t), ptr, 2);
+	ptr = storeLE(32, ptr, 2);
+	memcpy(ptr, "data", 4);
+	storeLE(bytes, ptr + 4, 4);
+
+	pwrite(handle, &header[0], sizeof(header), 0);
+}
+
+
+
+
+
+/******************* openRecordFile() *******************
+ * Creates the recorder's next WAV file, named RecPath
+ * plus (after the first) a number, and writes its header.
+ *
+ * RETURN: 0 if success.
+ */
+
+static int openRecordFile(void)
+{
+	char		path[PATH_MAX + 16];
+
+	sprintf(&path[0], RecFileNum ? "%s-%u.wav" : "%s.wav", &RecPath[0], RecFileNum + 1);
+	RecBytes = 0;
+	if ((RecHandle = open(&path[0], O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1) return -1;
+
+	// Wave data follows the header, which we update when done
+	writeWaveHeader(RecHandle, 0, RecChans);
+	lseek(RecHandle, 44, SEEK_SET);
+	return 0;
+}
+
+static void closeRecordFile(void)
+{
+	if (RecHandle != -1)
+	{
+		writeWaveHeader(RecHandle, RecBytes, RecChans);
+		close(RecHandle);
+		RecHandle = -1;
+	}
+}
+
+/******************* recordThread() *******************
+ * Streams the recorder's ring to the WAV file, as 32-bit
+ * float, with master volume applied. For RECORD_MIX,
+ * folds all chan pairs down to stereo. Writes only when
+ * it has REC_WRITE_SIZE (or is told to stop), so it
+ * wakes seldom and the disk sees large writes.
+ *
+ * Runs at normal priority.
+ */
+
+static void * recordThread(void * arg)
+{
+	register float *			src;
+	register float *			dest;
+	register uint32_t			frames, i, pos, bytes, maxFrames;
+	register unsigned char	stop;
+
+	maxFrames = REC_WRITE_SIZE / (RecChans * sizeof(float));
+	for (;;)
+	{
+		stop = __atomic_load_n(&RecStop, __ATOMIC_ACQUIRE);
+		frames = __atomic_load_n(&RecHead, __ATOMIC_ACQUIRE) - RecTail;
+		if (frames < maxFrames && !stop)
+		{
+			usleep(100000);
+			continue;
+		}
+		if (!frames) break;
+
+		// Don't go past the end of the ring, or our write buffer
+		pos = RecTail & (RecFrames - 1);
+		if (frames > RecFrames - pos) frames = RecFrames - pos;
+		if (frames > maxFrames) frames = maxFrames;
+
+		{
+		register float		scale;
+
+		src = &RecBuffer[pos * MixChans];
+		dest = (float *)RecWriteBuf;
+		scale = VolFactors[MasterVolAdjust] * 2.5f / (float)INT_MAX;
+		if (RecChans == MixChans)
+		{
+			for (i = 0; i < frames * MixChans; i++)
+				dest[i] = src[i] * scale;
+		}
+		else for (i = 0; i < frames; i++)
+		{
+			register float				left, right;
+			register unsigned char	chan;
+
+			left = right = 0;
+			for (chan = 0; chan < MixChans; chan += 2)
+			{
+				left += src[chan];
+				right += src[chan + 1];
+			}
+			*dest++ = left * scale;
+			*dest++ = right * scale;
+			src += MixChans;
+		}
+		}
+
+		// Free that part of the ring for the audio thread
+		__atomic_store_n(&RecTail, RecTail + frames, __ATOMIC_RELEASE);
+
+		if (RecHandle != -1)
+		{
+			// WAV can't exceed 4G. Continue in a new file
+			bytes = frames * RecChans * sizeof(float);
+			if (RecBytes > 0xFFFFFFFF - 36 - bytes)
+			{
+				closeRecordFile();
+				RecFileNum++;
+				if (openRecordFile()) continue;
+			}
+
+			// If the disk fails, we stop writing, but keep draining the ring
+			if (write(RecHandle, RecWriteBuf, bytes) != (ssize_t)bytes)
+				closeRecordFile();
+			else
+				RecBytes += bytes;
+		}
+	}
+
+	return 0;
+}
+
+/******************* stopRecorder() *******************
+ * Stops the recorder thread, after it writes what's in
+ * the ring, and finishes the WAV file. The audio thread
+ * must already be stopped.
+ */
+
+static void stopRecorder(void)
+{
+	if (RecThreadHandle)
+	{
+		__atomic_store_n(&RecStop, 1, __ATOMIC_RELEASE);
+		pthread_join(RecThreadHandle, 0);
+		RecThreadHandle = 0;
+	}
+	closeRecordFile();
+	if (RecWriteBuf) free(RecWriteBuf);
+	if (RecBuffer) free(RecBuffer);
+	RecWriteBuf = 0;
+	RecBuffer = 0;
+}
+
+/******************* startRecorder() *******************
+ * If the user enabled recording, allocates the ring, and
+ * creates the WAV file (named for the current date and
+ * time in the user's BackupBand dir), and starts the
+ * recorder thread. Called once the audio out's MixChans
+ * and rate are set, but before the audio thread starts.
+ *
+ * name =	If not 0, records all outs to this WAV file
+ *			(for AUDIODEV_FILE) instead, regardless of the
+ *			user's setting.
+ *
+ * RETURN: Error msg if fail, 0 otherwise.
+ */
+
+static const char * startRecorder(register const char * name)
+{
+	if (RecMode || name)
+	{
+		RecChans = (RecMode == RECORD_MIX && !name ? 2 : MixChans);
+		RecHead = RecTail = RecDrops = 0;
+		RecStop = RecFileNum = 0;
+
+		// A power of 2 frames, so positions can wrap past 4G
+		RecFrames = 1 << 16;
+		while (RecFrames < Rates[SampleRateFactor] * REC_RING_SECS) RecFrames <<= 1;
+
+		// Touch the ring now, so the audio thread doesn't fault it in
+		if (!(RecBuffer = (float *)malloc(RecFrames * MixChans * sizeof(float))) || posix_memalign((void **)&RecWriteBuf, 4096, REC_WRITE_SIZE))
+		{
+			RecWriteBuf = 0;
+			stopRecorder();
+			return &NoMemStr[0];
+		}
+		memset(RecBuffer, 0, RecFrames * MixChans * sizeof(float));
+
+		{
+		time_t						now;
+		register uint32_t			len;
+
+		len = get_home_path(&RecPath[0]);
+		if (name) strcpy(&RecPath[len], name);
+		else
+		{
+			time(&now);
+			strftime(&RecPath[len], sizeof(RecPath) - len, "Rec-%Y%m%d-%H%M%S", localtime(&now));
+		}
+		}
+		if (openRecordFile())
+		{
+			stopRecorder();
+			return name ? "Can't create the audio out WAV file" : "Can't create the recording WAV file";
+		}
+
+		if (pthread_create(&RecThreadHandle, 0, recordThread, 0))
+		{
+			RecThreadHandle = 0;
+			stopRecorder();
+			return "Can't start the recorder thread";
+		}
+	}
+
+	return 0;
+}
+
+/******************* setRecordMode() *******************
+ * Sets whether the recorder saves the stereo mix, all
+ * output pairs, or nothing, the next time the audio out
+ * is opened. 0xFF queries.
+ */
+
+unsigned char setRecordMode(register unsigned char mode)
+{
+	if (mode <= RECORD_OUTS) RecMode = mode;
+	return RecMode;
+}
+
+/******************* getRecordDrops() *******************
+ * Returns how many periods the recorder has lost because
+ * its writer fell behind.
+ */
+
+uint32_t getRecordDrops(void)
+{
+	return __atomic_load_n(&RecDrops, __ATOMIC_RELAXED);
+}
+
+
+
+
+
+/******************** prefault_stack() ********************
+ * Touches the first RT_STACK_PREFAULT bytes of the calling
+ * thread's stack, so it never page faults there once it
+ * runs in realtime.
+ */
+
+static void __attribute__((noinline)) prefault_stack(void)
+{
+	volatile unsigned char	stack[RT_STACK_PREFAULT];
+	register uint32_t			i;
+
+	for (i = 0; i < sizeof(stack); i += 4096) stack[i] = 0;
+}
+
+/***************** set_thread_priority() *****************
+ * Called by the audio, beat play, and MIDI in threads when
+ * they start, to set their realtime priority, and pin them
+ * to the user's choice of CPU.
+ *
+ * thread = RTTHREAD_AUDIO, RTTHREAD_BEAT, or RTTHREAD_MIDIIN.
+ *
+ * RETURN: 0 if success, or pthread_setschedparam() error.
+ */
+
+int set_thread_priority(register unsigned char thread)
+{
+	struct sched_param	params;
+	register int			err;
+
+	// Audio thread highest. Beat play and MIDI in slightly less, but > GUI thread
+	params.sched_priority = (thread == RTTHREAD_AUDIO ? AudioThreadPriority : SecondaryThreadPriority);
+	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &params);
+
+	if (ThreadCpus[thread])
+	{
+		cpu_set_t	cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(ThreadCpus[thread] - 1, &cpus);
+		sched_setaffinity(0, sizeof(cpus), &cpus);
+	}
+
+	prefault_stack();
+
+	return err;
+}
+
+/****************** create_rt_thread() *******************
+ * Creates the audio, beat play, MIDI in, or a MIDI out
+ * thread, with a stack of RT_STACK_SIZE. arg is passed
+ * to the thread.
+ *
+ * RETURN: 0 if success, or pthread_create() error.
+ */
+
+int create_rt_thread(pthread_t * handle, void * (*func)(void *), void * arg)
+{
+	pthread_attr_t		attr;
+	register int		err;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, RT_STACK_SIZE);
+	err = pthread_create(handle, &attr, func, arg);
+	pthread_attr_destroy(&attr);
+	return err;
+}
+
+/******************** setThreadCpu() *********************
+ * Sets/gets which CPU an RTTHREAD_ is pinned to. Takes
+ * effect when the thread next starts.
+ *
+ * cpu =	0 for any, else CPU # + 1. 0xFF to query.
+ */
+
+unsigned char setThreadCpu(register unsigned char thread, register unsigned char cpu)
+{
+	if (cpu != 0xFF && cpu <= getNumCpus()) ThreadCpus[thread] = cpu;
+	return ThreadCpus[thread];
+}
+
+unsigned char getNumCpus(void)
+{
+	register long	count;
+
+	count = sysconf(_SC_NPROCESSORS_CONF);
+	return (count < 1 ? 1 : (count > 254 ? 254 : (unsigned char)count));
+}
+
+/******************** checkRealtime() ********************
+ * Checks that the user's limits let our threads run at
+ * realtime priority, and let us lock our RAM (so a page
+ * fault never stalls the audio thread). If so, locks RAM.
+ * Called once at startup, before loading the waves.
+ *
+ * buffer =	Where to format an error msg.
+ *
+ * RETURN: Msg describing what we lack, or 0 if nothing.
+ */
+
+const char * checkRealtime(register char * buffer)
+{
+	struct rlimit		limit;
+	register char *	ptr;
+
+	ptr = buffer;
+
+	// Our RT priorities must fit under the rtprio limit. Root has none. If it's lower, but
+	// not 0, then use what it allows
+	if (geteuid() && !getrlimit(RLIMIT_RTPRIO, &limit) && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < (rlim_t)AudioThreadPriority)
+	{
+		if (limit.rlim_cur >= (rlim_t)SecondaryThreadPriority)
+			AudioThreadPriority = (int)limit.rlim_cur;
+		else
+			ptr += sprintf(ptr, "Your rtprio limit is %u, so BackupBand's audio, beat and MIDI in threads run at normal priority. \
+Their timing may suffer whenever other software is busy.", (unsigned int)limit.rlim_cur);
+	}
+
+	// Lock RAM only if the memlock limit is unlimited. Otherwise, MCL_FUTURE would fail our
+	// later allocations once we hit the limit
+	if ((geteuid() || mlockall(MCL_CURRENT|MCL_FUTURE)) &&
+		(getrlimit(RLIMIT_MEMLOCK, &limit) || limit.rlim_cur != RLIM_INFINITY || mlockall(MCL_CURRENT|MCL_FUTURE)))
+	{
+		if (ptr != buffer) *ptr++ = ' ';
+		ptr += sprintf(ptr, "Your memlock limit isn't unlimited, so BackupBand can't lock its RAM. Paging may cause xruns.");
+	}
+
+	if (ptr == buffer) return 0;
+	strcpy(ptr, " (See /etc/security/limits.conf.)");
+	return buffer;
+}
+
+
+
+
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+
+/****************** set_monitor_gain() *******************
+ * Calcs the left/right/reverb factors for the audio in
+ * monitor, from its vol/pan/reverb settings.
+ */
+
+static void set_monitor_gain(void)
+{
+	register float		vol;
+
+	// Same scaling as a voice's VolumeFactor. Pan is a balance, with center at 50
+	vol = VolFactors[MonitorAdjust[MONITOR_VOL]] * 40.0f;
+	MonitorGain[0] = MonitorAdjust[MONITOR_PAN] > 50 ? (vol * (100 - MonitorAdjust[MONITOR_PAN])) / 50.0f : vol;
+	MonitorGain[1] = MonitorAdjust[MONITOR_PAN] < 50 ? (vol * MonitorAdjust[MONITOR_PAN]) / 50.0f : vol;
+	MonitorGain[2] = MonitorAdjust[MONITOR_REVERB] / 100.0f;
+}
+
+/******************** setMonitor() *********************
+ * Sets the audio in monitor's vol (MONITOR_VOL), pan
+ * (MONITOR_PAN), or reverb send (MONITOR_REVERB). All are
+ * 0 to 100.
+ */
+
+void setMonitor(register unsigned char type, register unsigned char val)
+{
+	if (val <= 100)
+	{
+		MonitorAdjust[type] = val;
+		set_monitor_gain();
+	}
+}
+
+unsigned char getMonitor(register unsigned char type)
+{
+	return MonitorAdjust[type];
+}
+
+/********************* stampMix() **********************
+ * Called by the audio thread after it writes a block, to
+ * note when, and which frame is being heard then. (For
+ * placing and measuring MIDI in and accomp notes.)
+ */
+
+static void stampMix(void)
+{
+	snd_pcm_sframes_t		delay;
+	struct timespec		now;
+
+	if (snd_pcm_delay((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, &delay) >= 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		__atomic_add_fetch(&MixStampSeq, 1, __ATOMIC_ACQ_REL);
+		LastMixTime = (now.tv_sec * 1000000000ULL) + now.tv_nsec;
+		LastHeardFrame = MixFrames - (uint32_t)delay;
+		__atomic_add_fetch(&MixStampSeq, 1, __ATOMIC_ACQ_REL);
+	}
+}
+
+/******************** getHeardFrame() *********************
+ * Gets the MixFrames being heard now, per the stamp of the
+ * last block.
+ *
+ * elapsed = Where to return how many frames have played
+ * since the last block was stamped.
+ *
+ * RETURN: The frame, or 0 if no block stamped yet.
+ */
+
+static uint32_t getHeardFrame(register uint32_t * elapsed)
+{
+	struct timespec		now;
+	register uint64_t		mixTime;
+	register uint32_t		heard, seq;
+
+	// Get a consistent stamp of the last block
+	do
+	{
+		seq = __atomic_load_n(&MixStampSeq, __ATOMIC_ACQUIRE);
+		mixTime = LastMixTime;
+		heard = LastHeardFrame;
+	} while ((seq & 1) || seq != __atomic_load_n(&MixStampSeq, __ATOMIC_ACQUIRE));
+
+	if (!mixTime || !SoundDev[DEVNUM_AUDIOOUT].DevHash) return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*elapsed = (uint32_t)(((((now.tv_sec * 1000000000ULL) + now.tv_nsec) - mixTime) * Rates[SampleRateFactor]) / 1000000000ULL);
+	heard += *elapsed;
+	return heard ? heard : 1;
+}
+
+/******************** midiInArrived() *********************
+ * Called by the thread reading MIDI in, when input arrives.
+ * Measures how long until a note it starts is heard. If
+ * the audio thread is the reader, gets the frame for
+ * setMidiStartFrame(), so the note starts as far into the
+ * next block as the input arrived after the last block.
+ * Every note is then heard the same time after it's
+ * played, rather than on the next block boundary.
+ *
+ * fromAudio = 1 if called by the audio thread.
+ *
+ * RETURN: The MixFrames at which a note it starts should
+ * begin, or 0 for the next block.
+ */
+
+uint32_t midiInArrived(register unsigned char fromAudio)
+{
+	uint32_t					elapsed;
+	register uint32_t		heard, delay, frame;
+
+	frame = 0;
+
+	if ((heard = getHeardFrame(&elapsed)))
+	{
+		if (fromAudio)
+		{
+			// If we woke late, the note can't start before the next block
+			if (elapsed >= FramesPerPeriod) elapsed = FramesPerPeriod - 1;
+			if (!(frame = MixFrames + elapsed)) frame = 1;
+			delay = frame - heard;
+		}
+
+		// From the MIDI in thread, the note starts with the next block
+		else
+			delay = MixFrames - heard;
+
+		if (delay < MidiDelayMin) MidiDelayMin = delay;
+		if (delay > MidiDelayMax) MidiDelayMax = delay;
+	}
+
+	return frame;
+}
+
+/******************** getMidiDelay() *********************
+ * Gets the shortest and longest delay from MIDI in to
+ * audio out, measured since the audio out was opened, in
+ * tenths of a millisecond. The difference is the jitter.
+ *
+ * RETURN: 0 if nothing measured, or 1 if so.
+ */
+
+unsigned char getMidiDelay(register uint32_t * min, register uint32_t * max)
+{
+	if (MidiDelayMin > MidiDelayMax) return 0;
+	*min = (uint32_t)(((uint64_t)MidiDelayMin * 10000) / Rates[SampleRateFactor]);
+	*max = (uint32_t)(((uint64_t)MidiDelayMax * 10000) / Rates[SampleRateFactor]);
+	return 1;
+}
+
+/******************** setMidiInPoll() *********************
+ * Sets whether the audio thread services MIDI in. Takes
+ * effect at the audio thread's next wakeup. 0xFF queries.
+ */
+
+unsigned char setMidiInPoll(register unsigned char on)
+{
+	if (on != 0xFF) MidiInPoll = on;
+	return MidiInPoll;
+}
+
+/******************** getAheadFrames() *********************
+ * Gets how many frames ahead of what's heard the audio
+ * thread may have already mixed. With Timer wakeups, that's
+ * only the refill target, not the card's (large) buffer.
+ */
+
+static uint32_t getAheadFrames(void)
+{
+	return (uint32_t)(TschedBufferFrames ? TschedTarget : HwBufferFrames + FramesPerPeriod);
+}
+
+/********************* beatTick() **********************
+ * Called by the beat thread at each PPQN, before it starts
+ * that PPQN's notes, to place them on a grid kept in audio
+ * frames. Each PPQN advances the grid by its length, then
+ * the grid is pulled a little toward where the sound card
+ * says the beat thread is now, so the system and card
+ * clocks can't drift apart, but the beat thread's wakeup
+ * jitter doesn't move the notes. The grid runs
+ * getAheadFrames() ahead of what's heard, so each note's
+ * frame is not yet mixed when the audio thread gets it.
+ *
+ * nsecs = Length of the previous PPQN, or 0 to restart the
+ * grid at the current time (ie, the beat thread follows
+ * some other clock).
+ */
+
+void beatTick(register uint32_t nsecs)
+{
+	uint32_t					elapsed;
+	register uint32_t		heard, ahead;
+	register int32_t		diff;
+
+	BeatStartFrame = 0;
+	if (!(heard = getHeardFrame(&elapsed)))
+		BeatGridFrame = BeatPlaceFrame = 0;
+	else
+	{
+		ahead = getAheadFrames();
+		heard += ahead;
+		if (!nsecs || !BeatGridFrame)
+			BeatGridFrame = heard;
+		else
+		{
+			BeatGridFrame += (uint32_t)(((uint64_t)nsecs * Rates[SampleRateFactor]) / 1000000000);
+
+			// If way off (ie, the beat thread stalled, or the card was restarted), start the
+			// grid anew. Otherwise nudge it
+			diff = (int32_t)(heard - BeatGridFrame);
+			if (diff > (int32_t)(ahead / 2) || diff < -(int32_t)(ahead / 2))
+				BeatGridFrame = heard;
+			else
+				BeatGridFrame += diff / 16;
+		}
+		if (!BeatGridFrame) BeatGridFrame = 1;
+
+		// Notes held back always start at their exact frame
+		if (!(BeatPlaceFrame = BeatGridFrame + BeatDelayFrames)) BeatPlaceFrame = 1;
+		if (BeatSched || BeatDelayFrames) BeatStartFrame = BeatPlaceFrame;
+	}
+}
+
+/********************* endBeatTick() **********************
+ * Called by the beat thread after it starts a PPQN's notes.
+ * Any it starts while waiting for the next PPQN (ie, for a
+ * chord change) begin with the next block, and aren't
+ * measured.
+ */
+
+void endBeatTick(void)
+{
+	BeatStartFrame = BeatPlaceFrame = BeatSkipFrames = 0;
+}
+
+/******************** resetBeatOnset() *********************
+ * Called by the beat thread when play starts, to restart
+ * the PPQN grid, and the onset measurement.
+ */
+
+void resetBeatOnset(void)
+{
+	BeatStartFrame = BeatGridFrame = BeatPlaceFrame = BeatSkipFrames = 0;
+	BeatOnsetReset = 1;
+}
+
+/******************** getBeatOnset() *********************
+ * Gets the spread between the earliest and latest that the
+ * beat thread's notes started relative to its PPQN grid,
+ * since play started, in frames. This is the jitter of the
+ * accomp. Also gets how many notes started after their
+ * exact frame (when the beat thread places notes).
+ *
+ * RETURN: 0 if nothing measured, or 1 if so.
+ */
+
+unsigned char getBeatOnset(register uint32_t * jitter, register uint32_t * late)
+{
+	if (BeatOnsetReset || BeatOnsetMin > BeatOnsetMax) return 0;
+	*jitter = (uint32_t)(BeatOnsetMax - BeatOnsetMin);
+	*late = BeatLate;
+	return 1;
+}
+
+/********************* setBeatLate() **********************
+ * Called by the beat thread before it starts bass, gtr, or
+ * pad notes that should have started the specified nsecs
+ * ago (ie, it's replaying a measure's notes for a chord
+ * the user played late). The notes start that far into
+ * their waveforms, so they sound as if started on the beat.
+ * 0 starts notes normally.
+ */
+
+void setBeatLate(register uint32_t nsecs)
+{
+	BeatSkipFrames = (uint32_t)(((uint64_t)nsecs * Rates[SampleRateFactor]) / 1000000000);
+}
+
+/******************** setBeatSched() *********************
+ * Sets whether the beat thread places its notes at exact
+ * frames. Takes effect at the next PPQN. 0xFF queries.
+ */
+
+unsigned char setBeatSched(register unsigned char on)
+{
+	if (on != 0xFF) BeatSched = on;
+	return BeatSched;
+}
+
+/******************** getBeatLatency() *********************
+ * Gets how many nsecs after the beat thread plays a note,
+ * it's heard from the Internal Synth (ie, how far ahead
+ * beatTick() places it). 0 if no ALSA audio out is open.
+ */
+
+uint32_t getBeatLatency(void)
+{
+	return (SoundDev[DEVNUM_AUDIOOUT].Handle && SoundDev[DEVNUM_AUDIOOUT].DevHash) ? (uint32_t)(((uint64_t)getAheadFrames() * 1000000000) / Rates[SampleRateFactor]) : 0;
+}
+
+/******************** setBeatDelay() *********************
+ * Called by the beat thread to set how many nsecs to hold
+ * back its notes, so the Internal Synth sounds along with
+ * slower External Synths. Takes effect at the next PPQN.
+ */
+
+void setBeatDelay(register uint32_t nsecs)
+{
+	BeatDelayFrames = (uint32_t)(((uint64_t)nsecs * Rates[SampleRateFactor]) / 1000000000);
+}
+
+/******************** getRoundTrip() *********************
+ * Gets the most recent delay from audio in to out, in
+ * tenths of a millisecond. 0 if no audio in.
+ */
+
+uint32_t getRoundTrip(void)
+{
+	return SoundDev[DEVNUM_AUDIOIN].Handle ? (uint32_t)(((uint64_t)RoundTripFrames * 10000) / Rates[SampleRateFactor]) : 0;
+}
+
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+
+/***************** measureMidiOutLatency() *****************
+ * Measures how many msecs an External Synth takes to sound
+ * a note, by playing a loud one on the channel of a robot
+ * assigned to it, and timing its arrival at audio in (which
+ * the user must cable from the synth's out). Takes the
+ * middle of 3 tries. Called by Setup's Measure worker
+ * thread, since it takes up to several secs.
+ *
+ * An ALSA seq output stamps the note to play SeqLead after
+ * it's sent. align_outputs() adds that on its own, so it
+ * isn't counted here.
+ *
+ * bus =		0 to 3 for External Synth 1 to 4.
+ *
+ * RETURN: The msecs, or 0 if the note wasn't heard (or audio
+ * in wasn't quiet before it).
+ */
+
+uint32_t measureMidiOutLatency(register unsigned char bus)
+{
+	struct timespec					sent;
+	uint32_t								times[3];
+	unsigned char						msg[3];
+	register struct SOUNDDEVINFO *	sounddev;
+	register uint32_t					i, wait;
+
+	sounddev = &SoundDev[DEVNUM_MIDIOUT1 + bus];
+	if (!SoundDev[DEVNUM_AUDIOIN].Handle || !SoundDev[DEVNUM_AUDIOOUT].Handle || !SoundDev[DEVNUM_AUDIOOUT].DevHash) return 0;
+
+	// Find a robot that plays this synth. For the drums, use a snare
+	for (i = 0; DevAssigns[i] != sounddev; )
+	{
+		if (++i >= PLAYER_SOLO) return 0;
+	}
+	msg[0] = 0x90 | MidiChans[i];
+	msg[1] = (i == PLAYER_DRUMS ? 38 : 60);
+
+	for (i = 0; i < 3; i++)
+	{
+		// Make sure audio in is quiet (ie, the last note died away)
+		__atomic_store_n(&CalibState, CALIB_ARMED, __ATOMIC_RELEASE);
+		usleep(300000);
+		if (__atomic_load_n(&CalibState, __ATOMIC_ACQUIRE) != CALIB_ARMED) goto bad;
+
+		msg[2] = 127;
+		clock_gettime(CLOCK_MONOTONIC, &sent);
+		sendMidiOut(sounddev, msg, 3|GUITHREADID);
+
+		// Wait up to a second for the audio thread to hear it
+		for (wait = 0; wait < 100 && __atomic_load_n(&CalibState, __ATOMIC_ACQUIRE) == CALIB_ARMED; wait++) usleep(10000);
+		msg[2] = 0;
+		sendMidiOut(sounddev, msg, 3|GUITHREADID);
+		if (__atomic_load_n(&CalibState, __ATOMIC_ACQUIRE) != CALIB_FOUND) goto bad;
+
+		// Heard before it was sent? Then something else was
+		if (CalibOnset.tv_sec < sent.tv_sec || (CalibOnset.tv_sec == sent.tv_sec && CalibOnset.tv_nsec < sent.tv_nsec)) goto bad;
+		times[i] = (uint32_t)((((CalibOnset.tv_sec - sent.tv_sec) * 1000000000L) + CalibOnset.tv_nsec - sent.tv_nsec + 500000) / 1000000);
+	}
+	CalibState = CALIB_IDLE;
+
+	// Take the middle one, less any seq stamping
+	if (times[0] > times[1])
+	{
+		i = times[0];
+		times[0] = times[1];
+		times[1] = i;
+	}
+	if (times[1] > times[2]) times[1] = times[2];
+	if (times[0] > times[1]) times[1] = times[0];
+	i = getSeqLead(bus);
+	times[1] = (times[1] > i ? times[1] - i : 0);
+	if (!times[1]) times[1] = 1;
+	return times[1];
+bad:
+	CalibState = CALIB_IDLE;
+	return 0;
+}
+
+#endif
+
+/************* xrun_count() ******************
+ * Gets the # of xruns since the last time it
+ * was called.
+ *
+ * reset = -1 for resetting the count. 1 for
+ * the updated count. 0 for the total count of
+ * xruns.
+ */
+
+uint32_t xrun_count(register int32_t reset)
+{
+	if (reset)
+	{
+		reset = CurrentXRuns - PreviousXRuns;
+		if (reset < 0) CurrentXRuns = 0;
+		PreviousXRuns = CurrentXRuns;
+		return reset;
+	}
+	return CurrentXRuns;
+}
+
+/********************** audioRecovery() **********************
+ * Called whenever we encounter an error in filling the sound
+ * card's buffer with more audio data. ALSA only.
+ */
+
+static const char	AudioErrStrs[] = "Playback XRUN recovery failed\0\
+SUSPEND recovery failed\0\
+ALSA playback poll error\0\
+ReStart error\0\
+MMAP begin error\0\
+MMAP commit error\0\
+ALSA input poll error\0\
+ALSA poll error\0\
+Input XRUN recovery failed\0\
+You need permission to set thread realtime priority\0\
+Can't set thread realtime priority";
+
+void show_audio_error(register unsigned char err)
+{
+	register const char *	msg;
+
+	if (err)
+	{
+		msg = AudioErrStrs;
+		while (--err) msg += strlen(msg) + 1;
+		show_msgbox(msg);
+	}
+}
+
+/************* count_xrun() ******************
+ * Counts an audio out xrun, and has the GUI
+ * thread show it.
+ */
+
+static void count_xrun(register void * signalHandle)
+{
+	// Let main thread know there are xruns
+	if (CurrentXRuns < 255) CurrentXRuns++;
+	else if (PreviousXRuns >= 255) PreviousXRuns--;
+	if (TuneXRuns < 255) TuneXRuns++;
+
+	// If beat play thread is running, let it signal the gui thread upon
+	// the next downbeat. Otherwise, we must signal here. But don't wait...
+	// if we fail to report 1 xrun, no big deal
+	if (!BeatInPlay) drawGuiCtl(signalHandle, CTLMASK_XRUN, BEATTHREADID);
+}
+
+static int audioRecovery(register void * signalHandle, register int err, register int restart)
+{
+	if (!err)
+	{
+		switch (snd_pcm_state((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle))
+		{
+			case SND_PCM_STATE_XRUN:
+			{
+				err = -EPIPE;
+				break;
+			}
+
+			case SND_PCM_STATE_SUSPENDED:
+				err = -ESTRPIPE;
+
+			default:
+				break;
+		}
+	}
+
+	if (err == -EINTR) goto good;
+
+	// Under-run?
+	if (err == -EPIPE)
+	{
+		count_xrun(signalHandle);
+
+		if ((err = snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) >= 0)
+		{
+			if (restart && (err = snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) < 0) goto ret;
+
+good:		return 0;
+		}
+	}
+
+	// Audio suspended?
+	else if (err == -ESTRPIPE)
+	{
+		// Wait until the suspend flag is released
+		while ((err = snd_pcm_resume((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) == -EAGAIN) sleep(1);
+		if (err >= 0 || (err = snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) >= 0) goto good;
+	}
+ret:
+	return err;
+}
+
+
+
+
+
+/********************** readAudioData() **********************
+ * Copies a block of 32-bit audio input from the sound card's
+ * MMAP buffer to our float InputBuffPtr (always stereo) at
+ * InputIndex. Called by the Audio thread.
+ */
+
+static void readAudioData(register const snd_pcm_channel_area_t * buffer, register snd_pcm_uframes_t offset, register snd_pcm_uframes_t frames)
+{
+	register float *			dest;
+	register const int32_t *	left;
+	register const int32_t *	right;
+	register uint32_t			leftStep, rightStep;
+
+	dest = (float *)InputBuffPtr + (InputIndex * 2);
+	InputIndex += frames;
+
+	// ALSA gives the channel layout as bit offsets/strides, which covers both
+	// interleaved and non-interleaved. A mono mic feeds both sides
+	left = (const int32_t *)((const unsigned char *)buffer[0].addr + (buffer[0].first / 8) + (offset * (buffer[0].step / 8)));
+	leftStep = buffer[0].step / (8 * sizeof(int32_t));
+	right = left;
+	rightStep = leftStep;
+	if (NumInChans > 1)
+	{
+		right = (const int32_t *)((const unsigned char *)buffer[1].addr + (buffer[1].first / 8) + (offset * (buffer[1].step / 8)));
+		rightStep = buffer[1].step / (8 * sizeof(int32_t));
+	}
+
+	// Scale to the same range as a 16-bit wave
+	while (frames--)
+	{
+		*dest++ = (float)*left / 65536.0f;
+		*dest++ = (float)*right / 65536.0f;
+		left += leftStep;
+		right += rightStep;
+	}
+}
+
+/********************** readAudioIn() **********************
+ * Reads up to the specified number of frames of audio input
+ * (however many are ready) into InputBuffPtr. Used by timer
+ * scheduling. Called by the Audio thread.
+ */
+
+static void readAudioIn(register snd_pcm_uframes_t count)
+{
+	register snd_pcm_sframes_t		avail;
+
+	InputIndex = 0;
+	if ((avail = snd_pcm_avail_update((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)) > 0)
+	{
+		snd_pcm_uframes_t		frames;
+
+		if (count > (snd_pcm_uframes_t)avail) count = avail;
+		while ((frames = count))
+		{
+			const snd_pcm_channel_area_t *	buffer;
+			snd_pcm_uframes_t						offset;
+
+			if (snd_pcm_mmap_begin((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle, &buffer, &offset, &frames) < 0 || !frames) break;
+			if (frames > count) frames = count;
+			readAudioData(buffer, offset, frames);
+			if (snd_pcm_mmap_commit((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle, offset, frames) != (snd_pcm_sframes_t)frames) break;
+			count -= frames;
+		}
+	}
+
+	InputCount = InputIndex;
+	InputIndex = 0;
+}
+
+/********************** mixAudioIn() **********************
+ * Mixes the next block of InputBuffPtr into the output mix
+ * and reverb buffers, applying the monitor vol/pan/reverb
+ * send. Called by the Audio thread after clear_mix_buf(),
+ * and before mixPlayingVoices().
+ */
+
+static void mixAudioIn(register snd_pcm_uframes_t frames)
+{
+	register float *	src;
+	register float *	mixBuffPtr;
+#ifndef NO_REVERB_SUPPORT
+	register float *	revBuffPtr;
+#endif
+
+	if (InputIndex + frames > InputCount) frames = InputCount - InputIndex;
+	src = (float *)InputBuffPtr + (InputIndex * 2);
+	InputIndex += frames;
+
+	mixBuffPtr = (float *)MixBuffPtr;
+#ifndef NO_REVERB_SUPPORT
+	revBuffPtr = (float *)ReverbBuffPtr;
+#endif
+	while (frames--)
+	{
+		register float		left, right;
+
+		left = *src++ * MonitorGain[0];
+		right = *src++ * MonitorGain[1];
+		mixBuffPtr[0] += left;
+		mixBuffPtr[1] += right;
+		mixBuffPtr += MixChans;
+#ifndef NO_REVERB_SUPPORT
+		*revBuffPtr++ += left * MonitorGain[2];
+		*revBuffPtr++ += right * MonitorGain[2];
+#endif
+	}
+}
+
+/******************** measureRoundTrip() ********************
+ * Updates RoundTripFrames after the Audio thread has mixed
+ * audio in that waited "inDelay" frames in the card, into
+ * audio out.
+ */
+
+static void measureRoundTrip(register snd_pcm_sframes_t inDelay)
+{
+	snd_pcm_sframes_t		outDelay;
+
+	if (snd_pcm_delay((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, &outDelay) >= 0 && (outDelay += inDelay) > 0)
+		RoundTripFrames = outDelay;
+}
+
+/******************** findCalibOnset() ********************
+ * Called by the Audio thread after it reads audio in that
+ * waited "inDelay" frames in the card, while measuring an
+ * External Synth's latency, to look for the test note's
+ * onset.
+ */
+
+static void findCalibOnset(register snd_pcm_sframes_t inDelay)
+{
+	register float *		src;
+	register uint32_t		i;
+
+	src = (float *)InputBuffPtr;
+	for (i = 0; i < InputCount; i++)
+	{
+		if (src[0] > CALIB_THRESHOLD || src[0] < -CALIB_THRESHOLD || src[1] > CALIB_THRESHOLD || src[1] < -CALIB_THRESHOLD)
+		{
+			register long		nsecs;
+
+			// That frame arrived (inDelay - i) frames ago
+			clock_gettime(CLOCK_MONOTONIC, &CalibOnset);
+			nsecs = (long)(((uint64_t)(inDelay - i) * 1000000000) / Rates[SampleRateFactor]);
+			CalibOnset.tv_sec -= nsecs / 1000000000L;
+			if ((CalibOnset.tv_nsec -= nsecs % 1000000000L) < 0)
+			{
+				CalibOnset.tv_nsec += 1000000000L;
+				--CalibOnset.tv_sec;
+			}
+			__atomic_store_n(&CalibState, CALIB_FOUND, __ATOMIC_RELEASE);
+			break;
+		}
+		src += 2;
+	}
+}
+
+/********************* audioInRecovery() *********************
+ * Recovers from an audio in overrun, if audio in isn't linked
+ * to out (in which case audioRecovery handles both).
+ */
+
+static int audioInRecovery(void)
+{
+	register int		err;
+
+	switch (snd_pcm_state((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle))
+	{
+		case SND_PCM_STATE_SUSPENDED:
+		{
+			while ((err = snd_pcm_resume((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)) == -EAGAIN) sleep(1);
+			if (err >= 0) break;
 		}
-		else
+		// Fall through
+		case SND_PCM_STATE_XRUN:
 		{
-			while ((char *)mixBuffPtr < MixBuffEnd)
+			if ((err = snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)) < 0 ||
+				(err = snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)) < 0)
 			{
-				*pMixBuffL++ = (int32_t)(*mixBuffPtr++ * mastervol);
-				*pMixBuffL++ = (int32_t)(*mixBuffPtr++ * mastervol);
-				// Skip over interleaved channels we don't use
-				pMixBuffL += (NumChans - 2);
+				return err;
 			}
-#ifdef TEST_AUDIO_MIX
-			runWaveRecord((const char *)MixBufferPtr[0], numFrames * sizeof(int32_t) * 2);
-#endif
 		}
+		default:
+			break;
 	}
-	}
-#endif
+
+	return 0;
 }
 
+/******************** measureLoad() *********************
+ * Called by the audio thread after mixing a block, to
+ * update the peak load for the auto buffer tuner.
+ *
+ * start = When the mix began.
+ */
+
+static void measureLoad(register const struct timespec * start, register snd_pcm_uframes_t frames)
+{
+	// Only a whole block. A partial one (where the card's buffer wraps) has
+	// the same overhead in less time
+	if (frames == FramesPerPeriod)
+	{
+		struct timespec		end;
+		register uint64_t		load;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		load = (uint64_t)((end.tv_sec - start->tv_sec) * 1000000000 + (end.tv_nsec - start->tv_nsec));
+		load = (load * Rates[SampleRateFactor]) / ((uint64_t)frames * 10000000);
+		if (load > 255) load = 255;
+		if (load > TuneLoad) TuneLoad = (unsigned char)load;
+	}
 
+	// Time spent playing counts toward the soak
+	if (BeatInPlay) TuneFrames += frames;
+}
 
+/******************** set_mix_ptrs() *********************
+ * Sets MixBufferPtr[] to where mixPlayingVoices() writes
+ * in the card's MMAP buffer. For non-interleaved, each
+ * chan we use has its own buffer.
+ *
+ * buffer =	What snd_pcm_mmap_begin() returned.
+ * offset =	Frame offset into it.
+ */
 
-void set_thread_priority(void)
+static void set_mix_ptrs(register const snd_pcm_channel_area_t * buffer, register snd_pcm_uframes_t offset)
 {
-	struct sched_param	params;
+	if (NonInterleaveFlag)
+	{
+		register unsigned char	chan;
 
-	params.sched_priority = SecondaryThreadPriority;
-	pthread_setschedparam(pthread_self(), SCHED_FIFO, &params);
+		for (chan = 0; chan < MixChans; chan++)
+			MixBufferPtr[chan] = (int32_t *)((unsigned char *)buffer[chan].addr + (buffer[chan].first / 8) + (offset * sizeof(int32_t)));
+	}
+	else
+		MixBufferPtr[0] = (int32_t *)(((unsigned char *)buffer[0].addr) + (offset * sizeof(int32_t) * NumChans));
 }
 
 
 
 
 
-#ifndef NO_ALSA_AUDIO_SUPPORT
-
-/************* xrun_count() ******************
- * Gets the # of xruns since the last time it
- * was called.
+/******************* audioTschedLoop() ********************
+ * Timer scheduled version of audioThread()'s loop. Instead
+ * of waiting on the card's period interrupts, we keep
+ * TschedTarget frames queued ahead of the hardware pointer,
+ * and sleep on a timer until the card has played down to
+ * TschedWatermark. ALSA only.
  *
- * reset = -1 for resetting the count. 1 for
- * the updated count. 0 for the total count of
- * xruns.
+ * RETURN: Error # for setAudioDevErrNum(), or 0 if the main
+ * thread told us to terminate.
  */
 
-uint32_t xrun_count(register int32_t reset)
+static unsigned char audioTschedLoop(register void * arg)
 {
-	if (reset)
+	register snd_pcm_uframes_t		size;
+	register int						err;
+	register unsigned char			restart;
+
+	// Device isn't running yet
+	restart = 1;
+
+	for (;;)
 	{
-		reset = CurrentXRuns - PreviousXRuns;
-		if (reset < 0) CurrentXRuns = 0;
-		PreviousXRuns = CurrentXRuns;
-		return reset;
+		struct timespec		wake;
+		snd_pcm_uframes_t		frames;
+
+		// Main thread want us to terminate?
+		if (!AudioThreadFlags) break;
+
+		// Audio in overrun?
+		if ((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle && !AudioLinked && !restart && audioInRecovery() < 0) return 8+1;
+
+		// Update the hardware pointer, and get how many frames the card has room for, and when
+		// ALSA read the pointer
+		if ((err = snd_pcm_avail((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) >= 0)
+		{
+			snd_htimestamp_t		stamp;
+
+			if ((err = snd_pcm_htimestamp((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, &frames, &stamp)) >= 0)
+			{
+				if (restart || !TschedStamp || (!stamp.tv_sec && !stamp.tv_nsec))
+					clock_gettime(CLOCK_MONOTONIC, &wake);
+				else
+				{
+					wake.tv_sec = stamp.tv_sec;
+					wake.tv_nsec = stamp.tv_nsec;
+				}
+
+				// Convert to how many frames are still queued
+				size = frames < TschedBufferFrames ? TschedBufferFrames - frames : 0;
+
+				// Top up to our target fill level, a block at a time
+				while (size < TschedTarget)
+				{
+					const snd_pcm_channel_area_t *	buffer;
+					snd_pcm_uframes_t						offset;
+					struct timespec						start;
+
+					frames = TschedTarget - size;
+					if (frames > FramesPerPeriod) frames = FramesPerPeriod;
+					if ((err = snd_pcm_mmap_begin((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, &buffer, &offset, &frames)) < 0) goto bad;
+
+					// Audio card buffer is full?
+					if (!frames) break;
+
+					set_mix_ptrs(buffer, offset);
+					if (CurrTune) clock_gettime(CLOCK_MONOTONIC, &start);
+					clear_mix_buf(frames);
+
+					// Monitor whatever audio in has arrived
+					if ((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle && !restart)
+					{
+						register snd_pcm_sframes_t		inDelay;
+
+						inDelay = snd_pcm_avail_update((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle);
+						readAudioIn(frames);
+						if (InputCount)
+						{
+							// A negative inDelay is an error (ie, xrun), not a delay
+							if (inDelay >= 0 && __atomic_load_n(&CalibState, __ATOMIC_ACQUIRE) == CALIB_ARMED) findCalibOnset(inDelay);
+							mixAudioIn(frames);
+							if (inDelay >= 0) RoundTripFrames = inDelay + size;
+						}
+					}
+					mixPlayingVoices(frames);
+					if (CurrTune) measureLoad(&start, frames);
+
+					if ((err = snd_pcm_mmap_commit((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, offset, frames)) < 0 || (snd_pcm_uframes_t)err != frames)
+					{
+						if (err >= 0) err = -EPIPE;
+						goto bad;
+					}
+
+					size += frames;
+				}
+
+				// (Re)start playback now that there's something to play. (A resume
+				// from suspend may have already restarted it)
+				if (restart)
+				{
+					if (snd_pcm_state((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle) == SND_PCM_STATE_PREPARED &&
+						snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle) < 0)
+					{
+						return 3+1;
+					}
+
+					// Linked audio in started with out. Otherwise, start it now
+					if ((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle && !AudioLinked &&
+						snd_pcm_state((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle) == SND_PCM_STATE_PREPARED)
+					{
+						snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle);
+					}
+					restart = 0;
+				}
+
+				// Stamp the refill, to place and measure MIDI in and accomp notes
+				stampMix();
+
+				// Sleep until the card has played down to the watermark
+				if (size > TschedWatermark)
+				{
+					wake.tv_nsec += (long)(((uint64_t)(size - TschedWatermark) * 1000000000) / Rates[SampleRateFactor]);
+					while (wake.tv_nsec >= 1000000000)
+					{
+						wake.tv_nsec -= 1000000000;
+						wake.tv_sec++;
+					}
+
+					while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, 0) == EINTR);
+				}
+
+				continue;
+			}
+		}
+
+bad:	if (!AudioThreadFlags) break;
+
+		// An xrun (or suspend). Recover, and restart once refilled
+		if (audioRecovery(arg, err, 0)) return 0+1;
+		restart = 1;
+
+		// Our timing wasn't good enough, so keep more queued. But
+		// leave room to refill
+		if (err == -EPIPE && TschedTarget + FramesPerPeriod <= TschedBufferFrames - FramesPerPeriod)
+		{
+			TschedTarget += FramesPerPeriod;
+			TschedWatermark += FramesPerPeriod;
+		}
 	}
-	return CurrentXRuns;
+
+	return 0;
 }
 
-/********************** audioRecovery() **********************
- * Called whenever we encounter an error in filling the sound
- * card's buffer with more audio data. ALSA only.
- */
 
-static const char	AudioErrStrs[] = "Playback XRUN recovery failed\0\
-SUSPEND recovery failed\0\
-ALSA playback poll error\0\
-ReStart error\0\
-MMAP begin error\0\
-MMAP commit error\0\
-ALSA input poll error\0\
-ALSA poll error\0\
-Input XRUN recovery failed\0\
-You need permission to set thread realtime priority\0\
-Can't set thread realtime priority";
 
-void show_audio_error(register unsigned char err)
+
+
+/******************* audioNullLoop() ********************
+ * audioThread()'s loop when audio out is AUDIODEV_NULL or
+ * AUDIODEV_FILE (ie, no card). We mix a block each period
+ * into our own buffer, sleeping on a timer in place of the
+ * card's period interrupt. For AUDIODEV_FILE, mixing
+ * hands each block to the recorder, whose thread writes
+ * the WAV file.
+ *
+ * If SubDev is 1, we don't sleep, but mix the next block
+ * as soon as the last is done, waiting only while the
+ * recorder's ring lacks room, so the file is written as
+ * fast as the disk allows. (The beat play thread is still
+ * timed by the clock, so its notes land in the file
+ * wherever the mix happens to be when they play.)
+ *
+ * RETURN: Error # for setAudioDevErrNum(), or 0 if the main
+ * thread told us to terminate.
+ */
+
+static unsigned char audioNullLoop(register void * arg)
 {
-	register const char *	msg;
+	struct timespec		start;
+	register uint64_t		frames;
 
-	if (err)
+	MixBufferPtr[0] = (int32_t *)SoundDev[DEVNUM_AUDIOOUT].Handle;
+
+	// Free-running never sleeps, so it mustn't hog a CPU at realtime priority
+	if (SoundDev[DEVNUM_AUDIOOUT].SubDev)
 	{
-		msg = AudioErrStrs;
-		while (-err) msg += strlen(msg) + 1;
-		show_msgbox(msg);
+		struct sched_param	params;
+
+		params.sched_priority = 0;
+		pthread_setschedparam(pthread_self(), SCHED_OTHER, &params);
 	}
-}
 
-static int audioRecovery(register void * signalHandle, register int err, register int restart)
-{
-	if (!err)
+	// Our timer counts periods from here. We count frames (not
+	// nanoseconds), so rounding never drifts
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	frames = 0;
+
+	// Main thread want us to terminate?
+	while (AudioThreadFlags)
 	{
-		switch (snd_pcm_state((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle))
+		// Free-running? Then we mix faster than the recorder writes. Rather than
+		// have recordMix() drop blocks, let it catch up
+		if (SoundDev[DEVNUM_AUDIOOUT].SubDev && RecBuffer)
 		{
-			case SND_PCM_STATE_XRUN:
+			while (RecFrames - (RecHead - __atomic_load_n(&RecTail, __ATOMIC_ACQUIRE)) < FramesPerPeriod)
 			{
-				err = -EPIPE;
-				break;
+				if (!AudioThreadFlags) goto out;
+				usleep(1000);
 			}
-
-			case SND_PCM_STATE_SUSPENDED:
-				err = -ESTRPIPE;
-
-			default:
-				break;
 		}
-	}
 
-	if (err == -EINTR) goto good;
+		clear_mix_buf(FramesPerPeriod);
+		mixPlayingVoices(FramesPerPeriod);
+		frames += FramesPerPeriod;
 
-	// Under-run?
-	if (err == -EPIPE)
-	{
-		// Let main thread know there are xruns
-		if (CurrentXRuns < 255) CurrentXRuns++;
-		else if (PreviousXRuns >= 255) PreviousXRuns--;
+		// Free-running? Then don't wait
+		if (SoundDev[DEVNUM_AUDIOOUT].SubDev) continue;
 
-		if ((err = snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) >= 0)
+		// Sleep until the next period is due
 		{
-			if (restart && (err = snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) < 0) goto ret;
+		struct timespec		wake, now;
+		register uint64_t		nsecs;
 
-			// If beat play thread is running, let it signal the gui thread upon
-			// the next downbeat. Otherwise, we must signal here. But don't wait...
-			// if we fail to report 1 xrun, no big deal
-			if (!BeatInPlay) drawGuiCtl(signalHandle, CTLMASK_XRUN, BEATTHREADID);
+		nsecs = (frames * 1000000000) / Rates[SampleRateFactor];
+		wake.tv_sec = start.tv_sec + (time_t)(nsecs / 1000000000);
+		wake.tv_nsec = start.tv_nsec + (long)(nsecs % 1000000000);
+		if (wake.tv_nsec >= 1000000000)
+		{
+			wake.tv_nsec -= 1000000000;
+			wake.tv_sec++;
+		}
 
-good:		return 0;
+		// Already past due? If by a whole period, a card would have underrun. Count
+		// an xrun, and time from now rather than rushing to catch up
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > wake.tv_sec || (now.tv_sec == wake.tv_sec && now.tv_nsec >= wake.tv_nsec))
+		{
+			nsecs = (uint64_t)((now.tv_sec - wake.tv_sec) * 1000000000 + (now.tv_nsec - wake.tv_nsec));
+			if (nsecs * Rates[SampleRateFactor] >= (uint64_t)FramesPerPeriod * 1000000000)
+			{
+				count_xrun(arg);
+				start = now;
+				frames = 0;
+			}
+			continue;
 		}
-	}
 
-	// Audio suspended?
-	else if (err == -ESTRPIPE)
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, 0) == EINTR);
+		}
+	}
+out:
+#ifdef JG_MIX_TIMING
+	// Report how much faster than realtime we mixed
+	if (SoundDev[DEVNUM_AUDIOOUT].SubDev)
 	{
-		// Wait until the suspend flag is released
-		while ((err = snd_pcm_resume((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) == -EAGAIN) sleep(1);
-		if (err >= 0 || (err = snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) >= 0) goto good;
+		struct timespec		now;
+		register uint64_t		nsecs;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((nsecs = (uint64_t)((now.tv_sec - start.tv_sec) * 1000000000 + (now.tv_nsec - start.tv_nsec))))
+			printf("Mixed %llu frames at %.1f times realtime\r\n", (unsigned long long)frames, ((double)frames * 1000000000.0) / ((double)nsecs * Rates[SampleRateFactor]));
 	}
-ret:
-	return err;
+#endif
+
+	return 0;
 }
 
 
@@ -2819,6 +6513,10 @@ static void * audioThread(void * arg)
 	register snd_pcm_uframes_t		size;
 	register int						err;
 	register unsigned char			flags;
+	int									midiFd;
+
+	// No MIDI in fd to poll yet
+	midiFd = -1;
 
 //	arg = GuiWinSignal(GuiApp, 0, 0);
 	arg = (void *)1;
@@ -2826,13 +6524,21 @@ static void * audioThread(void * arg)
 	// Clear xrun errors
 	setAudioDevErrNum(0, 0);
 
+	// Set the priority to max, to minimize xruns
+	if ((err = set_thread_priority(RTTHREAD_AUDIO))) setAudioDevErrNum(arg, ((err == EPERM) ? 9+1 : 10+1));
+
+	// No card?
+	if (!SoundDev[DEVNUM_AUDIOOUT].DevHash)
 	{
-	struct sched_param	params;
+		if ((flags = audioNullLoop(arg))) setAudioDevErrNum(arg, flags);
+		goto out;
+	}
 
-	// Set the priority to max, to minimize xruns
-	params.sched_priority = AudioThreadPriority;
-	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &params);
-	if (err) setAudioDevErrNum(arg, ((err == EPERM) ? 9+1 : 10+1));
+	// Timer scheduling?
+	if (TschedBufferFrames)
+	{
+		if ((flags = audioTschedLoop(arg))) setAudioDevErrNum(arg, flags);
+		goto out;
 	}
 
 	// Fill the audio out hardware's buffer (before we start playback) for 1 period
@@ -2860,13 +6566,7 @@ static void * audioThread(void * arg)
 			// Fill the buffer
 			if (frames)
 			{
-				if (NonInterleaveFlag)
-				{
-					MixBufferPtr[0] = (int32_t *)(((unsigned char *)buffer[0].addr) + (offset * sizeof(int32_t)));
-					MixBufferPtr[1] = (int32_t *)((unsigned char *)buffer[1].addr + (buffer[1].first / 8) + (offset * sizeof(int32_t)));
-				}
-				else
-					MixBufferPtr[0] = (int32_t *)(((unsigned char *)buffer[0].addr) + (offset * sizeof(int32_t) * NumChans));
+				set_mix_ptrs(buffer, offset);
 				clear_mix_buf(frames);
 				/* if (AudioThreadFlags & 0x01) */ mixPlayingVoices(frames);
 			}
@@ -2882,8 +6582,9 @@ static void * audioThread(void * arg)
 	}
 	}
 
-	// Start the playback/input
-	if ((err = snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) < 0)
+	// Start the playback/input. If linked, starting out starts in too
+	if ((err = snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) < 0 ||
+		((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle && !AudioLinked && snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle) < 0))
 	{
 starterr:
 		setAudioDevErrNum(arg, 3+1);
@@ -2896,9 +6597,9 @@ starterr:
 
 		do
 		{
-			register uint32_t			in, out;
+			register uint32_t			in, out, midi;
 
-			in = out = 0;
+			in = out = midi = 0;
 
 			// Tell ALSA to give us its FDs we need to poll on
 			snd_pcm_poll_descriptors((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, DescPtrs, NumPlayDesc);
@@ -2909,13 +6610,33 @@ starterr:
 				in = NumInDesc;
 			}
 
+#ifndef NO_MIDI_IN_SUPPORT
+			// Poll MIDI in here too, if enabled. Then we see a note the moment it arrives, and
+			// can stamp it with where it falls between blocks. midiInThread() still parses it
+			if (midiFd < 0)
+			{
+				if (MidiInPoll && SoundDev[DEVNUM_MIDIIN].Handle) midiFd = claimMidiIn();
+			}
+			else if (!MidiInPoll)
+			{
+				releaseMidiIn();
+				midiFd = -1;
+			}
+			if (midiFd >= 0)
+			{
+				DescPtrs[out + in].fd = midiFd;
+				DescPtrs[out + in].events = POLLIN;
+				midi = 1;
+			}
+#endif
+
 			// Wait (go to sleep) until ALSA signals that there is audio input data to read, or the soundcard
 			// needs more audio output data. The call to poll() puts us to sleep. We're waiting for ALSA to set
 			// one (or both) of ALSA's 2 file descriptors. ALSA sets one of the file descriptors when the
 			// soundcard has input (recorded) audio data for us to read. ALSA sets the other file descriptor
 			// when the soundcard needs us to give it more output data to play. Ultimately, we wait for both
 			// to need servicing before we attend to either, so we can synch in/out
-			err = poll(DescPtrs, in + out, -1);
+			err = poll(DescPtrs, in + out + midi, -1);
 
 			// We woke because the card has input and/or needs output. Or alsa could be trying to inform us
 			// of an xrun with input or output. Or someone may be trying to terminate us. Or maybe something
@@ -2931,6 +6652,12 @@ starterr:
 				goto out;
 			}
 
+#ifndef NO_MIDI_IN_SUPPORT
+			// MIDI in? Read and stamp it now, and queue it for midiInThread() to parse. If
+			// MIDI in is closing, stop polling it
+			if (midi && DescPtrs[out + in].revents && ((DescPtrs[out + in].revents & POLLNVAL) || !audioMidiIn())) midiFd = -1;
+#endif
+
 			// If still waiting for out, see if it's ready
 			if (out)
 			{
@@ -2978,18 +6705,19 @@ starterr:
 
 		// =========== Get # of input/output frames that are ready ==========
 		{
-		register snd_pcm_uframes_t		inputFrames;
+		register snd_pcm_sframes_t		inputFrames, inDelay;
 
-		inputFrames = 0;
+		inDelay = inputFrames = 0;
 		if ((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)
 		{
-			if ((inputFrames = snd_pcm_avail_update((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)) < 0)
+			if ((inDelay = inputFrames = snd_pcm_avail_update((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)) < 0)
 			{
 				if (inputFrames == -EPIPE) flags |= THREAD_GOT_IN_XRUN;
 				inputFrames = 0;
 			}
 
-			if ((flags & THREAD_GOT_IN_XRUN) && audioRecovery(arg, 0, 0))
+			// Linked audio in overruns along with out, so audioRecovery() handles both
+			if ((flags & THREAD_GOT_IN_XRUN) && (AudioLinked ? audioRecovery(arg, 0, 0) : audioInRecovery()))
 			{
 				setAudioDevErrNum(arg, 8+1);
 				goto out;
@@ -3011,16 +6739,15 @@ urun:		setAudioDevErrNum(arg, 0+1);
 		}
 
 		// =========== Get audio input ==========
+		InputIndex = 0;
 		if (inputFrames)
 		{
 			snd_pcm_uframes_t					frames;
 			register snd_pcm_uframes_t		count;
 
-			InputIndex = 0;
-
 			// Use the lower amount for both in and out so they're in sync
-			if (inputFrames > FramesPerPeriod) inputFrames = FramesPerPeriod;
-			if (inputFrames < size)
+			if (inputFrames > (snd_pcm_sframes_t)FramesPerPeriod) inputFrames = FramesPerPeriod;
+			if ((snd_pcm_uframes_t)inputFrames < size)
 				size = inputFrames;
 			else
 				inputFrames = size;
@@ -3034,32 +6761,28 @@ urun:		setAudioDevErrNum(arg, 0+1);
 				// Get the pointer to the audio hardware's buffer where we need to read WAVE data,
 				// and the amount of bytes to read. NOTE: If the buffer wraps, then the amount
 				// of bytes to read may be less than a full block (in which case "frames" will be
-				// less than "count")
-				if ((err = snd_pcm_mmap_begin((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle, &buffer, &offset, &frames)) < 0)
-				{
-					if (audioRecovery(arg, err, 1) < 0) goto pmap;
-				}
-				else
-				{
-					if (frames > count) frames = count;
+				// less than "count"). If audio in overran, we'll recover it on the next wakeup
+				if (snd_pcm_mmap_begin((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle, &buffer, &offset, &frames) < 0 || !frames) break;
 
-					// Read the audio hardware's buffer. "buffer" = address of the
-					// interleaved buffers. Note: "offset" is in sample frames
-//					readAudioData(buffer, offset, frames);
+				if (frames > count) frames = count;
 
-					// Done accessing the buffer
-					if ((err = snd_pcm_mmap_commit((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle, offset, frames)) < 0 || (snd_pcm_uframes_t)err != frames)
-					{
-						if (audioRecovery(arg, err >= 0 ? -EPIPE : err, 1) < 0) goto pcommit;
-					}
-					else
+				// Read the audio hardware's buffer. "buffer" = address of the
+				// interleaved buffers. Note: "offset" is in sample frames
+				readAudioData(buffer, offset, frames);
 
-						// Dec count of frames we still need to read to complete the block
-						count -= frames;
-				}
+				// Done accessing the buffer
+				if ((err = snd_pcm_mmap_commit((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle, offset, frames)) < 0 || (snd_pcm_uframes_t)err != frames) break;
+
+				// Dec count of frames we still need to read to complete the block
+				count -= frames;
 			}
 		}
 
+		// Mix what we read, in the output loop below
+		InputCount = InputIndex;
+		InputIndex = 0;
+		if (InputCount && __atomic_load_n(&CalibState, __ATOMIC_ACQUIRE) == CALIB_ARMED) findCalibOnset(inDelay);
+
 		// =========== Send audio output ==========
 
 		// Fill the audio buffer with a block of WAVE data
@@ -3093,25 +6816,19 @@ pmap:				setAudioDevErrNum(arg, 4+1);
 
 			// Create the mix of playing voices in the audio hardware's buffer. Pass the address of the
 			// interleaved buffers. Note: "offset" is in sample frames
-			if (NonInterleaveFlag)
-			{
-				MixBufferPtr[0] = (int32_t *)(((unsigned char *)buffer[0].addr) + (offset * sizeof(int32_t)));
-				MixBufferPtr[1] = (int32_t *)((unsigned char *)buffer[1].addr + (buffer[1].first / 8) + (offset * sizeof(int32_t)));
-			}
-			else
-				MixBufferPtr[0] = (int32_t *)(((unsigned char *)buffer[0].addr) + (offset * sizeof(int32_t) * NumChans));
-#if 0
-			if (inputFrames)
-			{
-				// Copy mic in buffer to output buffer
-				copy_input_buf(buffer, offset, frames);
-				InputIndex += frames;
-			}
-#endif
+			set_mix_ptrs(buffer, offset);
 			if (frames /* && (AudioThreadFlags & 0x01) */)
 			{
+				struct timespec		start;
+
+				if (CurrTune) clock_gettime(CLOCK_MONOTONIC, &start);
 				clear_mix_buf(frames);
+
+				// Monitor the mic in
+				if (InputCount) mixAudioIn(frames);
+
 				mixPlayingVoices(frames);
+				if (CurrTune) measureLoad(&start, frames);
 			}
 
 			// Commit the data
@@ -3130,12 +6847,23 @@ pcommit:			setAudioDevErrNum(arg, 5+1);
 //			flags &= ~THREAD_GOT_OUT_XRUN;
 		}
 		}
+
+		// Update the delay we report for monitoring. The first frame we read had waited
+		// inDelay frames, and plays after all but this block's frames now queued
+		if (InputCount) measureRoundTrip(inDelay - (snd_pcm_sframes_t)InputCount);
+
+		// Stamp the block, to place and measure MIDI in and accomp notes
+		stampMix();
 		}
 
 		if ((flags & THREAD_GOT_OUT_XRUN) && snd_pcm_start((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle) < 0) goto starterr;
 	}
 
 out:
+#ifndef NO_MIDI_IN_SUPPORT
+	// Give MIDI in back to its thread
+	if (midiFd >= 0) releaseMidiIn();
+#endif
 	AudioThreadHandle = 0;
 
 //	GuiWinSignal(GuiApp, arg, 0);
@@ -3147,6 +6875,20 @@ out:
 
 
 
+/******************* closeNullAudio() *******************
+ * Frees AUDIODEV_NULL/AUDIODEV_FILE's mix buffer. The
+ * recorder finishes AUDIODEV_FILE's WAV file.
+ */
+
+static void closeNullAudio(void)
+{
+	free(SoundDev[DEVNUM_AUDIOOUT].Handle);
+}
+
+
+
+
+
 /********************** audio_On() **********************
  * Starts an audio thread that scans for playing "notes"
  * that trigger audio waveforms, and mixes down those
@@ -3160,23 +6902,33 @@ static const char * audio_On(void)
 {
 	register const char *	msg;
 
-	snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
+	RoundTripFrames = 0;
+	set_monitor_gain();
+	LastMixTime = MidiDelayMax = 0;
+	MidiDelayMin = 0xFFFFFFFF;
 
-	// Ask ALSA how many FDs it will give us when we call snd_pcm_poll_descriptors(). We must supply
-	// an array alsa fills in
-	NumPlayDesc = snd_pcm_poll_descriptors_count((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
-	NumInDesc = SoundDev[DEVNUM_AUDIOIN].Handle ? snd_pcm_poll_descriptors_count((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle) : 0;
-	if (!(DescPtrs = (struct pollfd *)malloc(sizeof(struct pollfd) * (NumPlayDesc + NumInDesc + 1))))
+	// No card (AUDIODEV_NULL/FILE) has nothing to prepare or poll
+	if (SoundDev[DEVNUM_AUDIOOUT].DevHash)
 	{
-		msg = &NoMemStr[0];
-		goto out;
+		snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
+		if (SoundDev[DEVNUM_AUDIOIN].Handle && !AudioLinked) snd_pcm_prepare((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle);
+
+		// Ask ALSA how many FDs it will give us when we call snd_pcm_poll_descriptors(). We must supply
+		// an array alsa fills in
+		NumPlayDesc = snd_pcm_poll_descriptors_count((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
+		NumInDesc = SoundDev[DEVNUM_AUDIOIN].Handle ? snd_pcm_poll_descriptors_count((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle) : 0;
+		if (!(DescPtrs = (struct pollfd *)malloc(sizeof(struct pollfd) * (NumPlayDesc + NumInDesc + 1 + 1))))
+		{
+			msg = &NoMemStr[0];
+			goto out;
+		}
 	}
 
 	// Indicate in play
 	AudioThreadFlags = 0x81;
 
 	// Start our audio thread
-	if (pthread_create(&AudioThreadHandle, 0, audioThread, 0))
+	if (create_rt_thread(&AudioThreadHandle, audioThread, 0))
 	{
 		msg = "Can't start audio thread";
 		AudioThreadHandle = 0;
@@ -3223,9 +6975,12 @@ static void audio_Off(void)
 		// Let audio thread know we want it to terminate
 		AudioThreadFlags = 0;
 
-		// Force a wakeup if poll'ing
-		snd_pcm_drop((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
-		write(DescPtrs->fd, &byt, 1);
+		// Force a wakeup if poll'ing. (With no card, it wakes within a period)
+		if (SoundDev[DEVNUM_AUDIOOUT].DevHash)
+		{
+			snd_pcm_drop((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
+			write(DescPtrs->fd, &byt, 1);
+		}
 
 		// Wait for thread to end
 		while (AudioThreadHandle) sleep(1);
@@ -3255,6 +7010,7 @@ static void resetAudioVars(void)
 #ifndef NO_ALSA_AUDIO_SUPPORT
 	DescPtrs = 0;
 	NonInterleaveFlag = 0;
+	CurrTune = 0;
 	xrun_count(-1);
 #endif
 #ifndef NO_JACK_SUPPORT
@@ -3363,13 +7119,16 @@ void freeAudio(register unsigned char unload)
 	if (SoundDev[DEVNUM_AUDIOOUT].Handle)
 	{
 #ifndef NO_JACK_SUPPORT
-		if (!SoundDev[DEVNUM_AUDIOOUT].DevHash)
+		if (IS_JACK_OUT())
 			unload_libjack();
 #ifndef NO_ALSA_AUDIO_SUPPORT
 		else
 #endif
 #endif
 #ifndef NO_ALSA_AUDIO_SUPPORT
+		if (!SoundDev[DEVNUM_AUDIOOUT].DevHash)
+			closeNullAudio();
+		else
 		{
 			drawGuiCtl(0, CTLMASK_XRUN, 0);
 			snd_pcm_close((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
@@ -3377,6 +7136,14 @@ void freeAudio(register unsigned char unload)
 #endif
 	}
 	SoundDev[DEVNUM_AUDIOOUT].Handle = SoundDev[DEVNUM_AUDIOIN].Handle = 0;
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	AudioLinked = 0;
+#endif
+
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	// Finish the recording, now that the audio thread is stopped
+	stopRecorder();
+#endif
 
 #ifndef NO_ALSA_AUDIO_SUPPORT
 	// Free poll() array
@@ -3397,6 +7164,9 @@ void freeAudio(register unsigned char unload)
 
 		// Free wave mem
 		unloadAllInstruments();
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+		closePool();
+#endif
 
 		// Free VOICE_INFOs
 		freeVoices();
@@ -3533,21 +7303,52 @@ bad2:	snd_pcm_hw_params_free(hw_params);
 #endif
 		// Set hardware buffer/period size
 		period_size = get_period_size(NumChans);
-		buffer_size = period_size * 2;
-		//printf("period_size=%u, Buffer=%u\n", period_size, buffer_size);
-		snd_pcm_hw_params_set_buffer_size_near(audioHandle, hw_params, &buffer_size);
-		snd_pcm_hw_params_set_period_size_near(audioHandle, hw_params, &period_size, 0);
+		FramesPerPeriod = period_size / (NumChans * sizeof(int32_t));
+		TschedBufferFrames = 0;
+
+		// Timer scheduling? The card must hold at least 8 of our mix blocks
+		if ((AppFlags4 & APPFLAG4_TSCHED) && snd_pcm_hw_params_get_buffer_size_max(hw_params, &buffer_size) >= 0 && buffer_size >= FramesPerPeriod * 8)
+		{
+			// The user's buffer setting decides only our mix block, and hence latency. The
+			// card gets a large buffer (about 1/4 second) with as few interrupts as it
+			// allows, since our timer (not the card) wakes the audio thread
+			buffer_size = Rates[SampleRateFactor] / 4;
+			if (buffer_size < FramesPerPeriod * 8) buffer_size = FramesPerPeriod * 8;
+			snd_pcm_hw_params_set_buffer_size_near(audioHandle, hw_params, &buffer_size);
+			period_size = buffer_size / 2;
+			snd_pcm_hw_params_set_period_size_near(audioHandle, hw_params, &period_size, 0);
+
+			// Tell the driver not to bother interrupting at all, if it can do that
+			snd_pcm_hw_params_set_period_wakeup(audioHandle, hw_params, 0);
+
+			// Keep 4 blocks queued, and refill when down to 2. On an xrun,
+			// audioTschedLoop() raises both by a block
+			TschedBufferFrames = buffer_size;
+			TschedTarget = FramesPerPeriod * 4;
+			TschedWatermark = FramesPerPeriod * 2;
+		}
+		else
+		{
+			buffer_size = period_size * 2;
+			//printf("period_size=%u, Buffer=%u\n", period_size, buffer_size);
+			snd_pcm_hw_params_set_buffer_size_near(audioHandle, hw_params, &buffer_size);
+			snd_pcm_hw_params_set_period_size_near(audioHandle, hw_params, &period_size, 0);
 
-		// Get the # of frames in a "block" we "mix"
-		FramesPerPeriod = period_size / (NumChans * sizeof(int32_t));
+			// Get the # of frames in a "block" we "mix"
+			FramesPerPeriod = period_size / (NumChans * sizeof(int32_t));
+		}
 
-		// We need a stereo float mixing buffer for the reverb/input, and one for the output mix
-		if (!(MixBuffPtr = (char *)malloc(FramesPerPeriod * 2 * sizeof(float) * 2)))
+		// We need a float mixing buffer for the output mix (as wide as the chan pairs the musicians
+		// are routed to), and stereo ones for the reverb send, reverb return, and input
+		setup_outputs(NumChans);
+		if (!(MixBuffPtr = (char *)malloc(FramesPerPeriod * sizeof(float) * (MixChans + 2 + 2 + 2))))
 		{
 			msg = &NoMemStr[0];
 			goto bad2;
 		}
-		ReverbBuffPtr = MixBuffPtr + (FramesPerPeriod * 2 * sizeof(float));
+		ReverbBuffPtr = MixBuffPtr + (FramesPerPeriod * MixChans * sizeof(float));
+		RevOutBuffPtr = ReverbBuffPtr + (FramesPerPeriod * 2 * sizeof(float));
+		InputBuffPtr = RevOutBuffPtr + (FramesPerPeriod * 2 * sizeof(float));
 	}
 
 	// Input setup
@@ -3565,31 +7366,25 @@ bad2:	snd_pcm_hw_params_free(hw_params);
 			}
 
 			NumInChans = 2;
+		}
 
-			// If more than 1 chan, we need to set this the same as output
-			if (snd_pcm_hw_params_set_access(audioHandle, hw_params, NonInterleaveFlag ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED : SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0)
-			{
-same:			msg = "Can't set audio input the same as audio out";
-				goto bad2;
-			}
+		// Direct access to the soundcard's buffer. readAudioData() handles either layout
+		if (snd_pcm_hw_params_set_access(audioHandle, hw_params, NonInterleaveFlag ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED : SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0 &&
+			snd_pcm_hw_params_set_access(audioHandle, hw_params, NonInterleaveFlag ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_MMAP_NONINTERLEAVED) < 0)
+		{
+same:		msg = "Can't set audio input the same as audio out";
+			goto bad2;
 		}
 
 		if (snd_pcm_hw_params_set_format(audioHandle, hw_params, SND_PCM_FORMAT_S32_LE) < 0) goto same;
 
-		// Set hardware buffer/period size
-		get_period_size(NumInChans);
-		buffer_size = period_size * 2;
-		//printf("period_size=%u, Buffer=%u\n", period_size, buffer_size);
+		// Set hardware buffer/period size the same as audio out, so both wake together
+		buffer_size = HwBufferFrames;
+		period_size = HwPeriodFrames;
 		snd_pcm_hw_params_set_buffer_size_near(audioHandle, hw_params, &buffer_size);
 		snd_pcm_hw_params_set_period_size_near(audioHandle, hw_params, &period_size, 0);
-
-		{
-		register uint32_t		framesPerPeriod;
-
-		// Get the # of frames in a "block" we input
-		framesPerPeriod = period_size / (NumInChans * sizeof(int32_t));
-		if (framesPerPeriod != FramesPerPeriod) goto same;
-		}
+		if (TschedBufferFrames) snd_pcm_hw_params_set_period_wakeup(audioHandle, hw_params, 0);
+		if (period_size != HwPeriodFrames) goto same;
 	}
 
 	if (snd_pcm_hw_params(audioHandle, hw_params) < 0)
@@ -3598,6 +7393,13 @@ same:			msg = "Can't set audio input the same as audio out";
 		goto bad2;
 	}
 
+	// Save what audio out got, for audio in to match
+	if (audioHandle == (snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)
+	{
+		snd_pcm_hw_params_get_buffer_size(hw_params, &HwBufferFrames);
+		snd_pcm_hw_params_get_period_size(hw_params, &HwPeriodFrames, 0);
+	}
+
 	snd_pcm_hw_params_free(hw_params);
 	}
 
@@ -3618,8 +7420,9 @@ bad3:	snd_pcm_sw_params_free(sw_params);
 		goto bad1;
 	}
 
-	// Tell ALSA to wake us up whenever period_size or more frames of playback data can be written
-	if (snd_pcm_sw_params_set_avail_min(audioHandle, sw_params, period_size) < 0)
+	// Tell ALSA to wake us up whenever period_size or more frames of playback data can be written.
+	// For timer scheduling, we never wait on ALSA, so let it wake us as seldom as possible
+	if (snd_pcm_sw_params_set_avail_min(audioHandle, sw_params, TschedBufferFrames && audioHandle == (snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle ? buffer_size : period_size) < 0)
 	{
 		msg = "Can't set audio block size";
 		goto bad3;
@@ -3639,6 +7442,12 @@ bad3:	snd_pcm_sw_params_free(sw_params);
 		goto bad3;
 	}
 
+	// For timer scheduling, have ALSA timestamp the hardware pointer with the same clock
+	// we sleep on. If it can't, we use the time we read the pointer instead
+	if (TschedBufferFrames && audioHandle == (snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)
+		TschedStamp = (snd_pcm_sw_params_set_tstamp_mode(audioHandle, sw_params, SND_PCM_TSTAMP_ENABLE) >= 0 &&
+			snd_pcm_sw_params_set_tstamp_type(audioHandle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC) >= 0);
+
 	if (snd_pcm_sw_params(audioHandle, sw_params) < 0)
 	{
 		msg = "Can't set software params";
@@ -3653,7 +7462,7 @@ bad3:	snd_pcm_sw_params_free(sw_params);
 
 static uint32_t get_period_size(register unsigned char numChans)
 {
-	return sizeof(int32_t) * numChans * (12 + (setFrameSize(0) << 2));
+	return sizeof(int32_t) * numChans * (12 + ((CurrTune ? CurrTune->FrameSize : setFrameSize(0)) << 2));
 }
 
 /********************** openAudioIn() **********************
@@ -3683,8 +7492,10 @@ static const char * openAudioIn(void)
 			}
 		}
 
-		// Setup hardware
-		else msg = setupAudioHardware((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle);
+		// Setup hardware. Link in to out so both start/stop on the same clock tick. (Not
+		// possible if they're separate cards, which then drift apart slowly)
+		else if (!(msg = setupAudioHardware((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)))
+			AudioLinked = (snd_pcm_link((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, (snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle) >= 0);
 
 		return msg;
 	}
@@ -3692,6 +7503,184 @@ static const char * openAudioIn(void)
 	return 0;
 }
 
+/******************** openNullAudio() ********************
+ * Sets up AUDIODEV_NULL/AUDIODEV_FILE audio out. In place
+ * of a card's buffer, we mix into our own, a block of the
+ * user's Buffer setting each period, with as many chans as
+ * the musicians are routed to. startRecorder() creates
+ * AUDIODEV_FILE's WAV file.
+ */
+
+static const char * openNullAudio(void)
+{
+	setup_outputs(MAX_OUT_PAIRS * 2);
+	NumChans = MixChans;
+	TschedBufferFrames = 0;
+	FramesPerPeriod = get_period_size(NumChans) / (NumChans * sizeof(int32_t));
+#ifndef NO_REVERB_SUPPORT
+	setupReverb();
+#endif
+	if (!(MixBuffPtr = (char *)malloc(FramesPerPeriod * sizeof(float) * (MixChans + 2 + 2 + 2))) ||
+		!(SoundDev[DEVNUM_AUDIOOUT].Handle = malloc(FramesPerPeriod * NumChans * sizeof(int32_t))))
+	{
+		return &NoMemStr[0];
+	}
+	ReverbBuffPtr = MixBuffPtr + (FramesPerPeriod * MixChans * sizeof(float));
+	RevOutBuffPtr = ReverbBuffPtr + (FramesPerPeriod * 2 * sizeof(float));
+	InputBuffPtr = RevOutBuffPtr + (FramesPerPeriod * 2 * sizeof(float));
+
+	return 0;
+}
+
+
+
+
+
+/******************** setAutoBuffer() *********************
+ * Sets how many minutes the auto buffer tuner plays at
+ * one buffer size before trying a smaller. 0 turns off
+ * the tuner. 0xff queries.
+ */
+
+unsigned char setAutoBuffer(register unsigned char minutes)
+{
+	if (minutes != 0xff) TuneSoak = minutes;
+	return TuneSoak;
+}
+
+/******************** startTuning() *********************
+ * Called by allocAudio() before setting up audio out, to
+ * get the card's auto buffer tuning (or start a new one
+ * at a conservative size).
+ */
+
+static void startTuning(void)
+{
+	register LATENCY_TUNE *	tune;
+
+	CurrTune = 0;
+	if (TuneSoak)
+	{
+		// Look for this card. If the list is full, reuse the last one
+		tune = &Tunings[0];
+		while (tune->DevHash && (tune->DevHash != SoundDev[DEVNUM_AUDIOOUT].DevHash || tune->Dev != SoundDev[DEVNUM_AUDIOOUT].Dev))
+		{
+			if (++tune >= &Tunings[MAX_TUNINGS]) (--tune)->DevHash = 0;
+		}
+
+		if (!tune->DevHash)
+		{
+			memset(tune, 0, sizeof(LATENCY_TUNE));
+			tune->DevHash = SoundDev[DEVNUM_AUDIOOUT].DevHash;
+			tune->Dev = SoundDev[DEVNUM_AUDIOOUT].Dev;
+			tune->FrameSize = setFrameSize(0) > TUNE_START_SIZE ? setFrameSize(0) : TUNE_START_SIZE;
+			SaveConfigFlag |= SAVECONFIG_DEVICES;
+		}
+
+		CurrTune = tune;
+	}
+
+	TuneXRuns = TuneLoad = 0;
+	TuneFrames = 0;
+}
+
+/******************** resizeAudio() *********************
+ * Sets up the open audio in/out again, for a new buffer
+ * size, and restarts the audio thread.
+ *
+ * NOTE: Displays any error msg.
+ */
+
+static void resizeAudio(void)
+{
+	register const char *	msg;
+
+	// Stop the audio thread, and free the cards' buffers, but leave them open
+	audio_Off();
+	if (SoundDev[DEVNUM_AUDIOIN].Handle)
+	{
+		if (AudioLinked) snd_pcm_unlink((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle);
+		AudioLinked = 0;
+		snd_pcm_hw_free((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle);
+	}
+	snd_pcm_hw_free((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle);
+	free(DescPtrs);
+	DescPtrs = 0;
+	free(MixBuffPtr);
+	MixBuffPtr = 0;
+	NonInterleaveFlag = 0;
+
+	if (!(msg = setupAudioHardware((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)))
+	{
+		if (SoundDev[DEVNUM_AUDIOIN].Handle && !(msg = setupAudioHardware((snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle)))
+			AudioLinked = (snd_pcm_link((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle, (snd_pcm_t *)SoundDev[DEVNUM_AUDIOIN].Handle) >= 0);
+		if (!msg) msg = audio_On();
+	}
+
+	if (msg)
+	{
+		freeAudio(0);
+		show_msgbox(msg);
+	}
+}
+
+/********************* tuneAudio() **********************
+ * Called by main thread when the accomp stops playing.
+ * This is where the auto buffer tuner decides upon a
+ * new buffer size for audio out, since nothing is
+ * playing. After any xrun, it backs off to a larger size,
+ * and won't try that smaller size again. Otherwise, once
+ * the current size has played clean for the soak time,
+ * with enough headroom, it tries a smaller size.
+ */
+
+void tuneAudio(void)
+{
+	register LATENCY_TUNE *	tune;
+
+	if ((tune = CurrTune) && AudioThreadHandle && !BeatInPlay)
+	{
+		register uint32_t		size;
+
+		size = tune->FrameSize;
+		if (TuneLoad > tune->Load) tune->Load = TuneLoad;
+
+		if (TuneXRuns)
+		{
+			tune->Floor = size;
+			size += (size >> 2) + 1;
+			if (size > 255) size = 255;
+		}
+		else
+		{
+			register uint32_t		minutes;
+
+			// Add up the minutes played clean at this size
+			minutes = TuneFrames / (Rates[SampleRateFactor] * 60);
+			TuneFrames -= minutes * Rates[SampleRateFactor] * 60;
+			minutes += tune->Minutes;
+			tune->Minutes = minutes > 255 ? 255 : minutes;
+
+			if (tune->Minutes >= TuneSoak && tune->Load < TUNE_MAX_LOAD)
+			{
+				size -= (size >> 2) ? (size >> 2) : 1;
+				if (size <= tune->Floor) size = tune->Floor + 1;
+			}
+		}
+
+		TuneXRuns = 0;
+		SaveConfigFlag |= SAVECONFIG_DEVICES;
+
+		if (size != tune->FrameSize)
+		{
+			tune->FrameSize = (unsigned char)size;
+			tune->Load = tune->Minutes = TuneLoad = 0;
+			TuneFrames = 0;
+			resizeAudio();
+		}
+	}
+}
+
 #endif
 
 
@@ -3763,22 +7752,37 @@ retry_in:
 			}
 
 			// Setup audio out
+			startTuning();
 			if ((msg = setupAudioHardware((snd_pcm_t *)SoundDev[DEVNUM_AUDIOOUT].Handle)) ||
 
 				// Open audio in, if chosen
 				(msg = openAudioIn()) ||
 
+				// Start the recorder, if enabled
+				(msg = startRecorder(0)) ||
+
 				// Start audio thread
 				(msg = audio_On()))
 			{
-#ifndef NO_JACK_SUPPORT
-out2:
-#endif
-				freeAudio(0);
+out2:			freeAudio(0);
 out:			show_msgbox(msg);
 				return 1;
 			}
 		}
+
+		// No card? Then our own timer paces the audio thread
+		else if (SoundDev[DEVNUM_AUDIOOUT].Dev != AUDIODEV_JACK)
+		{
+			if ((msg = openNullAudio()) ||
+
+				// AUDIODEV_FILE records all outs, through the recorder's ring, so the
+				// audio thread never waits on the disk
+				(msg = startRecorder(SoundDev[DEVNUM_AUDIOOUT].Dev == AUDIODEV_FILE ? &WaveOutName[0] : 0)) ||
+				(msg = audio_On()))
+			{
+				goto out2;
+			}
+		}
 #endif
 #ifndef NO_JACK_SUPPORT
 #ifndef NO_ALSA_AUDIO_SUPPORT
@@ -4332,6 +8336,34 @@ out:
 
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
 
+/******************** setStartFrame() *********************
+ * Sets the frame at which a voice starts, per the thread
+ * starting it.
+ */
+
+static void setStartFrame(register VOICE_INFO * voiceInfo, register unsigned char threadId)
+{
+	voiceInfo->StartFrame = voiceInfo->BeatFrame = 0;
+	if (threadId == MIDITHREADID)
+		voiceInfo->StartFrame = MidiStartFrame;
+	else if (threadId == BEATTHREADID)
+	{
+		voiceInfo->StartFrame = BeatStartFrame;
+		voiceInfo->BeatFrame = BeatPlaceFrame;
+	}
+}
+
+/****************** setMidiStartFrame() *******************
+ * Called by a MIDI in thread, before it parses input that
+ * the audio thread queued, to set the frame at which any
+ * note it starts begins (0 for the next block).
+ */
+
+void setMidiStartFrame(register uint32_t frame)
+{
+	MidiStartFrame = frame;
+}
+
 static void voiceToPlayQueue(register VOICE_INFO * voiceInfo, register unsigned char threadId)
 {
 #ifdef TEST_AUDIO_MIX
@@ -4353,6 +8385,7 @@ static void voiceToPlayQueue(register VOICE_INFO * voiceInfo, register unsigned
 
 		// Mark voice as in the play queue. Audio thread clears this when removed from queue
 		voiceInfo->AudioFuncFlags |= AUDIOPLAYFLAG_QUEUED;
+		setStartFrame(voiceInfo, threadId);
 
 		voiceInfo->Next = VoicePlayQueue;
 		VoicePlayQueue = voiceInfo;
@@ -4361,11 +8394,54 @@ static void voiceToPlayQueue(register VOICE_INFO * voiceInfo, register unsigned
 		__atomic_and_fetch(&VoicePlayLock, ~threadId, __ATOMIC_RELAXED);
 	}
 	else
+	{
+		setStartFrame(voiceInfo, threadId);
 		voiceInfo->AudioFuncFlags |= AUDIOPLAYFLAG_QUEUED;
+	}
+}
+
+
+
+
+/********************* fadeInVoice() **********************
+ * Quickly fades in a voice that starts somewhere past the
+ * waveform's head (ie, legato, or a late chord), so the
+ * jump into the wave doesn't click, and the attack overlaps
+ * the previous note's release.
+ */
+
+static void fadeInVoice(register VOICE_INFO * voiceInfo)
+{
+	voiceInfo->AttackLevel = voiceInfo->VolumeFactor;
+	voiceInfo->VolumeFactor = 0.2f;
+	voiceInfo->ReleaseTime = DecayRate * 4 - ((voiceInfo->NoteNum & 0x7f) / 40);
+	voiceInfo->AudioFuncFlags |= AUDIOPLAYFLAG_SKIP_RELEASE;
 }
 
+/******************** skipLateAttack() *********************
+ * Called after setupVoice() for a beat thread note. If the
+ * note is late (see setBeatLate), skips the part of the
+ * waveform that should already have played. Doesn't skip
+ * into the loop, nor past the end of the wave.
+ */
 
+static void skipLateAttack(register VOICE_INFO * voiceInfo)
+{
+	register WAVEFORM_INFO *	waveInfo;
+	register uint32_t				offset;
 
+	if (BeatSkipFrames)
+	{
+		// Convert output frames to wave frames at the transposed pitch
+		waveInfo = voiceInfo->Waveform;
+		offset = voiceInfo->CurrentOffset + (uint32_t)(((uint64_t)BeatSkipFrames * voiceInfo->TransposeIncrement) >> UPSAMPLE_BITS);
+		if (offset * (waveInfo->WaveFlags ? 2 : 1) < (waveInfo->LoopBegin == (uint32_t)-1 ? waveInfo->WaveformLen : waveInfo->LoopBegin))
+		{
+			if (!voiceInfo->CurrentOffset) fadeInVoice(voiceInfo);
+			voiceInfo->CurrentOffset = offset;
+		}
+	}
+}
 
 static void setupVoice(register PLAYZONE_INFO * zone, register VOICE_INFO * voiceInfo, unsigned char noteNum, unsigned char velocity)
 {
@@ -4382,13 +8458,7 @@ static void setupVoice(register PLAYZONE_INFO * zone, register VOICE_INFO * voic
 
 	// Set the current play position to the start of the waveform data
 	voiceInfo->TransposeFracPos = 0;
-	if (voiceInfo->CurrentOffset)
-	{
-		voiceInfo->AttackLevel = voiceInfo->VolumeFactor;
-		voiceInfo->VolumeFactor = 0.2f;
-		voiceInfo->ReleaseTime = DecayRate * 4 - ((voiceInfo->NoteNum & 0x7f) / 40);
-		voiceInfo->AudioFuncFlags |= AUDIOPLAYFLAG_SKIP_RELEASE;
-	}
+	if (voiceInfo->CurrentOffset) fadeInVoice(voiceInfo);
 
 	// Prepare for transpose, with linear interpolation
 	//voiceInfo->NoteNum = noteNum;
@@ -4531,6 +8601,7 @@ void startBassNote(unsigned char noteNum, unsigned char velocity, unsigned char
 								voiceInfo->Waveform = waveInfo;
 								voiceInfo->NoteNum = noteNum;
 								setupVoice(zone, voiceInfo, noteNum, velocity);
+								if (threadId == BEATTHREADID) skipLateAttack(voiceInfo);
 
 								// Let audio thread play this voice now
 								voiceToPlayQueue(voiceInfo, threadId);
@@ -5405,6 +9476,7 @@ void startGtrString(register unsigned char string, register unsigned char noteNu
 								voiceInfo->AttackDelay = PickAttack++;
 
 								setupVoice(zone, voiceInfo, noteNum, velocity);
+								if (threadId == BEATTHREADID) skipLateAttack(voiceInfo);
 
 								if (PickAttack < 6) PickAttack++;
 								if (PickAttack > 8) PickAttack = 0;
@@ -5623,7 +9695,7 @@ upd:			unlockInstrument(threadId);
 				if (lockInstrument(threadId) == threadId)
 				{
 					send_patch(PLAYER_PAD, PadPatchNums[padnum - 1], threadId | SETINS_NO_LSB | SETINS_NO_MSB);
-					checkStartPadNotes();
+					checkStartPadNotes(threadId);
 				}
 				goto upd;
 			}
@@ -5637,7 +9709,7 @@ upd:			unlockInstrument(threadId);
 				if (lockInstrument(threadId) == threadId)
 				{
 					CurrentInstrument[PLAYER_PAD] = patch;
-					checkStartPadNotes();
+					checkStartPadNotes(threadId);
 				}
 				goto upd;
 			}
@@ -5710,10 +9782,11 @@ uint32_t fadePadVoices(register unsigned char mutespeed)
 
 
 /********************** startPadVoices() ********************
- * Starts the pad voices.
+ * Starts the pad voices. Called by the beat, midi in, or
+ * main thread, whose ID is passed.
  */
 
-void startPadVoices(unsigned char * noteNums, unsigned char release)
+void startPadVoices(unsigned char * noteNums, unsigned char release, register unsigned char threadId)
 {
 #if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
 	if (DevAssigns[PLAYER_PAD] >= &SoundDev[DEVNUM_MIDIOUT1])
@@ -5729,12 +9802,12 @@ void startPadVoices(unsigned char * noteNums, unsigned char release)
 			if ((msg[1] = PadNotes[string]))
 			{
 				msg[2] = 0;
-				sendMidiOut(DevAssigns[PLAYER_PAD], msg, 3|BEATTHREADID);
+				sendMidiOut(DevAssigns[PLAYER_PAD], msg, 3|threadId);
 			}
 
 			PadNotes[string] = msg[1] = noteNums[string];
 			msg[2] = ChordVel;
-			sendMidiOut(DevAssigns[PLAYER_PAD], msg, 3|BEATTHREADID);
+			sendMidiOut(DevAssigns[PLAYER_PAD], msg, 3|threadId);
 		}
 
 		PlayFlags |= PLAYFLAG_CHORDSOUND;
@@ -5807,9 +9880,9 @@ next:		if (waveInfo && (voiceInfo = VoiceLists[PLAYER_PAD]))
 				// If audio thread is currently accessing the voice,
 				// wait for that to finish before we rewrite it
 #ifdef JG_NOTE_DEBUG
-				lockVoice(voiceInfo,BEATTHREADID,"Pad",noteNums[string]);
+				lockVoice(voiceInfo,threadId,"Pad",noteNums[string]);
 #else
-				lockVoice(voiceInfo, BEATTHREADID);
+				lockVoice(voiceInfo, threadId);
 #endif
 				voiceInfo->Waveform = waveInfo;
 				voiceInfo->NoteNum = noteNums[string];
@@ -5823,10 +9896,12 @@ next:		if (waveInfo && (voiceInfo = VoiceLists[PLAYER_PAD]))
 					voiceInfo->AudioFuncFlags |= AUDIOPLAYFLAG_SKIP_RELEASE;
 					voiceInfo->ReleaseTime = DecayRate * (uint32_t)release;
 				}
+				else if (threadId == BEATTHREADID)
+					skipLateAttack(voiceInfo);
 
-				voiceToPlayQueue(voiceInfo, BEATTHREADID);
+				voiceToPlayQueue(voiceInfo, threadId);
 
-				__atomic_and_fetch(&voiceInfo->Lock, ~BEATTHREADID, __ATOMIC_RELAXED);
+				__atomic_and_fetch(&voiceInfo->Lock, ~threadId, __ATOMIC_RELAXED);
 
 				voiceInfo->TriggerTime = 1;
 
@@ -6044,6 +10119,60 @@ unsigned char * saveAudioConfig(register unsigned char * buffer)
 		*buffer++ = MasterVolAdjust;
 	}
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	{
+	register unsigned char	i;
+
+	for (i = 0; i <= OUTPUT_REVERB; i++)
+	{
+		if (OutPairs[i])
+		{
+			*buffer++ = CONFIGKEY_OUTPUTS + i;
+			*buffer++ = OutPairs[i];
+		}
+	}
+	}
+#endif
+	{
+	register unsigned char	i;
+
+	for (i = RTTHREAD_AUDIO; i <= RTTHREAD_MIDIIN; i++)
+	{
+		if (ThreadCpus[i])
+		{
+			*buffer++ = CONFIGKEY_CPUS + i;
+			*buffer++ = ThreadCpus[i];
+		}
+	}
+	}
+
+#ifndef NO_JACK_SUPPORT
+	if (JackSync)
+	{
+		*buffer++ = CONFIGKEY_JACKSYNC;
+		*buffer++ = JackSync;
+	}
+#endif
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	if (RecMode)
+	{
+		*buffer++ = CONFIGKEY_RECORD;
+		*buffer++ = RecMode;
+	}
+#endif
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	if (MidiInPoll)
+	{
+		*buffer++ = CONFIGKEY_MIDIPOLL;
+		*buffer++ = MidiInPoll;
+	}
+	if (BeatSched)
+	{
+		*buffer++ = CONFIGKEY_BEATSCHED;
+		*buffer++ = BeatSched;
+	}
+#endif
+
 #ifndef NO_ALSA_AUDIO_SUPPORT
 	if (SampleRateFactor)
 	{
@@ -6056,6 +10185,25 @@ unsigned char * saveAudioConfig(register unsigned char * buffer)
 		*buffer++ = CONFIGKEY_FRAMES;
 		*buffer++ = setFrameSize(0);
 	}
+
+	{
+	register uint32_t		i;
+
+	for (i = MONITOR_VOL; i <= MONITOR_REVERB; i++)
+	{
+		if (MonitorAdjust[i] != (i == MONITOR_VOL ? MAX_VOL_ADJUST - 15 : (i == MONITOR_PAN ? 50 : 0)))
+		{
+			*buffer++ = CONFIGKEY_MONITOR + i;
+			*buffer++ = MonitorAdjust[i];
+		}
+	}
+	}
+
+	if (TuneSoak)
+	{
+		*buffer++ = CONFIGKEY_AUTOBUF;
+		*buffer++ = TuneSoak;
+	}
 #endif
 #ifndef NO_REVERB_SUPPORT
 	*buffer++ = CONFIGKEY_REVVOL;
@@ -6131,6 +10279,15 @@ static unsigned char prompt_retry(register const char * str)
 #define DEVLOAD_MIDIOUT4	(0x01 << DEVNUM_MIDIOUT4)
 #define DEVLOAD_MIDIIN		(0x01 << DEVNUM_MIDIIN)
 
+// A record of the auto buffer tuner's LATENCY_TUNE for some audio out card,
+// rather than a device. 10 bytes
+#define DEVCONFIG_TUNING	0x80
+#define DEVCONFIG_TUNESIZE	10
+
+// A record of an External Synth's latency (in msecs). 3 bytes
+#define DEVCONFIG_LATENCY	0x81
+#define DEVCONFIG_LATSIZE	3
+
 static const char DevicesName[] = "Devices";
 
 void loadDeviceConfig(void)
@@ -6152,6 +10309,39 @@ void loadDeviceConfig(void)
 		register unsigned char	devnum;
 
 		devnum = ptr[0];
+
+		if (devnum == DEVCONFIG_TUNING && &ptr[DEVCONFIG_TUNESIZE] <= endptr)
+		{
+#ifndef NO_ALSA_AUDIO_SUPPORT
+			register LATENCY_TUNE *	tune;
+
+			for (tune = &Tunings[0]; tune < &Tunings[MAX_TUNINGS]; tune++)
+			{
+				if (!tune->DevHash)
+				{
+					tune->DevHash = getLong(&ptr[1]);
+					tune->Dev = ptr[5];
+					tune->FrameSize = ptr[6] ? ptr[6] : TUNE_START_SIZE;
+					tune->Floor = ptr[7];
+					tune->Load = ptr[8];
+					tune->Minutes = ptr[9];
+					break;
+				}
+			}
+#endif
+			ptr += DEVCONFIG_TUNESIZE;
+			continue;
+		}
+
+		if (devnum == DEVCONFIG_LATENCY && &ptr[DEVCONFIG_LATSIZE] <= endptr)
+		{
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+			if (ptr[1] >= DEVNUM_MIDIOUT1 && ptr[1] <= DEVNUM_MIDIOUT4) setMidiOutLatency(ptr[1] - DEVNUM_MIDIOUT1, ptr[2]);
+#endif
+			ptr += DEVCONFIG_LATSIZE;
+			continue;
+		}
+
 		if (&ptr[8] > endptr || devnum > DEVNUM_MIDIIN || ptr[1] > DEVTYPE_SEQ)
 		{
 			if (devnum > DEVNUM_MIDIIN)
@@ -6426,6 +10616,39 @@ void saveDeviceConfig(void)
 		// Write audio in dev name
 		if (SoundDev[DEVNUM_AUDIOIN].DevFlags & DEVFLAG_DEVTYPE_MASK)
 			buffer = store_dev(buffer, DEVNUM_AUDIOIN);
+
+		// Write auto buffer tunings. Last, since older versions stop reading at them
+		{
+		register LATENCY_TUNE *	tune;
+
+		for (tune = &Tunings[0]; tune < &Tunings[MAX_TUNINGS] && tune->DevHash; tune++)
+		{
+			*buffer++ = DEVCONFIG_TUNING;
+			storeLong(tune->DevHash, buffer);
+			buffer += 4;
+			*buffer++ = tune->Dev;
+			*buffer++ = tune->FrameSize;
+			*buffer++ = tune->Floor;
+			*buffer++ = tune->Load;
+			*buffer++ = tune->Minutes;
+		}
+		}
+#endif
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+		// Write External Synth latencies. 0 is the def
+		{
+		register unsigned char devnum;
+
+		for (devnum = DEVNUM_MIDIOUT1; devnum <= DEVNUM_MIDIOUT4; devnum++)
+		{
+			if ((buffer[2] = setMidiOutLatency(devnum - DEVNUM_MIDIOUT1, 0xFF)))
+			{
+				buffer[0] = DEVCONFIG_LATENCY;
+				buffer[1] = devnum;
+				buffer += DEVCONFIG_LATSIZE;
+			}
+		}
+		}
 #endif
 		{
 		register int				fh;
@@ -6515,6 +10738,28 @@ int loadAudioConfig(register unsigned char * ptr, register unsigned long len)
 		goto ret1;
 	}
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	if (ptr[0] >= CONFIGKEY_OUTPUTS && ptr[0] <= CONFIGKEY_OUTPUTS + OUTPUT_REVERB)
+	{
+		setOutputPair(ptr[0] - CONFIGKEY_OUTPUTS, ptr[1]);
+		goto ret1;
+	}
+#endif
+
+	if (ptr[0] >= CONFIGKEY_CPUS && ptr[0] <= CONFIGKEY_CPUS + RTTHREAD_MIDIIN)
+	{
+		setThreadCpu(ptr[0] - CONFIGKEY_CPUS, ptr[1]);
+		goto ret1;
+	}
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	if (ptr[0] >= CONFIGKEY_MONITOR && ptr[0] <= CONFIGKEY_MONITOR + MONITOR_REVERB)
+	{
+		setMonitor(ptr[0] - CONFIGKEY_MONITOR, ptr[1]);
+		goto ret1;
+	}
+#endif
+
 	// Busses for DevAssigns[DEVNUM_AUDIOOUT] to DevAssigns[DEVNUM_MIDIOUT4]
 	if (ptr[0] >= CONFIGKEY_BUSS && ptr[0] <= CONFIGKEY_BUSS + PLAYER_SOLO)
 	{
@@ -6538,6 +10783,31 @@ ret1:		return 1;
 		case CONFIGKEY_SAMPLERATE:
 #ifndef NO_ALSA_AUDIO_SUPPORT
 			setSampleRateFactor(ptr[0]);
+#endif
+			goto ret1;
+		case CONFIGKEY_AUTOBUF:
+#ifndef NO_ALSA_AUDIO_SUPPORT
+			TuneSoak = ptr[0];
+#endif
+			goto ret1;
+		case CONFIGKEY_JACKSYNC:
+#ifndef NO_JACK_SUPPORT
+			if (ptr[0] <= JACKSYNC_MASTER) JackSync = ptr[0];
+#endif
+			goto ret1;
+		case CONFIGKEY_RECORD:
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+			setRecordMode(ptr[0]);
+#endif
+			goto ret1;
+		case CONFIGKEY_MIDIPOLL:
+#ifndef NO_ALSA_AUDIO_SUPPORT
+			MidiInPoll = ptr[0];
+#endif
+			goto ret1;
+		case CONFIGKEY_BEATSCHED:
+#ifndef NO_ALSA_AUDIO_SUPPORT
+			BeatSched = ptr[0];
 #endif
 			goto ret1;
 		case CONFIGKEY_MASTERVOL:
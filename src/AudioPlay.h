@@ -22,11 +22,33 @@ void				setReverb(GUICTL *, register uint32_t);
 uint32_t			getReverb(register uint32_t);
 void				copy_gtrnotes(register const unsigned char *);
 const char *	open_libjack(void);
+unsigned char	queueJackMidi(register uint32_t, register const unsigned char *, register uint32_t);
+#define JACKSYNC_OFF		0
+#define JACKSYNC_FOLLOW	1
+#define JACKSYNC_MASTER	2
+unsigned char	setJackSync(register unsigned char);
+unsigned char	isJackSync(void);
 void				ignoreErrors(void);
 uint32_t			xrun_count(register int32_t);
+#define MONITOR_VOL		0
+#define MONITOR_PAN		1
+#define MONITOR_REVERB	2
+void				setMonitor(register unsigned char, register unsigned char);
+unsigned char	getMonitor(register unsigned char);
+uint32_t			getRoundTrip(void);
+uint32_t			measureMidiOutLatency(register unsigned char);
+#define OUTPUT_REVERB	(PLAYER_SOLO + 1)
+#define MAX_OUT_PAIRS	8
+void				setOutputPair(register unsigned char, register unsigned char);
+unsigned char	getOutputPair(register unsigned char);
+unsigned char	setAutoBuffer(register unsigned char);
+void				tuneAudio(void);
 void				show_audio_error(register unsigned char);
 void				initAudioVars(void);
-void				loadInstrument(char *, uint32_t, unsigned char);
+int				queueInstrument(const char *, uint32_t, const char *, unsigned char);
+void				startInstrumentLoad(void);
+const char *	nextLoadedInstrument(void);
+void				endInstrumentLoad(void);
 void				loadDataSets(register unsigned char);
 void				freeAudio(register unsigned char);
 void				toggleReverb(register char);
@@ -60,7 +82,7 @@ uint32_t			findSoloInstrument(register char);
 uint32_t		 	changePadInstrument(register unsigned char);
 void *			getPadCached(register unsigned char);
 unsigned char	getPadPgmNum(void);
-void				startPadVoices(unsigned char *, unsigned char);
+void				startPadVoices(unsigned char *, unsigned char, register unsigned char);
 void				stopPadVoices(register unsigned char);
 uint32_t			fadePadVoices(register unsigned char);
 void				startSoloNote(unsigned char, unsigned char, unsigned char);
@@ -82,7 +104,31 @@ void				hashToAlsaDevs(void);
 void				clear_banksel(void);
 void				loadDeviceConfig(void);
 void				saveDeviceConfig(void);
-void				set_thread_priority(void);
+#define RECORD_OFF		0
+#define RECORD_MIX		1
+#define RECORD_OUTS		2
+uint32_t			midiInArrived(register unsigned char);
+void				setMidiStartFrame(register uint32_t);
+unsigned char	getMidiDelay(register uint32_t *, register uint32_t *);
+unsigned char	setMidiInPoll(register unsigned char);
+void				beatTick(register uint32_t);
+void				endBeatTick(void);
+void				setBeatLate(register uint32_t);
+void				resetBeatOnset(void);
+unsigned char	getBeatOnset(register uint32_t *, register uint32_t *);
+unsigned char	setBeatSched(register unsigned char);
+uint32_t			getBeatLatency(void);
+void				setBeatDelay(register uint32_t);
+unsigned char	setRecordMode(register unsigned char);
+uint32_t			getRecordDrops(void);
+#define RTTHREAD_AUDIO		0
+#define RTTHREAD_BEAT		1
+#define RTTHREAD_MIDIIN		2
+int				set_thread_priority(register unsigned char);
+int				create_rt_thread(pthread_t *, void * (*)(void *), void *);
+unsigned char	setThreadCpu(register unsigned char, register unsigned char);
+unsigned char	getNumCpus(void);
+const char *	checkRealtime(register char *);
 unsigned char	lockInstrument(register unsigned char);
 void				unlockInstrument(register unsigned char);
 
@@ -115,3 +161,6 @@ extern struct SOUNDDEVINFO *		DevAssigns[5];
 #define DEVNUM_MIDIOUT3		4
 #define DEVNUM_MIDIOUT4		5
 #define DEVNUM_MIDIIN		6
+
+// Audio out is Jack?
+#define IS_JACK_OUT()	(!SoundDev[DEVNUM_AUDIOOUT].DevHash && SoundDev[DEVNUM_AUDIOOUT].Dev == AUDIODEV_JACK)
@@ -155,10 +155,10 @@ static const uint32_t AppFlags4Bits[] = {
 0xE11AFF2A, // UPPERPAD
 0x2C7D7514,	// NOTOOLTIPS
 0xD5B4BBD2,	// CMDALWAYSON
-0,	// Not used
-0,	// Not used
-0,	// Not used
-0	// Not used
+0x28856B2D,	// BUNDLES
+0xA838F06B,	// SHAREPOOL
+0x30F2B8A1,	// COMPACT
+0x00F088C5	// TSCHED
 };
 
 static char					TimeBuf[6] = "00:00";
@@ -2430,9 +2430,9 @@ again:
 
 nexttime:				if (++numTaps >= 4)
 							{
-								amt = (60000 * (4-1)) / (GuiApp->CurrTime - tapTempo);
-								if (amt > 10 && amt <= 255)
-									set_bpm(amt);
+								amt = (6000000 * (4-1)) / (GuiApp->CurrTime - tapTempo);
+								if (amt >= 1100 && amt <= 25500)
+									set_tempo(amt);
 
 								goto out;
 							}
@@ -3796,6 +3796,15 @@ static void handleClientMsg(register GUIMSG * msg)
 			break;
 		}
 
+#if (!defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)) && !defined(NO_ALSA_AUDIO_SUPPORT)
+		// Setup's Measure worker is done
+		case SIGNALMAIN_MEASURE:
+		{
+			endMeasure();
+			break;
+		}
+#endif
+
 #ifndef NO_MIDI_IN_SUPPORT
 		// User finished assigning a midi msg to a cmd, via his controller
 		case SIGNALMAIN_MIDIIN:
@@ -3862,6 +3871,11 @@ static void updateAllCtls(register uint32_t mask)
 		selectStyleVariation(3, GUITHREADID);
 
 		if (ClockCtl) GuiCtlUpdate(GuiApp, 0, ClockCtl, 0, 0);
+
+#if !defined(NO_ALSA_AUDIO_SUPPORT)
+		// Nothing playing now, so a safe time to change the audio buffer size
+		tuneAudio();
+#endif
 	}
 
 #if !defined(NO_ALSA_AUDIO_SUPPORT)
@@ -4473,6 +4487,14 @@ int main(int argc, char *argv[])
 #endif
 			updChansInUse();
 
+			// Make sure we can run our audio/beat/midi threads realtime, and lock
+			// RAM. Do it before loading waves so they get locked too
+			{
+			register const char *	msg;
+
+			if ((msg = checkRealtime(GuiBuffer))) show_msgbox(msg);
+			}
+
 			// Locate the ALSA rawmidi/alsa devices the enduser saved to config file. We
 			// just verify their status, and get alsa card, dev, sub-dev numbers. We don't
 			// open them yet. We wait until after we load the sampled instruments. Why?
@@ -4519,7 +4541,7 @@ a list of devices from which you can pick one.", GUIBTN_OK_SHOW|GUIBTN_OK_DEFAUL
 				register const char *	err;
 
 				WavesLoadedFlag = 0;
-jack_good:	if (!SoundDev[DEVNUM_AUDIOOUT].DevHash && (err = open_libjack()))
+jack_good:	if (IS_JACK_OUT() && (err = open_libjack()))
 				{
 					sprintf((char *)TempBuffer, "%s. Would you like to choose another audio output?", err);
 					if (GuiErrShow(GuiApp, (char *)TempBuffer, GUIBTN_NO_SHOW|GUIBTN_YES_SHOW|GUIBTN_YES_DEFAULT) == GUIBTN_YES)
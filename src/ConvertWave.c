@@ -45,6 +45,8 @@ unsigned char				GuiLoop;
 
 static WaveCmpConvertPtr *	WaveConvert;
 static WaveCmpDirPtr *		DirConvert;
+static WaveCmpSetFlagsPtr *	SetConvertFlags;
+static WaveCmpUnpackPtr *	Unpack;
 
 
 
@@ -131,6 +133,7 @@ typedef struct
 #define WAVEFLAG_48000		0x10
 #define WAVEFLAG_88200		0x20
 #define WAVEFLAG_96000		0x30
+#define WAVEFLAG_LOSSLESS	0x40	// .cmp file only
 
 // Holds info about one loaded waveform
 typedef struct {
@@ -259,9 +262,11 @@ static const char * waveLoad(char * fn)
 
 			if (drum.WaveformLen >= drum.CompressPoint && (drum.LoopBegin == (uint32_t)-1 || drum.LoopBegin < drum.WaveformLen) && (drum.LoopEnd == (uint32_t)-1 || drum.LoopEnd > drum.LoopBegin))
 			{
-				// Allocate a WAVEFORM_INFO to load in the wave data
+				// Allocate a WAVEFORM_INFO to load in the wave data. A lossless file's data
+				// size is per the header. 16-bit samples upto CompressPoint, then 8-bit
 				fstat(inHandle, &buf);
 				size = buf.st_size - sizeof(DRUMBOXFILE);
+				if (drum.WaveFlags & WAVEFLAG_LOSSLESS) size = (drum.CompressPoint << 1) + (drum.WaveformLen - drum.CompressPoint);
 				if (!(waveInfo = (WAVEFORM_INFO *)malloc(size + sizeof(WAVEFORM_INFO) - 1)))
 				{
 					strcpy(fn, "No memory");
@@ -274,8 +279,21 @@ static const char * waveLoad(char * fn)
 				waveInfo->CompressPoint = drum.CompressPoint;
 				waveInfo->LoopBegin = drum.LoopBegin;
 				waveInfo->LoopEnd = drum.LoopEnd;
-				waveInfo->WaveFlags = drum.WaveFlags;
-				if (read(inHandle, &waveInfo->WaveForm[0], size) == size) message = 0;
+				waveInfo->WaveFlags = drum.WaveFlags & ~WAVEFLAG_LOSSLESS;
+				if (drum.WaveFlags & WAVEFLAG_LOSSLESS)
+				{
+					register unsigned char *	packed;
+					register unsigned long		packedSize;
+
+					packedSize = buf.st_size - sizeof(DRUMBOXFILE);
+					if ((packed = (unsigned char *)malloc(packedSize)))
+					{
+						if (read(inHandle, packed, packedSize) == packedSize &&
+							!Unpack(packed, packedSize, &waveInfo->WaveForm[0], drum.WaveformLen, drum.CompressPoint, (drum.WaveFlags & WAVEFLAG_STEREO) ? 2 : 1)) message = 0;
+						free(packed);
+					}
+				}
+				else if (read(inHandle, &waveInfo->WaveForm[0], size) == size) message = 0;
 			}
 		}
 
@@ -440,14 +458,16 @@ void clearMainWindow(void)
 // Convert screen ctls
 #define CTLID_WAVEDIR		0
 #define CTLID_WAVEFILE		1
-#define CTLID_CMPDIR			3
-#define CTLID_CMPFILE		4
-#define CTLID_MAPDRUMS		6
-#define CTLID_MAPPATCH		7
+#define CTLID_LOSSLESS		2
+#define CTLID_CMPDIR			4
+#define CTLID_CMPFILE		5
+#define CTLID_MAPDRUMS		7
+#define CTLID_MAPPATCH		8
 
 static GUICTL		ConvertCtls[] = {
  	{.Type=CTLTYPE_PUSH,			.Y=0,	.Label="WAVE Dir", .Width=10, .Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GROUPSTART},
  	{.Type=CTLTYPE_PUSH,			.Y=0,	.Label="WAVE File", .Width=10, .Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_NOPADDING},
+ 	{.Type=CTLTYPE_CHECK,		.Y=0,	.Label="Lossless", .Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_AUTO_VAL},
  	{.Type=CTLTYPE_GROUPBOX, .Label="Compress"},
 
  	{.Type=CTLTYPE_PUSH,			.Y=1,	.Label="CMP Dir", .Width=10, .Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GROUPSTART},
@@ -595,6 +615,13 @@ static void do_convertctl(register GUICTL * ctl)
 				break;
 			}
 
+			case CTLID_LOSSLESS:
+			{
+				SetConvertFlags(ctl->Attrib.Value ? WAVECMP_LOSSLESS : 0);
+				GuiCtlUpdate(GuiApp, MainWin, ctl, 0, 0);
+				break;
+			}
+
 			case CTLID_CMPDIR:
 			{
 				WaveDeCmpDir();
@@ -785,7 +812,8 @@ again:
 	}
 	else
 	{
-		if (!(DirConvert = (WaveCmpDirPtr *)dlsym(handle, "WaveCmpDir")) || !(WaveConvert = (WaveCmpConvertPtr *)dlsym(handle, "WaveCmpConvert")))
+		if (!(DirConvert = (WaveCmpDirPtr *)dlsym(handle, "WaveCmpDir")) || !(WaveConvert = (WaveCmpConvertPtr *)dlsym(handle, "WaveCmpConvert")) ||
+			!(SetConvertFlags = (WaveCmpSetFlagsPtr *)dlsym(handle, "WaveCmpSetFlags")) || !(Unpack = (WaveCmpUnpackPtr *)dlsym(handle, "WaveCmpUnpack")))
 		{
 			dlclose(handle);
 			GuiErrShow(GuiApp, "Need a later version of WaveCmp!", GUIBTN_OK_SHOW|GUIBTN_OK_DEFAULT);
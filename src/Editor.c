@@ -228,9 +228,10 @@ void doStyleEdit(void)
 	memcpy(&TempAudioDev, &SoundDev[DEVNUM_AUDIOOUT], sizeof(struct SOUNDDEVINFO));
 	if (SoundDev[DEVNUM_AUDIOOUT].Handle)
 	{
-		if (!SoundDev[DEVNUM_AUDIOOUT].DevHash) goto gotJack;
+		if (IS_JACK_OUT()) goto gotJack;
 		freeAudio(0);
 		SoundDev[DEVNUM_AUDIOOUT].DevHash = 0;
+		SoundDev[DEVNUM_AUDIOOUT].Dev = AUDIODEV_JACK;
 		TempAudioDev.Handle = 0;
 	}
 
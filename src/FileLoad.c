@@ -175,21 +175,18 @@ again:
 				path[size] = '.';
 				path[size+1] = 0;
 
-				// Open the dir for searching. If it doesn't exist, that may not be an error
+				// Open the dir for searching. If it doesn't exist, that may not be an error.
+				// Queue each instrument found. We load them all at once below
 				if ((dirp = opendir(&path[0])))
 				{
-					while ((dirEntryPtr = readdir(dirp)))
+					while (WhatToLoadFlag && (dirEntryPtr = readdir(dirp)))
 					{
 						NamePtr = dirEntryPtr->d_name;
 						if (NamePtr[0] != '.')
 						{
 							strcpy(&path[size], NamePtr);
-							headingCopyTo(NamePtr, 0);
 							strcat(&path[size], "/");
-							GuiWinSignal(GuiApp, 0, SIGNALMAIN_LOADMSG_BASE|WhatToLoadFlag);
-							loadInstrument(path, size + strlen(NamePtr) + 1, i);
-							if (getErrorStr()) post_load_error(arg);
-							if (!WhatToLoadFlag) goto abort;
+							if (queueInstrument(path, size + strlen(NamePtr) + 1, NamePtr, i)) post_load_error(arg);
 						}
 					}
 
@@ -203,6 +200,21 @@ again:
 				WhatToLoadFlag &= ~(0x10 << i);
 			}
 		} while ((WhatToLoadFlag & LOADFLAG_INSTRUMENTS));
+
+		// Load the queued instruments using a worker thread per CPU core. We get
+		// them back in the order queued, to link into the lists and report errors
+		if (WhatToLoadFlag)
+		{
+			startInstrumentLoad();
+			while ((NamePtr = nextLoadedInstrument()))
+			{
+				headingCopyTo(NamePtr, 0);
+				GuiWinSignal(GuiApp, 0, SIGNALMAIN_LOADMSG_BASE|WhatToLoadFlag);
+				if (getErrorStr()) post_load_error(arg);
+				if (!WhatToLoadFlag) break;
+			}
+		}
+		endInstrumentLoad();
 	}
 
 	{
@@ -249,6 +249,10 @@ extern unsigned char				TempFlags;
 #define APPFLAG4_UPPER_PAD		0x02
 #define APPFLAG4_NO_TIPS		0x04
 #define APPFLAG4_CMD_ALWAYS_ON 0x08
+#define APPFLAG4_BUNDLES		0x10
+#define APPFLAG4_SHAREPOOL		0x20
+#define APPFLAG4_COMPACT		0x40
+#define APPFLAG4_TSCHED		0x80
 extern unsigned char				AppFlags4;
 
 const char *	play_button_label(GUIAPPHANDLE, GUICTL *, char *);
@@ -289,6 +293,7 @@ typedef void (*VOIDRETFUNC)(void);
 #define SIGNALMAIN_MIDIVIEW2	134
 #define SIGNALMAIN_CMDSWITCHERR 135
 #define SIGNALMAIN_CMDMODE_SEL 136
+#define SIGNALMAIN_MEASURE		137
 #define SIGNALMAIN_LOADMSG_BASE 0x80000000
 
 #define GUIBTN_EDIT	GUIBTN_ABORT
@@ -158,8 +158,8 @@ static uint32_t do_taptempo(register unsigned char threadId)
 	if (++NumTaps >= 4)
 	{
 		NumTaps = 0;
-		amt = (60000 * (4-1)) / (get_current_clock() - TapTempo);
-		if (amt > 10 && amt <= 255) set_bpm(amt);
+		amt = (6000000 * (4-1)) / (get_current_clock() - TapTempo);
+		if (amt >= 1100 && amt <= 25500) set_tempo(amt);
 	}
 
 	return setTempoLabel(NumTaps);
@@ -1143,6 +1143,16 @@ void *						MidiInSigHandle;
 static MIDIINSIPHON *	SiphonFunc;
 static int					MidiEventHandle, MidiEventQueue;
 
+// When the audio thread services MIDI in (instead of midiInThread), it polls
+// MidiAudioHandle, an epoll set we move the MIDI in fds to. MidiAudioClaimed
+// is set while it does. MidiReadLock ensures only one thread reads/parses
+// MidiInData at a time, during the handoff
+static int					MidiAudioHandle;
+static struct epoll_event	MidiFds[8];
+static unsigned char		NumMidiFds;
+static unsigned char		MidiAudioClaimed;
+static unsigned char		MidiReadLock;
+
 // To smooth the attack of rolls
 #define MIDIKEY_HISTORY	8
 static unsigned char		PlayingKeys[MIDIKEY_HISTORY];
@@ -4145,571 +4155,747 @@ struct MIDIINDATA {
 	unsigned char			InputBuffer[32];
 	struct epoll_event 	Event;
 	};
+	unsigned char			RunningCount;
 };
 #pragma pack()
 
-/******************** midiInThread() **********************
- * A secondary thread that handles MIDI controller input.
- * Supports both ALSA Seq API, and RawMidi API. Only one of
- * those 2 is used at any given time.
+/******************** parseMidiIn() **********************
+ * Processes a block of MIDI input from the controller.
+ * Called by midiInThread(), and by jackMidiInThread() for
+ * msgs received on Jack's midi_in port.
+ *
+ * data =		Running status/partial msg state of the input.
+ * inBuf =		MIDI bytes.
+ * inBufEnd =	End of bytes.
  */
 
-static void * midiInThread(void * arg)
+static void parseMidiIn(register struct MIDIINDATA * data, unsigned char * inBuf, unsigned char * inBufEnd, void * arg)
 {
-	struct MIDIINDATA	data;
-	unsigned char		runningCount;
-
-	data.RunningStatus = 0x90;
-	runningCount = 2;
+	register unsigned char		status;
 
-	// Set the priority to slightly less than audio thread (AudioPlay.c), but same
-	// as Beat Play thread (AccompSeq.c), and higher than gui thread
-	set_thread_priority();
-
-//	arg = GuiWinSignal(GuiApp, 0, 0);
-	MidiInSigHandle = arg = (void *)3;
-
-	for (;;)
+next_in:
+	while (inBuf < inBufEnd)
 	{
-		unsigned char *	inBufEnd;
-
-		// Wait for some midi input from controller
-		epoll_wait(MidiEventHandle, &data.Event, 1, -1);
-
-		// Main thread wants us to terminate?
-		if (data.Event.data.fd == MidiEventQueue || !SoundDev[DEVNUM_MIDIIN].Handle) break;
+		// Move the byte to the head of the buffer, so when we have a complete msg,
+		// the 2 or 3 bytes are RunningStatus/Data1/InputBuffer[0]
+		data->InputBuffer[0] = status = *inBuf++;
 
-#ifndef NO_SEQ_IN_SUPPORT
-		if ((SoundDev[DEVNUM_MIDIIN].DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ)
+		// Status byte?
+		if (status & 0x80)
 		{
-			snd_seq_event_t *ev;
-
-			inBufEnd = &data.InputBuffer[0];
-			do
+			// Is it MIDI System realtime/common/exclusive msg?
+			if (status >= 0xF0)
 			{
-				if (snd_seq_event_input((snd_seq_t *)SoundDev[DEVNUM_MIDIIN].Handle, &ev) < 0) break;
+				// Ignore active sense
+				if (status == 0xFE) goto next_in;
 
-				if (ev->type >= SND_SEQ_EVENT_START && ev->type <= SND_SEQ_EVENT_STOP)
-					*inBufEnd++ = SysStatus[ev->type - SND_SEQ_EVENT_START];
-				if (ev->type >= SND_SEQ_EVENT_NOTEON && ev->type <= SND_SEQ_EVENT_PITCHBEND)
+				if (status != 0xF0 && status != 0xF7)
 				{
-					*inBufEnd++ = SeqStatus[ev->type - SND_SEQ_EVENT_NOTEON] | ev->data.control.channel;
-					if (ev->type <= SND_SEQ_EVENT_KEYPRESS)
-					{
-						*inBufEnd++ = ev->data.note.note;
-						*inBufEnd++ = ev->data.note.velocity;
-					}
-					else if (ev->type <= SND_SEQ_EVENT_CHANPRESS)
-					{
-						if (ev->type < SND_SEQ_EVENT_PGMCHANGE)
-							*inBufEnd++ = (unsigned char)ev->data.control.param;
-						*inBufEnd++ = (unsigned char)ev->data.control.value;
-					}
-					else
-					{
-						register unsigned short		val;
+					register uint32_t		mask;
 
-						val = ev->data.control.value + 8192;
-						*inBufEnd++ = (unsigned char)(val >> 7);
-						*inBufEnd++ = (unsigned char)(val & 0x7F);
-					}
-				}
-
-				snd_seq_free_event(ev);
-			} while (inBufEnd < &data.InputBuffer[32 - 3]);
-		}
-		else
-#endif
-		{
-			register int				count;
-
-			if ((count = snd_rawmidi_read((snd_rawmidi_t *)SoundDev[DEVNUM_MIDIIN].Handle, &data.InputBuffer[0], sizeof(data.InputBuffer))) < 0) count=0;
-			inBufEnd = &data.InputBuffer[count];
-		}
-
-		{
-		unsigned char *				inBuf;
-		register unsigned char		status;
-
-		inBuf = &data.InputBuffer[0];
-next_in:
-		while (inBuf < inBufEnd)
-		{
-			// Move the byte to the head of the buffer, so when we have a complete msg,
-			// the 2 or 3 bytes are RunningStatus/Data1/InputBuffer[0]
-			data.InputBuffer[0] = status = *inBuf++;
-
-			// Status byte?
-			if (status & 0x80)
-			{
-				// Is it MIDI System realtime/common/exclusive msg?
-				if (status >= 0xF0)
-				{
-					// Ignore active sense
-					if (status == 0xFE) goto next_in;
-
-					if (status != 0xF0 && status != 0xF7)
-					{
-						register uint32_t		mask;
-
-						// Let other threads know that I'm awake and processing midi input
-						if (__atomic_or_fetch(&SoundDev[DEVNUM_MIDIIN].Lock, MIDITHREADID, __ATOMIC_RELAXED) != MIDITHREADID) goto next_byte;
+					// Let other threads know that I'm awake and processing midi input
+					if (__atomic_or_fetch(&SoundDev[DEVNUM_MIDIIN].Lock, MIDITHREADID, __ATOMIC_RELAXED) != MIDITHREADID) goto next_byte;
 
-						// Does some thread want to siphon this msg?
-						if (SiphonFunc) goto siphon;
+					// Does some thread want to siphon this msg?
+					if (SiphonFunc) goto siphon;
 resumeSys:
 #ifndef NO_MIDICLOCK_IN
-						if (is_midiclock())
+					if (is_midiclock())
+					{
+						mask = CLOCKTHREADID;
+						switch (status)
 						{
-							mask = CLOCKTHREADID;
-							switch (status)
+							case 0xf8:
 							{
-								case 0xf8:
-								{
-									advance_midiclock();
-									goto next_byte;
-								}
-								case 0xfa:
-								case 0xfb:
-									goto start;
-								case 0xfc:
-									goto stop;
+								advance_midiclock();
+								goto next_byte;
 							}
+							case 0xfa:
+							case 0xfb:
+								goto start;
+							case 0xfc:
+								goto stop;
 						}
+					}
 #endif
-						// Ignore MIDI Clock
-						if (status == 0xF8) goto next_byte;
+					// Ignore MIDI Clock
+					if (status == 0xF8) goto next_byte;
 
-						// Has the user mapped it to some action?
-						if ((mask = findMidiSysCmd(status, 0)))
-							signalMainFromMidiIn(arg, mask);
+					// Has the user mapped it to some action?
+					if ((mask = findMidiSysCmd(status, 0)))
+						signalMainFromMidiIn(arg, mask);
 
-						// If MIDI Start,Stop,Continue, then implement it when
-						// using internal clock, unless user assigned it otherwise
-						// above
-						else
+					// If MIDI Start,Stop,Continue, then implement it when
+					// using internal clock, unless user assigned it otherwise
+					// above
+					else
 #ifndef NO_MIDICLOCK_IN
-						if (!is_midiclock())
+					if (!is_midiclock())
 #endif
+					{
+						mask = MIDITHREADID;
+						switch (status)
 						{
-							mask = MIDITHREADID;
-							switch (status)
+							case 0xfa:
+							case 0xfb:
 							{
-								case 0xfa:
-								case 0xfb:
-								{
 start:							start_play(0, mask);
-									goto next_byte;
-								}
-								case 0xfc:
-								{
+								goto next_byte;
+							}
+							case 0xfc:
+							{
 stop:								stop_play(0, mask);
-									goto next_byte;
-								}
+								goto next_byte;
 							}
 						}
 					}
-
-					// We have no further use for realtime/common/exclusive msgs,
-					// so skip any following data bytes (except wrt realtime msgs)
-					if (data.InputBuffer[0] < 0xF8) data.RunningStatus = 0;
-next_byte:
-					// Let other threads know I'm done processing midi, and going to sleep
-					__atomic_and_fetch(&SoundDev[DEVNUM_MIDIIN].Lock, ~MIDITHREADID, __ATOMIC_RELAXED);
 				}
-				else
-				{
-					// We have the start of a midi msg.
 
-					// Update running status, and the count of data bytes we expect will follow
-					data.RunningStatus = status;
-					runningCount = (status >= 0xC0 && status <= 0xDF ? 1 : 2);
-				}
+				// We have no further use for realtime/common/exclusive msgs,
+				// so skip any following data bytes (except wrt realtime msgs)
+				if (data->InputBuffer[0] < 0xF8) data->RunningStatus = 0;
+next_byte:
+				// Let other threads know I'm done processing midi, and going to sleep
+				__atomic_and_fetch(&SoundDev[DEVNUM_MIDIIN].Lock, ~MIDITHREADID, __ATOMIC_RELAXED);
+			}
+			else
+			{
+				// We have the start of a midi msg.
 
-				goto next_in;
+				// Update running status, and the count of data bytes we expect will follow
+				data->RunningStatus = status;
+				data->RunningCount = (status >= 0xC0 && status <= 0xDF ? 1 : 2);
 			}
 
-			// Get any Midi data byte(s)
+			goto next_in;
+		}
+
+		// Get any Midi data byte(s)
 
-			// Are we ignoring this msg? (status == 0)
-			if ((status = data.RunningStatus))
+		// Are we ignoring this msg? (status == 0)
+		if ((status = data->RunningStatus))
+		{
+			// Check if we are now starting a new msg via running status
+			if (!data->RunningCount) data->RunningCount = (status >= 0xC0 && status <= 0xDF ? 1 : 2);
+
+			// Do we have a complete MIDI msg?
+			if (--data->RunningCount)
 			{
-				// Check if we are now starting a new msg via running status
-				if (!runningCount) runningCount = (status >= 0xC0 && status <= 0xDF ? 1 : 2);
+				// Not yet finished fetching this midi msg. Store first data byte
+				// and then proceed to retrieve the next byte
+				data->Data1 = data->InputBuffer[0];
+			}
+			else
+			{
+				// We got a complete MIDI msg now. Proceed to process it.
+				if (status >= 0xC0 && status <= 0xDF) data->Data1 = data->InputBuffer[0];
 
-				// Do we have a complete MIDI msg?
-				if (--runningCount)
+				// Change note-off to note-on 0 vel, retaining midi chan
+				if (status < 0x90)
 				{
-					// Not yet finished fetching this midi msg. Store first data byte
-					// and then proceed to retrieve the next byte
-					data.Data1 = data.InputBuffer[0];
+					status |= 0x90;
+					data->InputBuffer[0] = 0;
 				}
-				else
-				{
-					// We got a complete MIDI msg now. Proceed to process it.
-					if (status >= 0xC0 && status <= 0xDF) data.Data1 = data.InputBuffer[0];
 
-					// Change note-off to note-on 0 vel, retaining midi chan
-					if (status < 0x90)
-					{
-						status |= 0x90;
-						data.InputBuffer[0] = 0;
-					}
+				if (__atomic_or_fetch(&SoundDev[DEVNUM_MIDIIN].Lock, MIDITHREADID, __ATOMIC_RELAXED) != MIDITHREADID) goto next_byte;
 
-					if (__atomic_or_fetch(&SoundDev[DEVNUM_MIDIIN].Lock, MIDITHREADID, __ATOMIC_RELAXED) != MIDITHREADID) goto next_byte;
+				// ====================== MIDI callback ======================
+				// Does another thread want to siphon this msg? If so, call that siphon function. It
+				// will do something with this midi msg, then report back what it wants us to do
+				if (SiphonFunc)
+				{
+					register MIDIINSIPHON *	func;
 
-					// ====================== MIDI callback ======================
-					// Does another thread want to siphon this msg? If so, call that siphon function. It
-					// will do something with this midi msg, then report back what it wants us to do
-					if (SiphonFunc)
+siphon:				if ((func = SiphonFunc(arg, status >= 0xF0 ? &data->InputBuffer[0] : &data->RunningStatus)) != (MIDIINSIPHON *)-1)
+					// RETURN: -1 means siphon this message, 1 means process the message as usual, 0 or
+					// a ptr to some MIDIINSIPHON means to change the state of siphon (where 0 is remove
+					// siphon)
 					{
-						register MIDIINSIPHON *	func;
-
-siphon:				if ((func = SiphonFunc(arg, status >= 0xF0 ? &data.InputBuffer[0] : &data.RunningStatus)) != (MIDIINSIPHON *)-1)
-						// RETURN: -1 means siphon this message, 1 means process the message as usual, 0 or
-						// a ptr to some MIDIINSIPHON means to change the state of siphon (where 0 is remove
-						// siphon)
+						if (func == (MIDIINSIPHON *)1)
 						{
-							if (func == (MIDIINSIPHON *)1)
-							{
-								// Other thread wants us to proceed with processing the msg
-								// as we normally would
-								if (status > 0xF0) goto resumeSys;
-								goto resume;
-							}
-
-							// Other thread wants us to remove/change its siphon handler
-							SiphonFunc = func;
+							// Other thread wants us to proceed with processing the msg
+							// as we normally would
+							if (status > 0xF0) goto resumeSys;
+							goto resume;
 						}
 
-						// Other thread wants us to skip processing this msg. (ie The thread stole
-						// this msg from us)
-						goto next_byte;
+						// Other thread wants us to remove/change its siphon handler
+						SiphonFunc = func;
 					}
 
-					// =======================================
-					// Master chan command key mode, and note, handling
-					// =======================================
-					{
-					register uint32_t			mask;
-					register unsigned char	chan;
+					// Other thread wants us to skip processing this msg. (ie The thread stole
+					// this msg from us)
+					goto next_byte;
+				}
+
+				// =======================================
+				// Master chan command key mode, and note, handling
+				// =======================================
+				{
+				register uint32_t			mask;
+				register unsigned char	chan;
 
 resume:			chan = status & 0x0f;
-					mask = 0;
+				mask = 0;
 
 #if !defined(NO_DRUMPAD_MODEL) || !defined(NO_WINDCTL_MODEL)
-					if ((AppFlags & (APPFLAG_DRUMPAD|APPFLAG_WINDCTL)) && (MasterMidiChan > 15 || MasterMidiChan == chan))
+				if ((AppFlags & (APPFLAG_DRUMPAD|APPFLAG_WINDCTL)) && (MasterMidiChan > 15 || MasterMidiChan == chan))
+				{
+					if (ChordTrigger == (status & 0xf0)) goto ctl;
+					if ((status & 0xf0) == 0xB0 && ChordTrigger == data->Data1)
 					{
-						if (ChordTrigger == (status & 0xf0)) goto ctl;
-						if ((status & 0xf0) == 0xB0 && ChordTrigger == data.Data1)
-						{
-							data.Data1 = data.InputBuffer[0];
-ctl:						chan = (data.Data1 % 12) + 24;
-							if (chan < 28) chan += 12;
-							data.Data1 /= 12;
-							mask = pickChord(chan, data.Data1, MIDITHREADID);
-							if (PendingPtr) mask = 0x90;
-							goto saveview;
-						}
+						data->Data1 = data->InputBuffer[0];
+ctl:						chan = (data->Data1 % 12) + 24;
+						if (chan < 28) chan += 12;
+						data->Data1 /= 12;
+						mask = pickChord(chan, data->Data1, MIDITHREADID);
+						if (PendingPtr) mask = 0x90;
+						goto saveview;
 					}
+				}
 #endif
-					if (status < 0xA0)
-					{
-						// Apply velocity curve
-						if (data.InputBuffer[0] && VelCurve) data.InputBuffer[0] = Comp1VelCurve[data.InputBuffer[0] - 1];
+				if (status < 0xA0)
+				{
+					// Apply velocity curve
+					if (data->InputBuffer[0] && VelCurve) data->InputBuffer[0] = Comp1VelCurve[data->InputBuffer[0] - 1];
 
-						// Is this a note msg on the Master channel? "Auto" always matches
-						if (MasterMidiChan > 15 || MasterMidiChan == chan)
+					// Is this a note msg on the Master channel? "Auto" always matches
+					if (MasterMidiChan > 15 || MasterMidiChan == chan)
+					{
+						// User sets up "Setup -> Commands -> Switch Note" to designate a
+						// note that switches the Master chan between invoking assigned actions, or playing chords
+						if (data->Data1 == CmdSwitchNote)
 						{
-							// User sets up "Setup -> Commands -> Switch Note" to designate a
-							// note that switches the Master chan between invoking assigned actions, or playing chords
-							if (data.Data1 == CmdSwitchNote)
+							// Note-off
+							if (!data->InputBuffer[0])
 							{
-								// Note-off
-								if (!data.InputBuffer[0])
+								// Has browsing occurred?
+								if (CmdSwitchMode & 0x04)
 								{
-									// Has browsing occurred?
-									if (CmdSwitchMode & 0x04)
-									{
-										// Yes, so we simply end browsing mode, but don't end
-										// command key mode
-										CmdSwitchMode = 0x01;
-									}
-
-									// If not CMD_ALWAYS_ON, we switch in/out of command key mode. Otherwise, we just switch browsing
-									CmdSwitchMode ^= 0x03;
-									if (CmdSwitchMode) goto next_byte;
-									if (AppFlags4 & APPFLAG4_CMD_ALWAYS_ON)
-									{
-										CmdSwitchMode = 0x02;
-										status = 0xc0;
-										mask = CTLMASK_CMDNOTEBROWSE;
-										goto saveview;
-									}
+									// Yes, so we simply end browsing mode, but don't end
+									// command key mode
+									CmdSwitchMode = 0x01;
 								}
 
-								else
+								// If not CMD_ALWAYS_ON, we switch in/out of command key mode. Otherwise, we just switch browsing
+								CmdSwitchMode ^= 0x03;
+								if (CmdSwitchMode) goto next_byte;
+								if (AppFlags4 & APPFLAG4_CMD_ALWAYS_ON)
 								{
-									CmdSwitchMode |= 0x01;
+									CmdSwitchMode = 0x02;
+									status = 0xc0;
+									mask = CTLMASK_CMDNOTEBROWSE;
+									goto saveview;
 								}
-								status = ((mask = notifyCmdMode()) ? 0xc1 : 0xc0);
-								goto saveview;
 							}
 
-							// If not "auto", we use CmdSwitchNote as the split point between chords and command keys
-							if (CmdSwitchMode && (MasterMidiChan > 15 || data.Data1 > (CmdSwitchNote & 0x7f))) goto cmd;
+							else
+							{
+								CmdSwitchMode |= 0x01;
+							}
+							status = ((mask = notifyCmdMode()) ? 0xc1 : 0xc0);
+							goto saveview;
+						}
 
-							// Cancel any tap tempo in progress
-							mask = cancel_midi_taptempo();
+						// If not "auto", we use CmdSwitchNote as the split point between chords and command keys
+						if (CmdSwitchMode && (MasterMidiChan > 15 || data->Data1 > (CmdSwitchNote & 0x7f))) goto cmd;
 
-							// If the Master chan is set to "Auto" (16), then all received note
-							// events are automatically routed to the Human Solo chan, and all
-							// other evts handled globally (as if received on the Master chan)
-							if (MasterMidiChan > 15)
-							{
-								chan = MidiChans[PLAYER_SOLO];
-								status = (status & 0xf0) | chan;
+						// Cancel any tap tempo in progress
+						mask = cancel_midi_taptempo();
 
-								// For AUTO, if user has selected bass or drums for the lower split,
-								// don't play chords if play is stopped
-								if (MasterMidiChan > 16 || (!BeatInPlay && (AppFlags & (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO)))) goto robotnote;
-							}
+						// If the Master chan is set to "Auto" (16), then all received note
+						// events are automatically routed to the Human Solo chan, and all
+						// other evts handled globally (as if received on the Master chan)
+						if (MasterMidiChan > 15)
+						{
+							chan = MidiChans[PLAYER_SOLO];
+							status = (status & 0xf0) | chan;
 
-							if ((mask |= do_master_note(&data.Data1, status)) & 0x80000000)
-							{
-								mask &= 0x7fffffff;
-								if ((MidiViewInPtr = PendingPtr)) goto sigview;
-								goto sigview2;
-							}
+							// For AUTO, if user has selected bass or drums for the lower split,
+							// don't play chords if play is stopped
+							if (MasterMidiChan > 16 || (!BeatInPlay && (AppFlags & (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO)))) goto robotnote;
+						}
+
+						if ((mask |= do_master_note(&data->Data1, status)) & 0x80000000)
+						{
+							mask &= 0x7fffffff;
+							if ((MidiViewInPtr = PendingPtr)) goto sigview;
+							goto sigview2;
 						}
 					}
+				}
 
-					// Not a note
-					else
+				// Not a note
+				else
+				{
+					// ================================================
+					// See if this midi msg is mapped to an action. If so, execute it
+					// ================================================
 					{
-						// ================================================
-						// See if this midi msg is mapped to an action. If so, execute it
-						// ================================================
-						{
-						register ACTIONINSTANCE *	entry;
+					register ACTIONINSTANCE *	entry;
 
-cmd:					if ((entry = findMidiCmd(&data.Data1, status)))
+cmd:					if ((entry = findMidiCmd(&data->Data1, status)))
+					{
+						if (entry != (ACTIONINSTANCE *)-1)
 						{
-							if (entry != (ACTIONINSTANCE *)-1)
-							{
-								register ACTION_FUNC *	func;
+							register ACTION_FUNC *	func;
 
-								func = ActionCategory[entry->CatIndex].Func;
-								mask = func(entry->Action & (~ACTION_RANGELIMIT), entry->LastValue);
+							func = ActionCategory[entry->CatIndex].Func;
+							mask = func(entry->Action & (~ACTION_RANGELIMIT), entry->LastValue);
 
-								// If MIDI Test screen is being shown, then there are no gui ctls displayed that
-								// need updating. Instead, we need to store info on the ACTIONINSTANCE we just
-								// executed, as well as the midi msg that triggered it
-								if (status < 0xA0)
-									status = (unsigned char)(((unsigned char *)entry - &CommandKeyAssigns[0]) / 3);
-								else
-									status = (unsigned char)(entry - EntryList[1]) + 1;
+							// If MIDI Test screen is being shown, then there are no gui ctls displayed that
+							// need updating. Instead, we need to store info on the ACTIONINSTANCE we just
+							// executed, as well as the midi msg that triggered it
+							if (status < 0xA0)
+								status = (unsigned char)(((unsigned char *)entry - &CommandKeyAssigns[0]) / 3);
+							else
+								status = (unsigned char)(entry - EntryList[1]) + 1;
 
-								if (func != &tempoHandler || entry->Action != (ACTION_INCBUTTON|ACTION_2))
-									mask |= cancel_midi_taptempo();
+							if (func != &tempoHandler || entry->Action != (ACTION_INCBUTTON|ACTION_2))
+								mask |= cancel_midi_taptempo();
 
 saveview:					if ((MidiViewInPtr = PendingPtr))
-								{
-									MidiViewInPtr[3] = status;
-									//	GuiWinSignal(GuiApp, arg, SIGNALMAIN_MIDIVIEW);
+							{
+								MidiViewInPtr[3] = status;
+								//	GuiWinSignal(GuiApp, arg, SIGNALMAIN_MIDIVIEW);
 sigview:							GuiWinSignal(GuiApp, 0, SIGNALMAIN_MIDIVIEW);
-								}
-								else
-sigview2:						if (mask) signalMainFromMidiIn(arg, mask);
 							}
-							goto next_byte;
-						}
+							else
+sigview2:						if (mask) signalMainFromMidiIn(arg, mask);
 						}
+						goto next_byte;
+					}
+					}
 
-						// ================================================
-						// Master chan handling of non-note event
-						// ================================================
-						if (MasterMidiChan > 15 || MasterMidiChan == chan)
+					// ================================================
+					// Master chan handling of non-note event
+					// ================================================
+					if (MasterMidiChan > 15 || MasterMidiChan == chan)
+					{
+						switch (status >> 4)
 						{
-							switch (status >> 4)
-							{
-								case 0x0B:
-									mask = do_master_ctrl(&data.Data1);
-									break;
+							case 0x0B:
+								mask = do_master_ctrl(&data->Data1);
+								break;
 
-								// For program change on the Master chan, select among styles,
-								// songsheets, patches, pads, basses, and drum kits in that order
-								case 0x0C:
-									mask = do_master_pgm(data.Data1);
+							// For program change on the Master chan, select among styles,
+							// songsheets, patches, pads, basses, and drum kits in that order
+							case 0x0C:
+								mask = do_master_pgm(data->Data1);
 
-								// Note: no default handling for AFT, PRESS, and PWL on Master channel
-							}
+							// Note: no default handling for AFT, PRESS, and PWL on Master channel
+						}
 
-							mask |= cancel_midi_taptempo();
+						mask |= cancel_midi_taptempo();
 
-							// -1 means "I didn't handle it. Check the individual robot handlers
-							if (mask != (uint32_t)-1)
-							{
+						// -1 means "I didn't handle it. Check the individual robot handlers
+						if (mask != (uint32_t)-1)
+						{
 final:						status = (unsigned char)mask;
-								goto saveview;
-							}
-							mask = 0;
+							goto saveview;
 						}
+						mask = 0;
+					}
 
-						// ===========================
-						// Non-note for Drums/Bass/Guitar/Pad/Solo
-						// ===========================
-						{
-						register unsigned char	musicianNum;
+					// ===========================
+					// Non-note for Drums/Bass/Guitar/Pad/Solo
+					// ===========================
+					{
+					register unsigned char	musicianNum;
 
-						musicianNum = 0;
-						do
+					musicianNum = 0;
+					do
+					{
+						if (MidiChans[musicianNum] == chan && DevAssigns[musicianNum])
 						{
-							if (MidiChans[musicianNum] == chan && DevAssigns[musicianNum])
+							switch (status >> 4)
 							{
-								switch (status >> 4)
+								case 0x0B:
 								{
-									case 0x0B:
-									{
-										mask = individualCtlr(&data.RunningStatus, musicianNum);
-										break;
-									}
+									mask = individualCtlr(&data->RunningStatus, musicianNum);
+									break;
+								}
 
-									// Pgm Change
-									case 0x0C:
-									{
-										mask = setInstrumentByNum(musicianNum | ((BankNums[musicianNum * 2] << 8) | (BankNums[(musicianNum * 2) + 1] << 16)) | MIDITHREADID, data.Data1, 0);
-										if (PendingPtr) mask = 0xBF;
-	//									break;
-									}
+								// Pgm Change
+								case 0x0C:
+								{
+									mask = setInstrumentByNum(musicianNum | ((BankNums[musicianNum * 2] << 8) | (BankNums[(musicianNum * 2) + 1] << 16)) | MIDITHREADID, data->Data1, 0);
+									if (PendingPtr) mask = 0xBF;
+//									break;
 								}
 							}
-						} while (++musicianNum <= PLAYER_SOLO);
 						}
-
-						if (mask) goto final;
+					} while (++musicianNum <= PLAYER_SOLO);
 					}
 
-					// ===========================
-					// Note handling for Drums/Bass/Guitar/Pad/Solo
-					// ===========================
-					{
-					register unsigned char	musicianNum;
+					if (mask) goto final;
+				}
+
+				// ===========================
+				// Note handling for Drums/Bass/Guitar/Pad/Solo
+				// ===========================
+				{
+				register unsigned char	musicianNum;
 
 robotnote:		musicianNum = 0;
 
-//					data.Data1 += setTranspose(0xFE, 0 /* MIDITHREADID */);
+//					data->Data1 += setTranspose(0xFE, 0 /* MIDITHREADID */);
 
-					// Determine who it's for: Drummer, Bass, Guitar, Pad, and/or Human
-					do
-					{
-						// For drums, we allow controller, and poly aftertouch, msgs to trigger drum notes, since
-						// lots of electronic pads offer this option. The exception is MIDI bank select controllers
-						// (#0 and #32), which we use in conjunction with MIDI program change to select kits
-						if (status < (musicianNum ? 0xA0 : 0xC0) &&
+				// Determine who it's for: Drummer, Bass, Guitar, Pad, and/or Human
+				do
+				{
+					// For drums, we allow controller, and poly aftertouch, msgs to trigger drum notes, since
+					// lots of electronic pads offer this option. The exception is MIDI bank select controllers
+					// (#0 and #32), which we use in conjunction with MIDI program change to select kits
+					if (status < (musicianNum ? 0xA0 : 0xC0) &&
 
-							// If a musician is disabled ("Playback Device = Off"), his instrument doesn't play at all
-							DevAssigns[musicianNum])
+						// If a musician is disabled ("Playback Device = Off"), his instrument doesn't play at all
+						DevAssigns[musicianNum])
+					{
+						if (musicianNum == PLAYER_SOLO)
 						{
-							if (musicianNum == PLAYER_SOLO)
+							// If Master chan is AUTO, then we must honor the SplitPoint, unless FULL/GTR modes
+							if (MidiChans[PLAYER_SOLO] == chan && ((AppFlags & (APPFLAG_GTRCHORD|APPFLAG_FULLKEY)) ||
+								data->Data1 >= ((AppFlags & APPFLAG_2KEY) ? SplitPoint+1 : SplitPoint)))
 							{
-								// If Master chan is AUTO, then we must honor the SplitPoint, unless FULL/GTR modes
-								if (MidiChans[PLAYER_SOLO] == chan && ((AppFlags & (APPFLAG_GTRCHORD|APPFLAG_FULLKEY)) ||
-									data.Data1 >= ((AppFlags & APPFLAG_2KEY) ? SplitPoint+1 : SplitPoint)))
-								{
-									// Output to MIDI module or internal synth. Note: Querying transpose value doesn't require threadId
-									if (!data.InputBuffer[0])
-										stopSoloNote(data.Data1 + setTranspose(0xFE, 0 /* MIDITHREADID */), PLAYER_SOLO|MIDITHREADID);
-									else
-										startSoloNote(data.Data1 + setTranspose(0xFE, 0 /* MIDITHREADID */), data.InputBuffer[0], PLAYER_SOLO|MIDITHREADID);
+								// Output to MIDI module or internal synth. Note: Querying transpose value doesn't require threadId
+								if (!data->InputBuffer[0])
+									stopSoloNote(data->Data1 + setTranspose(0xFE, 0 /* MIDITHREADID */), PLAYER_SOLO|MIDITHREADID);
+								else
+									startSoloNote(data->Data1 + setTranspose(0xFE, 0 /* MIDITHREADID */), data->InputBuffer[0], PLAYER_SOLO|MIDITHREADID);
 
-									mask |= 0x88;
-								}
+								mask |= 0x88;
 							}
+						}
 
-							else if ((MasterMidiChan > 15 || MidiChans[musicianNum] == chan) &&
+						else if ((MasterMidiChan > 15 || MidiChans[musicianNum] == chan) &&
 
-									// A robot's instrument can be played live only if that robot is muted, or play has stopped
-									(!BeatInPlay || (TempFlags & (APPFLAG3_NODRUMS << musicianNum))))
+								// A robot's instrument can be played live only if that robot is muted, or play has stopped
+								(!BeatInPlay || (TempFlags & (APPFLAG3_NODRUMS << musicianNum))))
+						{
+							// If same channel as solo (or Master=AUTO), then we must honor the SplitPoint
+							if (chan == MidiChans[PLAYER_SOLO])
 							{
-								// If same channel as solo (or Master=AUTO), then we must honor the SplitPoint
-								if (chan == MidiChans[PLAYER_SOLO])
+								if (musicianNum == PLAYER_DRUMS)
 								{
-									if (musicianNum == PLAYER_DRUMS)
-									{
-										// Note # within the lower split range (Setup -> Human -> Controller -> Split)?
-										if (data.Data1 < SplitPoint &&
+									// Note # within the lower split range (Setup -> Human -> Controller -> Split)?
+									if (data->Data1 < SplitPoint &&
 
-											// ..."Setup -> Human -> Solo Instrument -> Lower Split" == "Drums"
-											(AppFlags & (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO)) == (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO))
-										{
-											goto play_dr;
-										}
-									}
-									else if (musicianNum == PLAYER_BASS)
+										// ..."Setup -> Human -> Solo Instrument -> Lower Split" == "Drums"
+										(AppFlags & (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO)) == (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO))
 									{
-										// Bass Split is where the lower note range of the user's controller plays one of the bass
-										// patches, while the upper range simultaneously plays other patches. Typically this is useful to a
-										// keyboardist who wants to play "left-hand bass" (instead of using BackupBand's robot bassist).
+										goto play_dr;
+									}
+								}
+								else if (musicianNum == PLAYER_BASS)
+								{
+									// Bass Split is where the lower note range of the user's controller plays one of the bass
+									// patches, while the upper range simultaneously plays other patches. Typically this is useful to a
+									// keyboardist who wants to play "left-hand bass" (instead of using BackupBand's robot bassist).
 
-										// Note # within the split range?
-										if (data.Data1 < SplitPoint)
+									// Note # within the split range?
+									if (data->Data1 < SplitPoint)
+									{
+										// "Lower Split" is "Bass", or "Legato Bass" (not "Off" or "Drums")...
+										switch (AppFlags & (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO))
 										{
-											// "Lower Split" is "Bass", or "Legato Bass" (not "Off" or "Drums")...
-											switch (AppFlags & (APPFLAG_BASS_ON|APPFLAG_BASS_LEGATO))
-											{
-												case APPFLAG_BASS_ON:
-												case APPFLAG_BASS_LEGATO:
-													goto play_ba;
-											}
+											case APPFLAG_BASS_ON:
+											case APPFLAG_BASS_LEGATO:
+												goto play_ba;
 										}
 									}
-									else if (data.Data1 >= ((AppFlags & APPFLAG_2KEY) ? SplitPoint+1 : SplitPoint))
-									{
-										if ((AppFlags4 & APPFLAG4_UPPER_PAD) && musicianNum == PLAYER_PAD) goto play_pad;
-									}
 								}
-
-								else switch (musicianNum)
+								else if (data->Data1 >= ((AppFlags & APPFLAG_2KEY) ? SplitPoint+1 : SplitPoint))
 								{
-									case PLAYER_DRUMS:
-play_dr:								mask |= do_drum_note(&data.Data1, status);
-										break;
-									case PLAYER_BASS:
-play_ba:								mask |= do_bass_note(data.Data1, data.InputBuffer[0]);
-										break;
-									case PLAYER_PAD:
-									{
-										// The background pad can be played by either a robot musician, or the user. When played by the
-										// robot, he simply holds sustained chords. When played by the user, the pad patch (ie, strings,
-										// brass, or organ) plays the same notes as (doubles) whatever other patch the user is playing
-										// on the upper range of his controller. Typically this is used to "layer" sounds, such as strings
-										// beneath piano. The user chooses who plays the background pad by setting "Setup -> Robots ->
-										// Background pad" to either "Play" on or off.
-										//
-										// Regardless of who plays it, the background pad itself is turned on/off via the four buttons
-										// labeled "None", "Strings", "Brass", and "Organ" on the main screen (under "Background pad").
-play_pad:							if (!data.InputBuffer[0])
-											stopSoloNote(data.Data1, PLAYER_PAD|MIDITHREADID);
-										else
-											startSoloNote(data.Data1, data.InputBuffer[0], PLAYER_PAD|MIDITHREADID);
-
-										mask |= 0x84;
-									}
+									if ((AppFlags4 & APPFLAG4_UPPER_PAD) && musicianNum == PLAYER_PAD) goto play_pad;
 								}
 							}
 
+							else switch (musicianNum)
+							{
+								case PLAYER_DRUMS:
+play_dr:								mask |= do_drum_note(&data->Data1, status);
+									break;
+								case PLAYER_BASS:
+play_ba:								mask |= do_bass_note(data->Data1, data->InputBuffer[0]);
+									break;
+								case PLAYER_PAD:
+								{
+									// The background pad can be played by either a robot musician, or the user. When played by the
+									// robot, he simply holds sustained chords. When played by the user, the pad patch (ie, strings,
+									// brass, or organ) plays the same notes as (doubles) whatever other patch the user is playing
+									// on the upper range of his controller. Typically this is used to "layer" sounds, such as strings
+									// beneath piano. The user chooses who plays the background pad by setting "Setup -> Robots ->
+									// Background pad" to either "Play" on or off.
+									//
+									// Regardless of who plays it, the background pad itself is turned on/off via the four buttons
+									// labeled "None", "Strings", "Brass", and "Organ" on the main screen (under "Background pad").
+play_pad:							if (!data->InputBuffer[0])
+										stopSoloNote(data->Data1, PLAYER_PAD|MIDITHREADID);
+									else
+										startSoloNote(data->Data1, data->InputBuffer[0], PLAYER_PAD|MIDITHREADID);
+
+									mask |= 0x84;
+								}
+							}
 						}
-					} while (++musicianNum <= PLAYER_SOLO);
-					} // Drums/Bass/Guitar/Pad/Solo
-
-					if (!PendingPtr) mask = 0;
-					goto final;
-					} // resume:
-				}	// Completed midi msg
-			}	// Ignoring msg
-		} // while (inBuf < inBufEnd)
+
+					}
+				} while (++musicianNum <= PLAYER_SOLO);
+				} // Drums/Bass/Guitar/Pad/Solo
+
+				if (!PendingPtr) mask = 0;
+				goto final;
+				} // resume:
+			}	// Completed midi msg
+		}	// Ignoring msg
+	} // while (inBuf < inBufEnd)
+}
+
+static struct MIDIINDATA	MidiInData;
+
+#if !defined(NO_JACK_SUPPORT) || !defined(NO_ALSA_AUDIO_SUPPORT)
+
+/*********************** MIDI in rings ************************
+ * When MIDI in arrives in a realtime audio thread (Jack's
+ * process callback, or the ALSA audio thread servicing MIDI
+ * in), that thread only notes the frame at which a note it
+ * plays should start, and queues it here. A MIDI in thread
+ * parses it, since acting upon a msg may wait on a voice
+ * lock, or signal the GUI. Each ring has one sender and one
+ * reader, so needs no lock.
+ */
+
+#define MIDIIN_RINGSIZE	64
+
+typedef struct {
+	uint32_t				Frame;		// MixFrames at which a note it starts begins (0 = next block)
+	unsigned char			Len;
+	unsigned char			Bytes[27];
+} MIDIINCHUNK;
+
+typedef struct {
+	uint32_t				Head;		// Changed only by the parsing thread
+	uint32_t				Tail;		// Changed only by the audio thread
+	int					WakeFd;		// eventfd that wakes the parsing thread
+	MIDIINCHUNK			Chunks[MIDIIN_RINGSIZE];
+} MIDIINRING;
+
+/********************* queue_midi_in() ***********************
+ * Called by the audio thread to queue MIDI in for a MIDI
+ * in thread to parse. Never waits. If the ring is full,
+ * the rest is dropped.
+ *
+ * frame =	MixFrames at which any note it starts begins.
+ */
+
+static void queue_midi_in(register MIDIINRING * ring, register const unsigned char * msg, register uint32_t len, register uint32_t frame)
+{
+	register MIDIINCHUNK *	chunk;
+	register uint32_t			tail, next;
+
+	tail = ring->Tail;
+	while (len)
+	{
+		next = (tail + 1) % MIDIIN_RINGSIZE;
+		if (next == __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE)) break;
+
+		chunk = &ring->Chunks[tail];
+		chunk->Frame = frame;
+		chunk->Len = (len > sizeof(chunk->Bytes) ? sizeof(chunk->Bytes) : len);
+		memcpy(chunk->Bytes, msg, chunk->Len);
+		msg += chunk->Len;
+		len -= chunk->Len;
+		tail = next;
+	}
+
+	if (tail != ring->Tail)
+	{
+		uint64_t		val;
+
+		__atomic_store_n(&ring->Tail, tail, __ATOMIC_RELEASE);
+		val = 1;
+		write(ring->WakeFd, &val, sizeof(val));
+	}
+}
+
+/********************* drain_midi_in() ***********************
+ * Called by a MIDI in thread to parse what queue_midi_in()
+ * queued. Any note a chunk starts begins at its frame.
+ *
+ * data =	Running status/partial msg state of the input.
+ */
+
+static void drain_midi_in(register MIDIINRING * ring, register struct MIDIINDATA * data)
+{
+	register MIDIINCHUNK *	chunk;
+	register uint32_t			head, tail;
+
+	head = ring->Head;
+	tail = __atomic_load_n(&ring->Tail, __ATOMIC_ACQUIRE);
+	while (head != tail)
+	{
+		chunk = &ring->Chunks[head];
+		setMidiStartFrame(chunk->Frame);
+		parseMidiIn(data, &chunk->Bytes[0], &chunk->Bytes[chunk->Len], (void *)3);
+		head = (head + 1) % MIDIIN_RINGSIZE;
+		__atomic_store_n(&ring->Head, head, __ATOMIC_RELEASE);
+	}
+	setMidiStartFrame(0);
+}
+
+#endif
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+// What the audio thread reads while it services MIDI in, for midiInThread()
+static MIDIINRING			AudioMidiRing;
+#endif
+
+/********************* readMidiIn() ***********************
+ * Reads what MIDI controller input is waiting, and acts
+ * upon it. Called by midiInThread(), or the audio thread
+ * when it services MIDI in. The audio thread only stamps
+ * and queues it, for midiInThread() to act upon. Supports
+ * both ALSA Seq API, and RawMidi API.
+ *
+ * fromAudio = 1 if called by the audio thread.
+ */
+
+static void readMidiIn(register unsigned char fromAudio)
+{
+	register struct MIDIINDATA *	data;
+	unsigned char *					inBufEnd;
+	unsigned char *					inBuf;
+	unsigned char						audioBuf[32];
+
+	// The other thread is finishing a read during a handoff? The audio thread never
+	// waits. It polls again, and gets the input after
+	if (__atomic_or_fetch(&MidiReadLock, fromAudio ? AUDIOTHREADID : MIDITHREADID, __ATOMIC_RELAXED) != (fromAudio ? AUDIOTHREADID : MIDITHREADID))
+	{
+		__atomic_and_fetch(&MidiReadLock, fromAudio ? ~AUDIOTHREADID : ~MIDITHREADID, __ATOMIC_RELAXED);
+		if (!fromAudio) usleep(100);
+		return;
+	}
+
+	data = &MidiInData;
+
+	// The audio thread mustn't touch MidiInData, which midiInThread() may be parsing
+	inBuf = (fromAudio ? &audioBuf[0] : &data->InputBuffer[0]);
+
+	{
+#ifndef NO_SEQ_IN_SUPPORT
+		if ((SoundDev[DEVNUM_MIDIIN].DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_SEQ)
+		{
+			snd_seq_event_t *ev;
+
+			inBufEnd = inBuf;
+			do
+			{
+				if (snd_seq_event_input((snd_seq_t *)SoundDev[DEVNUM_MIDIIN].Handle, &ev) < 0) break;
+
+				if (ev->type >= SND_SEQ_EVENT_START && ev->type <= SND_SEQ_EVENT_STOP)
+					*inBufEnd++ = SysStatus[ev->type - SND_SEQ_EVENT_START];
+				if (ev->type >= SND_SEQ_EVENT_NOTEON && ev->type <= SND_SEQ_EVENT_PITCHBEND)
+				{
+					*inBufEnd++ = SeqStatus[ev->type - SND_SEQ_EVENT_NOTEON] | ev->data.control.channel;
+					if (ev->type <= SND_SEQ_EVENT_KEYPRESS)
+					{
+						*inBufEnd++ = ev->data.note.note;
+						*inBufEnd++ = ev->data.note.velocity;
+					}
+					else if (ev->type <= SND_SEQ_EVENT_CHANPRESS)
+					{
+						if (ev->type < SND_SEQ_EVENT_PGMCHANGE)
+							*inBufEnd++ = (unsigned char)ev->data.control.param;
+						*inBufEnd++ = (unsigned char)ev->data.control.value;
+					}
+					else
+					{
+						register unsigned short		val;
+
+						val = ev->data.control.value + 8192;
+						*inBufEnd++ = (unsigned char)(val >> 7);
+						*inBufEnd++ = (unsigned char)(val & 0x7F);
+					}
+				}
+
+				snd_seq_free_event(ev);
+			} while (inBufEnd < &inBuf[32 - 3]);
+		}
+		else
+#endif
+		{
+			register int				count;
+
+			if ((count = snd_rawmidi_read((snd_rawmidi_t *)SoundDev[DEVNUM_MIDIIN].Handle, inBuf, sizeof(audioBuf))) < 0) count=0;
+			inBufEnd = &inBuf[count];
+		}
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+		// Note when it arrived, to start any note at the matching frame. The audio
+		// thread can't act upon it (that may wait on a voice, or the GUI), so
+		// queues it for midiInThread()
+		if (inBufEnd != inBuf)
+		{
+			register uint32_t		frame;
+
+			frame = midiInArrived(fromAudio);
+			if (fromAudio)
+			{
+				queue_midi_in(&AudioMidiRing, inBuf, inBufEnd - inBuf, frame);
+				goto out;
+			}
+		}
+#endif
+
+		parseMidiIn(data, inBuf, inBufEnd, (void *)3);
+	}
+#ifndef NO_ALSA_AUDIO_SUPPORT
+out:
+#endif
+
+	__atomic_and_fetch(&MidiReadLock, fromAudio ? ~AUDIOTHREADID : ~MIDITHREADID, __ATOMIC_RELAXED);
+}
+
+/******************** midiInThread() **********************
+ * A secondary thread that handles MIDI controller input.
+ * While the audio thread services MIDI in, this parses
+ * what that reads.
+ */
+
+static void * midiInThread(void * arg)
+{
+	struct epoll_event	event;
+
+	// Set the priority to slightly less than audio thread (AudioPlay.c), but same
+	// as Beat Play thread (AccompSeq.c), and higher than gui thread
+	set_thread_priority(RTTHREAD_MIDIIN);
+
+//	arg = GuiWinSignal(GuiApp, 0, 0);
+	MidiInSigHandle = arg = (void *)3;
+
+	for (;;)
+	{
+		// Wait for some midi input from controller. (Or nothing but the
+		// terminate signal while the audio thread has our fds)
+		epoll_wait(MidiEventHandle, &event, 1, -1);
+
+		// Main thread wants us to terminate?
+		if (event.data.fd == MidiEventQueue || !SoundDev[DEVNUM_MIDIIN].Handle) break;
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+		// Parse whatever the audio thread queued first, so msgs stay in order
+		if (event.data.fd == AudioMidiRing.WakeFd)
+		{
+			uint64_t		val;
+
+			read(AudioMidiRing.WakeFd, &val, sizeof(val));
+			drain_midi_in(&AudioMidiRing, &MidiInData);
+			continue;
 		}
+		drain_midi_in(&AudioMidiRing, &MidiInData);
+#endif
+		readMidiIn(0);
 	} // for (;;)
 
 //	GuiWinSignal(GuiApp, arg, 0);
@@ -4719,6 +4905,164 @@ play_pad:							if (!data.InputBuffer[0])
 	return 0;
 }
 
+/******************** claimMidiIn() **********************
+ * Called by the audio thread to take over servicing MIDI
+ * in from midiInThread(), by moving the MIDI in fds to
+ * MidiAudioHandle.
+ *
+ * RETURN: The fd to poll for MIDI in, or -1 if none.
+ */
+
+int claimMidiIn(void)
+{
+	register unsigned char	i;
+
+	if (!SoundDev[DEVNUM_MIDIIN].Handle || !MidiInThread || MidiAudioClaimed) return -1;
+
+	for (i = 0; i < NumMidiFds; i++)
+	{
+		epoll_ctl(MidiEventHandle, EPOLL_CTL_DEL, MidiFds[i].data.fd, 0);
+		epoll_ctl(MidiAudioHandle, EPOLL_CTL_ADD, MidiFds[i].data.fd, &MidiFds[i]);
+	}
+
+	MidiAudioClaimed = 1;
+	return MidiAudioHandle;
+}
+
+/******************* releaseMidiIn() *********************
+ * Called by the audio thread to give servicing MIDI in
+ * back to midiInThread().
+ */
+
+void releaseMidiIn(void)
+{
+	register unsigned char	i;
+
+	if (MidiAudioClaimed)
+	{
+		for (i = 0; i < NumMidiFds; i++)
+		{
+			epoll_ctl(MidiAudioHandle, EPOLL_CTL_DEL, MidiFds[i].data.fd, 0);
+			epoll_ctl(MidiEventHandle, EPOLL_CTL_ADD, MidiFds[i].data.fd, &MidiFds[i]);
+		}
+
+		__atomic_store_n(&MidiAudioClaimed, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/********************* audioMidiIn() *********************
+ * Called by the audio thread when its poll() says the fd
+ * claimMidiIn() returned is ready.
+ *
+ * RETURN: 0 if MIDI in is closing (so the audio thread
+ * has released it), 1 otherwise.
+ */
+
+unsigned char audioMidiIn(void)
+{
+	struct epoll_event	event;
+
+	if (epoll_wait(MidiAudioHandle, &event, 1, 0) > 0)
+	{
+		if (event.data.fd == MidiEventQueue || !SoundDev[DEVNUM_MIDIIN].Handle)
+		{
+			releaseMidiIn();
+			return 0;
+		}
+
+		readMidiIn(1);
+	}
+
+	return 1;
+}
+
+#ifndef NO_JACK_SUPPORT
+
+static struct MIDIINDATA	JackMidiIn = {0x90, 0, {{0}}, 2};
+static MIDIINRING			JackMidiRing;
+static pthread_t			JackMidiThread;
+static unsigned char		JackMidiQuit;
+
+/******************** jackMidiIn() **********************
+ * Queues a MIDI msg received on Jack's midi_in port, for
+ * jackMidiInThread() to parse. Called by the audio thread,
+ * inside of the Jack process callback, only when no ALSA
+ * MIDI In device is open (so midiInThread() isn't
+ * running).
+ *
+ * frame =	MixFrames at which any note it starts begins.
+ */
+
+void jackMidiIn(register unsigned char * msg, register uint32_t len, register uint32_t frame)
+{
+	queue_midi_in(&JackMidiRing, msg, len, frame);
+}
+
+/****************** jackMidiInThread() ********************
+ * Parses what jackMidiIn() queues.
+ */
+
+static void * jackMidiInThread(void * arg)
+{
+	uint64_t		val;
+
+	// Same priority as midiInThread()
+	set_thread_priority(RTTHREAD_MIDIIN);
+
+	// Wait for jackMidiIn(), or endJackMidiIn()
+	while (read(JackMidiRing.WakeFd, &val, sizeof(val)) > 0 || errno == EINTR)
+	{
+		if (__atomic_load_n(&JackMidiQuit, __ATOMIC_ACQUIRE)) break;
+		drain_midi_in(&JackMidiRing, &JackMidiIn);
+	}
+
+	return 0;
+}
+
+/****************** startJackMidiIn() ********************
+ * Called when Jack's midi_in port is registered, to start
+ * jackMidiInThread().
+ *
+ * RETURN: 0 if success.
+ */
+
+int startJackMidiIn(void)
+{
+	JackMidiIn.RunningStatus = 0x90;
+	JackMidiIn.RunningCount = 2;
+	JackMidiRing.Head = JackMidiRing.Tail = 0;
+	JackMidiQuit = 0;
+	if ((JackMidiRing.WakeFd = eventfd(0, 0)) >= 0)
+	{
+		if (!create_rt_thread(&JackMidiThread, jackMidiInThread, 0)) return 0;
+		close(JackMidiRing.WakeFd);
+	}
+	JackMidiThread = 0;
+	return -1;
+}
+
+/******************* endJackMidiIn() *********************
+ * Called once the Jack process callback no longer calls
+ * jackMidiIn(), to end jackMidiInThread().
+ */
+
+void endJackMidiIn(void)
+{
+	if (JackMidiThread)
+	{
+		uint64_t		val;
+
+		__atomic_store_n(&JackMidiQuit, 1, __ATOMIC_RELEASE);
+		val = 1;
+		write(JackMidiRing.WakeFd, &val, sizeof(val));
+		pthread_join(JackMidiThread, 0);
+		JackMidiThread = 0;
+		close(JackMidiRing.WakeFd);
+	}
+}
+
+#endif
+
 
 
 
@@ -5714,21 +6058,26 @@ void closeMidiIn(void)
 
 	handle = SoundDev[DEVNUM_MIDIIN].Handle;
 
-	// Signal MIDI in thread to terminate
+	// Signal MIDI in thread, and the audio thread if servicing MIDI in, to terminate
 	SoundDev[DEVNUM_MIDIIN].Handle = 0;
 	if (MidiInThread)
 	{
 		uint64_t		data;
 
 		data = 0;
-		while (MidiInThread && ++data < 10)
+		while ((MidiInThread || __atomic_load_n(&MidiAudioClaimed, __ATOMIC_ACQUIRE)) && ++data < 10)
 		{
 			write(MidiEventQueue, &data, sizeof(data));
 			usleep(1000);
 		}
+		MidiAudioClaimed = 0;
 
+		close(MidiAudioHandle);
 		close(MidiEventHandle);
 		close(MidiEventQueue);
+#ifndef NO_ALSA_AUDIO_SUPPORT
+		close(AudioMidiRing.WakeFd);
+#endif
 	}
 
 	// Close ALSA handle
@@ -5831,35 +6180,61 @@ handles:
 			snd_rawmidi_poll_descriptors((snd_rawmidi_t *)SoundDev[DEVNUM_MIDIIN].Handle, fdArray, numFds);
 		}
 
+		if (numFds > (int)(sizeof(MidiFds) / sizeof(struct epoll_event))) numFds = sizeof(MidiFds) / sizeof(struct epoll_event);
 		if ((MidiEventQueue = eventfd(0, EFD_NONBLOCK)) >= 0)
 		{
 			if ((MidiEventHandle = epoll_create(1 + numFds)) >= 0)
 			{
-				struct epoll_event	eventMsg;
-
-				eventMsg.events = EPOLLIN;
-				eventMsg.data.fd = MidiEventQueue;
-
-				if (epoll_ctl(MidiEventHandle, EPOLL_CTL_ADD, eventMsg.data.fd, &eventMsg) >= 0)
+				// For when the audio thread services MIDI in. Both sets get the terminate signal
+				if ((MidiAudioHandle = epoll_create(1 + numFds)) >= 0)
 				{
-					while (numFds--)
-					{
-						eventMsg.events = fdArray[numFds].events;
-						eventMsg.data.fd = fdArray[numFds].fd;
-						if (epoll_ctl(MidiEventHandle, EPOLL_CTL_ADD, eventMsg.data.fd, &eventMsg) < 0) goto bad2;
-					}
+					struct epoll_event	eventMsg;
 
-					// Start up a background thread to handle midi input
-					if (!pthread_create(&MidiInThread, 0, midiInThread, 0))
+					eventMsg.events = EPOLLIN;
+					eventMsg.data.fd = MidiEventQueue;
+#ifndef NO_ALSA_AUDIO_SUPPORT
+					AudioMidiRing.Head = AudioMidiRing.Tail = 0;
+					AudioMidiRing.WakeFd = -1;
+#endif
+					if (epoll_ctl(MidiEventHandle, EPOLL_CTL_ADD, eventMsg.data.fd, &eventMsg) >= 0 &&
+						epoll_ctl(MidiAudioHandle, EPOLL_CTL_ADD, eventMsg.data.fd, &eventMsg) >= 0
+#ifndef NO_ALSA_AUDIO_SUPPORT
+						// And midiInThread() is woken to parse what the audio thread reads
+						&& (eventMsg.data.fd = AudioMidiRing.WakeFd = eventfd(0, EFD_NONBLOCK)) >= 0
+						&& epoll_ctl(MidiEventHandle, EPOLL_CTL_ADD, eventMsg.data.fd, &eventMsg) >= 0
+#endif
+						)
 					{
-						pthread_detach(MidiInThread);
-						return 0;
+						NumMidiFds = (unsigned char)numFds;
+						while (numFds--)
+						{
+							MidiFds[numFds].events = fdArray[numFds].events;
+							MidiFds[numFds].data.fd = fdArray[numFds].fd;
+							if (epoll_ctl(MidiEventHandle, EPOLL_CTL_ADD, MidiFds[numFds].data.fd, &MidiFds[numFds]) < 0) goto bad2;
+						}
+
+						MidiInData.RunningStatus = 0x90;
+						MidiInData.RunningCount = 2;
+						MidiAudioClaimed = MidiReadLock = 0;
+
+						// Start up a background thread to handle midi input
+						if (!create_rt_thread(&MidiInThread, midiInThread, 0))
+						{
+							pthread_detach(MidiInThread);
+							return 0;
+						}
+
+						message = &NoMidiInThreadMsg[0];
 					}
 
-					message = &NoMidiInThreadMsg[0];
+bad2:
+#ifndef NO_ALSA_AUDIO_SUPPORT
+					if (AudioMidiRing.WakeFd >= 0) close(AudioMidiRing.WakeFd);
+#endif
+					close(MidiAudioHandle);
 				}
 
-bad2:			close(MidiEventHandle);
+				close(MidiEventHandle);
 			}
 
 			close(MidiEventQueue);
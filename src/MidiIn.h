@@ -44,6 +44,12 @@ void doMidiNoteAsn(void);
 void doMouseBtnAsn(void);
 void doPcKeyAsn(void);
 int	openMidiIn(void);
+void	jackMidiIn(register unsigned char *, register uint32_t, register uint32_t);
+int	startJackMidiIn(void);
+void	endJackMidiIn(void);
+int	claimMidiIn(void);
+void	releaseMidiIn(void);
+unsigned char audioMidiIn(void);
 void	closeMidiIn(void);
 void setMidiInSiphon(register MIDIINSIPHON *, register unsigned char);
 void updChansInUse(void);
@@ -297,7 +297,7 @@ static int compare_orig(void)
 	// For an audio dev, check if frame size or sample rate changed
 #if !defined(NO_JACK_SUPPORT) && !defined(NO_ALSA_AUDIO_SUPPORT)
 	if ((SndDevCopy.DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_AUDIO &&
-		(!(SndDevCopy.DevFlags & DEVFLAG_JACK) || SndDevCopy.DevHash) &&
+		(!(SndDevCopy.DevFlags & DEVFLAG_JACK) || SndDevCopy.DevHash || SndDevCopy.Dev != AUDIODEV_JACK) &&
 		((DevGuiCtls[CTLID_RATE].Attrib.Value != OrigRate || FrameSize != OrigFrameSize)))
 	{
 		goto chg;
@@ -651,6 +651,8 @@ out:	DoneOnce = 1;
  * RETURN: 0 for success if choosing a dev.
  */
 
+static const char	NoCardStrs[] = "No audio out (timer only)\0Write WAV file\0Write WAV file (not realtime)";
+
 static GUILIST * pickAudioDev(GUIAPPHANDLE app, GUICTL * ctl, GUIAREA * area)
 {
 	if (app)
@@ -675,6 +677,35 @@ static GUILIST * pickAudioDev(GUIAPPHANDLE app, GUICTL * ctl, GUIAREA * area)
 			}
 		}
 #endif
+		// Audio out can also be no card at all, or a WAV file
+		if (!(SndDevCopy.DevFlags & DEVFLAG_INPUTDEV))
+		{
+			register const char *	name;
+
+			name = &NoCardStrs[0];
+			for (cardNum = 0; cardNum < 3; cardNum++)
+			{
+				set_defaults();
+				SndDevCopy.Dev = (cardNum ? AUDIODEV_FILE : AUDIODEV_NULL);
+				SndDevCopy.SubDev = (cardNum > 1);
+				if (!area)
+				{
+					if (!List.CurrItemNum--)
+					{
+						SndDevCopy.Card = 0;
+						SndDevCopy.DevFlags = (SndDevCopy.DevFlags & ~DEVFLAG_DEVTYPE_MASK) | DEVTYPE_AUDIO;
+						return 0;
+					}
+				}
+				else
+				{
+					check_selection(area);
+					if (dspDevName(name, EmptyStr, ctl, area)) goto out;
+				}
+				name += strlen(name) + 1;
+			}
+		}
+
 		snd_ctl_card_info_alloca(&cardInfo);
 
 		snd_pcm_info_alloca(&pcmInfo);
@@ -998,7 +1029,7 @@ void doPickSoundDevDlg(register struct SOUNDDEVINFO * sounddev, register DEVRETF
 {
 	memcpy(&SndDevCopy, sounddev, sizeof(struct SOUNDDEVINFO));
 	SndDevCopy.Original = sounddev;
-	OrigSelIsJack = ((SndDevCopy.Card = SndDevCopy.DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_AUDIO && !sounddev->DevHash) ? 1 : 0;
+	OrigSelIsJack = ((SndDevCopy.Card = SndDevCopy.DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_AUDIO && !sounddev->DevHash && sounddev->Dev == AUDIODEV_JACK) ? 1 : 0;
 	RetFunc = func;
 
 	DevGuiCtls[CTLID_DEVTYPE].Attrib.Value = 1;
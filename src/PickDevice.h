@@ -13,10 +13,15 @@
 #define DEVFLAG_INPUTDEV		0x80	// Set if an input. Clear if an output
 
 #define DEVTYPE_NONE		0		// User has disabled the device
-#define DEVTYPE_AUDIO	1		// ALSA audio if DevHash non-zero, Jack if 0
+#define DEVTYPE_AUDIO	1		// ALSA audio if DevHash non-zero, else per Dev (AUDIODEV_JACK, etc)
 #define DEVTYPE_MIDI		2		// ALSA raw MIDI
 #define DEVTYPE_SEQ		3		// ALSA Seq API. DevHash=0 if no specific host connect, non-0 if host
 
+// SOUNDDEVINFO's Dev for DEVTYPE_AUDIO out when DevHash=0 (ie, not an ALSA card)
+#define AUDIODEV_JACK	0
+#define AUDIODEV_NULL	1		// No audio hardware. Our own timer paces the audio thread
+#define AUDIODEV_FILE	2		// Like AUDIODEV_NULL, but all outs go to a WAV file. SubDev=1 to not wait on the timer
+
 #pragma pack(1)
 struct SOUNDDEVINFO {
 	union {
@@ -32,9 +32,20 @@ void					loadConfig(void);
 #define CONFIGKEY_BASSOCT		(CONFIGKEY_BYTES+31)
 #define CONFIGKEY_SENSITIVITY	(CONFIGKEY_BYTES+32)
 #define CONFIGKEY_DRUMTRIGGER	(CONFIGKEY_BYTES+33)
+#define CONFIGKEY_MONITOR		(CONFIGKEY_BYTES+34)		// CONFIGKEY_BYTES[34] to CONFIGKEY_BYTES[36]
+#define CONFIGKEY_AUTOBUF		(CONFIGKEY_BYTES+37)
+#define CONFIGKEY_JACKSYNC		(CONFIGKEY_BYTES+38)
+#define CONFIGKEY_RECORD		(CONFIGKEY_BYTES+39)
 
 #define CONFIGKEY_DRUMSVOL		(CONFIGKEY_BYTES+40)		// RESERVED TO 44
 #define CONFIGKEY_SOLOVOL		(CONFIGKEY_BYTES+44)
+#define CONFIGKEY_OUTPUTS		(CONFIGKEY_BYTES+45)		// CONFIGKEY_BYTES[45] to CONFIGKEY_BYTES[50]
+#define CONFIGKEY_CPUS			(CONFIGKEY_BYTES+51)		// CONFIGKEY_BYTES[51] to CONFIGKEY_BYTES[53]
+#define CONFIGKEY_MIDIPOLL		(CONFIGKEY_BYTES+54)
+#define CONFIGKEY_BEATSCHED		(CONFIGKEY_BYTES+55)
+#define CONFIGKEY_CLOCKOUT		(CONFIGKEY_BYTES+56)
+#define CONFIGKEY_CLOCKPLL		(CONFIGKEY_BYTES+57)
+#define CONFIGKEY_SEQLEAD		(CONFIGKEY_BYTES+58)
 
 #define CONFIGKEY_FLAG			CONFIGKEY_LONGS
 
@@ -85,7 +85,7 @@ static void updateDevice(register struct SOUNDDEVINFO * sounddev, register unsig
 				if ((sounddev->DevFlags & DEVFLAG_DEVTYPE_MASK) == DEVTYPE_AUDIO)
 				{
 #if !defined(NO_JACK_SUPPORT)
-					if (!SoundDev[DEVNUM_AUDIOOUT].DevHash)
+					if (IS_JACK_OUT())
 					{
 						register const char *	err;
 
@@ -192,6 +192,210 @@ static uint32_t ctl_set_intsynth_dev(register GUICTL * ctl)
 
 #if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
 
+// A "MIDI clock out" checkbox's (or a latency arrows') label ends with its
+// External Synth number
+static unsigned char getClockOutBus(register GUICTL * ctl)
+{
+	register const char *	str;
+
+	str = ctl->Label;
+	str += strlen(str);
+	return str[-1] - '1';
+}
+
+static uint32_t ctl_update_clockout(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = setClockOut(getClockOutBus(ctl), 0xFF);
+	return 1;
+}
+
+static uint32_t ctl_set_clockout(register GUICTL * ctl)
+{
+	register unsigned char	bus;
+
+	bus = getClockOutBus(ctl);
+	setClockOut(bus, setClockOut(bus, 0xFF) ^ 1);
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+// Sized for the widest jitter we show
+static char		ClockJitterStr[24] = "Jitter 000000 usec";
+
+static uint32_t ctl_update_clockjitter(register GUICTL * ctl)
+{
+	uint32_t		usecs;
+
+	if (getClockOutJitter(&usecs))
+		sprintf(ClockJitterStr, "Jitter %u usec", usecs);
+	else
+		strcpy(ClockJitterStr, "No jitter yet");
+	return 1;
+}
+
+// Sized for the widest counts we show
+static char		MidiOutStatsStr[56] = "Queued 000, 000000 usec, wire 000000 usec, 000000 lost";
+
+static uint32_t ctl_update_midioutstats(register GUICTL * ctl)
+{
+	uint32_t		depth, usecs, lost, wire;
+	register uint32_t	maxDepth, maxUsecs, maxLost, maxWire;
+	register unsigned char	bus, open;
+	register char *	ptr;
+
+	// Show the worst of the open buses
+	maxDepth = maxUsecs = maxLost = maxWire = open = 0;
+	for (bus = 0; bus < 4; bus++)
+	{
+		if (getMidiOutStats(bus, &depth, &usecs, &lost, &wire))
+		{
+			open = 1;
+			if (depth > maxDepth) maxDepth = depth;
+			if (usecs > maxUsecs) maxUsecs = usecs;
+			if (wire > maxWire) maxWire = wire;
+			maxLost += lost;
+		}
+	}
+	if (!open)
+		strcpy(MidiOutStatsStr, "No MIDI out open");
+	else
+	{
+		ptr = MidiOutStatsStr + sprintf(MidiOutStatsStr, "Queued %u, %u usec", maxDepth, maxUsecs);
+		if (maxWire) ptr += sprintf(ptr, ", wire %u usec", maxWire);
+		if (maxLost) sprintf(ptr, ", %u lost", maxLost);
+	}
+	return 1;
+}
+
+#ifndef NO_SEQ_SUPPORT
+static uint32_t ctl_update_seqlead(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, setSeqLead(0xFF));
+	return 1;
+}
+
+static uint32_t ctl_set_seqlead(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setSeqLead(ctl->Attrib.Value);
+	return CTLMASK_SETCONFIGSAVE;
+}
+#endif
+
+static uint32_t ctl_update_latency(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, setMidiOutLatency(getClockOutBus(ctl), 0xFF));
+	return 1;
+}
+
+static uint32_t ctl_set_latency(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setMidiOutLatency(getClockOutBus(ctl), ctl->Attrib.Value);
+
+	// It's saved with the devices
+	SaveConfigFlag |= SAVECONFIG_DEVICES;
+	return 1;
+}
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+// The Measure button, and its worker thread. MeasuredLatency is the msecs
+// it got for each bus (0 if not heard, or 0xFF if no robot plays it)
+static GUICTL *			MeasureCtl;
+static pthread_t			MeasureThread;
+static unsigned char		MeasuredLatency[4];
+
+/****************** measureThread() ******************
+ * Measures each External Synth a robot plays. This takes
+ * up to several seconds per synth, so the GUI thread
+ * doesn't wait for it. Signals the GUI thread to
+ * endMeasure() when done.
+ */
+
+static void * measureThread(void * arg)
+{
+	register uint32_t			msecs;
+	register unsigned char	bus, robot;
+
+	for (bus = 0; bus < 4; bus++)
+	{
+		msecs = 0xFF;
+		for (robot = 0; robot < PLAYER_SOLO && DevAssigns[robot] != &SoundDev[DEVNUM_MIDIOUT1 + bus]; robot++);
+		if (robot < PLAYER_SOLO && (msecs = measureMidiOutLatency(bus)) > MIDIOUT_LATENCY_MAX) msecs = MIDIOUT_LATENCY_MAX;
+		MeasuredLatency[bus] = (unsigned char)msecs;
+	}
+
+	GuiWinSignal(GuiApp, 0, SIGNALMAIN_MEASURE);
+	return 0;
+}
+
+/****************** endMeasure() ******************
+ * Called by GUI thread when measureThread() signals it's
+ * done. Sets the latencies it measured, and shows them.
+ */
+
+void endMeasure(void)
+{
+	register GUICTL *			ctl;
+	register char *			ptr;
+	register unsigned char	bus;
+
+	pthread_join(MeasureThread, 0);
+	MeasureThread = 0;
+
+	// Are the latency arrows still shown? They precede the button
+	for (ctl = MainWin->Ctls; ctl && ctl->Type != CTLTYPE_END && ctl != MeasureCtl; ctl++);
+	if (ctl && ctl->Type == CTLTYPE_END) ctl = 0;
+
+	ptr = (char *)TempBuffer;
+	for (bus = 0; bus < 4; bus++)
+	{
+		if (MeasuredLatency[bus] == 0xFF) continue;
+		if (MeasuredLatency[bus])
+		{
+			setMidiOutLatency(bus, MeasuredLatency[bus]);
+			SaveConfigFlag |= SAVECONFIG_DEVICES;
+			if (ctl)
+			{
+				ctl_update_latency(ctl - 4 + bus);
+				GuiCtlUpdate(GuiApp, 0, ctl - 4 + bus, 0, 0);
+			}
+			ptr += sprintf(ptr, "Synth %u: %u msec\n", bus + 1, MeasuredLatency[bus]);
+		}
+		else
+			ptr += sprintf(ptr, "Synth %u: not heard\n", bus + 1);
+	}
+
+	if (!SoundDev[DEVNUM_AUDIOIN].Handle) strcpy(ptr, "Measuring needs an audio in device, cabled from the synth's output.");
+	else ptr[-1] = 0;
+	show_msgbox((char *)TempBuffer);
+}
+
+static uint32_t ctl_set_measure(register GUICTL * ctl)
+{
+	register unsigned char	robot;
+
+	if (MeasureThread)
+		show_msgbox("Still measuring. Wait for the results.");
+	else
+	{
+		// Any External Synth to measure?
+		for (robot = 0; robot < PLAYER_SOLO && DevAssigns[robot] < &SoundDev[DEVNUM_MIDIOUT1]; robot++);
+		if (robot >= PLAYER_SOLO)
+			show_msgbox("No robot plays an External Synth.");
+		else
+		{
+			MeasureCtl = ctl;
+			if (pthread_create(&MeasureThread, 0, measureThread, 0))
+			{
+				MeasureThread = 0;
+				show_msgbox("Can't start measure thread");
+			}
+		}
+	}
+	return CTLMASK_NONE;
+}
+#endif
+
 static uint32_t ctl_set_midiout_dev(register GUICTL * ctl)
 {
 	register const char *	str;
@@ -272,6 +476,61 @@ static const char * getSoloChanLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buff
 	return buffer;
 }
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+
+/**************** update_output() ****************
+ * Updates the arrows for which output pair (of a
+ * multichannel audio card) a musician, or the
+ * reverb, is routed to.
+ */
+
+static uint32_t update_output(register GUICTL * ctl, register unsigned char musicianNum)
+{
+	register unsigned char pair;
+
+	pair = getOutputPair(musicianNum);
+	ctl->Flags.Local &= ~(CTLFLAG_NO_DOWN|CTLFLAG_NO_UP);
+	if (!pair) ctl->Flags.Local |= CTLFLAG_NO_DOWN;
+	if (pair >= MAX_OUT_PAIRS - 1) ctl->Flags.Local |= CTLFLAG_NO_UP;
+	return 1;
+}
+
+static uint32_t set_output(register GUICTL * ctl, register unsigned char musicianNum)
+{
+	register unsigned char pair;
+
+	pair = getOutputPair(musicianNum);
+	if (ctl->Flags.Local & CTLFLAG_DOWN_SELECT)
+	{
+		if (pair)
+		{
+			--pair;
+			goto redraw;
+		}
+	}
+	else if ((ctl->Flags.Local & CTLFLAG_UP_SELECT) && pair < MAX_OUT_PAIRS - 1)
+	{
+		pair++;
+redraw:
+		setOutputPair(musicianNum, pair);
+		SaveConfigFlag |= SAVECONFIG_OTHER;
+		return update_output(ctl, musicianNum);
+	}
+
+	return 0;
+}
+
+static const char * formatOutputLabel(register unsigned char musicianNum, register char * buffer)
+{
+	register unsigned char pair;
+
+	pair = getOutputPair(musicianNum) * 2;
+	sprintf(buffer, "Out %u-%u", pair + 1, pair + 2);
+	return buffer;
+}
+
+#endif
+
 
 
 static const char CtlNames[] = {0,'B','a','n','k','S','w',' ','H',0,
@@ -482,7 +741,11 @@ while you're sustaining \(holding) the notes of the chord. The drummer continues
 is where you set what MIDI device you wish BackupBand's robot musicians to \"follow\" for changing chords, and receiving \
 remote commands. Click on the \2Device \1button to choose one device from a list of external MIDI hardware, or other software programs, which BackupBand can follow. Click the Split button, and \
 play the note on your controller where you want to split it into 2 note ranges. Note that \2Full Piano \1and \2Guitar \1chord models do not need the split note set.\nThe \
-\2Test \1button opens a screen that displays information about each MIDI message received from your controller. Also indicated is what BackupBand does with that message.\nThe \
+\2Test \1button opens a screen that displays information about each MIDI message received from your controller. Also indicated is what BackupBand does with that message.\nWhen \2Fast \1is on, your \
+sound card's audio thread watches your controller, and notes the moment each message arrives. The MIDI thread still interprets the message, but each note starts as far into the \
+next block of audio as it arrived after the last block. Every note is \
+then heard the same time after you play it, rather than early or late depending upon where it fell between blocks. This works only with an ALSA sound card when Timer wakeups is off. The \
+shortest and longest delay, from MIDI in to audio out, are shown beside it. The difference is the jitter.\nThe \
 \2Master Chan \1indicates what MIDI channel you will set your controller to play chords upon. This channel is also used to control Master settings that affect all robots, such as transpose, tempo, \
 etc. If set it to \"Auto\", then all notes from your controller (on any channel) will play chords below the split point. Also, all non-note events will control Master settings.\nThe \
 \7Solo Instrument \1section are settings for the upper half of your controller (above the split note). You can play any of BackupBand's sampled instruments on its Internal Synth. Or \
@@ -612,6 +875,37 @@ static uint32_t ctl_set_midi_test(register GUICTL * ctl)
 	return CTLMASK_NONE;
 }
 
+#ifndef NO_ALSA_AUDIO_SUPPORT
+static uint32_t ctl_update_midipoll(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = setMidiInPoll(0xFF);
+	return 1;
+}
+
+static uint32_t ctl_set_midipoll(register GUICTL * ctl)
+{
+	setMidiInPoll(setMidiInPoll(0xFF) ^ 1);
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+// Sized for the widest delay we show
+static char		MidiDelayStr[32] = "Delay 000.0-000.0 msec";
+
+static uint32_t ctl_update_mididelay(register GUICTL * ctl)
+{
+	uint32_t		min, max;
+
+	if (getMidiDelay(&min, &max))
+		sprintf(MidiDelayStr, "Delay %u.%u-%u.%u msec", min / 10, min % 10, max / 10, max % 10);
+	else
+		strcpy(MidiDelayStr, "No delay yet");
+	return 1;
+}
+
+static GUICTLDATA	MidiPollFunc = {ctl_update_midipoll, ctl_set_midipoll};
+static GUICTLDATA	MidiDelayFunc = {ctl_update_mididelay, 0};
+#endif
+
 static GUICTLDATA	MidiInTestFunc = {ctl_update_nothing, ctl_set_midi_test};
 static GUICTLDATA	MasterChanFunc = {ctl_update_masterchan, ctl_set_masterchan};
 static GUICTLDATA	SplitFunc = {ctl_update_nothing, ctl_set_split};
@@ -896,6 +1190,25 @@ static uint32_t ctl_update_solo_playdev(register GUICTL * ctl)
 	return get_playdev_assign(ctl, PLAYER_SOLO);
 }
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+
+static uint32_t ctl_set_solo_out(register GUICTL * ctl)
+{
+	return set_output(ctl, PLAYER_SOLO);
+}
+
+static uint32_t ctl_update_solo_out(register GUICTL * ctl)
+{
+	return update_output(ctl, PLAYER_SOLO);
+}
+
+static const char * getSoloOutLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	return formatOutputLabel(PLAYER_SOLO, buffer);
+}
+
+#endif
+
 static uint32_t ctl_set_chordhold(register GUICTL * ctl)
 {
 	AppFlags4 ^= APPFLAG4_NOCHORDHOLD;
@@ -946,6 +1259,9 @@ static GUICTLDATA	ChordTypeFunc = {ctl_update_ctype, ctl_set_ctype};
 static GUICTLDATA	ChordBoundFunc = {ctl_update_bound, ctl_set_bound};
 static GUICTLDATA	SoloPlayDevFunc = {ctl_update_solo_playdev, ctl_set_solo_playdev};
 static GUICTLDATA	SoloMidiChanFunc = {ctl_update_solo_midichan, ctl_set_solo_midichan};
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+static GUICTLDATA	SoloOutFunc = {ctl_update_solo_out, ctl_set_solo_out};
+#endif
 static GUICTLDATA	ChordHoldFunc = {ctl_update_chordhold, ctl_set_chordhold};
 static GUICTLDATA	ChordSensFunc = {ctl_update_chordsens, ctl_set_chordsens};
 static GUICTLDATA	ChordMsgStatus = {ctl_update_nothing, ctl_set_chordmsgs};
@@ -972,6 +1288,9 @@ static GUICTL		HumanCtls[] = {
   	{.Type=CTLTYPE_GROUPBOX, .Label="Lower split"},
  	{.Type=CTLTYPE_RADIO,	.Y=4, .X=1,	.Label=&UpperStr[0],.Ptr=&UpperFunc,					.Attrib.NumOfLabels=2, .Flags.Local=CTLFLAG_LABELBOX, .Flags.Global=CTLGLOBAL_AUTO_VAL},
 	{.Type=CTLTYPE_ARROWS, 	.Y=4,	.Label=&CurveStr[0],			.Ptr=&CurveFunc,					.Attrib.NumOfLabels=2,				.Flags.Global=CTLGLOBAL_AUTO_VAL},
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+ 	{.Type=CTLTYPE_ARROWS,	.Y=4,	.BtnLabel=getSoloOutLabel,	.Ptr=&SoloOutFunc,				.Attrib.NumOfLabels=1,				.Flags.Global=CTLGLOBAL_GET_LABEL},
+#endif
   	{.Type=CTLTYPE_GROUPBOX, .Label="Solo instrument"},
 
   	// =================== Controller
@@ -983,6 +1302,10 @@ static GUICTL		HumanCtls[] = {
  	{.Type=CTLTYPE_PUSH,		.Label="Test",						.Y=6,	.Attrib.NumOfLabels=1, .Ptr=&MidiInTestFunc},
  	{.Type=CTLTYPE_STATIC,	.Label="Split\nNote:",			.Y=6,	.Attrib.NumOfLabels=1},
  	{.Type=CTLTYPE_PUSH, 	.BtnLabel=getSplitStr,			.Y=6,	.Attrib.NumOfLabels=1, .Ptr=&SplitFunc,  .Width=7,		.Flags.Global=CTLGLOBAL_NOPADDING|CTLGLOBAL_GET_LABEL},
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	{.Type=CTLTYPE_CHECK,	.Label="Fast",						.Y=6,	.Attrib.NumOfLabels=1, .Ptr=&MidiPollFunc},
+	{.Type=CTLTYPE_STATIC,	.Label=MidiDelayStr,				.Y=6,	.Attrib.NumOfLabels=1, .Ptr=&MidiDelayFunc},
+#endif
  	{.Type=CTLTYPE_GROUPBOX, .Label=ControllerStr},
 #elif !defined(NO_QWERTY_PIANO)
  	{.Type=CTLTYPE_RADIO,	.Y=2,	.X=1, .Label=&QwertyStrs[0],.Ptr=&QwertyFunc,				.Attrib.NumOfLabels=2,		 .Flags.Local=CTLFLAG_LABELBOX},
@@ -1121,6 +1444,73 @@ static uint32_t ctl_set_clock(register GUICTL * ctl)
 	return CTLMASK_SETCONFIGSAVE;
 }
 
+#ifndef NO_MIDICLOCK_IN
+#define CLOCKPLL_WIDEST	4
+static const char * const	ClockPllNames[CLOCKPLL_WIDEST + 1] = {"Off", "Max", "High", "Medium", "Low"};
+
+static uint32_t ctl_update_clockpll(register GUICTL * ctl)
+{
+	register unsigned char bw;
+
+	bw = setClockPll(0xFF) & 0x7F;
+	ctl->Flags.Local &= ~(CTLFLAG_NO_DOWN|CTLFLAG_NO_UP);
+	if (!bw) ctl->Flags.Local |= CTLFLAG_NO_DOWN;
+	if (bw >= CLOCKPLL_WIDEST) ctl->Flags.Local |= CTLFLAG_NO_UP;
+	return 1;
+}
+
+static uint32_t ctl_set_clockpll(register GUICTL * ctl)
+{
+	register unsigned char bw;
+
+	bw = setClockPll(0xFF) & 0x7F;
+	if (ctl->Flags.Local & CTLFLAG_DOWN_SELECT)
+	{
+		if (bw)
+		{
+			--bw;
+			goto redraw;
+		}
+	}
+	else if ((ctl->Flags.Local & CTLFLAG_UP_SELECT) && bw < CLOCKPLL_WIDEST)
+	{
+		bw++;
+redraw:
+		setClockPll(bw);
+		SaveConfigFlag |= SAVECONFIG_OTHER;
+		return ctl_update_clockpll(ctl);
+	}
+
+	return 0;
+}
+
+static const char * getClockPllLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	register unsigned char	bw;
+
+	bw = setClockPll(0xFF);
+	sprintf(buffer, (bw & 0x80) ? "Smooth %s (locked)" : "Smooth %s", ClockPllNames[bw & 0x7F]);
+	return buffer;
+}
+#endif
+
+#if !defined(NO_JACK_SUPPORT) && !defined(NO_MIDICLOCK_IN)
+static uint32_t ctl_update_jacksync(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, setJackSync(0xFF));
+	return 1;
+}
+
+static uint32_t ctl_set_jacksync(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setJackSync(ctl->Attrib.Value);
+
+	// Done setting this parameter. Let caller redraw the ctl
+	return CTLMASK_SETCONFIGSAVE;
+}
+#endif
+
 static uint32_t ctl_update_flash(register GUICTL * ctl)
 {
 	ctl->Attrib.Value = (AppFlags2 & APPFLAG2_TIMED_ERR) ? 1 : 0;
@@ -1135,6 +1525,160 @@ static uint32_t ctl_set_flash(register GUICTL * ctl)
 	return CTLMASK_SETCONFIGSAVE;
 }
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+static uint32_t ctl_update_bundles(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = (AppFlags4 & APPFLAG4_BUNDLES) ? 1 : 0;
+	return 1;
+}
+
+static uint32_t ctl_set_bundles(register GUICTL * ctl)
+{
+	AppFlags4 ^= APPFLAG4_BUNDLES;
+
+	// Done setting this parameter. Let caller redraw the ctl
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+static uint32_t ctl_update_sharepool(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = (AppFlags4 & APPFLAG4_SHAREPOOL) ? 1 : 0;
+	return 1;
+}
+
+static uint32_t ctl_set_sharepool(register GUICTL * ctl)
+{
+	AppFlags4 ^= APPFLAG4_SHAREPOOL;
+
+	// Done setting this parameter. Let caller redraw the ctl
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+static uint32_t ctl_update_compact(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = (AppFlags4 & APPFLAG4_COMPACT) ? 1 : 0;
+	return 1;
+}
+
+static uint32_t ctl_set_compact(register GUICTL * ctl)
+{
+	AppFlags4 ^= APPFLAG4_COMPACT;
+
+	// Done setting this parameter. Let caller redraw the ctl
+	return CTLMASK_SETCONFIGSAVE;
+}
+#endif
+
+#ifndef NO_ALSA_AUDIO_SUPPORT
+static uint32_t ctl_update_tsched(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = (AppFlags4 & APPFLAG4_TSCHED) ? 1 : 0;
+	return 1;
+}
+
+static uint32_t ctl_set_tsched(register GUICTL * ctl)
+{
+	AppFlags4 ^= APPFLAG4_TSCHED;
+
+	// Done setting this parameter. Let caller redraw the ctl
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+static uint32_t ctl_update_autobuf(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, setAutoBuffer(0xff));
+	return 1;
+}
+
+static uint32_t ctl_set_autobuf(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setAutoBuffer(ctl->Attrib.Value);
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+static uint32_t ctl_update_monvol(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, getMonitor(MONITOR_VOL));
+	return 1;
+}
+
+static uint32_t ctl_set_monvol(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setMonitor(MONITOR_VOL, ctl->Attrib.Value);
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+static uint32_t ctl_update_monpan(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, getMonitor(MONITOR_PAN));
+	return 1;
+}
+
+static uint32_t ctl_set_monpan(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setMonitor(MONITOR_PAN, ctl->Attrib.Value);
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+#ifndef NO_REVERB_SUPPORT
+static uint32_t ctl_update_monrev(register GUICTL * ctl)
+{
+	GuiCtlArrowsInit(ctl, getMonitor(MONITOR_REVERB));
+	return 1;
+}
+
+static uint32_t ctl_set_monrev(register GUICTL * ctl)
+{
+	GuiCtlArrowsValue(GuiApp, ctl);
+	setMonitor(MONITOR_REVERB, ctl->Attrib.Value);
+	return CTLMASK_SETCONFIGSAVE;
+}
+#endif
+
+// Sized for the widest delay we show
+static char		RoundTripStr[24] = "Delay 000.0 msec";
+
+static uint32_t ctl_update_roundtrip(register GUICTL * ctl)
+{
+	register uint32_t		delay;
+
+	if ((delay = getRoundTrip()))
+		sprintf(RoundTripStr, "Delay %u.%u msec", delay / 10, delay % 10);
+	else
+		strcpy(RoundTripStr, "No audio in");
+	return 1;
+}
+
+static uint32_t ctl_update_beatsched(register GUICTL * ctl)
+{
+	ctl->Attrib.Value = setBeatSched(0xFF);
+	return 1;
+}
+
+static uint32_t ctl_set_beatsched(register GUICTL * ctl)
+{
+	setBeatSched(setBeatSched(0xFF) ^ 1);
+	return CTLMASK_SETCONFIGSAVE;
+}
+
+// Sized for the widest jitter we show
+static char		BeatJitterStr[32] = "Jitter 00000 (00000 late)";
+
+static uint32_t ctl_update_beatjitter(register GUICTL * ctl)
+{
+	uint32_t		jitter, late;
+
+	if (getBeatOnset(&jitter, &late))
+		sprintf(BeatJitterStr, late ? "Jitter %u (%u late)" : "Jitter %u", jitter, late);
+	else
+		strcpy(BeatJitterStr, "No jitter yet");
+	return 1;
+}
+#endif
+
 
 #ifndef NO_REVERB_SUPPORT
 
@@ -1162,6 +1706,25 @@ static uint32_t ctl_update_rdamp(register GUICTL * ctl)
 	return 1;
 }
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+
+static uint32_t ctl_set_rout(register GUICTL * ctl)
+{
+	return set_output(ctl, OUTPUT_REVERB);
+}
+
+static uint32_t ctl_update_rout(register GUICTL * ctl)
+{
+	return update_output(ctl, OUTPUT_REVERB);
+}
+
+static const char * getReverbOutLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	return formatOutputLabel(OUTPUT_REVERB, buffer);
+}
+
+#endif
+
 static uint32_t ctl_set_rdecay(register GUICTL * ctl)
 {
 	setReverb(ctl, REVPARAM_DECAYMASK);
@@ -1209,17 +1772,213 @@ static GUICTLDATA	ReverbDamping = {ctl_update_rdamp, ctl_set_rdamp};
 static GUICTLDATA	ReverbPreDelay = {ctl_update_rpredelay, ctl_set_rpredelay};
 static GUICTLDATA	ReverbDecay = {ctl_update_rdecay, ctl_set_rdecay};
 static GUICTLDATA	ReverbEarly = {ctl_update_rearly, ctl_set_rearly};
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+static GUICTLDATA	ReverbOut = {ctl_update_rout, ctl_set_rout};
+#endif
+#endif
+
+/***************** update_cpu() *****************
+ * Updates the arrows for which CPU the audio, beat
+ * play, or MIDI in thread is pinned to.
+ */
+
+static uint32_t update_cpu(register GUICTL * ctl, register unsigned char thread)
+{
+	register unsigned char cpu;
+
+	cpu = setThreadCpu(thread, 0xFF);
+	ctl->Flags.Local &= ~(CTLFLAG_NO_DOWN|CTLFLAG_NO_UP);
+	if (!cpu) ctl->Flags.Local |= CTLFLAG_NO_DOWN;
+	if (cpu >= getNumCpus()) ctl->Flags.Local |= CTLFLAG_NO_UP;
+	return 1;
+}
+
+static uint32_t set_cpu(register GUICTL * ctl, register unsigned char thread)
+{
+	register unsigned char cpu;
+
+	cpu = setThreadCpu(thread, 0xFF);
+	if (ctl->Flags.Local & CTLFLAG_DOWN_SELECT)
+	{
+		if (cpu)
+		{
+			--cpu;
+			goto redraw;
+		}
+	}
+	else if ((ctl->Flags.Local & CTLFLAG_UP_SELECT) && cpu < getNumCpus())
+	{
+		cpu++;
+redraw:
+		setThreadCpu(thread, cpu);
+		SaveConfigFlag |= SAVECONFIG_OTHER;
+		return update_cpu(ctl, thread);
+	}
+
+	return 0;
+}
+
+static const char * formatCpuLabel(register unsigned char thread, register char * buffer)
+{
+	register unsigned char	cpu;
+	register const char *	name;
+
+	name = (thread == RTTHREAD_AUDIO ? "Audio" : (thread == RTTHREAD_BEAT ? "Beat play" : "MIDI in"));
+	if (!(cpu = setThreadCpu(thread, 0xFF)))
+		sprintf(buffer, "%s Any", name);
+	else
+		sprintf(buffer, "%s %u", name, cpu - 1);
+	return buffer;
+}
+
+static uint32_t ctl_update_audiocpu(register GUICTL * ctl)
+{
+	return update_cpu(ctl, RTTHREAD_AUDIO);
+}
+
+static uint32_t ctl_set_audiocpu(register GUICTL * ctl)
+{
+	return set_cpu(ctl, RTTHREAD_AUDIO);
+}
+
+static const char * getAudioCpuLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	return formatCpuLabel(RTTHREAD_AUDIO, buffer);
+}
+
+static uint32_t ctl_update_beatcpu(register GUICTL * ctl)
+{
+	return update_cpu(ctl, RTTHREAD_BEAT);
+}
+
+static uint32_t ctl_set_beatcpu(register GUICTL * ctl)
+{
+	return set_cpu(ctl, RTTHREAD_BEAT);
+}
+
+static const char * getBeatCpuLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	return formatCpuLabel(RTTHREAD_BEAT, buffer);
+}
+
+static uint32_t ctl_update_midicpu(register GUICTL * ctl)
+{
+	return update_cpu(ctl, RTTHREAD_MIDIIN);
+}
+
+static uint32_t ctl_set_midicpu(register GUICTL * ctl)
+{
+	return set_cpu(ctl, RTTHREAD_MIDIIN);
+}
+
+static const char * getMidiCpuLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	return formatCpuLabel(RTTHREAD_MIDIIN, buffer);
+}
+
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+
+static uint32_t ctl_update_record(register GUICTL * ctl)
+{
+	register unsigned char mode;
+
+	mode = setRecordMode(0xFF);
+	ctl->Flags.Local &= ~(CTLFLAG_NO_DOWN|CTLFLAG_NO_UP);
+	if (mode == RECORD_OFF) ctl->Flags.Local |= CTLFLAG_NO_DOWN;
+	if (mode == RECORD_OUTS) ctl->Flags.Local |= CTLFLAG_NO_UP;
+	return 1;
+}
+
+static uint32_t ctl_set_record(register GUICTL * ctl)
+{
+	register unsigned char mode;
+
+	mode = setRecordMode(0xFF);
+	if (ctl->Flags.Local & CTLFLAG_DOWN_SELECT)
+	{
+		if (mode != RECORD_OFF)
+		{
+			--mode;
+			goto redraw;
+		}
+	}
+	else if ((ctl->Flags.Local & CTLFLAG_UP_SELECT) && mode != RECORD_OUTS)
+	{
+		mode++;
+redraw:
+		setRecordMode(mode);
+		SaveConfigFlag |= SAVECONFIG_OTHER;
+		return ctl_update_record(ctl);
+	}
+
+	return 0;
+}
+
+static const char * getRecordLabel(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	register const char *	name;
+	register uint32_t			drops;
+	register unsigned char	mode;
+
+	mode = setRecordMode(0xFF);
+	name = (mode == RECORD_OFF ? "Off" : (mode == RECORD_MIX ? "Mix" : "All outs"));
+
+	// Show if the recorder's writer couldn't keep up
+	if ((drops = getRecordDrops()))
+		sprintf(buffer, "Record %s (%u lost)", name, drops);
+	else
+		sprintf(buffer, "Record %s", name);
+	return buffer;
+}
+
+static GUICTLDATA	RecordFunc = {ctl_update_record, ctl_set_record};
+
 #endif
 
 static GUICTLDATA	ClickFunc = {ctl_update_click, ctl_set_click};
+static GUICTLDATA	AudioCpuFunc = {ctl_update_audiocpu, ctl_set_audiocpu};
+static GUICTLDATA	BeatCpuFunc = {ctl_update_beatcpu, ctl_set_beatcpu};
+static GUICTLDATA	MidiCpuFunc = {ctl_update_midicpu, ctl_set_midicpu};
 static GUICTLDATA	FlashFunc = {ctl_update_flash, ctl_set_flash};
 static GUICTLDATA	ClockFunc = {ctl_update_clock, ctl_set_clock};
+#ifndef NO_MIDICLOCK_IN
+static GUICTLDATA	ClockPllFunc = {ctl_update_clockpll, ctl_set_clockpll};
+#endif
+#if !defined(NO_JACK_SUPPORT) && !defined(NO_MIDICLOCK_IN)
+static GUICTLDATA	JackSyncFunc = {ctl_update_jacksync, ctl_set_jacksync};
+static const char JackSyncStrs[] = "Jack transport\0Off\0Follow\0Master";
+#endif
 
 #if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
 static GUICTLDATA	AudioOutFunc = {ctl_update_nothing, ctl_set_intsynth_dev};
+static GUICTLDATA	BundlesFunc = {ctl_update_bundles, ctl_set_bundles};
+static GUICTLDATA	SharePoolFunc = {ctl_update_sharepool, ctl_set_sharepool};
+static GUICTLDATA	CompactFunc = {ctl_update_compact, ctl_set_compact};
+#endif
+#ifndef NO_ALSA_AUDIO_SUPPORT
+static GUICTLDATA	TschedFunc = {ctl_update_tsched, ctl_set_tsched};
+static GUICTLDATA	AutoBufFunc = {ctl_update_autobuf, ctl_set_autobuf};
+static GUICTLDATA	MonVolFunc = {ctl_update_monvol, ctl_set_monvol};
+static GUICTLDATA	MonPanFunc = {ctl_update_monpan, ctl_set_monpan};
+#ifndef NO_REVERB_SUPPORT
+static GUICTLDATA	MonRevFunc = {ctl_update_monrev, ctl_set_monrev};
+#endif
+static GUICTLDATA	RoundTripFunc = {ctl_update_roundtrip, 0};
+static GUICTLDATA	BeatSchedFunc = {ctl_update_beatsched, ctl_set_beatsched};
+static GUICTLDATA	BeatJitterFunc = {ctl_update_beatjitter, 0};
 #endif
 #if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
 static GUICTLDATA	MidiOutFunc = {ctl_update_nothing, ctl_set_midiout_dev};
+static GUICTLDATA	ClockOutFunc = {ctl_update_clockout, ctl_set_clockout};
+static GUICTLDATA	ClockJitterFunc = {ctl_update_clockjitter, 0};
+static GUICTLDATA	MidiOutStatsFunc = {ctl_update_midioutstats, 0};
+#ifndef NO_SEQ_SUPPORT
+static GUICTLDATA	SeqLeadFunc = {ctl_update_seqlead, ctl_set_seqlead};
+#endif
+static GUICTLDATA	LatencyFunc = {ctl_update_latency, ctl_set_latency};
+#ifndef NO_ALSA_AUDIO_SUPPORT
+static GUICTLDATA	MeasureFunc = {ctl_update_nothing, ctl_set_measure};
+#endif
 #endif
 #ifndef NO_MIDICLOCK_IN
 static const char ClockStrs[] = "Clock\0Normal\0Fast\0Fastest\0MIDI";
@@ -1255,8 +2014,16 @@ static GUICTL		GlobalCtls[] = {
 
 #ifndef NO_MIDICLOCK_IN
  	{.Type=CTLTYPE_ARROWS,	.Y=2,	.Label=ClockStrs,	.Ptr=&ClockFunc,						.Attrib.NumOfLabels=4},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=2,	.BtnLabel=getClockPllLabel,	.Ptr=&ClockPllFunc,	.Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GET_LABEL},
+#ifndef NO_JACK_SUPPORT
+ 	{.Type=CTLTYPE_ARROWS,	.Y=2,	.Label=JackSyncStrs,	.Ptr=&JackSyncFunc,					.Attrib.NumOfLabels=3},
+#endif
 #else
  	{.Type=CTLTYPE_ARROWS,	.Y=2,	.Label=ClockStrs,	.Ptr=&ClockFunc,						.Attrib.NumOfLabels=3},
+#endif
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	{.Type=CTLTYPE_CHECK, .Y=2,	.Label="Exact beat",	.Ptr=&BeatSchedFunc,	.Attrib.NumOfLabels=1},
+	{.Type=CTLTYPE_STATIC,	.Y=2, .Label=BeatJitterStr,	.Ptr=&BeatJitterFunc,	.Attrib.NumOfLabels=1},
 #endif
 	{.Type=CTLTYPE_CHECK, .Y=2,	.Label="Flash error",	.Ptr=&FlashFunc,		.Attrib.NumOfLabels=1},
 
@@ -1268,20 +2035,110 @@ static GUICTL		GlobalCtls[] = {
  	{.Type=CTLTYPE_ARROWS,	.Y=4, .Label=DecayStr,		.Ptr=&ReverbDecay,  					.Attrib.NumOfLabels=100+1, .Flags.Local=CTLFLAG_NOSTRINGS},
  	{.Type=CTLTYPE_ARROWS,	.Y=4, .Label=PreDelayStr,	.Ptr=&ReverbPreDelay,  				.Attrib.NumOfLabels=100+1, .Flags.Local=CTLFLAG_NOSTRINGS},
  	{.Type=CTLTYPE_ARROWS,	.Y=4, .Label=DampingStr,	.Ptr=&ReverbDamping, 				.Attrib.NumOfLabels=100+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+ 	{.Type=CTLTYPE_ARROWS,	.Y=4, .BtnLabel=getReverbOutLabel, .Ptr=&ReverbOut,				.Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GET_LABEL},
+#endif
  	{.Type=CTLTYPE_GROUPBOX, .Y=4, .Label=ReverbStr},
+#endif
+#ifndef NO_ALSA_AUDIO_SUPPORT
+ 	{.Type=CTLTYPE_ARROWS,	.Y=5, .Label=VolStr,			.Ptr=&MonVolFunc,	.Attrib.NumOfLabels=100+1, .Flags.Local=CTLFLAG_NOSTRINGS,	.Flags.Global=CTLGLOBAL_GROUPSTART},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=5, .Label="Pan",			.Ptr=&MonPanFunc,	.Attrib.NumOfLabels=100+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+#ifndef NO_REVERB_SUPPORT
+ 	{.Type=CTLTYPE_ARROWS,	.Y=5, .Label=ReverbStr,		.Ptr=&MonRevFunc,	.Attrib.NumOfLabels=100+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+#endif
+	{.Type=CTLTYPE_STATIC,	.Y=5, .Label=RoundTripStr,	.Ptr=&RoundTripFunc,	.Attrib.NumOfLabels=1},
+ 	{.Type=CTLTYPE_GROUPBOX, .Y=5, .Label="Audio in monitor"},
 #endif
  	{.Type=CTLTYPE_ARROWS,	.Y=6, .Label="Click delay",	.Ptr=&ClickFunc,  	.Attrib.NumOfLabels=255, 	.Flags.Local=CTLFLAG_NOSTRINGS},
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+	{.Type=CTLTYPE_CHECK, .Y=6,	.Label="Bundle instruments",	.Ptr=&BundlesFunc,	.Attrib.NumOfLabels=1},
+	{.Type=CTLTYPE_CHECK, .Y=6,	.Label="Share samples",	.Ptr=&SharePoolFunc,	.Attrib.NumOfLabels=1},
+	{.Type=CTLTYPE_CHECK, .Y=6,	.Label="Compact samples",	.Ptr=&CompactFunc,	.Attrib.NumOfLabels=1},
+#endif
+#ifndef NO_ALSA_AUDIO_SUPPORT
+	{.Type=CTLTYPE_CHECK, .Y=6,	.Label="Timer wakeups",	.Ptr=&TschedFunc,	.Attrib.NumOfLabels=1},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=6, .Label="Auto buffer",	.Ptr=&AutoBufFunc,	.Attrib.NumOfLabels=120+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+#endif
 	{.Type=CTLTYPE_STATIC, .Y=6,	.Label=VERSIONSTRING,		.Attrib.NumOfLabels=1},
+
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+ 	{.Type=CTLTYPE_ARROWS,	.Y=7, .BtnLabel=getRecordLabel,	.Ptr=&RecordFunc,	.Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GET_LABEL},
+#endif
+ 	{.Type=CTLTYPE_ARROWS,	.Y=7, .BtnLabel=getAudioCpuLabel,	.Ptr=&AudioCpuFunc,	.Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GET_LABEL|CTLGLOBAL_GROUPSTART},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=7, .BtnLabel=getBeatCpuLabel,	.Ptr=&BeatCpuFunc,	.Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GET_LABEL},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=7, .BtnLabel=getMidiCpuLabel,	.Ptr=&MidiCpuFunc,	.Attrib.NumOfLabels=1, .Flags.Global=CTLGLOBAL_GET_LABEL},
+ 	{.Type=CTLTYPE_GROUPBOX, .Y=7, .Label="Thread CPU"},
+
+#if !defined(NO_MIDI_OUT_SUPPORT) || !defined(NO_SEQ_SUPPORT)
+	{.Type=CTLTYPE_CHECK, .Y=8,	.Label="Synth 1",	.Ptr=&ClockOutFunc,	.Attrib.NumOfLabels=1,	.Flags.Global=CTLGLOBAL_GROUPSTART},
+	{.Type=CTLTYPE_CHECK, .Y=8,	.Label="Synth 2",	.Ptr=&ClockOutFunc,	.Attrib.NumOfLabels=1},
+	{.Type=CTLTYPE_CHECK, .Y=8,	.Label="Synth 3",	.Ptr=&ClockOutFunc,	.Attrib.NumOfLabels=1},
+	{.Type=CTLTYPE_CHECK, .Y=8,	.Label="Synth 4",	.Ptr=&ClockOutFunc,	.Attrib.NumOfLabels=1},
+	{.Type=CTLTYPE_STATIC,	.Y=8, .Label=ClockJitterStr,	.Ptr=&ClockJitterFunc,	.Attrib.NumOfLabels=1},
+ 	{.Type=CTLTYPE_GROUPBOX, .Y=8, .Label="MIDI clock out"},
+#ifndef NO_SEQ_SUPPORT
+ 	{.Type=CTLTYPE_ARROWS,	.Y=8, .Label="Seq lead",	.Ptr=&SeqLeadFunc,	.Attrib.NumOfLabels=20+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+#endif
+	{.Type=CTLTYPE_STATIC,	.Y=8, .Label=MidiOutStatsStr,	.Ptr=&MidiOutStatsFunc,	.Attrib.NumOfLabels=1},
+
+ 	{.Type=CTLTYPE_ARROWS,	.Y=9, .Label="Synth 1",	.Ptr=&LatencyFunc,	.Attrib.NumOfLabels=MIDIOUT_LATENCY_MAX+1, .Flags.Local=CTLFLAG_NOSTRINGS,	.Flags.Global=CTLGLOBAL_GROUPSTART},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=9, .Label="Synth 2",	.Ptr=&LatencyFunc,	.Attrib.NumOfLabels=MIDIOUT_LATENCY_MAX+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=9, .Label="Synth 3",	.Ptr=&LatencyFunc,	.Attrib.NumOfLabels=MIDIOUT_LATENCY_MAX+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+ 	{.Type=CTLTYPE_ARROWS,	.Y=9, .Label="Synth 4",	.Ptr=&LatencyFunc,	.Attrib.NumOfLabels=MIDIOUT_LATENCY_MAX+1, .Flags.Local=CTLFLAG_NOSTRINGS},
+#ifndef NO_ALSA_AUDIO_SUPPORT
+ 	{.Type=CTLTYPE_PUSH,		.Y=9, .Label="Measure",	.Ptr=&MeasureFunc,	.Attrib.NumOfLabels=1},
+#endif
+ 	{.Type=CTLTYPE_GROUPBOX, .Y=9, .Label="External Synth latency"},
+#endif
 	{.Type=CTLTYPE_END},
 };
 
 static const char GeneralHelpStr[] = "\2Flash error \1automatically dismisses any error message after 5 seconds. Be sure to enable this if you're running BackupBand without a computer \
-keyboard or mouse.\n\2Clock \1offers 3 settings for timing. The faster settings invoke less overhead, but may result in the robots playing at an erratic tempo, depending upon your \
-system. Choose the fastest clock that doesn't adversely affect the robots' rhythm. \2MIDI \1clock is used only if you wish to slave BackupBand to some other hardware/software's tempo, \
-using MIDI clock messages. You must set the tempo, and start/stop play, from the other device.\nIncreasing \2Click delay \1 causes BackupBand to be less sensitive to mouse button \
+keyboard or mouse.\n\2Clock \1offers 3 settings for the clock that times tap tempo and MIDI input. The faster settings invoke less overhead, but are less precise. The robots' \
+rhythm doesn't depend upon this setting. BackupBand always sleeps until the exact time of each beat, so the tempo never drifts. \2MIDI \1clock is used only if you wish to slave BackupBand to some other hardware/software's tempo, \
+using MIDI clock messages. You must set the tempo, and start/stop play, from the other device.\n\2Smooth \1applies only to \2MIDI \1clock. \
+Rather than play upon each clock as it arrives (which may jitter a few milliseconds through USB), BackupBand estimates when each clock is due, and plays then. \2Max \1smooths the \
+most, but takes longer to follow a tempo change. \2Low \1follows changes fastest. \2Locked \1shows once the clock has been steady for a beat. Until then, or when the tempo \
+suddenly changes, BackupBand plays upon each clock as it arrives. \2Off \1always does.\n\2Exact beat \1applies only \
+when an ALSA sound card is the audio out. The robots then play each note at the exact sample where it falls in the beat, instead of at the start of the sound card's \
+next block, so their timing doesn't depend upon the block size or upon how promptly your system wakes BackupBand. The robots are heard about one block later. The \
+\2Jitter \1shown beside it is how far apart (in samples) the earliest and latest robot notes landed compared to the exact beat, since play last started, and how many \
+notes were late. Compare it with this setting on and off.\n\2Jack transport \1applies only when Jack is the audio out. \2Follow \1slaves BackupBand to Jack's transport: play starts on the first downbeat after the transport rolls, stops when it stops, and the tempo and position come from the transport. \2Master \1makes BackupBand Jack's timebase master, so other Jack programs see its bar, beat and tempo, and starting/stopping play starts/stops the transport.\nIncreasing \2Click delay \1 causes BackupBand to be less sensitive to mouse button \
 double-clicks. Adjust this setting if you're using a touchscreen that tends to generate false double-clicks, or when using a USB pedal configured as a mouse it does \
 likewise.\n\2Transpose \1 transposes the drum, guitar, pad, and human solo instruments up/down by half steps. Unlike the Transpose setting in the main screen, the Setup screen's \
-transpose is maintained each time you run BackupBand.";
+transpose is maintained each time you run BackupBand.\n\2Bundle instruments \1loads each sampled instrument from a single prebuilt file (with a .bnd extension, in \
+the instrument's folder) instead of its txt and wave files, which makes startup faster. BackupBand builds the bundle the first time it loads the instrument, and rebuilds \
+it whenever you change any of the instrument's files.\n\2Share samples \1lets several copies of BackupBand, running at the same time, share one copy of \
+each sampled instrument's waves in RAM, instead of each loading its own.\n\2Compact samples \1stores the waves in about a third of the RAM, with a slight loss \
+of quality and a little more CPU use. It doesn't apply to shared samples.\n\2Timer wakeups \1has BackupBand use its own timer to decide when to feed \
+the sound card, instead of waiting for the card to ask. Latency then depends only upon the Buffer setting (in the audio device screen), even on cards (such as many \
+USB ones) that offer only large buffers. It takes effect the next time the audio device is opened.\n\2Auto buffer \1has BackupBand find the \
+smallest Buffer setting your audio device plays without xruns. It starts with a large buffer, and each time the robots stop playing, tries a smaller one if they have \
+played cleanly for this many minutes. After an xrun, it goes back to a larger buffer, and never again tries the one that failed. It remembers what it found for each \
+audio device. 0 turns it off, so the Buffer setting is used.\n\2Audio in monitor \1mixes your mic or \
+instrument (plugged into the audio in device) into BackupBand's output, with its own \2Volume\1, \2Pan\1, and \2Reverb \1amount. The \2Delay \1shown is the time from \
+audio in to audio out, as last measured.\nThe \2Out \1setting (here for the reverb, on the Robots page for each robot, and on the Human page for the solo \
+instrument) sends that part to its own pair of outputs on a multichannel audio card, or its own pair of \"out\" ports under Jack, so you can mix it separately. \
+If the card doesn't have that pair, the part plays on Out 1-2. It takes effect the next time the audio device is opened.\n\2Record \1saves \
+everything BackupBand plays to a WAV file in your BackupBand folder, named for the date and time the audio device was opened. \2Mix \1saves the stereo mix. \
+\2All outs \1saves every output pair separately, so you can remix each robot later. It starts the next time the audio device is opened, and runs until \
+it's closed. Over 4G, it continues in a new file. If your disk can't keep up, the lost periods are counted next to the setting.\n\2Thread CPU \1pins the \
+\2Audio\1, \2Beat play\1, and \2MIDI in \1threads each to one CPU core, so they aren't moved between cores (losing their cache) while playing. For best timing, pick a \
+core that other software doesn't use much, such as one reserved with the isolcpus boot option. \2Any \1lets Linux choose. It takes effect the next time the thread \
+starts. BackupBand also locks itself in RAM if your memlock limit is unlimited, and warns at startup if your rtprio or memlock limit stops it running in realtime.\n\2MIDI clock out \1makes BackupBand \
+the master clock for drum machines, sequencers, or lighting rigs connected to the checked \2External Synth \1outputs. When play starts, they get a MIDI Start, then MIDI clock (24 per beat) \
+at BackupBand's tempo, including ritards and accelerandos. When play stops, they get a MIDI Stop and the song position where it stopped. It takes effect the next time play \
+starts, and isn't sent when the \2Clock \1is MIDI. The \2Jitter \1shown beside it is how far apart (in microseconds) the earliest and latest clocks went out compared to \
+the exact time, since play last started.\n\2Seq lead \1applies to \2External Synth \1outputs that are ALSA sequencer (not raw MIDI) ports. Rather than sending the robots' \
+notes the moment BackupBand gets around to them, it stamps each with the time it's due (or for notes you play, when you play them), plus this many milliseconds, and lets Linux deliver it then. This removes BackupBand's \
+timing jitter from your external synths, but delays them by the lead. Set it just high enough that notes don't arrive late (a few milliseconds is usually enough). 0 sends \
+notes immediately.\nBeside it is how much MIDI out has queued up at once, and the longest (in microseconds) between BackupBand queuing a note, and \
+it being written to the \2External Synth\1, since the output was opened. For a (raw MIDI) hardware port, \2wire \1is the longest those \
+notes took to go down a MIDI cable. To shorten that, BackupBand sends the kick, snare, and bass first, and uses running status. Each output has its own thread to do the writing. It runs on the same CPU as the \
+\2MIDI in \1thread.\n\2External Synth latency \1is how many milliseconds each external synth takes to sound a note after BackupBand sends it. BackupBand holds back \
+the robots' notes to faster outputs (including the Internal Synth, which takes about as long as its buffer), so that every robot sounds together with the slowest. \
+0 for all means no holding back. \2Measure \1sets it for each external synth a robot plays, by playing a loud note on that robot's channel and timing when it arrives at \
+the audio in device. Cable the synth's output to audio in, and make sure nothing else is heard there. Measure one synth at a time, and stop play first. It takes a few seconds per synth, then shows the results.";
 
 static void updateBussBtns(void)
 {
@@ -1676,6 +2533,25 @@ static const char * getRobotChanStr(GUIAPPHANDLE app, GUICTL * ctl, char * buffe
 	return buffer;
 }
 
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+
+static uint32_t ctl_set_robot_out(register GUICTL * ctl)
+{
+	return set_output(ctl, getCurrSelRobot(ctl));
+}
+
+static uint32_t ctl_update_robot_out(register GUICTL * ctl)
+{
+	return update_output(ctl, getCurrSelRobot(ctl));
+}
+
+static const char * getRobotOutStr(GUIAPPHANDLE app, GUICTL * ctl, char * buffer)
+{
+	return formatOutputLabel(getCurrSelRobot(ctl), buffer);
+}
+
+#endif
+
 static uint32_t ctl_set_CurrentRobot(register GUICTL * ctl)
 {
 	register unsigned char	musicianNum;
@@ -1751,6 +2627,9 @@ static GUICTLDATA	CurrentRobotFunc = {ctl_update_nothing, ctl_set_CurrentRobot};
 static GUICTLDATA	RobotMuteFunc = {ctl_update_robot_mute, ctl_set_robot_mute};
 static GUICTLDATA	RobotPlayDevFunc = {ctl_update_robot_playdev, ctl_set_robot_playdev};
 static GUICTLDATA	RobotMidiChanFunc = {ctl_update_robot_midichan, ctl_set_robot_midichan};
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+static GUICTLDATA	RobotOutFunc = {ctl_update_robot_out, ctl_set_robot_out};
+#endif
 
 static GUICTL		RobotCtls[] = {
 	{.Type=CTLTYPE_ARROWS,	 .Label=AutostartStr,	 	.Ptr=&AutostartFunc,				 		.Attrib.NumOfLabels=3, 		.Flags.Global=CTLGLOBAL_AUTO_VAL},
@@ -1766,6 +2645,9 @@ static GUICTL		RobotCtls[] = {
 	{.Type=CTLTYPE_CHECK,	.Y=4,			.Label=RobotMuteStr,			.Ptr=&RobotMuteFunc, 			.Attrib.NumOfLabels=1, 		 .Flags.Global=CTLGLOBAL_AUTO_VAL},
  	{.Type=CTLTYPE_ARROWS,	.Y=4,			.Label=VolStr,					.Ptr=(void *)CTLSTR_DRUMVOL,	.Attrib.NumOfLabels=89,		 .Flags.Local=CTLFLAG_NOSTRINGS,	.Flags.Global=CTLGLOBAL_PRESET},
 	{.Type=CTLTYPE_ARROWS,	.Y=5,			.Label=PlayDevStr,			.Ptr=&RobotPlayDevFunc,			.Attrib.NumOfLabels=BUSSCNT,.Flags.Local=CTLFLAG_NO_DOWN,	.Flags.Global=CTLGLOBAL_AUTO_VAL},
+#if !defined(NO_ALSA_AUDIO_SUPPORT) || !defined(NO_JACK_SUPPORT)
+ 	{.Type=CTLTYPE_ARROWS,	.Y=5,			.BtnLabel=getRobotOutStr,	.Ptr=&RobotOutFunc,				.Attrib.NumOfLabels=1, 		 .Flags.Global=CTLGLOBAL_GET_LABEL},
+#endif
  	{.Type=CTLTYPE_RADIO,	.Y=5,	.X=1,	.Label=&PolStrs[0],			.Ptr=&HHPolFunc,					.Attrib.NumOfLabels=2,		 .Flags.Local=CTLFLAG_LABELBOX},
 	{.Type=CTLTYPE_GROUPBOX, .Y=5, .Label=RobotStr},
 	{.Type=CTLTYPE_END},
@@ -19,6 +19,7 @@ void showSetupHelp(void);
 void updateMidiViewStop(void);
 void doNoteScreen(register const char *, register unsigned char);
 void endNotePoint(void);
+void endMeasure(void);
 void ctl_set_default(register GUICTL *);
 int isRobotSetup(void);
 void play_off_state(void);
@@ -21,6 +21,9 @@
 #include "AudioPlay.h"
 #include "SongSheet.h"
 #include "FileLoad.h"
+
+//#define JG_RESYNC_TIMING
+
 #ifndef O_NOATIME
 #define O_NOATIME        01000000
 #endif
@@ -28,12 +31,24 @@
 #define VARFLAG_DEFAULT_END		0x80
 #define VARFLAG_HAS_HALFMEAS		0x40
 
+// A variation's index has a 16-bit offset to each ptn's first evt, followed
+// by a PPQN index for each ptn. The PPQN index has an entry per
+// INDEX_TICKS (ie, every 16th note) with the offset (from the ptn's
+// first evt) of the first evt at or after that time
+#define INDEX_TICKS					(PPQN_VALUE / 4)
+#define INDEX_SLOTS					((256 / INDEX_TICKS) + 1)
+
+#define VARTYPE_BASS					0
+#define VARTYPE_GTR					1
+#define VARTYPE_DRUM					2
+
 
 
 #pragma pack(1)
 // Prepended to STYLE_VARIATION to maintain a linked list
 struct VARIATION_HEAD {
 	struct VARIATION_HEAD *	Next;
+	unsigned char *			Index;		// Ptn and PPQN index. 0 if not built
 	uint32_t						Name;			// Name hash formed from filename
 };
 
@@ -253,14 +268,15 @@ const unsigned char *				DrumEvtPtr;
 // Current style's drum chain byte to play
 static const unsigned char *		PlayDrumChainPtr;
 static STYLE_VARIATION *			PlayDrumVariation;
+static unsigned char					PlayDrumPtnNum;
 
 // Currently playing Bass/Gtr variations
 static STYLE_VARIATION *			PlayGtrVariation;
 static STYLE_VARIATION *			PlayBassVariation;
 static char	*							PlayGtrChainPtr;
 static char *							PlayBassChainPtr;
-static const unsigned char	*		GtrSameEvtPtr;
-static const unsigned char *		BassSameEvtPtr;
+static unsigned char					GtrSamePtn;
+static unsigned char					BassSamePtn;
 static char								PlayBassPtnNum[2] = {0, -1};
 static char								PlayGtrPtnNum[2] = {0, -1};
 
@@ -312,6 +328,19 @@ unsigned char getMeasureTime(void)
 	return PlayCurrentStyle->MeasureLen;
 }
 
+/************* getMeasureBeats() *******************
+ * Gets the beats per measure of the style in play, or
+ * else the selected style. Safe to call from any thread.
+ */
+
+unsigned char getMeasureBeats(void)
+{
+	register STYLE *	style;
+
+	if (!(style = PlayCurrentStyle) && !(style = CurrentStyle)) return 4;
+	return style->MeasureLen / PPQN_VALUE;
+}
+
 
 
 /************* isStyleQueued() *******************
@@ -442,6 +471,83 @@ def:	PlayDrumVariation = ptr;
 
 
 
+/********************* getEvtSize() *******************
+ * Gets the size of a bass, gtr, or drum event.
+ */
+
+static unsigned char getEvtSize(register const unsigned char * evt, register unsigned char type)
+{
+	switch (type)
+	{
+		case VARTYPE_BASS:
+			return (evt[1] & BASSEVTFLAG_NOT_ON) ? 2 : 3;
+		case VARTYPE_GTR:
+			return ((evt[1] & GTREVTFLAG_STEPOFFMASK) == GTREVTFLAG_STEPOFF || (evt[1] & GTREVTFLAG_STRINGOFFMASK) == GTREVTFLAG_STRINGOFF) ? 2 : 3;
+	}
+	return 3;
+}
+
+
+
+
+
+/********************* seekPtn() *******************
+ * Gets a pointer to the first event at or after the
+ * specified PPQN clock in the specified ptn. Uses the
+ * variation's index (built by loadVariation) so this
+ * takes the same short time regardless of the ptn #
+ * or clock. The built-in variations have no index, but
+ * are only 1 short ptn.
+ *
+ * Called by Beat Play thread.
+ */
+
+static const unsigned char * seekPtn(register const STYLE_VARIATION * ptr, register unsigned char ptnnum, register unsigned char clock, register unsigned char type)
+{
+	register const unsigned char *	evt;
+	register const unsigned char *	index;
+
+	index = 0;
+	if ((const unsigned char *)ptr != SilentVariation && (const unsigned char *)ptr != DefaultDrumEnding &&
+		(const unsigned char *)ptr != DefaultBassEnding && (const unsigned char *)ptr != DefaultGtrEnding)
+	{
+		index = ((struct VARIATION_HEAD *)ptr - 1)->Index;
+	}
+
+	if (index)
+	{
+		evt = &ptr->NumChains + ((const uint16_t *)index)[ptnnum];
+		if (clock) evt += index[(ptr->NumPtns * 2) + (ptnnum * INDEX_SLOTS) + (clock / INDEX_TICKS)];
+	}
+	else
+	{
+		// Start with ptn chain
+		evt = &ptr->NumChains;
+		do
+		{
+			// Skip to next ptn. First time, skip over chain
+			evt += *evt;
+
+		// Is this the desired ptn?
+		} while (ptnnum--);
+
+		// Skip size of Pattern
+		evt++;
+	}
+
+	// Skip the few evts before the clock
+	if (clock)
+	{
+		while (clock > *evt) evt += getEvtSize(evt, type);
+	}
+
+	return evt;
+}
+
+
+
+
+
 /********************* setDrumEvtPtr() *******************
  * Sets DrumEvtPtr to point to the first drum event in the
  * specified ptn.
@@ -463,19 +569,24 @@ static void setDrumEvtPtr(register unsigned char ptnnum)
 	}
 #endif
 
-	// Start with ptn chain
-	DrumEvtPtr = &ptr->NumChains;
+	PlayDrumPtnNum = ptnnum;
+	DrumEvtPtr = seekPtn(ptr, ptnnum, 0, VARTYPE_DRUM);
+}
+
 
-	do
-	{
-		// Skip to next ptn. First time, skip over chain
-		DrumEvtPtr += *DrumEvtPtr;
 
-	// Is this the desired ptn?
-	} while (ptnnum--);
 
-	// Skip size of Drum Pattern
-	DrumEvtPtr++;
+
+/********************* seekDrumEvtPtr() *******************
+ * Sets DrumEvtPtr to point to the first drum event at or
+ * after the specified PPQN clock in the playing ptn.
+ *
+ * Called by Beat Play thread.
+ */
+
+void seekDrumEvtPtr(register unsigned char clock)
+{
+	DrumEvtPtr = seekPtn(PlayDrumVariation, PlayDrumPtnNum, clock, VARTYPE_DRUM);
 }
 
 
@@ -850,7 +961,7 @@ uint32_t update_play_style(register unsigned char threadId)
 #ifndef NO_SONGSHEET_SUPPORT
 	if (isSongsheetActive())
 #endif
-		set_PPQN(set_bpm(0));
+		set_PPQN(set_tempo(0));
 
 	return refresh;
 }
@@ -877,6 +988,11 @@ void setAccompEvtPtr(unsigned char clock)
 {
 	register STYLE_VARIATION *	ptr;
 	register unsigned char		tempnum;
+#ifdef JG_RESYNC_TIMING
+	struct timespec				startTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+#endif
 
 	// Bass/gtr accomp on?
 	ptr = PlayBassVariation;
@@ -891,42 +1007,17 @@ void setAccompEvtPtr(unsigned char clock)
 		// If so, loop back to repeat start
 		if (*PlayBassChainPtr < 0) PlayBassChainPtr += *PlayBassChainPtr;
 
-		tempnum = *PlayBassChainPtr++;
-		BassEvtPtr = &ptr->NumChains;
-
-		do
-		{
-			// Skip to next ptn. First time, skip over chain
-			BassEvtPtr += *BassEvtPtr;
-
-		// Is this the desired ptn?
-		} while (tempnum--);
-
-		// Skip size of Pattern
-		BassEvtPtr++;
-
-		BassSameEvtPtr = BassEvtPtr;
+		BassSamePtn = *PlayBassChainPtr++;
+		BassEvtPtr = seekPtn(ptr, BassSamePtn, 0, VARTYPE_BASS);
 	}
 
 	else
 	{
-		if (clock && (ptr->u.Flags & VARFLAG_HAS_HALFMEAS) && (VariationNum[VARIATION_INPLAY] < 4 || !(ptr->u.Flags & VARFLAG_DEFAULT_END)))
-		{
+		// Resync within the current ptn, unless the variation changed and no longer has it
+		tempnum = BassSamePtn;
+		if (tempnum >= ptr->NumPtns || (clock && (ptr->u.Flags & VARFLAG_HAS_HALFMEAS) && (VariationNum[VARIATION_INPLAY] < 4 || !(ptr->u.Flags & VARFLAG_DEFAULT_END))))
 			tempnum = 0;
-			BassEvtPtr = &ptr->NumChains;
-			do
-			{
-				BassEvtPtr += *BassEvtPtr;
-			} while (tempnum--);
-
-			BassEvtPtr++;
-		}
-		else
-			BassEvtPtr = BassSameEvtPtr;
-		if (clock)
-		{
-			while (clock > *BassEvtPtr) BassEvtPtr += ((BassEvtPtr[1] & BASSEVTFLAG_NOT_ON) ? 2 : 3);
-		}
+		BassEvtPtr = seekPtn(ptr, tempnum, clock, VARTYPE_BASS);
 	}
 
 	// Do the same for the gtr
@@ -935,38 +1026,34 @@ void setAccompEvtPtr(unsigned char clock)
 	{
 		if (PlayGtrChainPtr >= (char *)&ptr->Chains[ptr->NumChains - 1]) PlayGtrChainPtr = (char *)&ptr->Chains[0];
 		if (*PlayGtrChainPtr < 0) PlayGtrChainPtr += *PlayGtrChainPtr;
-		tempnum = *PlayGtrChainPtr++;
-		GtrEvtPtr = &ptr->NumChains;
-		do
-		{
-			GtrEvtPtr += *GtrEvtPtr;
-		} while (tempnum--);
-		GtrEvtPtr++;
-		GtrSameEvtPtr = GtrEvtPtr;
+		GtrSamePtn = *PlayGtrChainPtr++;
+		GtrEvtPtr = seekPtn(ptr, GtrSamePtn, 0, VARTYPE_GTR);
 	}
 	else
 	{
-		if (clock && (ptr->u.Flags & VARFLAG_HAS_HALFMEAS) && (VariationNum[VARIATION_INPLAY] < 4 || !(ptr->u.Flags & VARFLAG_DEFAULT_END)))
-		{
+		tempnum = GtrSamePtn;
+		if (tempnum >= ptr->NumPtns || (clock && (ptr->u.Flags & VARFLAG_HAS_HALFMEAS) && (VariationNum[VARIATION_INPLAY] < 4 || !(ptr->u.Flags & VARFLAG_DEFAULT_END))))
 			tempnum = 0;
-			GtrEvtPtr = &ptr->NumChains;
-			do
-			{
-				GtrEvtPtr += *GtrEvtPtr;
-			} while (tempnum--);
-			GtrEvtPtr++;
-		}
-		else
-			GtrEvtPtr = GtrSameEvtPtr;
-		if (clock)
+		GtrEvtPtr = seekPtn(ptr, tempnum, clock, VARTYPE_GTR);
+	}
+
+#ifdef JG_RESYNC_TIMING
+	// Report the worst case time to resync to a mid-measure clock
+	if (clock && clock < PlayCurrentStyle->MeasureLen)
+	{
+		static uint32_t		worstTime;
+		struct timespec		endTime;
+		register uint32_t		nsecs;
+
+		clock_gettime(CLOCK_MONOTONIC, &endTime);
+		nsecs = (uint32_t)(((endTime.tv_sec - startTime.tv_sec) * 1000000000ULL) + endTime.tv_nsec - startTime.tv_nsec);
+		if (nsecs > worstTime)
 		{
-			while (clock > *GtrEvtPtr)
-			{
-				GtrEvtPtr++;
-				GtrEvtPtr += ((GtrEvtPtr[0] & GTREVTFLAG_STEPOFFMASK) == GTREVTFLAG_STEPOFF || (GtrEvtPtr[0] & GTREVTFLAG_STRINGOFFMASK) == GTREVTFLAG_STRINGOFF) ? 1 : 2;
-			}
+			worstTime = nsecs;
+			printf("Resync to clock %u: %u nsecs (worst)\r\n", clock, nsecs);
 		}
 	}
+#endif
 }
 
 
@@ -1524,9 +1611,13 @@ uint32_t playFillAndAdvance(register unsigned char threadId)
  *
  * fn =			Variation file's nul-terminated full pathname.
  * namePtr =	Ptr to the filename.
- * which =		Intro, verse, chorus, bridge, or ending.
+ * which =		VARTYPE_BASS, VARTYPE_GTR, or VARTYPE_DRUM.
  *
  * RETURNS: 0 = success, non-zero = fail.
+ *
+ * Appends an index of the ptns and their PPQN clocks so
+ * that the Beat Play thread can resync to any clock without
+ * walking the variation. See seekPtn().
  */
 
 static const char * loadVariation(char * fn, const char * namePtr, unsigned int which)
@@ -1590,8 +1681,48 @@ corrupt:
 		ptr += *ptr;
 	} while (--cnt);
 	if (ptr != &variation->Chains[len]) goto corrupt;
+
+	// Build the index after the data, 16-bit aligned. If the variation is too big for
+	// 16-bit offsets, or we can't get the mem, just go without an index
+	mem->Index = 0;
+	len = ((ptr - (unsigned char *)mem) + 1) & ~1UL;
+	if (ptr - &variation->NumChains < 0x10000)
+	{
+		register unsigned char *		index;
+		register unsigned char *		ptn;
+		register const unsigned char *	evt;
+		register unsigned char			slot;
+
+		if (!(index = (unsigned char *)realloc(mem, len + (variation->NumPtns * (2 + INDEX_SLOTS))))) goto noindex;
+		mem = (struct VARIATION_HEAD *)index;
+		index += len;
+		variation = (STYLE_VARIATION *)(&mem[1]);
+
+		// Skip chain to first ptn
+		ptn = &variation->NumChains;
+		ptn += *ptn;
+		for (cnt = 0; cnt < variation->NumPtns; cnt++)
+		{
+			// Offset to ptn's first evt
+			((uint16_t *)index)[cnt] = (uint16_t)(ptn + 1 - &variation->NumChains);
+
+			// Offset to the first evt at each 16th note. Stop at the end of ptn timing
+			evt = ptn + 1;
+			for (slot = 0; slot < INDEX_SLOTS; slot++)
+			{
+				while (evt < ptn + *ptn - 1 && *evt < slot * INDEX_TICKS) evt += getEvtSize(evt, which);
+				if (evt > ptn + *ptn - 1) evt = ptn + *ptn - 1;
+				index[(variation->NumPtns * 2) + (cnt * INDEX_SLOTS) + slot] = (unsigned char)(evt - (ptn + 1));
+			}
+
+			ptn += *ptn;
+		}
+
+		mem->Index = index;
+	}
 	}
 
+noindex:
 	mem->Name = hash_string((unsigned char *)namePtr);
 
 	// Link into list
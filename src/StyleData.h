@@ -10,7 +10,9 @@ int			isStyleQueued(void);
 uint32_t		update_play_style(register unsigned char);
 uint32_t		queueNextDrumMeas(void);
 unsigned char	getMeasureTime(void);
+unsigned char	getMeasureBeats(void);
 void			setAccompEvtPtr(unsigned char);
+void			seekDrumEvtPtr(register unsigned char);
 void			play_beat(register unsigned char, register unsigned char);
 uint32_t		change_style(register unsigned char, register char *, register unsigned char);
 uint32_t		selectStyleCategory(register unsigned char);
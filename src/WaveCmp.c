@@ -91,8 +91,15 @@ typedef struct {
 	unsigned char	StereoFlag;
 } DRUMBOXFILE;
 
+// DRUMBOXFILE StereoFlag
+#define CMPFLAG_STEREO		0x01
+#define CMPFLAG_LOSSLESS	0x40
+
 #pragma pack()
 
+// The lossless format, and its decoder, shared with AudioPlay.c
+#include "WaveUnpack.c"
+
 
 
 
@@ -116,6 +123,8 @@ static const char ErrorMsgs[] = {'d','i','d','n','\'','t',' ','o','p','e','n',0,
 
 static const char WavExtension[] = ".wav";
 
+static uint32_t	WaveCmpFlags;
+
 
 
 
@@ -203,6 +212,242 @@ static unsigned char compareID(const unsigned char * id, unsigned char * ptr)
 
 
 
+/******************** WaveCmpSetFlags() *******************
+ * Sets options for subsequent WaveCmpConvert/Dir() calls.
+ *
+ * flags =	WAVECMP_xxx
+ */
+
+void WaveCmpSetFlags(uint32_t flags)
+{
+	WaveCmpFlags = flags;
+}
+
+
+
+
+
+/*********************** putBits() ***********************
+ * Appends the low "count" (upto 32) bits of "val" to the
+ * bitstream.
+ */
+
+static void putBits(register BITSTREAM * bits, register uint32_t val, register uint32_t count)
+{
+	bits->Bits = (bits->Bits << count) | (val & (uint32_t)((1ULL << count) - 1));
+	bits->Count += count;
+	while (bits->Count >= 8)
+	{
+		bits->Count -= 8;
+		*(bits->Ptr)++ = (unsigned char)(bits->Bits >> bits->Count);
+	}
+}
+
+/********************* packChan() ***********************
+ * Picks the predictor order that yields the smallest
+ * residuals for one chan of a block, and optionally writes
+ * the chan to the bitstream.
+ *
+ * RETURN: The sum of the residuals' magnitudes, for the
+ * chosen order.
+ */
+
+static uint64_t packChan(register const int32_t * data, uint32_t numPts, BITSTREAM * bits)
+{
+	register uint32_t	i;
+	uint64_t				sum, best;
+	unsigned char		order, bestOrder;
+
+	best = (uint64_t)-1;
+	bestOrder = 0;
+	for (order = 0; order <= 4 && order <= numPts; order++)
+	{
+		sum = 0;
+		for (i = order; i < numPts; i++) sum += llabs(data[i] - predictPt(&data[i], order));
+		if (sum < best)
+		{
+			best = sum;
+			bestOrder = order;
+		}
+	}
+
+	if (bits)
+	{
+		uint32_t		partition;
+
+		putBits(bits, bestOrder, 3);
+		for (i = 0; i < bestOrder; i++) putBits(bits, data[i], 17);
+
+		for (partition = 0; partition < numPts; partition += LOSSLESS_PARTITION)
+		{
+			register uint32_t	end;
+			unsigned char		k;
+
+			end = partition + LOSSLESS_PARTITION;
+			if (end > numPts) end = numPts;
+			if ((i = partition) < bestOrder) i = bestOrder;
+			if (i < end)
+			{
+				// Choose k so 2^k is about the mean residual
+				sum = 0;
+				for (; i < end; i++)
+				{
+					register int32_t	residual;
+
+					residual = data[i] - predictPt(&data[i], bestOrder);
+					sum += ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+				}
+				i = end - ((partition < bestOrder) ? bestOrder : partition);
+				k = 0;
+				while (k < 24 && ((uint64_t)i << (k + 1)) < sum) k++;
+				putBits(bits, k, 5);
+
+				for (i = (partition < bestOrder ? bestOrder : partition); i < end; i++)
+				{
+					register int32_t	residual;
+					register uint32_t	val;
+
+					residual = data[i] - predictPt(&data[i], bestOrder);
+					val = ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+					if ((val >> k) >= RICE_ESCAPE)
+					{
+						putBits(bits, 0, RICE_ESCAPE);
+						putBits(bits, val, RICE_ESCAPE_BITS);
+					}
+					else
+					{
+						putBits(bits, 1, (val >> k) + 1);
+						if (k) putBits(bits, val, k);
+					}
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+/*********************** getPt() ************************
+ * Returns the sample at the specified offset in .cmp data.
+ */
+
+static int32_t getPt(register const char * data, register uint32_t offset, register uint32_t compressPoint)
+{
+	if (offset < compressPoint) return ((short *)data)[offset];
+	return data[(compressPoint << 1) + (offset - compressPoint)];
+}
+
+/********************** packWave() **********************
+ * Compresses .cmp data losslessly.
+ *
+ * data =	The .cmp data (ie, 16-bit samples, then any 8-bit).
+ * drum =	The .cmp header, with DataLength and CompressPoint
+ *				in samples.
+ * dest =	Where to return the malloc'ed compressed data.
+ *
+ * RETURN: The size of the compressed data, or 0 if an error.
+ */
+
+static uint32_t packWave(register const char * data, register DRUMBOXFILE * drum, unsigned char ** dest)
+{
+	register unsigned char *	mem;
+	register uint32_t				frame, size;
+	uint32_t							frames, i, avail;
+	unsigned char					chans;
+	int32_t							pts[2][LOSSLESS_BLOCK_FRAMES];
+
+	chans = (drum->StereoFlag & CMPFLAG_STEREO) ? 2 : 1;
+	frames = drum->DataLength / chans;
+	if (frames * chans != drum->DataLength) goto bad;
+
+	mem = 0;
+	size = avail = 0;
+	for (frame = 0; frame < frames; frame += LOSSLESS_BLOCK_FRAMES)
+	{
+		BITSTREAM		bits;
+		uint32_t			numPts;
+		unsigned char	side;
+
+		numPts = frames - frame;
+		if (numPts > LOSSLESS_BLOCK_FRAMES) numPts = LOSSLESS_BLOCK_FRAMES;
+
+		// Make sure there's room for the worst case, where every residual escapes
+		if (avail - size < 4 + 1 + (((RICE_ESCAPE + RICE_ESCAPE_BITS) * numPts * chans) / 8) + (chans * 16) + (LOSSLESS_BLOCK_FRAMES / LOSSLESS_PARTITION) * chans)
+		{
+			register unsigned char *	temp;
+
+			avail += 4 + 1 + (((RICE_ESCAPE + RICE_ESCAPE_BITS) * LOSSLESS_BLOCK_FRAMES * chans) / 8) + (chans * 16) + (LOSSLESS_BLOCK_FRAMES / LOSSLESS_PARTITION) * chans;
+			if (!(temp = (unsigned char *)realloc(mem, avail))) goto bad2;
+			mem = temp;
+		}
+
+		// Deinterleave the block's samples
+		for (i = 0; i < numPts; i++)
+		{
+			pts[0][i] = getPt(data, (frame + i) * chans, drum->CompressPoint);
+			if (chans > 1) pts[1][i] = getPt(data, ((frame + i) * chans) + 1, drum->CompressPoint);
+		}
+
+		bits.Ptr = &mem[size + 4];
+		bits.Bits = bits.Count = 0;
+
+		// For stereo, store the second chan as the difference (left - right) if that
+		// predicts better
+		side = 0;
+		if (chans > 1)
+		{
+			uint64_t		right;
+
+			right = packChan(&pts[1][0], numPts, 0);
+			for (i = 0; i < numPts; i++) pts[1][i] = pts[0][i] - pts[1][i];
+			if (packChan(&pts[1][0], numPts, 0) < right)
+				side = 1;
+			else for (i = 0; i < numPts; i++) pts[1][i] = pts[0][i] - pts[1][i];
+			putBits(&bits, side, 1);
+		}
+
+		for (i = 0; i < chans; i++) packChan(&pts[i][0], numPts, &bits);
+		if (bits.Count) putBits(&bits, 0, 8 - bits.Count);
+
+		// Store the block size
+		i = (bits.Ptr - &mem[size]) - 4;
+		memcpy(&mem[size], &i, 4);
+		size += i + 4;
+	}
+
+	*dest = mem;
+	return size;
+
+bad2:
+	if (mem) free(mem);
+bad:
+	return 0;
+}
+
+/******************** WaveCmpUnpack() *******************
+ * Decompresses the data of a lossless .cmp. See
+ * unpackWave() in WaveUnpack.c.
+ *
+ * src =				The compressed data.
+ * size =			Size of the compressed data.
+ * dest =			Where to store the data, as per compressPoint.
+ * numPts =			Number of samples (not frames).
+ * compressPoint =	Sample offset to 8-bit bytes. Pass numPts
+ * 						to get all 16-bit samples.
+ * chans =			1 or 2.
+ *
+ * RETURN: 0 if success, or -1 if bad data.
+ */
+
+int WaveCmpUnpack(const unsigned char * src, uint32_t size, char * dest, uint32_t numPts, uint32_t compressPoint, unsigned char chans)
+{
+	return unpackWave(src, size, dest, numPts, compressPoint, chans);
+}
+
+
+
+
+
 /******************** WaveCmpConvert() *******************
  * Converts a WAVE file to proprietary compressed format.
  */
@@ -476,13 +721,11 @@ skip:			if (head.Length & 1) ++head.Length;  // If odd, round it up to account f
 					drum.StereoFlag |= 0x30;
 			}
 
-			// Write the drum header
-			if (write(outHandle, &drum, sizeof(DRUMBOXFILE)) != sizeof(DRUMBOXFILE))
-badwrite:		action = 7;
-			else
 			{
 				register uint32_t	offset;
 				register short	pt;
+				unsigned char *	packed;
+				register char *	data;
 
 				// Compress the data
 				offset = action = drum.CompressPoint << 1;
@@ -494,10 +737,25 @@ badwrite:		action = 7;
 					++offset;
 				}
 
-				// Write the compressed data
-				if (write(outHandle, wavePtr, offset) != offset) goto badwrite;
+				// Losslessly compress it too? If that doesn't save anything, store it as is
+				data = wavePtr;
+				packed = 0;
+				if (WaveCmpFlags & WAVECMP_LOSSLESS)
+				{
+					if ((action = packWave(wavePtr, &drum, &packed)) && action < offset)
+					{
+						drum.StereoFlag |= CMPFLAG_LOSSLESS;
+						data = (char *)packed;
+						offset = action;
+					}
+				}
 
-				action = 0;
+				// Write the drum header, then the compressed data
+				if (write(outHandle, &drum, sizeof(DRUMBOXFILE)) != sizeof(DRUMBOXFILE) || write(outHandle, data, offset) != offset)
+					action = 7;
+				else
+					action = 0;
+				if (packed) free(packed);
 			}
 
 			// Close the file
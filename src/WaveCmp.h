@@ -40,6 +40,15 @@ typedef uint32_t WaveCmpConvertPtr(char *);
 uint32_t WaveCmpDir(char *);
 typedef uint32_t WaveCmpDirPtr(char *);
 
+// WaveCmpSetFlags()
+#define WAVECMP_LOSSLESS	0x01	// Store the wave data with lossless compression
+
+void WaveCmpSetFlags(uint32_t);
+typedef void WaveCmpSetFlagsPtr(uint32_t);
+
+int WaveCmpUnpack(const unsigned char *, uint32_t, char *, uint32_t, uint32_t, unsigned char);
+typedef int WaveCmpUnpackPtr(const unsigned char *, uint32_t, char *, uint32_t, uint32_t, unsigned char);
+
 #ifdef __cplusplus
 }
 #endif
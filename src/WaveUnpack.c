@@ -0,0 +1,240 @@
+/*
+ * Lossless .cmp decoder. Both libwavecmp (WaveCmp.c) and the
+ * player (AudioPlay.c) #include this, so they're built from the
+ * same code, without the player needing libwavecmp.
+ */
+
+// A lossless .cmp's data is a series of blocks of LOSSLESS_BLOCK_FRAMES frames
+// (the last may be shorter). Each block starts with its size in bytes (a uint32_t,
+// not counting itself), so a reader can skip or bounds-check a block. Then a
+// bitstream (msb first), padded to a whole byte:
+//
+// 1 bit		Side flag, stereo only. If set, the second chan holds left minus right
+// Per chan:
+// 3 bits	Order of the fixed polynomial predictor, 0 to 4
+// 17 bits	each, the first "order" samples verbatim (two's complement)
+// Per partition of LOSSLESS_PARTITION samples that holds any residuals:
+// 5 bits	Rice parameter (k)
+// Rice code of each residual (zigzagged): q zero bits, a one bit, then the
+//				low k bits. If q >= RICE_ESCAPE, just RICE_ESCAPE zero bits, then
+//				the zigzagged residual in RICE_ESCAPE_BITS bits
+//
+// The decoded samples are stored as per CompressPoint, the same as the data of
+// an uncompressed .cmp
+#define LOSSLESS_BLOCK_FRAMES	4096
+#define LOSSLESS_PARTITION		256
+#define RICE_ESCAPE				31
+#define RICE_ESCAPE_BITS		24
+
+typedef struct {
+	unsigned char *	Ptr;
+	uint64_t				Bits;
+	uint32_t				Count;
+} BITSTREAM;
+
+/*********************** getBits() ***********************
+ * Extracts the next "count" (upto 24) bits from the
+ * bitstream. Returns -1 if that would read past "end".
+ */
+
+static int32_t getBits(register BITSTREAM * bits, register uint32_t count, const unsigned char * end)
+{
+	while (bits->Count < count)
+	{
+		if (bits->Ptr >= end) return -1;
+		bits->Bits = (bits->Bits << 8) | *(bits->Ptr)++;
+		bits->Count += 8;
+	}
+	bits->Count -= count;
+	return (int32_t)((bits->Bits >> bits->Count) & ((1UL << count) - 1));
+}
+
+/********************** getUnary() ***********************
+ * Counts the zero bits before the next one bit in the
+ * bitstream, and skips past that one bit. Stops at
+ * RICE_ESCAPE zeros (without skipping any one bit). Returns
+ * -1 if that would read past "end".
+ */
+
+static int32_t getUnary(register BITSTREAM * bits, const unsigned char * end)
+{
+	register uint32_t	count;
+
+	count = 0;
+	for (;;)
+	{
+		register uint64_t	window;
+
+		if (!bits->Count)
+		{
+			if (bits->Ptr >= end) return -1;
+			bits->Bits = *(bits->Ptr)++;
+			bits->Count = 8;
+		}
+
+		// Left-justify the unread bits, and count the leading zeros
+		if ((window = bits->Bits << (64 - bits->Count)))
+		{
+			window = __builtin_clzll(window);
+			if (count + window >= RICE_ESCAPE) break;
+			bits->Count -= window + 1;
+			return count + window;
+		}
+
+		count += bits->Count;
+		bits->Count = 0;
+		if (count >= RICE_ESCAPE)
+		{
+			// Leave any zeros past the escape unread
+			bits->Count = count - RICE_ESCAPE;
+			return RICE_ESCAPE;
+		}
+	}
+
+	bits->Count -= RICE_ESCAPE - count;
+	return RICE_ESCAPE;
+}
+
+/********************** predictPt() **********************
+ * Returns the fixed polynomial predictor's guess for
+ * data[0], from the "order" previous samples.
+ */
+
+static int32_t predictPt(register const int32_t * data, register unsigned char order)
+{
+	switch (order)
+	{
+		case 1:
+			return data[-1];
+		case 2:
+			return (2 * data[-1]) - data[-2];
+		case 3:
+			return (3 * data[-1]) - (3 * data[-2]) + data[-3];
+		case 4:
+			return (4 * data[-1]) - (6 * data[-2]) + (4 * data[-3]) - data[-4];
+	}
+	return 0;
+}
+
+/********************** unpackWave() ********************
+ * Decompresses the data of a lossless .cmp. Called by a
+ * Load worker thread, and by WaveCmpUnpack().
+ *
+ * src =				The compressed data.
+ * size =			Size of the compressed data.
+ * dest =			Where to store the data, as per compressPoint.
+ * numPts =			Number of samples (not frames).
+ * compressPoint =	Sample offset to 8-bit bytes. Pass numPts
+ * 						to get all 16-bit samples.
+ * chans =			1 or 2.
+ *
+ * RETURN: 0 if success, or -1 if bad data.
+ */
+
+static int unpackWave(const unsigned char * src, uint32_t size, char * dest, uint32_t numPts, uint32_t compressPoint, unsigned char chans)
+{
+	register const unsigned char *	end;
+	register uint32_t					frame, i;
+	uint32_t								frames;
+	int32_t								pts[2][LOSSLESS_BLOCK_FRAMES];
+
+	end = src + size;
+	frames = numPts / chans;
+	for (frame = 0; frame < frames; frame += LOSSLESS_BLOCK_FRAMES)
+	{
+		BITSTREAM			bits;
+		const unsigned char *	blockEnd;
+		uint32_t				count, blockPts;
+		int32_t				val;
+		unsigned char		chan, side;
+
+		blockPts = frames - frame;
+		if (blockPts > LOSSLESS_BLOCK_FRAMES) blockPts = LOSSLESS_BLOCK_FRAMES;
+
+		if (end - src < 4) goto bad;
+		memcpy(&count, src, 4);
+		src += 4;
+		if (count > (uint32_t)(end - src)) goto bad;
+		blockEnd = src + count;
+		bits.Ptr = (unsigned char *)src;
+		bits.Bits = bits.Count = 0;
+		src = blockEnd;
+
+		side = 0;
+		if (chans > 1 && (side = getBits(&bits, 1, blockEnd)) > 1) goto bad;
+
+		for (chan = 0; chan < chans; chan++)
+		{
+			register int32_t *	data;
+			uint32_t					partition;
+			unsigned char			order;
+
+			data = &pts[chan][0];
+			if ((val = getBits(&bits, 3, blockEnd)) < 0 || val > 4 || val > blockPts) goto bad;
+			order = val;
+			for (i = 0; i < order; i++)
+			{
+				if ((val = getBits(&bits, 17, blockEnd)) < 0) goto bad;
+				data[i] = ((int32_t)((uint32_t)val << 15)) >> 15;
+			}
+
+			for (partition = 0; partition < blockPts; partition += LOSSLESS_PARTITION)
+			{
+				unsigned char	k;
+
+				count = partition + LOSSLESS_PARTITION;
+				if (count > blockPts) count = blockPts;
+				if ((i = partition) < order) i = order;
+				if (i >= count) continue;
+				if ((val = getBits(&bits, 5, blockEnd)) < 0 || val > 24) goto bad;
+				k = val;
+				for (; i < count; i++)
+				{
+					if ((val = getUnary(&bits, blockEnd)) < 0) goto bad;
+					if (val >= RICE_ESCAPE)
+					{
+						if ((val = getBits(&bits, RICE_ESCAPE_BITS, blockEnd)) < 0) goto bad;
+					}
+					else
+					{
+						val <<= k;
+						if (k)
+						{
+							register int32_t	low;
+
+							if ((low = getBits(&bits, k, blockEnd)) < 0) goto bad;
+							val |= low;
+						}
+					}
+
+					// A valid sample (or left - right) fits in 17 bits. If not, the data is
+					// bad (and we don't let it overflow the next prediction)
+					val = (int32_t)(((uint32_t)val >> 1) ^ -((uint32_t)val & 1)) + predictPt(&data[i], order);
+					if (val > 65535 || val < -65536) goto bad;
+					data[i] = val;
+				}
+			}
+		}
+
+		// Interleave the samples, undoing any left/side, and store them
+		for (i = 0; i < blockPts; i++)
+		{
+			for (chan = 0; chan < chans; chan++)
+			{
+				register uint32_t	offset;
+
+				val = pts[chan][i];
+				if (chan && side) val = pts[0][i] - val;
+				offset = ((frame + i) * chans) + chan;
+				if (offset < compressPoint)
+					((short *)dest)[offset] = (short)val;
+				else
+					dest[(compressPoint << 1) + (offset - compressPoint)] = (char)val;
+			}
+		}
+	}
+
+	return 0;
+bad:
+	return -1;
+}